@@ -1,10 +1,18 @@
 #include <stdio.h>
+#include <string.h>
 #include <renderer/engine.h>
 #include <renderer/camera.h>
 #include <renderer/math.h>
 #include <renderer/mesh.h>
 #include <renderer/allocator.h>
 #include <renderer/model_asset.h>
+#include <renderer/asset_cache.h>
+#include <renderer/animation.h>
+#include <renderer/array.h>
+#include <renderer/scene.h>
+#ifdef RG_NULL_BACKEND
+#include <rg_null.h>
+#endif
 
 typedef struct App
 {
@@ -28,26 +36,36 @@ typedef struct App
     RgPipeline *offscreen_pipeline;
     RgPipeline *backbuffer_pipeline;
     RgPipeline *blur_pipeline;
+    RgPipeline *skinning_pipeline;
 
     EgModelManager *model_manager;
     EgFPSCamera camera;
     EgModelAsset *model_asset;
     EgMesh *cube_mesh;
     EgModelAsset *gltf_asset;
+
+    EgScene *scene;
+    EgSceneHandle spheres[2];
+    EgArray(uint8_t) visible;
+
+    EgJointPose *gltf_poses;
+    float4x4 *gltf_palette;
 } App;
 
-App *appCreate();
+App *appCreate(const EgEngineInfo *engine_info);
 void appDestroy(App *app);
 void appResize(App *app);
 void appRenderFrame(App *app);
 void appRun(App *app);
+void appRunHeadless(
+    App *app, uint32_t frame_count, const char *output_path, const char *capture_path);
 
-App *appCreate()
+App *appCreate(const EgEngineInfo *engine_info)
 {
     App *app = egAllocate(NULL, sizeof(App));
     *app = (App){};
 
-    app->engine = egEngineCreate(NULL);
+    app->engine = egEngineCreate(NULL, engine_info);
 
     RgDevice *device = egEngineGetDevice(app->engine);
 
@@ -84,6 +102,10 @@ App *appCreate()
         egEngineCreateGraphicsPipeline(app->engine, "../shaders/blur.hlsl");
     EG_ASSERT(app->blur_pipeline);
 
+    app->skinning_pipeline =
+        egEngineCreateComputePipeline(app->engine, "../shaders/skinning.hlsl");
+    EG_ASSERT(app->skinning_pipeline);
+
     app->cmd_pool = rgCmdPoolCreate(device, RG_QUEUE_TYPE_GRAPHICS);
     app->cmd_buffers[0] = rgCmdBufferCreate(device, app->cmd_pool);
     app->cmd_buffers[1] = rgCmdBufferCreate(device, app->cmd_pool);
@@ -96,11 +118,20 @@ App *appCreate()
 
     app->model_asset = egModelAssetFromMesh(app->model_manager, app->cube_mesh);
 
+    app->scene = egSceneCreate(NULL, EG_CARRAY_LENGTH(app->spheres));
+    app->visible = egArrayCreate(NULL, uint8_t);
+    for (size_t i = 0; i < EG_CARRAY_LENGTH(app->spheres); ++i)
+    {
+        float4x4 transform = egFloat4x4Diagonal(1.0f);
+        app->spheres[i] = egSceneAdd(app->scene, app->model_asset, &transform, 0);
+    }
+
     size_t gltf_data_size = 0;
     uint8_t *gltf_data = egEngineLoadFileRelative(
         app->engine, NULL, "../assets/helmet.glb", &gltf_data_size);
     EG_ASSERT(gltf_data);
-    app->gltf_asset = egModelAssetFromGltf(app->model_manager, gltf_data, gltf_data_size);
+    app->gltf_asset =
+        egModelAssetLoadAsync(app->model_manager, gltf_data, gltf_data_size);
     egFree(NULL, gltf_data);
 
     appResize(app);
@@ -112,7 +143,22 @@ void appDestroy(App *app)
 {
     RgDevice *device = egEngineGetDevice(app->engine);
 
+    EgAssetCache *asset_cache = egEngineGetAssetCache(app->engine);
+    if (asset_cache)
+    {
+        EgAssetCacheStats stats = egAssetCacheGetStats(asset_cache);
+        printf(
+            "Asset cache: %llu hits, %llu misses, %llu bytes read\n",
+            (unsigned long long)stats.hits,
+            (unsigned long long)stats.misses,
+            (unsigned long long)stats.bytes_read);
+    }
+
+    egFree(NULL, app->gltf_poses);
+    egFree(NULL, app->gltf_palette);
     egModelAssetDestroy(app->gltf_asset);
+    egArrayFree(&app->visible);
+    egSceneDestroy(app->scene);
     egModelAssetDestroy(app->model_asset);
     egMeshDestroy(app->cube_mesh);
     egModelManagerDestroy(app->model_manager);
@@ -120,6 +166,7 @@ void appDestroy(App *app)
     rgPipelineDestroy(device, app->offscreen_pipeline);
     rgPipelineDestroy(device, app->backbuffer_pipeline);
     rgPipelineDestroy(device, app->blur_pipeline);
+    rgPipelineDestroy(device, app->skinning_pipeline);
 
     egEngineFreeSampler(app->engine, &app->sampler);
 
@@ -245,55 +292,87 @@ void appRenderFrame(App *app)
     EgCameraUniform camera_uniform =
         egFPSCameraUpdate(&app->camera, (float)app->delta_time);
 
-    RgSwapchain *swapchain = egEngineGetSwapchain(app->engine);
     RgCmdBuffer *cmd_buffer = app->cmd_buffers[app->current_frame];
     RgRenderPass *offscreen_pass = app->offscreen_pass;
-    RgRenderPass *backbuffer_pass = rgSwapchainGetRenderPass(swapchain);
+    RgRenderPass *backbuffer_pass = egEngineGetBackbufferRenderPass(app->engine);
 
-    rgSwapchainAcquireImage(swapchain);
+    egEngineBeginFrame(app->engine);
 
     rgCmdBufferBegin(cmd_buffer);
 
-    // Offscreen pass
-
-    RgClearValue offscreen_clear_values[] = {
-        {.color = {{0.0, 0.0, 0.0, 1.0}}},
-        {.color = {{0.0, 0.0, 0.0, 1.0}}},
-        {.depth_stencil = {0.0f, 0}},
-    };
-    rgCmdSetRenderPass(
-        cmd_buffer,
-        offscreen_pass,
-        EG_CARRAY_LENGTH(offscreen_clear_values),
-        offscreen_clear_values);
-
-    rgCmdBindPipeline(cmd_buffer, app->offscreen_pipeline);
-    rgCmdBindDescriptorSet(
-        cmd_buffer, 0, egEngineGetGlobalDescriptorSet(app->engine), 0, NULL);
-
+    egModelManagerUpdate(app->model_manager);
     egModelManagerBeginFrame(app->model_manager, &camera_uniform);
 
+    float3 sphere_positions[] = {V3(-3.0, 0.0, -3.0), V3(3.0, 0.0, -3.0)};
+    for (size_t i = 0; i < EG_CARRAY_LENGTH(app->spheres); ++i)
     {
         float4x4 transform = egFloat4x4Diagonal(1.0f);
         egFloat4x4Rotate(&transform, (float)egEngineGetTime(app->engine) / 100.0f, V3(0, 1, 0));
-        egFloat4x4Translate(&transform, V3(-3.0, 0.0, -3.0));
-        egModelAssetRender(app->model_asset, cmd_buffer, &transform);
+        egFloat4x4Translate(&transform, sphere_positions[i]);
+        egSceneSetTransform(app->scene, app->spheres[i], &transform);
     }
 
+    float4x4 view_proj = egFloat4x4Mul(&camera_uniform.view, &camera_uniform.proj);
+    egArrayResize(&app->visible, egSceneGetInstanceCount(app->scene));
+    egSceneCull(
+        app->scene, egEngineGetJobSystem(app->engine), &view_proj, app->visible);
+    egSceneQueueRender(app->scene, app->visible);
+
     {
         float4x4 transform = egFloat4x4Diagonal(1.0f);
         egFloat4x4Rotate(&transform, (float)egEngineGetTime(app->engine) / 100.0f, V3(0, 1, 0));
         egFloat4x4Translate(&transform, V3(0.0, 0.0, -3.0));
-        egModelAssetRender(app->gltf_asset, cmd_buffer, &transform);
-    }
 
-    {
-        float4x4 transform = egFloat4x4Diagonal(1.0f);
-        egFloat4x4Rotate(&transform, (float)egEngineGetTime(app->engine) / 100.0f, V3(0, 1, 0));
-        egFloat4x4Translate(&transform, V3(3.0, 0.0, -3.0));
-        egModelAssetRender(app->model_asset, cmd_buffer, &transform);
+        const EgSkeleton *skeleton = egModelAssetGetSkeleton(app->gltf_asset);
+        if (skeleton && egModelAssetGetAnimationCount(app->gltf_asset) > 0)
+        {
+            if (!app->gltf_poses)
+            {
+                app->gltf_poses =
+                    egAllocate(NULL, sizeof(EgJointPose) * skeleton->node_count);
+                app->gltf_palette =
+                    egAllocate(NULL, sizeof(float4x4) * skeleton->joint_count);
+            }
+
+            memcpy(
+                app->gltf_poses,
+                skeleton->rest_pose,
+                sizeof(EgJointPose) * skeleton->node_count);
+            egCompressedAnimationClipSample(
+                egModelAssetGetAnimation(app->gltf_asset, 0),
+                (float)egEngineGetTime(app->engine),
+                app->gltf_poses);
+            egSkeletonBuildPalettes(
+                NULL, NULL, skeleton, app->gltf_poses, 1, app->gltf_palette);
+
+            egModelAssetQueueRenderSkinned(
+                app->gltf_asset, &transform, app->gltf_palette);
+        }
+        else
+        {
+            egModelAssetQueueRender(app->gltf_asset, &transform);
+        }
     }
 
+    egModelManagerDispatchSkinning(
+        app->model_manager, cmd_buffer, app->skinning_pipeline);
+
+    // Offscreen pass
+
+    RgClearValue offscreen_clear_values[] = {
+        {.color = {{0.0, 0.0, 0.0, 1.0}}},
+        {.color = {{0.0, 0.0, 0.0, 1.0}}},
+        {.depth_stencil = {0.0f, 0}},
+    };
+    rgCmdSetRenderPassSecondary(
+        cmd_buffer,
+        offscreen_pass,
+        EG_CARRAY_LENGTH(offscreen_clear_values),
+        offscreen_clear_values);
+
+    egModelManagerRecordDraws(
+        app->model_manager, cmd_buffer, offscreen_pass, app->offscreen_pipeline);
+
     // Blur pass
 
     {
@@ -356,13 +435,7 @@ void appRenderFrame(App *app)
 
     rgCmdDraw(cmd_buffer, 3, 1, 0, 0);
 
-    rgCmdBufferEnd(cmd_buffer);
-
-    rgCmdBufferWaitForPresent(cmd_buffer, swapchain);
-    rgCmdBufferSubmit(cmd_buffer);
-
-    rgSwapchainWaitForCommands(swapchain, cmd_buffer);
-    rgSwapchainPresent(swapchain);
+    egEngineEndFrame(app->engine, cmd_buffer);
 
     app->current_frame = (app->current_frame + 1) % 2;
 }
@@ -403,10 +476,120 @@ void appRun(App *app)
     }
 }
 
-int main()
+// Renders frame_count frames without a window, prints the average frame time
+// and writes the last frame to output_path (a binary PPM) if not NULL. The last
+// frame is also captured to capture_path for tools/rg_replay if not NULL.
+void appRunHeadless(
+    App *app, uint32_t frame_count, const char *output_path, const char *capture_path)
+{
+#ifdef RG_NULL_BACKEND
+    rgNullResetStats(egEngineGetDevice(app->engine));
+#endif
+
+    double start_time = egEngineGetTime(app->engine);
+
+    for (uint32_t i = 0; i < frame_count; ++i)
+    {
+        double now = egEngineGetTime(app->engine);
+        app->delta_time = now - app->last_time;
+        app->last_time = now;
+
+        if (capture_path && i + 1 == frame_count)
+        {
+            egEngineCaptureFrame(app->engine, capture_path);
+        }
+
+        appRenderFrame(app);
+    }
+
+    double elapsed = egEngineGetTime(app->engine) - start_time;
+    printf(
+        "%u frames, %.3f ms per frame\n",
+        frame_count,
+        frame_count ? elapsed * 1000.0 / frame_count : 0.0);
+
+#ifdef RG_NULL_BACKEND
+    // Nothing reaches a GPU, report what each frame would have sent to it
+    RgNullStats stats;
+    rgNullGetStats(egEngineGetDevice(app->engine), &stats);
+    uint64_t frames = frame_count ? frame_count : 1;
+    printf(
+        "per frame: %llu submits, %llu draws, %llu vertices, %llu dispatches, "
+        "%llu pipeline binds, %llu descriptor set binds, %llu push constant bytes\n",
+        (unsigned long long)(stats.submit_count / frames),
+        (unsigned long long)(stats.draw_count / frames),
+        (unsigned long long)(stats.vertex_count / frames),
+        (unsigned long long)(stats.dispatch_count / frames),
+        (unsigned long long)(stats.pipeline_bind_count / frames),
+        (unsigned long long)(stats.descriptor_set_bind_count / frames),
+        (unsigned long long)(stats.push_constant_bytes / frames));
+    printf(
+        "%llu buffers (%llu KiB), %llu images (%llu KiB)\n",
+        (unsigned long long)stats.buffer_count,
+        (unsigned long long)(stats.buffer_bytes / 1024),
+        (unsigned long long)stats.image_count,
+        (unsigned long long)(stats.image_bytes / 1024));
+#endif
+
+    const uint8_t *pixels = egEngineGetReadback(app->engine);
+    if (!output_path || !pixels) return;
+
+    uint32_t width, height;
+    egEngineGetWindowSize(app->engine, &width, &height);
+
+    FILE *file = fopen(output_path, "wb");
+    if (!file)
+    {
+        fprintf(stderr, "Could not open %s\n", output_path);
+        return;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+    for (size_t i = 0; i < (size_t)width * height; ++i)
+    {
+        fwrite(&pixels[i * 4], 1, 3, file);
+    }
+    fclose(file);
+}
+
+// Usage: app [--headless <frame count> [output.ppm] [--capture <capture file>]]
+int main(int argc, char *argv[])
 {
-    App *app = appCreate();
-    appRun(app);
+    EgEngineInfo engine_info = {};
+    engine_info.enable_validation = true;
+
+    uint32_t headless_frame_count = 0;
+    const char *output_path = NULL;
+    const char *capture_path = NULL;
+    if (argc >= 3 && strcmp(argv[1], "--headless") == 0)
+    {
+        engine_info.headless = true;
+        engine_info.enable_validation = false;
+        headless_frame_count = (uint32_t)strtoul(argv[2], NULL, 10);
+        for (int i = 3; i < argc; ++i)
+        {
+            if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            {
+                capture_path = argv[++i];
+                engine_info.enable_capture = true;
+            }
+            else
+            {
+                output_path = argv[i];
+                engine_info.readback = true;
+            }
+        }
+    }
+
+    App *app = appCreate(&engine_info);
+    if (engine_info.headless)
+    {
+        appRunHeadless(app, headless_frame_count, output_path, capture_path);
+    }
+    else
+    {
+        appRun(app);
+    }
     appDestroy(app);
 
     return 0;
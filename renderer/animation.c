@@ -0,0 +1,751 @@
+#include "animation.h"
+
+#include "math.h"
+#include "allocator.h"
+#include "array.h"
+#include "job_system.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define EG_ANIMATION_SSE
+#include <xmmintrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EG_ANIMATION_SSE2
+#include <emmintrin.h>
+#endif
+
+// Instances are handed to jobs in chunks of about this many nodes
+#define PALETTE_NODES_PER_JOB 1024
+
+// Index of the last key at or before time, the times are searched in halves
+static uint32_t FindKey(const EgAnimationChannel *channel, float time)
+{
+    uint32_t low = 0;
+    uint32_t high = channel->key_count;
+    while (high - low > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+        if (channel->times[middle] <= time)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// Linear interpolation of two keys, rotations take the shortest path and are
+// renormalized
+static float4 InterpolateKeys(float4 a, float4 b, float t, bool is_rotation)
+{
+    float4 result;
+#if defined(EG_ANIMATION_SSE)
+    __m128 va = _mm_loadu_ps(&a.x);
+    __m128 vb = _mm_loadu_ps(&b.x);
+
+    if (is_rotation)
+    {
+        __m128 product = _mm_mul_ps(va, vb);
+        product = _mm_add_ps(product, _mm_movehl_ps(product, product));
+        product = _mm_add_ss(product, _mm_shuffle_ps(product, product, 1));
+        if (_mm_cvtss_f32(product) < 0.0f) vb = _mm_sub_ps(_mm_setzero_ps(), vb);
+    }
+
+    __m128 value = _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(vb, va), _mm_set1_ps(t)));
+
+    if (is_rotation)
+    {
+        __m128 length = _mm_mul_ps(value, value);
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, 0x4E));
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, 0xB1));
+        value = _mm_div_ps(value, _mm_sqrt_ps(length));
+    }
+
+    _mm_storeu_ps(&result.x, value);
+#else
+    if (is_rotation && a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w < 0.0f)
+    {
+        b = V4(-b.x, -b.y, -b.z, -b.w);
+    }
+
+    result = V4(
+        a.x + (b.x - a.x) * t,
+        a.y + (b.y - a.y) * t,
+        a.z + (b.z - a.z) * t,
+        a.w + (b.w - a.w) * t);
+
+    if (is_rotation)
+    {
+        float length = sqrtf(
+            result.x * result.x + result.y * result.y + result.z * result.z +
+            result.w * result.w);
+        result = V4(
+            result.x / length, result.y / length, result.z / length, result.w / length);
+    }
+#endif
+    return result;
+}
+
+static float4 SampleChannel(const EgAnimationChannel *channel, float time)
+{
+    uint32_t key = FindKey(channel, time);
+    if (key + 1 >= channel->key_count ||
+        channel->interpolation == EG_ANIMATION_INTERPOLATION_STEP ||
+        time <= channel->times[key])
+    {
+        return channel->values[key];
+    }
+
+    float t0 = channel->times[key];
+    float t1 = channel->times[key + 1];
+    float t = EG_CLAMP((time - t0) / (t1 - t0), 0.0f, 1.0f);
+
+    return InterpolateKeys(
+        channel->values[key],
+        channel->values[key + 1],
+        t,
+        channel->path == EG_ANIMATION_PATH_ROTATION);
+}
+
+static void SetPose(EgJointPose *pose, EgAnimationPath path, float4 value)
+{
+    switch (path)
+    {
+    case EG_ANIMATION_PATH_TRANSLATION: pose->translation = value; break;
+    case EG_ANIMATION_PATH_ROTATION: {
+        pose->rotation.x = value.x;
+        pose->rotation.y = value.y;
+        pose->rotation.z = value.z;
+        pose->rotation.w = value.w;
+        break;
+    }
+    case EG_ANIMATION_PATH_SCALE: pose->scale = value; break;
+    }
+}
+
+void egAnimationClipSample(const EgAnimationClip *clip, float time, EgJointPose *poses)
+{
+    if (clip->duration > 0.0f)
+    {
+        time = fmodf(time, clip->duration);
+        if (time < 0.0f) time += clip->duration;
+    }
+
+    for (uint32_t i = 0; i < clip->channel_count; ++i)
+    {
+        const EgAnimationChannel *channel = &clip->channels[i];
+        if (channel->key_count == 0) continue;
+
+        SetPose(&poses[channel->node], channel->path, SampleChannel(channel, time));
+    }
+}
+
+// Channel that holds the same value at every key
+typedef struct ConstantTrack
+{
+    float4 value;
+    uint32_t node;
+    EgAnimationPath path;
+} ConstantTrack;
+
+// Channel with keys quantized to its range, value = offset + scale * q.
+// Rotations keep all four components, rebuilding w from xyz loses most of its
+// precision where w is close to zero.
+typedef struct AnimatedTrack
+{
+    float4 offset; // w is zero for translations and scales
+    float4 scale;  // Size of one 16-bit step, w is zero for translations and scales
+    uint32_t node;
+    uint8_t path;
+    uint8_t interpolation;
+    uint16_t padding;
+    uint32_t first_key;
+    uint32_t key_count;
+} AnimatedTrack;
+
+struct EgCompressedAnimationClip
+{
+    EgAllocator *allocator;
+    size_t size;
+    float duration;
+    uint32_t constant_track_count;
+    uint32_t animated_track_count;
+    // Point into the same allocation as the clip, in this order
+    const ConstantTrack *constant_tracks;
+    const AnimatedTrack *animated_tracks;
+    // Steps of duration / 65535
+    const uint16_t *times;
+    // Four per key, so every key is a single 8-byte load
+    const uint16_t *values;
+};
+
+#define COMPRESSED_TIME_STEPS 65535.0f
+#define DEFAULT_TRANSLATION_TOLERANCE 0.0001f
+#define DEFAULT_ROTATION_TOLERANCE 0.0001f
+#define DEFAULT_SCALE_TOLERANCE 0.0001f
+
+static size_t Align16(size_t size)
+{
+    return (size + 15) & ~(size_t)15;
+}
+
+static float4 DecodeKey(const AnimatedTrack *track, const uint16_t *key)
+{
+    float4 value;
+#if defined(EG_ANIMATION_SSE2)
+    __m128i bits = _mm_loadl_epi64((const __m128i *)key);
+    __m128 steps = _mm_cvtepi32_ps(_mm_unpacklo_epi16(bits, _mm_setzero_si128()));
+    __m128 decoded = _mm_add_ps(
+        _mm_loadu_ps(&track->offset.x), _mm_mul_ps(_mm_loadu_ps(&track->scale.x), steps));
+    _mm_storeu_ps(&value.x, decoded);
+#else
+    value = V4(
+        track->offset.x + track->scale.x * (float)key[0],
+        track->offset.y + track->scale.y * (float)key[1],
+        track->offset.z + track->scale.z * (float)key[2],
+        track->offset.w + track->scale.w * (float)key[3]);
+#endif
+
+    if (track->path == EG_ANIMATION_PATH_ROTATION)
+    {
+        float length = sqrtf(
+            value.x * value.x + value.y * value.y + value.z * value.z +
+            value.w * value.w);
+        value = V4(
+            value.x / length, value.y / length, value.z / length, value.w / length);
+    }
+    return value;
+}
+
+// Index of the last key at or before time, in steps
+static uint32_t FindCompressedKey(const uint16_t *times, uint32_t key_count, float time)
+{
+    uint32_t low = 0;
+    uint32_t high = key_count;
+    while (high - low > 1)
+    {
+        uint32_t middle = (low + high) / 2;
+        if ((float)times[middle] <= time)
+            low = middle;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static float4 SampleTrack(
+    const AnimatedTrack *track, const uint16_t *times, const uint16_t *values, float time)
+{
+    uint32_t key = FindCompressedKey(times, track->key_count, time);
+    if (key + 1 >= track->key_count ||
+        track->interpolation == EG_ANIMATION_INTERPOLATION_STEP ||
+        time <= (float)times[key])
+    {
+        return DecodeKey(track, &values[key * 4]);
+    }
+
+    float t0 = (float)times[key];
+    float t1 = (float)times[key + 1];
+    float t = EG_CLAMP((time - t0) / (t1 - t0), 0.0f, 1.0f);
+
+    return InterpolateKeys(
+        DecodeKey(track, &values[key * 4]),
+        DecodeKey(track, &values[key * 4 + 4]),
+        t,
+        track->path == EG_ANIMATION_PATH_ROTATION);
+}
+
+// Largest component difference, q and -q are the same rotation
+static float KeyError(float4 a, float4 b, bool is_rotation)
+{
+    float error = EG_MAX(
+        EG_MAX(fabsf(a.x - b.x), fabsf(a.y - b.y)),
+        EG_MAX(fabsf(a.z - b.z), fabsf(a.w - b.w)));
+    if (is_rotation)
+    {
+        float flipped_error = EG_MAX(
+            EG_MAX(fabsf(a.x + b.x), fabsf(a.y + b.y)),
+            EG_MAX(fabsf(a.z + b.z), fabsf(a.w + b.w)));
+        error = EG_MIN(error, flipped_error);
+    }
+    return error;
+}
+
+// Value of the segment between the kept keys first and last at time, in steps
+static float4 SampleSegment(
+    const AnimatedTrack *track,
+    const uint16_t *quantized_times,
+    const uint16_t *quantized_values,
+    uint32_t first,
+    uint32_t last,
+    float time)
+{
+    float4 a = DecodeKey(track, &quantized_values[first * 4]);
+    float t0 = (float)quantized_times[first];
+    float t1 = (float)quantized_times[last];
+    if (track->interpolation != EG_ANIMATION_INTERPOLATION_LINEAR || t1 <= t0 ||
+        time <= t0)
+    {
+        return a;
+    }
+
+    float4 b = DecodeKey(track, &quantized_values[last * 4]);
+    float t = EG_CLAMP((time - t0) / (t1 - t0), 0.0f, 1.0f);
+    return InterpolateKeys(a, b, t, track->path == EG_ANIMATION_PATH_ROTATION);
+}
+
+// Whether sampling between the kept keys first and last reproduces every key
+// in between within tolerance. Translations and scales are linear between
+// keys, so their error peaks at a key. Normalized rotations aren't, they are
+// also checked halfway between keys.
+static bool SegmentFits(
+    const AnimatedTrack *track,
+    const float *times,
+    const float4 *values,
+    const uint16_t *quantized_times,
+    const uint16_t *quantized_values,
+    float time_scale,
+    uint32_t first,
+    uint32_t last,
+    float tolerance)
+{
+    bool is_rotation = track->path == EG_ANIMATION_PATH_ROTATION;
+    bool is_linear = track->interpolation == EG_ANIMATION_INTERPOLATION_LINEAR;
+
+    for (uint32_t i = first; i < last; ++i)
+    {
+        if (i > first)
+        {
+            float4 value = SampleSegment(
+                track,
+                quantized_times,
+                quantized_values,
+                first,
+                last,
+                times[i] * time_scale);
+            if (KeyError(value, values[i], is_rotation) > tolerance) return false;
+        }
+
+        if (is_rotation && is_linear)
+        {
+            float4 expected = InterpolateKeys(values[i], values[i + 1], 0.5f, true);
+            float time = (times[i] + times[i + 1]) * 0.5f * time_scale;
+            float4 value = SampleSegment(
+                track, quantized_times, quantized_values, first, last, time);
+            if (KeyError(value, expected, true) > tolerance) return false;
+        }
+    }
+    return true;
+}
+
+EgCompressedAnimationClip *egAnimationClipCompress(
+    EgAllocator *allocator,
+    const EgAnimationClip *clip,
+    const EgAnimationCompressionInfo *info)
+{
+    EgAnimationCompressionInfo default_info = {
+        .translation_tolerance = DEFAULT_TRANSLATION_TOLERANCE,
+        .rotation_tolerance = DEFAULT_ROTATION_TOLERANCE,
+        .scale_tolerance = DEFAULT_SCALE_TOLERANCE,
+    };
+    if (!info) info = &default_info;
+
+    float time_scale = 0.0f;
+    if (clip->duration > 0.0f) time_scale = COMPRESSED_TIME_STEPS / clip->duration;
+
+    EgArray(ConstantTrack) constant_tracks = egArrayCreate(allocator, ConstantTrack);
+    EgArray(AnimatedTrack) animated_tracks = egArrayCreate(allocator, AnimatedTrack);
+    EgArray(uint16_t) times = egArrayCreate(allocator, uint16_t);
+    EgArray(uint16_t) values = egArrayCreate(allocator, uint16_t);
+
+    // Scratch for one channel
+    EgArray(float4) channel_values = egArrayCreate(allocator, float4);
+    EgArray(uint16_t) channel_times = egArrayCreate(allocator, uint16_t);
+    EgArray(uint16_t) channel_steps = egArrayCreate(allocator, uint16_t);
+
+    for (uint32_t c = 0; c < clip->channel_count; ++c)
+    {
+        const EgAnimationChannel *channel = &clip->channels[c];
+        uint32_t key_count = channel->key_count;
+        if (key_count == 0) continue;
+
+        bool is_rotation = channel->path == EG_ANIMATION_PATH_ROTATION;
+        float tolerance = info->scale_tolerance;
+        if (channel->path == EG_ANIMATION_PATH_TRANSLATION)
+            tolerance = info->translation_tolerance;
+        else if (is_rotation)
+            tolerance = info->rotation_tolerance;
+
+        // Rotations are normalized, and flipped to the side of the previous key
+        // as q and -q are the same rotation, which keeps their range small
+        egArrayResize(&channel_values, key_count);
+        for (uint32_t i = 0; i < key_count; ++i)
+        {
+            float4 value = channel->values[i];
+            if (is_rotation)
+            {
+                float length = sqrtf(
+                    value.x * value.x + value.y * value.y + value.z * value.z +
+                    value.w * value.w);
+                if (i > 0)
+                {
+                    float4 previous = channel_values[i - 1];
+                    float dot = value.x * previous.x + value.y * previous.y +
+                                value.z * previous.z + value.w * previous.w;
+                    if (dot < 0.0f) length = -length;
+                }
+                value = V4(
+                    value.x / length,
+                    value.y / length,
+                    value.z / length,
+                    value.w / length);
+            }
+            else
+            {
+                value.w = 0.0f;
+            }
+            channel_values[i] = value;
+        }
+
+        bool is_constant = true;
+        for (uint32_t i = 1; i < key_count && is_constant; ++i)
+        {
+            is_constant =
+                KeyError(channel_values[i], channel_values[0], is_rotation) <= tolerance;
+        }
+        if (is_constant)
+        {
+            ConstantTrack track = {
+                .value = channel_values[0],
+                .node = channel->node,
+                .path = channel->path,
+            };
+            egArrayPush(&constant_tracks, track);
+            continue;
+        }
+
+        float4 min = channel_values[0];
+        float4 max = channel_values[0];
+        for (uint32_t i = 1; i < key_count; ++i)
+        {
+            float4 value = channel_values[i];
+            min = V4(
+                EG_MIN(min.x, value.x),
+                EG_MIN(min.y, value.y),
+                EG_MIN(min.z, value.z),
+                EG_MIN(min.w, value.w));
+            max = V4(
+                EG_MAX(max.x, value.x),
+                EG_MAX(max.y, value.y),
+                EG_MAX(max.z, value.z),
+                EG_MAX(max.w, value.w));
+        }
+
+        AnimatedTrack track = {
+            .offset = min,
+            .scale = V4(
+                (max.x - min.x) / 65535.0f,
+                (max.y - min.y) / 65535.0f,
+                (max.z - min.z) / 65535.0f,
+                (max.w - min.w) / 65535.0f),
+            .node = channel->node,
+            .path = (uint8_t)channel->path,
+            .interpolation = (uint8_t)channel->interpolation,
+            .first_key = (uint32_t)egArrayLength(times),
+        };
+
+        egArrayResize(&channel_times, key_count);
+        egArrayResize(&channel_steps, key_count * 4);
+        for (uint32_t i = 0; i < key_count; ++i)
+        {
+            float time =
+                EG_CLAMP(channel->times[i] * time_scale, 0.0f, COMPRESSED_TIME_STEPS);
+            channel_times[i] = (uint16_t)(time + 0.5f);
+
+            const float *value = &channel_values[i].x;
+            const float *offset = &track.offset.x;
+            const float *scale = &track.scale.x;
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                float step = scale[j] > 0.0f ? (value[j] - offset[j]) / scale[j] : 0.0f;
+                step = EG_CLAMP(step, 0.0f, 65535.0f);
+                channel_steps[i * 4 + j] = (uint16_t)(step + 0.5f);
+            }
+        }
+
+        // Greedy: every key is dropped while the segment from the last kept
+        // key to the following one still fits
+        uint32_t last_kept = 0;
+        for (uint32_t i = 0; i < key_count; ++i)
+        {
+            bool keep = i == 0 || i == key_count - 1;
+            if (!keep)
+            {
+                keep = !SegmentFits(
+                    &track,
+                    channel->times,
+                    channel_values,
+                    channel_times,
+                    channel_steps,
+                    time_scale,
+                    last_kept,
+                    i + 1,
+                    tolerance);
+            }
+            if (!keep) continue;
+
+            egArrayPush(&times, channel_times[i]);
+            for (uint32_t j = 0; j < 4; ++j)
+            {
+                egArrayPush(&values, channel_steps[i * 4 + j]);
+            }
+            track.key_count++;
+            last_kept = i;
+        }
+
+        egArrayPush(&animated_tracks, track);
+    }
+
+    size_t constant_track_count = egArrayLength(constant_tracks);
+    size_t animated_track_count = egArrayLength(animated_tracks);
+    size_t key_count = egArrayLength(times);
+
+    // One allocation, every part starts 16-byte aligned
+    size_t constant_tracks_offset = Align16(sizeof(EgCompressedAnimationClip));
+    size_t animated_tracks_offset =
+        constant_tracks_offset + sizeof(ConstantTrack) * constant_track_count;
+    size_t times_offset =
+        animated_tracks_offset + sizeof(AnimatedTrack) * animated_track_count;
+    size_t values_offset = Align16(times_offset + sizeof(uint16_t) * key_count);
+    size_t size = values_offset + sizeof(uint16_t) * egArrayLength(values);
+
+    uint8_t *memory = (uint8_t *)egAllocate(allocator, size);
+    EgCompressedAnimationClip *compressed = (EgCompressedAnimationClip *)memory;
+    *compressed = (EgCompressedAnimationClip){
+        .allocator = allocator,
+        .size = size,
+        .duration = clip->duration,
+        .constant_track_count = (uint32_t)constant_track_count,
+        .animated_track_count = (uint32_t)animated_track_count,
+        .constant_tracks = (const ConstantTrack *)(memory + constant_tracks_offset),
+        .animated_tracks = (const AnimatedTrack *)(memory + animated_tracks_offset),
+        .times = (const uint16_t *)(memory + times_offset),
+        .values = (const uint16_t *)(memory + values_offset),
+    };
+
+    memcpy(
+        memory + constant_tracks_offset,
+        constant_tracks,
+        sizeof(ConstantTrack) * constant_track_count);
+    memcpy(
+        memory + animated_tracks_offset,
+        animated_tracks,
+        sizeof(AnimatedTrack) * animated_track_count);
+    memcpy(memory + times_offset, times, sizeof(uint16_t) * key_count);
+    memcpy(memory + values_offset, values, sizeof(uint16_t) * egArrayLength(values));
+
+    egArrayFree(&constant_tracks);
+    egArrayFree(&animated_tracks);
+    egArrayFree(&times);
+    egArrayFree(&values);
+    egArrayFree(&channel_values);
+    egArrayFree(&channel_times);
+    egArrayFree(&channel_steps);
+
+    return compressed;
+}
+
+void egCompressedAnimationClipDestroy(EgCompressedAnimationClip *clip)
+{
+    if (!clip) return;
+    egFree(clip->allocator, clip);
+}
+
+float egCompressedAnimationClipGetDuration(const EgCompressedAnimationClip *clip)
+{
+    return clip->duration;
+}
+
+size_t egCompressedAnimationClipGetSize(const EgCompressedAnimationClip *clip)
+{
+    return clip->size;
+}
+
+void egCompressedAnimationClipSample(
+    const EgCompressedAnimationClip *clip, float time, EgJointPose *poses)
+{
+    float time_in_steps = 0.0f;
+    if (clip->duration > 0.0f)
+    {
+        time = fmodf(time, clip->duration);
+        if (time < 0.0f) time += clip->duration;
+        time_in_steps = time * (COMPRESSED_TIME_STEPS / clip->duration);
+    }
+
+    for (uint32_t i = 0; i < clip->constant_track_count; ++i)
+    {
+        const ConstantTrack *track = &clip->constant_tracks[i];
+        SetPose(&poses[track->node], track->path, track->value);
+    }
+
+    for (uint32_t i = 0; i < clip->animated_track_count; ++i)
+    {
+        const AnimatedTrack *track = &clip->animated_tracks[i];
+        float4 value = SampleTrack(
+            track,
+            &clip->times[track->first_key],
+            &clip->values[track->first_key * 4],
+            time_in_steps);
+        SetPose(&poses[track->node], (EgAnimationPath)track->path, value);
+    }
+}
+
+// result = a * b in math notation, both stored by columns. result may be
+// either of them.
+static void MulMatrices(const float4x4 *a, const float4x4 *b, float4x4 *result)
+{
+    const float *ma = &a->xx;
+    const float *mb = &b->xx;
+    float *mr = &result->xx;
+
+#if defined(EG_ANIMATION_SSE)
+    __m128 a0 = _mm_loadu_ps(&ma[0]);
+    __m128 a1 = _mm_loadu_ps(&ma[4]);
+    __m128 a2 = _mm_loadu_ps(&ma[8]);
+    __m128 a3 = _mm_loadu_ps(&ma[12]);
+
+    __m128 columns[4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        const float *column = &mb[c * 4];
+        columns[c] = _mm_add_ps(
+            _mm_add_ps(
+                _mm_mul_ps(a0, _mm_set1_ps(column[0])),
+                _mm_mul_ps(a1, _mm_set1_ps(column[1]))),
+            _mm_add_ps(
+                _mm_mul_ps(a2, _mm_set1_ps(column[2])),
+                _mm_mul_ps(a3, _mm_set1_ps(column[3]))));
+    }
+
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        _mm_storeu_ps(&mr[c * 4], columns[c]);
+    }
+#else
+    float columns[16];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        for (uint32_t r = 0; r < 4; ++r)
+        {
+            columns[c * 4 + r] = ma[r] * mb[c * 4 + 0] + ma[4 + r] * mb[c * 4 + 1] +
+                                 ma[8 + r] * mb[c * 4 + 2] + ma[12 + r] * mb[c * 4 + 3];
+        }
+    }
+    memcpy(mr, columns, sizeof(columns));
+#endif
+}
+
+// Translation * rotation * scale
+static float4x4 PoseMatrix(const EgJointPose *pose)
+{
+    float4x4 m = egQuatToMatrix(pose->rotation);
+
+    m.xx *= pose->scale.x;
+    m.xy *= pose->scale.x;
+    m.xz *= pose->scale.x;
+    m.yx *= pose->scale.y;
+    m.yy *= pose->scale.y;
+    m.yz *= pose->scale.y;
+    m.zx *= pose->scale.z;
+    m.zy *= pose->scale.z;
+    m.zz *= pose->scale.z;
+
+    m.wx = pose->translation.x;
+    m.wy = pose->translation.y;
+    m.wz = pose->translation.z;
+    m.ww = 1.0f;
+
+    return m;
+}
+
+typedef struct PaletteJob
+{
+    EgAllocator *allocator;
+    const EgSkeleton *skeleton;
+    const EgJointPose *poses;
+    float4x4 *palettes;
+} PaletteJob;
+
+static void BuildPalettesProc(void *user_data, size_t begin, size_t end)
+{
+    PaletteJob *job = (PaletteJob *)user_data;
+    const EgSkeleton *skeleton = job->skeleton;
+
+    float4x4 *model_matrices =
+        (float4x4 *)egAllocate(job->allocator, sizeof(float4x4) * skeleton->node_count);
+
+    for (size_t instance = begin; instance < end; ++instance)
+    {
+        const EgJointPose *poses = &job->poses[instance * skeleton->node_count];
+
+        // Parents come first, so their model matrix is always ready
+        for (uint32_t i = 0; i < skeleton->node_count; ++i)
+        {
+            float4x4 local = PoseMatrix(&poses[i]);
+            if (skeleton->node_matrices)
+            {
+                MulMatrices(&local, &skeleton->node_matrices[i], &local);
+            }
+
+            int32_t parent = skeleton->parents[i];
+            if (parent >= 0)
+            {
+                EG_ASSERT((uint32_t)parent < i);
+                MulMatrices(&model_matrices[parent], &local, &model_matrices[i]);
+            }
+            else
+            {
+                model_matrices[i] = local;
+            }
+        }
+
+        float4x4 *palette = &job->palettes[instance * skeleton->joint_count];
+        for (uint32_t j = 0; j < skeleton->joint_count; ++j)
+        {
+            MulMatrices(
+                &model_matrices[skeleton->joint_nodes[j]],
+                &skeleton->inverse_bind_matrices[j],
+                &palette[j]);
+        }
+    }
+
+    egFree(job->allocator, model_matrices);
+}
+
+void egSkeletonBuildPalettes(
+    EgAllocator *allocator,
+    EgJobSystem *job_system,
+    const EgSkeleton *skeleton,
+    const EgJointPose *poses,
+    size_t instance_count,
+    float4x4 *palettes)
+{
+    if (instance_count == 0 || skeleton->node_count == 0) return;
+
+    PaletteJob job = {
+        .allocator = allocator,
+        .skeleton = skeleton,
+        .poses = poses,
+        .palettes = palettes,
+    };
+
+    if (!job_system)
+    {
+        BuildPalettesProc(&job, 0, instance_count);
+        return;
+    }
+
+    size_t grain_size = EG_MAX(1, PALETTE_NODES_PER_JOB / skeleton->node_count);
+    egJobSystemParallelFor(
+        job_system, instance_count, grain_size, BuildPalettesProc, &job);
+}
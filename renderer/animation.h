@@ -0,0 +1,118 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgJobSystem EgJobSystem;
+
+// Local transform of a skeleton node
+typedef struct EgJointPose
+{
+    float4 translation; // w is unused
+    quat128 rotation;
+    float4 scale; // w is unused
+} EgJointPose;
+
+// Node hierarchy of a model and the joints its skins bind vertices to
+typedef struct EgSkeleton
+{
+    uint32_t node_count;
+    // Parents always come before their children, -1 for roots
+    const int32_t *parents;
+    const EgJointPose *rest_pose;
+    // Applied after the pose, for glTF nodes that have a matrix instead of a
+    // translation, rotation and scale
+    const float4x4 *node_matrices;
+
+    // Joints of every skin one after the other, the palette has a matrix for
+    // each of them
+    uint32_t joint_count;
+    const uint32_t *joint_nodes;
+    const float4x4 *inverse_bind_matrices;
+} EgSkeleton;
+
+typedef enum EgAnimationPath
+{
+    EG_ANIMATION_PATH_TRANSLATION,
+    EG_ANIMATION_PATH_ROTATION,
+    EG_ANIMATION_PATH_SCALE,
+} EgAnimationPath;
+
+typedef enum EgAnimationInterpolation
+{
+    EG_ANIMATION_INTERPOLATION_LINEAR,
+    EG_ANIMATION_INTERPOLATION_STEP,
+} EgAnimationInterpolation;
+
+// Keyframes of one property of one node
+typedef struct EgAnimationChannel
+{
+    uint32_t node;
+    EgAnimationPath path;
+    EgAnimationInterpolation interpolation;
+    uint32_t key_count;
+    const float *times; // Increasing
+    // xyz for translations and scales, rotations are quaternions
+    const float4 *values;
+} EgAnimationChannel;
+
+typedef struct EgAnimationClip
+{
+    float duration;
+    uint32_t channel_count;
+    const EgAnimationChannel *channels;
+} EgAnimationClip;
+
+// Overwrites the poses of the nodes the clip animates with their value at
+// time, which wraps around the duration. Nodes the clip doesn't animate keep
+// their pose, so poses usually start as a copy of the rest pose.
+void egAnimationClipSample(const EgAnimationClip *clip, float time, EgJointPose *poses);
+
+// Clip whose channels are stored as 16-bit keys quantized to the range of
+// each channel. Channels that hold a single value keep only that value, and
+// keys that linear interpolation of their neighbours reproduces are removed.
+typedef struct EgCompressedAnimationClip EgCompressedAnimationClip;
+
+// Largest error allowed when removing keys and stripping constant channels,
+// per component. Quantization adds up to half a step of the channel range.
+typedef struct EgAnimationCompressionInfo
+{
+    float translation_tolerance; // Model units
+    float rotation_tolerance;    // Quaternion components
+    float scale_tolerance;
+} EgAnimationCompressionInfo;
+
+// info may be NULL for tolerances that are invisible on typical models
+EgCompressedAnimationClip *egAnimationClipCompress(
+    EgAllocator *allocator,
+    const EgAnimationClip *clip,
+    const EgAnimationCompressionInfo *info);
+void egCompressedAnimationClipDestroy(EgCompressedAnimationClip *clip);
+float egCompressedAnimationClipGetDuration(const EgCompressedAnimationClip *clip);
+// Bytes used by the clip, it's a single allocation
+size_t egCompressedAnimationClipGetSize(const EgCompressedAnimationClip *clip);
+// Same as egAnimationClipSample
+void egCompressedAnimationClipSample(
+    const EgCompressedAnimationClip *clip, float time, EgJointPose *poses);
+
+// Builds the palettes of instance_count instances of the skeleton. poses has
+// node_count poses per instance and palettes receives joint_count matrices
+// per instance, each the model matrix of the joint times its inverse bind
+// matrix. Instances are spread over job_system (if not NULL), in which case
+// the allocator has to be thread safe.
+void egSkeletonBuildPalettes(
+    EgAllocator *allocator,
+    EgJobSystem *job_system,
+    const EgSkeleton *skeleton,
+    const EgJointPose *poses,
+    size_t instance_count,
+    float4x4 *palettes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,228 @@
+#include "asset_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "allocator.h"
+#include "file_map.h"
+#include "hash.h"
+#include "thread.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define ENTRY_MAGIC 0x31434745 // "EGC1"
+
+// Written in front of every entry, keeps the data 16 byte aligned
+typedef struct EntryHeader
+{
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t hash;
+    uint64_t size;
+    uint64_t reserved2;
+} EntryHeader;
+
+struct EgAssetCache
+{
+    EgAllocator *allocator;
+    const char *directory;
+
+    EgMutex *stats_mutex;
+    EgAssetCacheStats stats;
+
+    // Keeps the temporary files of concurrent stores apart
+    volatile uint32_t temp_counter;
+};
+
+static bool MakeDirectory(const char *path)
+{
+#if defined(_WIN32)
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+static uint32_t CurrentProcessId(void)
+{
+#if defined(_WIN32)
+    return (uint32_t)GetCurrentProcessId();
+#else
+    return (uint32_t)getpid();
+#endif
+}
+
+// Replaces dst if it already exists
+static bool RenameFile(const char *src, const char *dst)
+{
+#if defined(_WIN32)
+    return MoveFileExA(src, dst, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(src, dst) == 0;
+#endif
+}
+
+static void EntryPath(EgAssetCache *cache, EgAssetCacheKey key, char *path, size_t size)
+{
+    snprintf(
+        path,
+        size,
+        "%s/%s-%016llx",
+        cache->directory,
+        key.kind,
+        (unsigned long long)key.hash);
+}
+
+EgAssetCache *egAssetCacheCreate(EgAllocator *allocator, const char *directory)
+{
+    if (!MakeDirectory(directory))
+    {
+        fprintf(stderr, "Failed to create asset cache directory: %s\n", directory);
+        return NULL;
+    }
+
+    EgAssetCache *cache = (EgAssetCache *)egAllocate(allocator, sizeof(*cache));
+    *cache = (EgAssetCache){0};
+
+    cache->allocator = allocator;
+    cache->directory = egStrdup(allocator, directory);
+    cache->stats_mutex = egMutexCreate(allocator);
+
+    return cache;
+}
+
+void egAssetCacheDestroy(EgAssetCache *cache)
+{
+    egMutexDestroy(cache->stats_mutex);
+    egFree(cache->allocator, (void *)cache->directory);
+    egFree(cache->allocator, cache);
+}
+
+EgAssetCacheKey egAssetCacheKeyCreate(
+    const char *kind,
+    const void *source,
+    size_t source_size,
+    const void *params,
+    size_t params_size)
+{
+    uint64_t hash = egHash64(kind, strlen(kind), 0);
+    hash = egHash64(source, source_size, hash);
+    hash = egHash64(params, params_size, hash);
+
+    return (EgAssetCacheKey){kind, hash};
+}
+
+bool egAssetCacheLoad(EgAssetCache *cache, EgAssetCacheKey key, EgAssetCacheEntry *entry)
+{
+    *entry = (EgAssetCacheEntry){0};
+
+    char path[1024];
+    EntryPath(cache, key, path, sizeof(path));
+
+    EgFileMap *file_map = egFileMapOpen(cache->allocator, path);
+
+    // Entries from an unrelated key that hashed to the same name, or truncated
+    // by a crash, count as misses
+    bool valid = false;
+    if (file_map)
+    {
+        const uint8_t *data = egFileMapGetData(file_map);
+        size_t size = egFileMapGetSize(file_map);
+
+        EntryHeader header;
+        if (size >= sizeof(header))
+        {
+            memcpy(&header, data, sizeof(header));
+            valid = header.magic == ENTRY_MAGIC && header.hash == key.hash &&
+                    header.size == size - sizeof(header);
+        }
+
+        if (valid)
+        {
+            entry->file_map = file_map;
+            entry->data = data + sizeof(header);
+            entry->size = (size_t)header.size;
+        }
+        else
+        {
+            egFileMapClose(file_map);
+        }
+    }
+
+    egMutexLock(cache->stats_mutex);
+    if (valid)
+    {
+        cache->stats.hits++;
+        cache->stats.bytes_read += entry->size;
+    }
+    else
+    {
+        cache->stats.misses++;
+    }
+    egMutexUnlock(cache->stats_mutex);
+
+    return valid;
+}
+
+void egAssetCacheEntryRelease(EgAssetCacheEntry *entry)
+{
+    if (entry->file_map) egFileMapClose(entry->file_map);
+    *entry = (EgAssetCacheEntry){0};
+}
+
+bool egAssetCacheStore(
+    EgAssetCache *cache, EgAssetCacheKey key, const void *data, size_t size)
+{
+    char path[1024];
+    EntryPath(cache, key, path, sizeof(path));
+
+    char temp_path[1100];
+    snprintf(
+        temp_path,
+        sizeof(temp_path),
+        "%s.%u.%u.tmp",
+        path,
+        CurrentProcessId(),
+        egAtomicFetchAddU32(&cache->temp_counter, 1));
+
+    FILE *f = fopen(temp_path, "wb");
+    if (!f) return false;
+
+    EntryHeader header = {0};
+    header.magic = ENTRY_MAGIC;
+    header.hash = key.hash;
+    header.size = size;
+
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (size > 0) success = success && fwrite(data, size, 1, f) == 1;
+    success = (fclose(f) == 0) && success;
+    success = success && RenameFile(temp_path, path);
+
+    if (!success)
+    {
+        remove(temp_path);
+        return false;
+    }
+
+    egMutexLock(cache->stats_mutex);
+    cache->stats.stores++;
+    cache->stats.bytes_written += size;
+    egMutexUnlock(cache->stats_mutex);
+
+    return true;
+}
+
+EgAssetCacheStats egAssetCacheGetStats(EgAssetCache *cache)
+{
+    egMutexLock(cache->stats_mutex);
+    EgAssetCacheStats stats = cache->stats;
+    egMutexUnlock(cache->stats_mutex);
+
+    return stats;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgFileMap EgFileMap;
+typedef struct EgAssetCache EgAssetCache;
+
+// Identifies derived data by the bytes it was made from and the parameters
+// used to process them. Loaders bump the version in their parameters whenever
+// their output changes.
+typedef struct EgAssetCacheKey
+{
+    const char *kind; // Short name used as the file prefix, e.g. "texture"
+    uint64_t hash;
+} EgAssetCacheKey;
+
+typedef struct EgAssetCacheEntry
+{
+    EgFileMap *file_map;
+    const uint8_t *data;
+    size_t size;
+} EgAssetCacheEntry;
+
+typedef struct EgAssetCacheStats
+{
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+} EgAssetCacheStats;
+
+// Entries are stored as one file each in directory, which is created if it
+// doesn't exist. Every function is thread safe.
+EgAssetCache *egAssetCacheCreate(EgAllocator *allocator, const char *directory);
+void egAssetCacheDestroy(EgAssetCache *cache);
+
+EgAssetCacheKey egAssetCacheKeyCreate(
+    const char *kind,
+    const void *source,
+    size_t source_size,
+    const void *params,
+    size_t params_size);
+
+// Maps the entry into memory and returns true on a hit. The data stays valid
+// until the entry is released.
+bool egAssetCacheLoad(EgAssetCache *cache, EgAssetCacheKey key, EgAssetCacheEntry *entry);
+void egAssetCacheEntryRelease(EgAssetCacheEntry *entry);
+// Entries are written to a temporary file first and renamed into place, so
+// readers never see partial entries
+bool egAssetCacheStore(
+    EgAssetCache *cache, EgAssetCacheKey key, const void *data, size_t size);
+
+EgAssetCacheStats egAssetCacheGetStats(EgAssetCache *cache);
+
+#ifdef __cplusplus
+}
+#endif
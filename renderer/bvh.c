@@ -0,0 +1,986 @@
+#include "bvh.h"
+
+#include "math.h"
+#include "allocator.h"
+#include "array.h"
+#include "job_system.h"
+#include "meshlet.h"
+
+#define LEAF_MAX_ITEMS 4
+#define SAH_BIN_COUNT 16
+
+// Rebuilds once refits have made the SAH cost of the tree this many times
+// what it was after the last build, at most once every REBUILD_MIN_INTERVAL
+// egBvhMaintain calls. Also rebuilds once the list holds this many items and
+// a sixteenth of the tree.
+#define REBUILD_COST_RATIO 1.5f
+#define REBUILD_MIN_INTERVAL 30
+#define REBUILD_MIN_LIST_ITEMS 64
+
+// Node count of internal nodes
+#define INTERNAL_NODE UINT32_MAX
+
+// ItemLocation nodes of items that aren't in a leaf
+#define LOCATION_NONE UINT32_MAX
+#define LOCATION_LIST (UINT32_MAX - 1)
+
+typedef struct BvhNode
+{
+    float3 min;
+    // First child of internal nodes, the second follows it. First item of
+    // leaves in the tree item ids.
+    uint32_t first;
+    float3 max;
+    uint32_t count; // Items of leaves, up to LEAF_MAX_ITEMS
+} BvhNode;
+
+typedef struct ItemLocation
+{
+    uint32_t node; // Leaf index, or one of the LOCATION values
+    uint32_t slot; // In the leaf or the list
+} ItemLocation;
+
+// Children always come after their parent
+typedef struct BvhTree
+{
+    EgArray(BvhNode) nodes;
+    EgArray(uint32_t) parents;
+    EgArray(uint32_t) item_ids;
+} BvhTree;
+
+typedef struct BuildJob
+{
+    EgAllocator *allocator;
+    EgJobSystem *job_system;
+    EgJobCounter counter;
+    // Items as they were when the build started
+    EgArray(uint32_t) ids;
+    EgArray(EgBvhBounds) bounds;
+    BvhTree tree;
+} BuildJob;
+
+struct EgBvh
+{
+    EgAllocator *allocator;
+    BvhTree tree;
+
+    // Indexed by id
+    EgArray(EgBvhBounds) item_bounds;
+    EgArray(ItemLocation) item_locations;
+
+    EgArray(uint32_t) list;
+    size_t unbounded_count; // List items with infinite bounds
+
+    size_t tree_item_count;
+    size_t updates_since_build;
+    // egBvhMaintain calls since the last build
+    uint32_t maintains_since_build;
+    // TreeCost right after the last build
+    float built_cost;
+
+    // Leaves whose items changed since the last query, refitted together.
+    // Past a share of the tree the whole tree is refitted instead.
+    EgArray(uint32_t) dirty_leaves;
+    bool refit_all;
+
+    BuildJob *build; // While one is running
+    EgArray(uint32_t) stack;
+};
+
+static const EgBvhBounds EMPTY_BOUNDS = {
+    .min = {INFINITY, INFINITY, INFINITY},
+    .max = {-INFINITY, -INFINITY, -INFINITY},
+};
+
+static BvhTree TreeCreate(EgAllocator *allocator)
+{
+    return (BvhTree){
+        .nodes = egArrayCreate(allocator, BvhNode),
+        .parents = egArrayCreate(allocator, uint32_t),
+        .item_ids = egArrayCreate(allocator, uint32_t),
+    };
+}
+
+static void TreeFree(BvhTree *tree)
+{
+    egArrayFree(&tree->nodes);
+    egArrayFree(&tree->parents);
+    egArrayFree(&tree->item_ids);
+}
+
+static bool BoundsFinite(const EgBvhBounds *bounds)
+{
+    return isfinite(bounds->min.x) && isfinite(bounds->min.y) &&
+           isfinite(bounds->min.z) && isfinite(bounds->max.x) &&
+           isfinite(bounds->max.y) && isfinite(bounds->max.z);
+}
+
+static void BoundsGrow(float3 *min, float3 *max, float3 other_min, float3 other_max)
+{
+    *min = V3(
+        EG_MIN(min->x, other_min.x),
+        EG_MIN(min->y, other_min.y),
+        EG_MIN(min->z, other_min.z));
+    *max = V3(
+        EG_MAX(max->x, other_max.x),
+        EG_MAX(max->y, other_max.y),
+        EG_MAX(max->z, other_max.z));
+}
+
+static float SurfaceArea(float3 min, float3 max)
+{
+    if (min.x > max.x) return 0.0f;
+    float3 size = egFloat3Sub(max, min);
+    return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+EgBvh *egBvhCreate(EgAllocator *allocator)
+{
+    EgBvh *bvh = (EgBvh *)egAllocate(allocator, sizeof(*bvh));
+    *bvh = (EgBvh){
+        .allocator = allocator,
+        .tree = TreeCreate(allocator),
+        .item_bounds = egArrayCreate(allocator, EgBvhBounds),
+        .item_locations = egArrayCreate(allocator, ItemLocation),
+        .list = egArrayCreate(allocator, uint32_t),
+        .dirty_leaves = egArrayCreate(allocator, uint32_t),
+        .stack = egArrayCreate(allocator, uint32_t),
+    };
+    return bvh;
+}
+
+static void BuildJobDestroy(BuildJob *job)
+{
+    egArrayFree(&job->ids);
+    egArrayFree(&job->bounds);
+    TreeFree(&job->tree);
+    egFree(job->allocator, job);
+}
+
+void egBvhDestroy(EgBvh *bvh)
+{
+    if (bvh->build)
+    {
+        egJobSystemWait(bvh->build->job_system, &bvh->build->counter);
+        BuildJobDestroy(bvh->build);
+    }
+
+    TreeFree(&bvh->tree);
+    egArrayFree(&bvh->item_bounds);
+    egArrayFree(&bvh->item_locations);
+    egArrayFree(&bvh->list);
+    egArrayFree(&bvh->dirty_leaves);
+    egArrayFree(&bvh->stack);
+    egFree(bvh->allocator, bvh);
+}
+
+//
+// Building
+//
+
+typedef struct BuildRange
+{
+    uint32_t node;
+    uint32_t begin;
+    uint32_t end;
+} BuildRange;
+
+static float Axis(float3 v, uint32_t axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Splits order[begin, end) in two non-empty halves at the best of
+// SAH_BIN_COUNT planes along each axis, or in the middle when the centroids
+// can't be told apart. Returns the first item of the second half.
+static uint32_t SplitRange(
+    const EgBvhBounds *bounds,
+    const float3 *centroids,
+    uint32_t *order,
+    uint32_t begin,
+    uint32_t end)
+{
+    float3 centroid_min = V3(INFINITY, INFINITY, INFINITY);
+    float3 centroid_max = V3(-INFINITY, -INFINITY, -INFINITY);
+    for (uint32_t i = begin; i < end; ++i)
+    {
+        float3 centroid = centroids[order[i]];
+        BoundsGrow(&centroid_min, &centroid_max, centroid, centroid);
+    }
+
+    float best_cost = INFINITY;
+    uint32_t best_axis = 0;
+    uint32_t best_bin = 0;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        float axis_min = Axis(centroid_min, axis);
+        float extent = Axis(centroid_max, axis) - axis_min;
+        if (extent <= 0.0f) continue;
+
+        struct
+        {
+            float3 min;
+            float3 max;
+            uint32_t count;
+        } bins[SAH_BIN_COUNT];
+        for (uint32_t b = 0; b < SAH_BIN_COUNT; ++b)
+        {
+            bins[b].min = EMPTY_BOUNDS.min;
+            bins[b].max = EMPTY_BOUNDS.max;
+            bins[b].count = 0;
+        }
+
+        float bin_scale = (float)SAH_BIN_COUNT / extent;
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const EgBvhBounds *item = &bounds[order[i]];
+            float position = (Axis(centroids[order[i]], axis) - axis_min) * bin_scale;
+            uint32_t b = EG_MIN((uint32_t)position, SAH_BIN_COUNT - 1);
+            BoundsGrow(&bins[b].min, &bins[b].max, item->min, item->max);
+            bins[b].count++;
+        }
+
+        // Sweep from the right, then evaluate every plane from the left
+        float right_areas[SAH_BIN_COUNT];
+        uint32_t right_counts[SAH_BIN_COUNT];
+        float3 min = EMPTY_BOUNDS.min;
+        float3 max = EMPTY_BOUNDS.max;
+        uint32_t count = 0;
+        for (uint32_t b = SAH_BIN_COUNT - 1; b > 0; --b)
+        {
+            BoundsGrow(&min, &max, bins[b].min, bins[b].max);
+            count += bins[b].count;
+            right_areas[b] = SurfaceArea(min, max);
+            right_counts[b] = count;
+        }
+
+        min = EMPTY_BOUNDS.min;
+        max = EMPTY_BOUNDS.max;
+        count = 0;
+        for (uint32_t b = 0; b < SAH_BIN_COUNT - 1; ++b)
+        {
+            BoundsGrow(&min, &max, bins[b].min, bins[b].max);
+            count += bins[b].count;
+            if (count == 0 || right_counts[b + 1] == 0) continue;
+
+            float cost = SurfaceArea(min, max) * (float)count +
+                         right_areas[b + 1] * (float)right_counts[b + 1];
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    if (best_cost == INFINITY) return begin + (end - begin) / 2;
+
+    float axis_min = Axis(centroid_min, best_axis);
+    float bin_scale = (float)SAH_BIN_COUNT / (Axis(centroid_max, best_axis) - axis_min);
+    uint32_t left = begin;
+    uint32_t right = end;
+    while (left < right)
+    {
+        float position = (Axis(centroids[order[left]], best_axis) - axis_min) * bin_scale;
+        if (EG_MIN((uint32_t)position, SAH_BIN_COUNT - 1) <= best_bin)
+        {
+            left++;
+        }
+        else
+        {
+            uint32_t temp = order[left];
+            order[left] = order[--right];
+            order[right] = temp;
+        }
+    }
+    // Rounding can leave a side empty
+    if (left == begin || left == end) return begin + (end - begin) / 2;
+    return left;
+}
+
+static void BuildTree(
+    EgAllocator *allocator,
+    const uint32_t *ids,
+    const EgBvhBounds *bounds,
+    uint32_t item_count,
+    BvhTree *tree)
+{
+    egArrayResize(&tree->nodes, 0);
+    egArrayResize(&tree->parents, 0);
+    egArrayResize(&tree->item_ids, item_count);
+    if (item_count == 0) return;
+
+    uint32_t *order = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * item_count);
+    float3 *centroids = (float3 *)egAllocate(allocator, sizeof(float3) * item_count);
+    for (uint32_t i = 0; i < item_count; ++i)
+    {
+        order[i] = i;
+        centroids[i] = egFloat3MulScalar(egFloat3Add(bounds[i].min, bounds[i].max), 0.5f);
+    }
+
+    EgArray(BuildRange) ranges = egArrayCreate(allocator, BuildRange);
+    egArrayPush(&tree->nodes, (BvhNode){});
+    egArrayPush(&tree->parents, UINT32_MAX);
+    egArrayPush(&ranges, ((BuildRange){.node = 0, .begin = 0, .end = item_count}));
+
+    while (egArrayLength(ranges) > 0)
+    {
+        BuildRange range = ranges[egArrayLength(ranges) - 1];
+        egArrayPop(&ranges);
+
+        BvhNode node = {
+            .min = EMPTY_BOUNDS.min,
+            .max = EMPTY_BOUNDS.max,
+        };
+        for (uint32_t i = range.begin; i < range.end; ++i)
+        {
+            BoundsGrow(&node.min, &node.max, bounds[order[i]].min, bounds[order[i]].max);
+        }
+
+        uint32_t count = range.end - range.begin;
+        if (count <= LEAF_MAX_ITEMS)
+        {
+            node.first = range.begin;
+            node.count = count;
+            for (uint32_t i = range.begin; i < range.end; ++i)
+            {
+                tree->item_ids[i] = ids[order[i]];
+            }
+            tree->nodes[range.node] = node;
+            continue;
+        }
+
+        uint32_t middle = SplitRange(bounds, centroids, order, range.begin, range.end);
+        uint32_t first_child = (uint32_t)egArrayLength(tree->nodes);
+        node.first = first_child;
+        node.count = INTERNAL_NODE;
+        tree->nodes[range.node] = node;
+
+        egArrayPush(&tree->nodes, (BvhNode){});
+        egArrayPush(&tree->nodes, (BvhNode){});
+        egArrayPush(&tree->parents, range.node);
+        egArrayPush(&tree->parents, range.node);
+
+        BuildRange left = {.node = first_child, .begin = range.begin, .end = middle};
+        BuildRange right = {.node = first_child + 1, .begin = middle, .end = range.end};
+        egArrayPush(&ranges, left);
+        egArrayPush(&ranges, right);
+    }
+
+    egArrayFree(&ranges);
+    egFree(allocator, order);
+    egFree(allocator, centroids);
+}
+
+static void BuildProc(void *user_data)
+{
+    BuildJob *job = (BuildJob *)user_data;
+    BuildTree(
+        job->allocator,
+        job->ids,
+        job->bounds,
+        (uint32_t)egArrayLength(job->ids),
+        &job->tree);
+}
+
+//
+// Refitting
+//
+
+static void RefitNode(EgBvh *bvh, uint32_t node_index)
+{
+    BvhNode *node = &bvh->tree.nodes[node_index];
+    float3 min = EMPTY_BOUNDS.min;
+    float3 max = EMPTY_BOUNDS.max;
+    if (node->count == INTERNAL_NODE)
+    {
+        BvhNode *left = &bvh->tree.nodes[node->first];
+        BvhNode *right = &bvh->tree.nodes[node->first + 1];
+        BoundsGrow(&min, &max, left->min, left->max);
+        BoundsGrow(&min, &max, right->min, right->max);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            const EgBvhBounds *item =
+                &bvh->item_bounds[bvh->tree.item_ids[node->first + i]];
+            BoundsGrow(&min, &max, item->min, item->max);
+        }
+    }
+    node->min = min;
+    node->max = max;
+}
+
+static void MarkDirty(EgBvh *bvh, uint32_t leaf)
+{
+    if (bvh->refit_all) return;
+    if (egArrayLength(bvh->dirty_leaves) * 8 >= egArrayLength(bvh->tree.nodes))
+    {
+        bvh->refit_all = true;
+        egArrayResize(&bvh->dirty_leaves, 0);
+        return;
+    }
+    egArrayPush(&bvh->dirty_leaves, leaf);
+}
+
+// Refits a leaf and walks up until a node keeps its bounds
+static void RefitPath(EgBvh *bvh, uint32_t leaf)
+{
+    uint32_t node_index = leaf;
+    while (node_index != UINT32_MAX)
+    {
+        BvhNode *node = &bvh->tree.nodes[node_index];
+        float3 old_min = node->min;
+        float3 old_max = node->max;
+        RefitNode(bvh, node_index);
+        if (node_index != leaf && memcmp(&old_min, &node->min, sizeof(float3)) == 0 &&
+            memcmp(&old_max, &node->max, sizeof(float3)) == 0)
+        {
+            break;
+        }
+        node_index = bvh->tree.parents[node_index];
+    }
+}
+
+// Brings the nodes up to date with the items before a query
+static void Refit(EgBvh *bvh)
+{
+    if (bvh->refit_all)
+    {
+        // Children come after their parent
+        for (uint32_t n = (uint32_t)egArrayLength(bvh->tree.nodes); n > 0; --n)
+        {
+            RefitNode(bvh, n - 1);
+        }
+        bvh->refit_all = false;
+    }
+    else
+    {
+        for (size_t i = 0; i < egArrayLength(bvh->dirty_leaves); ++i)
+        {
+            RefitPath(bvh, bvh->dirty_leaves[i]);
+        }
+    }
+    egArrayResize(&bvh->dirty_leaves, 0);
+}
+
+static void ListPush(EgBvh *bvh, uint32_t id)
+{
+    bvh->item_locations[id] = (ItemLocation){
+        .node = LOCATION_LIST,
+        .slot = (uint32_t)egArrayLength(bvh->list),
+    };
+    egArrayPush(&bvh->list, id);
+    if (!BoundsFinite(&bvh->item_bounds[id])) bvh->unbounded_count++;
+}
+
+static void ListRemove(EgBvh *bvh, uint32_t id)
+{
+    uint32_t slot = bvh->item_locations[id].slot;
+    uint32_t last = bvh->list[egArrayLength(bvh->list) - 1];
+    bvh->list[slot] = last;
+    bvh->item_locations[last].slot = slot;
+    egArrayPop(&bvh->list);
+    if (!BoundsFinite(&bvh->item_bounds[id])) bvh->unbounded_count--;
+}
+
+// Leaves keep their place in the tree when they lose items, the last item of
+// the leaf fills the gap
+static void LeafRemove(EgBvh *bvh, uint32_t id)
+{
+    ItemLocation location = bvh->item_locations[id];
+    BvhNode *leaf = &bvh->tree.nodes[location.node];
+    uint32_t last = bvh->tree.item_ids[leaf->first + leaf->count - 1];
+    bvh->tree.item_ids[leaf->first + location.slot] = last;
+    bvh->item_locations[last].slot = location.slot;
+    leaf->count--;
+    bvh->tree_item_count--;
+}
+
+void egBvhInsert(EgBvh *bvh, uint32_t id, const EgBvhBounds *bounds)
+{
+    EG_ASSERT(!egBvhContains(bvh, id));
+
+    size_t old_length = egArrayLength(bvh->item_locations);
+    if (id >= old_length)
+    {
+        egArrayResize(&bvh->item_bounds, id + 1);
+        egArrayResize(&bvh->item_locations, id + 1);
+        for (size_t i = old_length; i <= id; ++i)
+        {
+            bvh->item_locations[i] = (ItemLocation){.node = LOCATION_NONE};
+        }
+    }
+
+    bvh->item_bounds[id] = *bounds;
+    ListPush(bvh, id);
+}
+
+void egBvhRemove(EgBvh *bvh, uint32_t id)
+{
+    EG_ASSERT(egBvhContains(bvh, id));
+
+    ItemLocation location = bvh->item_locations[id];
+    if (location.node == LOCATION_LIST)
+    {
+        ListRemove(bvh, id);
+    }
+    else
+    {
+        LeafRemove(bvh, id);
+        MarkDirty(bvh, location.node);
+    }
+    bvh->item_locations[id].node = LOCATION_NONE;
+}
+
+void egBvhUpdate(EgBvh *bvh, uint32_t id, const EgBvhBounds *bounds)
+{
+    EG_ASSERT(egBvhContains(bvh, id));
+
+    ItemLocation location = bvh->item_locations[id];
+    if (location.node == LOCATION_LIST)
+    {
+        ListRemove(bvh, id);
+        bvh->item_bounds[id] = *bounds;
+        ListPush(bvh, id);
+        return;
+    }
+
+    bvh->item_bounds[id] = *bounds;
+    if (!BoundsFinite(bounds))
+    {
+        LeafRemove(bvh, id);
+        ListPush(bvh, id);
+    }
+    MarkDirty(bvh, location.node);
+    bvh->updates_since_build++;
+}
+
+bool egBvhContains(EgBvh *bvh, uint32_t id)
+{
+    return id < egArrayLength(bvh->item_locations) &&
+           bvh->item_locations[id].node != LOCATION_NONE;
+}
+
+// SAH cost of a query through the tree, relative to one that only visits the
+// root: the surface area of every node over the root's, with leaves weighted
+// by their item count
+static float TreeCost(EgBvh *bvh)
+{
+    if (egArrayLength(bvh->tree.nodes) == 0) return 0.0f;
+
+    float root_area = SurfaceArea(bvh->tree.nodes[0].min, bvh->tree.nodes[0].max);
+    if (root_area <= 0.0f) return 0.0f;
+
+    float cost = 0.0f;
+    for (size_t n = 0; n < egArrayLength(bvh->tree.nodes); ++n)
+    {
+        BvhNode *node = &bvh->tree.nodes[n];
+        float weight = node->count == INTERNAL_NODE ? 1.0f : (float)node->count;
+        cost += SurfaceArea(node->min, node->max) * weight;
+    }
+    return cost / root_area;
+}
+
+// Takes the built tree in place of the current one. Items may have been
+// inserted, removed or moved while it was built: removed items are dropped
+// from their leaves, the others leave the list, and every node is refitted
+// to the current bounds.
+static void AdoptBuild(EgBvh *bvh, BuildJob *job)
+{
+    TreeFree(&bvh->tree);
+    bvh->tree = job->tree;
+    job->tree = TreeCreate(job->allocator);
+    bvh->tree_item_count = 0;
+
+    for (uint32_t n = 0; n < egArrayLength(bvh->tree.nodes); ++n)
+    {
+        BvhNode *node = &bvh->tree.nodes[n];
+        if (node->count == INTERNAL_NODE) continue;
+
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            uint32_t id = bvh->tree.item_ids[node->first + i];
+            ItemLocation location = bvh->item_locations[id];
+            if (location.node == LOCATION_NONE) continue;
+            if (!BoundsFinite(&bvh->item_bounds[id]))
+            {
+                if (location.node != LOCATION_LIST) ListPush(bvh, id);
+                continue;
+            }
+            if (location.node == LOCATION_LIST) ListRemove(bvh, id);
+
+            bvh->tree.item_ids[node->first + kept] = id;
+            bvh->item_locations[id] = (ItemLocation){.node = n, .slot = kept};
+            kept++;
+        }
+        node->count = kept;
+        bvh->tree_item_count += kept;
+    }
+
+    egArrayResize(&bvh->dirty_leaves, 0);
+    bvh->refit_all = true;
+    Refit(bvh);
+
+    bvh->updates_since_build = 0;
+    bvh->maintains_since_build = 0;
+    bvh->built_cost = TreeCost(bvh);
+}
+
+static BuildJob *StartBuild(EgBvh *bvh)
+{
+    BuildJob *job = (BuildJob *)egAllocate(bvh->allocator, sizeof(*job));
+    *job = (BuildJob){
+        .allocator = bvh->allocator,
+        .ids = egArrayCreate(bvh->allocator, uint32_t),
+        .bounds = egArrayCreate(bvh->allocator, EgBvhBounds),
+        .tree = TreeCreate(bvh->allocator),
+    };
+
+    for (size_t n = 0; n < egArrayLength(bvh->tree.nodes); ++n)
+    {
+        BvhNode *node = &bvh->tree.nodes[n];
+        if (node->count == INTERNAL_NODE) continue;
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            uint32_t id = bvh->tree.item_ids[node->first + i];
+            egArrayPush(&job->ids, id);
+            egArrayPush(&job->bounds, bvh->item_bounds[id]);
+        }
+    }
+    for (size_t i = 0; i < egArrayLength(bvh->list); ++i)
+    {
+        uint32_t id = bvh->list[i];
+        if (!BoundsFinite(&bvh->item_bounds[id])) continue;
+        egArrayPush(&job->ids, id);
+        egArrayPush(&job->bounds, bvh->item_bounds[id]);
+    }
+
+    return job;
+}
+
+void egBvhRebuild(EgBvh *bvh)
+{
+    BuildJob *job = StartBuild(bvh);
+    BuildProc(job);
+    AdoptBuild(bvh, job);
+    BuildJobDestroy(job);
+}
+
+void egBvhMaintain(EgBvh *bvh, EgJobSystem *job_system)
+{
+    if (bvh->build)
+    {
+        if (!egJobCounterIsDone(&bvh->build->counter)) return;
+        AdoptBuild(bvh, bvh->build);
+        BuildJobDestroy(bvh->build);
+        bvh->build = NULL;
+        return;
+    }
+
+    bvh->maintains_since_build++;
+
+    // Refits are cheap and keep queries fast while items move, the cost is
+    // only measured once a rebuild would be allowed anyway
+    bool degraded = false;
+    if (bvh->tree_item_count > 0 && bvh->updates_since_build > 0 &&
+        bvh->maintains_since_build >= REBUILD_MIN_INTERVAL)
+    {
+        Refit(bvh);
+        degraded = TreeCost(bvh) > bvh->built_cost * REBUILD_COST_RATIO;
+    }
+
+    size_t list_count = egArrayLength(bvh->list) - bvh->unbounded_count;
+    bool list_full = list_count >= REBUILD_MIN_LIST_ITEMS &&
+                     list_count * 16 >= bvh->tree_item_count;
+    if (!degraded && !list_full) return;
+
+    if (!job_system)
+    {
+        egBvhRebuild(bvh);
+        return;
+    }
+
+    bvh->build = StartBuild(bvh);
+    bvh->build->job_system = job_system;
+    egJobSystemRun(job_system, BuildProc, bvh->build, &bvh->build->counter);
+}
+
+//
+// Queries
+//
+
+static void Emit(uint32_t *ids, size_t max_count, size_t *count, uint32_t id)
+{
+    if (*count < max_count) ids[*count] = id;
+    (*count)++;
+}
+
+// Emits the items of every leaf under node_index
+static void EmitSubtree(
+    EgBvh *bvh, uint32_t node_index, uint32_t *ids, size_t max_count, size_t *count)
+{
+    size_t stack_base = egArrayLength(bvh->stack);
+    egArrayPush(&bvh->stack, node_index);
+    while (egArrayLength(bvh->stack) > stack_base)
+    {
+        BvhNode *node = &bvh->tree.nodes[bvh->stack[egArrayLength(bvh->stack) - 1]];
+        egArrayPop(&bvh->stack);
+        if (node->count == INTERNAL_NODE)
+        {
+            egArrayPush(&bvh->stack, node->first);
+            egArrayPush(&bvh->stack, node->first + 1);
+            continue;
+        }
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            Emit(ids, max_count, count, bvh->tree.item_ids[node->first + i]);
+        }
+    }
+}
+
+typedef enum FrustumTest
+{
+    FRUSTUM_OUTSIDE,
+    FRUSTUM_INTERSECTS,
+    FRUSTUM_INSIDE,
+} FrustumTest;
+
+static FrustumTest TestFrustum(const EgMeshletCuller *culler, float3 min, float3 max)
+{
+    if (min.x > max.x) return FRUSTUM_OUTSIDE;
+
+    FrustumTest result = FRUSTUM_INSIDE;
+    for (uint32_t p = 0; p < 6; ++p)
+    {
+        float px = culler->plane_x[p];
+        float py = culler->plane_y[p];
+        float pz = culler->plane_z[p];
+        float pw = culler->plane_w[p];
+
+        // Corners furthest along and against the plane normal
+        float furthest = px * (px > 0.0f ? max.x : min.x) +
+                         py * (py > 0.0f ? max.y : min.y) +
+                         pz * (pz > 0.0f ? max.z : min.z) + pw;
+        if (furthest < 0.0f) return FRUSTUM_OUTSIDE;
+
+        float nearest = px * (px > 0.0f ? min.x : max.x) +
+                        py * (py > 0.0f ? min.y : max.y) +
+                        pz * (pz > 0.0f ? min.z : max.z) + pw;
+        if (nearest < 0.0f) result = FRUSTUM_INTERSECTS;
+    }
+    return result;
+}
+
+size_t egBvhQueryFrustum(
+    EgBvh *bvh, const float4x4 *view_proj, uint32_t *ids, size_t max_count)
+{
+    Refit(bvh);
+
+    EgMeshletCuller culler;
+    egMeshletCullerInit(&culler, view_proj, V3(0.0f, 0.0f, 0.0f));
+
+    size_t count = 0;
+    for (size_t i = 0; i < egArrayLength(bvh->list); ++i)
+    {
+        const EgBvhBounds *bounds = &bvh->item_bounds[bvh->list[i]];
+        if (TestFrustum(&culler, bounds->min, bounds->max) != FRUSTUM_OUTSIDE)
+        {
+            Emit(ids, max_count, &count, bvh->list[i]);
+        }
+    }
+
+    if (egArrayLength(bvh->tree.nodes) == 0) return count;
+
+    egArrayResize(&bvh->stack, 0);
+    egArrayPush(&bvh->stack, 0);
+    while (egArrayLength(bvh->stack) > 0)
+    {
+        uint32_t node_index = bvh->stack[egArrayLength(bvh->stack) - 1];
+        egArrayPop(&bvh->stack);
+        BvhNode *node = &bvh->tree.nodes[node_index];
+
+        FrustumTest test = TestFrustum(&culler, node->min, node->max);
+        if (test == FRUSTUM_OUTSIDE) continue;
+        if (test == FRUSTUM_INSIDE)
+        {
+            EmitSubtree(bvh, node_index, ids, max_count, &count);
+            continue;
+        }
+
+        if (node->count == INTERNAL_NODE)
+        {
+            egArrayPush(&bvh->stack, node->first);
+            egArrayPush(&bvh->stack, node->first + 1);
+            continue;
+        }
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            uint32_t id = bvh->tree.item_ids[node->first + i];
+            const EgBvhBounds *bounds = &bvh->item_bounds[id];
+            if (TestFrustum(&culler, bounds->min, bounds->max) != FRUSTUM_OUTSIDE)
+            {
+                Emit(ids, max_count, &count, id);
+            }
+        }
+    }
+
+    return count;
+}
+
+static bool OverlapsSphere(float3 min, float3 max, float3 center, float radius)
+{
+    float3 closest = V3(
+        EG_CLAMP(center.x, min.x, max.x),
+        EG_CLAMP(center.y, min.y, max.y),
+        EG_CLAMP(center.z, min.z, max.z));
+    float3 offset = egFloat3Sub(closest, center);
+    return min.x <= max.x && egFloat3Dot(offset, offset) <= radius * radius;
+}
+
+size_t egBvhQuerySphere(
+    EgBvh *bvh, float3 center, float radius, uint32_t *ids, size_t max_count)
+{
+    Refit(bvh);
+
+    size_t count = 0;
+    for (size_t i = 0; i < egArrayLength(bvh->list); ++i)
+    {
+        const EgBvhBounds *bounds = &bvh->item_bounds[bvh->list[i]];
+        if (OverlapsSphere(bounds->min, bounds->max, center, radius))
+        {
+            Emit(ids, max_count, &count, bvh->list[i]);
+        }
+    }
+
+    if (egArrayLength(bvh->tree.nodes) == 0) return count;
+
+    egArrayResize(&bvh->stack, 0);
+    egArrayPush(&bvh->stack, 0);
+    while (egArrayLength(bvh->stack) > 0)
+    {
+        BvhNode *node = &bvh->tree.nodes[bvh->stack[egArrayLength(bvh->stack) - 1]];
+        egArrayPop(&bvh->stack);
+        if (!OverlapsSphere(node->min, node->max, center, radius)) continue;
+
+        if (node->count == INTERNAL_NODE)
+        {
+            egArrayPush(&bvh->stack, node->first);
+            egArrayPush(&bvh->stack, node->first + 1);
+            continue;
+        }
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            uint32_t id = bvh->tree.item_ids[node->first + i];
+            const EgBvhBounds *bounds = &bvh->item_bounds[id];
+            if (OverlapsSphere(bounds->min, bounds->max, center, radius))
+            {
+                Emit(ids, max_count, &count, id);
+            }
+        }
+    }
+
+    return count;
+}
+
+// Distance at which the ray enters the box, INFINITY if it misses it
+static float RayEnter(float3 origin, float3 inverse_direction, float3 min, float3 max)
+{
+    if (min.x > max.x) return INFINITY;
+
+    float tx0 = (min.x - origin.x) * inverse_direction.x;
+    float tx1 = (max.x - origin.x) * inverse_direction.x;
+    float ty0 = (min.y - origin.y) * inverse_direction.y;
+    float ty1 = (max.y - origin.y) * inverse_direction.y;
+    float tz0 = (min.z - origin.z) * inverse_direction.z;
+    float tz1 = (max.z - origin.z) * inverse_direction.z;
+
+    float enter = EG_MAX(EG_MAX(EG_MIN(tx0, tx1), EG_MIN(ty0, ty1)), EG_MIN(tz0, tz1));
+    float exit = EG_MIN(EG_MIN(EG_MAX(tx0, tx1), EG_MAX(ty0, ty1)), EG_MAX(tz0, tz1));
+    if (exit < EG_MAX(enter, 0.0f)) return INFINITY;
+    return EG_MAX(enter, 0.0f);
+}
+
+bool egBvhRaycast(
+    EgBvh *bvh,
+    float3 origin,
+    float3 direction,
+    float max_distance,
+    uint32_t *id,
+    float *distance)
+{
+    Refit(bvh);
+
+    float3 inverse_direction =
+        V3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+    float best = max_distance;
+    bool hit = false;
+
+    for (size_t i = 0; i < egArrayLength(bvh->list); ++i)
+    {
+        const EgBvhBounds *bounds = &bvh->item_bounds[bvh->list[i]];
+        float enter = RayEnter(origin, inverse_direction, bounds->min, bounds->max);
+        if (enter < INFINITY && enter <= best)
+        {
+            best = enter;
+            *id = bvh->list[i];
+            hit = true;
+        }
+    }
+
+    if (egArrayLength(bvh->tree.nodes) > 0)
+    {
+        egArrayResize(&bvh->stack, 0);
+        egArrayPush(&bvh->stack, 0);
+    }
+    while (egArrayLength(bvh->stack) > 0)
+    {
+        BvhNode *node = &bvh->tree.nodes[bvh->stack[egArrayLength(bvh->stack) - 1]];
+        egArrayPop(&bvh->stack);
+        float enter = RayEnter(origin, inverse_direction, node->min, node->max);
+        if (enter == INFINITY || enter > best) continue;
+
+        if (node->count == INTERNAL_NODE)
+        {
+            // The nearer child goes on top so it's visited first
+            BvhNode *left = &bvh->tree.nodes[node->first];
+            BvhNode *right = &bvh->tree.nodes[node->first + 1];
+            float left_enter =
+                RayEnter(origin, inverse_direction, left->min, left->max);
+            float right_enter =
+                RayEnter(origin, inverse_direction, right->min, right->max);
+            if (left_enter < right_enter)
+            {
+                egArrayPush(&bvh->stack, node->first + 1);
+                egArrayPush(&bvh->stack, node->first);
+            }
+            else
+            {
+                egArrayPush(&bvh->stack, node->first);
+                egArrayPush(&bvh->stack, node->first + 1);
+            }
+            continue;
+        }
+
+        for (uint32_t i = 0; i < node->count; ++i)
+        {
+            uint32_t item = bvh->tree.item_ids[node->first + i];
+            const EgBvhBounds *bounds = &bvh->item_bounds[item];
+            float item_enter =
+                RayEnter(origin, inverse_direction, bounds->min, bounds->max);
+            if (item_enter < INFINITY && item_enter <= best)
+            {
+                best = item_enter;
+                *id = item;
+                hit = true;
+            }
+        }
+    }
+
+    if (hit) *distance = best;
+    return hit;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgJobSystem EgJobSystem;
+typedef struct EgBvh EgBvh;
+
+typedef struct EgBvhBounds
+{
+    float3 min;
+    float3 max;
+} EgBvhBounds;
+
+// Bounding volume hierarchy over items identified by small integers, such as
+// pool slots. Items that move are refitted in place. Items inserted since the
+// last build, and items with infinite bounds, are kept in a list that every
+// query goes through, until egBvhMaintain rebuilds the tree.
+EgBvh *egBvhCreate(EgAllocator *allocator);
+void egBvhDestroy(EgBvh *bvh);
+
+void egBvhInsert(EgBvh *bvh, uint32_t id, const EgBvhBounds *bounds);
+void egBvhRemove(EgBvh *bvh, uint32_t id);
+// Refits the leaf of the item and its ancestors
+void egBvhUpdate(EgBvh *bvh, uint32_t id, const EgBvhBounds *bounds);
+bool egBvhContains(EgBvh *bvh, uint32_t id);
+
+// Once refits have degraded the tree enough, measured by its surface area
+// heuristic cost against the one of the last build, or once enough items were
+// inserted since, starts a new build on job_system (if not NULL, synchronously
+// otherwise), and swaps it in on a later call once it's done. Meant to be
+// called once a frame. The allocator has to be thread safe when a job system
+// is given.
+void egBvhMaintain(EgBvh *bvh, EgJobSystem *job_system);
+// Builds the tree from scratch right away, with a binned surface area heuristic
+void egBvhRebuild(EgBvh *bvh);
+
+// The queries write the ids of at most max_count items to ids and return how
+// many items matched, which can be more than max_count.
+
+// Items whose bounds are at least partly inside the frustum of view_proj,
+// which has a [0, 1] depth range
+size_t egBvhQueryFrustum(
+    EgBvh *bvh, const float4x4 *view_proj, uint32_t *ids, size_t max_count);
+size_t egBvhQuerySphere(
+    EgBvh *bvh, float3 center, float radius, uint32_t *ids, size_t max_count);
+// Closest item whose bounds the ray enters within max_distance, distances are
+// in units of direction
+bool egBvhRaycast(
+    EgBvh *bvh,
+    float3 origin,
+    float3 direction,
+    float max_distance,
+    uint32_t *id,
+    float *distance);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,11 +4,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <rg.h>
-#include <tinyshader/tinyshader.h>
 #include "allocator.h"
+#include "array.h"
 #include "pipeline_util.h"
 #include "pbr.h"
 #include "pool.h"
+#include "offset_allocator.h"
+#include "job_system.h"
+#include "asset_cache.h"
+#include "thread.h"
 
 #if defined(_MSC_VER)
 #pragma warning(disable : 4996)
@@ -17,6 +21,7 @@
 #ifdef __linux__
 #define GLFW_EXPOSE_NATIVE_X11
 #include <unistd.h>
+#include <time.h>
 #include <linux/limits.h>
 #endif
 
@@ -31,6 +36,17 @@
 
 #define EVENT_CAPACITY 1024
 
+#define DEFAULT_WIDTH 800
+#define DEFAULT_HEIGHT 600
+
+// Size of the shared geometry buffers
+#define GEOMETRY_VERTEX_CAPACITY (4 * 1024 * 1024) // 64MiB of EgCompactVertex
+#define GEOMETRY_INDEX_CAPACITY (64 * 1024 * 1024) // 64MiB
+
+// Frames the GPU can still be reading from when a new one begins, the same as
+// the frame allocators of the model manager
+#define FRAMES_IN_FLIGHT 2
+
 static struct
 {
     EgEvent events[EVENT_CAPACITY];
@@ -115,10 +131,29 @@ struct EgEngine
     RgDevice *device;
     RgSwapchain *swapchain;
 
+    // Without a window, see EgEngineInfo
+    bool headless;
+    uint32_t width;
+    uint32_t height;
+    double start_time;
+    EgImage backbuffer_image;
+    RgRenderPass *backbuffer_pass;
+    RgBuffer *readback_buffer; // NULL if readback is disabled
+    uint8_t *readback_mapping;
+
+    bool enable_capture;
+    // Set by egEngineCaptureFrame until the frame it captures ends
+    char *capture_path;
+    bool capturing;
+
     const char *exe_dir;
 
+    EgJobSystem *job_system;
+    EgAssetCache *asset_cache;
+
     RgCmdPool *graphics_cmd_pool;
     RgCmdPool *transfer_cmd_pool;
+    RgUploadContext *upload_context;
     EgImage white_image;
     EgImage black_image;
     EgSampler default_sampler;
@@ -129,11 +164,98 @@ struct EgEngine
     RgPipelineLayout *global_pipeline_layout;
     RgDescriptorSet *global_descriptor_set;
 
+    // Guards the descriptor pools and updates of the global set, which
+    // recording threads reach when an EgFrameAllocator overflows
+    EgMutex *descriptor_mutex;
     EgPool *storage_buffer_pool;
     EgPool *texture_pool;
     EgPool *sampler_pool;
+
+    EgBuffer vertex_buffer;
+    RgBuffer *index_buffer;
+    EgOffsetAllocator *vertex_allocator; // In vertices
+    EgOffsetAllocator *index_allocator;  // In bytes
+    // Geometry freed during each of the last frames, given back to the
+    // allocators once its frame comes around again in egEngineBeginFrame
+    EgArray(EgGeometry) freed_geometry[FRAMES_IN_FLIGHT];
+    uint32_t frame_index;
 };
 
+static double GetMonotonicTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Headless engines render into this instead of a swapchain image
+static void EgEngineCreateBackbuffer(EgEngine *engine, bool readback)
+{
+    RgImageInfo image_info = {};
+    image_info.extent = (RgExtent3D){engine->width, engine->height, 1};
+    image_info.format = RG_FORMAT_RGBA8_UNORM;
+    image_info.usage = RG_IMAGE_USAGE_SAMPLED | RG_IMAGE_USAGE_COLOR_ATTACHMENT |
+                       RG_IMAGE_USAGE_TRANSFER_SRC;
+    image_info.aspect = RG_IMAGE_ASPECT_COLOR;
+    image_info.sample_count = 1;
+    image_info.mip_count = 1;
+    image_info.layer_count = 1;
+    engine->backbuffer_image = egEngineAllocateImage(engine, &image_info);
+
+    RgRenderPassInfo render_pass_info = {};
+    render_pass_info.color_attachments = &engine->backbuffer_image.image;
+    render_pass_info.color_attachment_count = 1;
+    engine->backbuffer_pass = rgRenderPassCreate(engine->device, &render_pass_info);
+
+    if (readback)
+    {
+        RgBufferInfo buffer_info = {};
+        buffer_info.size = (size_t)engine->width * engine->height * 4;
+        buffer_info.usage = RG_BUFFER_USAGE_TRANSFER_DST;
+        buffer_info.memory = RG_BUFFER_MEMORY_HOST;
+        engine->readback_buffer = rgBufferCreate(engine->device, &buffer_info);
+        engine->readback_mapping =
+            (uint8_t *)rgBufferMap(engine->device, engine->readback_buffer);
+    }
+}
+
+static void EgEngineCreateWindow(EgEngine *engine)
+{
+    glfwInit();
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+    GLFWwindow *window = glfwCreateWindow(
+        (int)engine->width, (int)engine->height, "Vulkan renderer", NULL, NULL);
+    glfwSetWindowUserPointer(window, engine);
+
+    glfwSetMonitorCallback(eventQueueMonitorCallback);
+    glfwSetJoystickCallback(eventQueueJoystickCallback);
+    glfwSetWindowPosCallback(window, eventQueueWindowPosCallback);
+    glfwSetWindowSizeCallback(window, eventQueueWindowSizeCallback);
+    glfwSetWindowCloseCallback(window, eventQueueWindowCloseCallback);
+    glfwSetWindowRefreshCallback(window, eventQueueWindowRefreshCallback);
+    glfwSetWindowFocusCallback(window, eventQueueWindowFocusCallback);
+    glfwSetWindowIconifyCallback(window, eventQueueWindowIconifyCallback);
+    glfwSetFramebufferSizeCallback(window, eventQueueFramebufferSizeCallback);
+    glfwSetMouseButtonCallback(window, eventQueueMouseButtonCallback);
+    glfwSetCursorPosCallback(window, eventQueueCursorPosCallback);
+    glfwSetCursorEnterCallback(window, eventQueueCursorEnterCallback);
+    glfwSetScrollCallback(window, eventQueueScrollCallback);
+    glfwSetKeyCallback(window, eventQueueKeyCallback);
+    glfwSetCharCallback(window, eventQueueCharCallback);
+    glfwSetDropCallback(window, eventQueueFileDropCallback);
+    glfwSetWindowMaximizeCallback(window, eventQueueWindowMaximizeCallback);
+    glfwSetWindowContentScaleCallback(window, eventQueueWindowContentScaleCallback);
+
+    engine->window = window;
+}
+
 static void EgEngineResizeResources(EgEngine *engine)
 {
     int width, height;
@@ -163,7 +285,7 @@ static void EgEngineResizeResources(EgEngine *engine)
     }
 }
 
-EgEngine *egEngineCreate(EgAllocator *allocator)
+EgEngine *egEngineCreate(EgAllocator *allocator, const EgEngineInfo *info)
 {
     EgEngine *engine = (EgEngine *)egAllocate(allocator, sizeof(EgEngine));
     *engine = (EgEngine){};
@@ -173,40 +295,45 @@ EgEngine *egEngineCreate(EgAllocator *allocator)
 
     engine->exe_dir = getExeDirPath(allocator);
 
-    glfwInit();
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    GLFWwindow *window = glfwCreateWindow(800, 600, "Vulkan renderer", NULL, NULL);
-    glfwSetWindowUserPointer(window, engine);
+    EgJobSystemInfo job_system_info = {};
+    engine->job_system = egJobSystemCreate(allocator, &job_system_info);
 
-    glfwSetMonitorCallback(eventQueueMonitorCallback);
-    glfwSetJoystickCallback(eventQueueJoystickCallback);
-    glfwSetWindowPosCallback(window, eventQueueWindowPosCallback);
-    glfwSetWindowSizeCallback(window, eventQueueWindowSizeCallback);
-    glfwSetWindowCloseCallback(window, eventQueueWindowCloseCallback);
-    glfwSetWindowRefreshCallback(window, eventQueueWindowRefreshCallback);
-    glfwSetWindowFocusCallback(window, eventQueueWindowFocusCallback);
-    glfwSetWindowIconifyCallback(window, eventQueueWindowIconifyCallback);
-    glfwSetFramebufferSizeCallback(window, eventQueueFramebufferSizeCallback);
-    glfwSetMouseButtonCallback(window, eventQueueMouseButtonCallback);
-    glfwSetCursorPosCallback(window, eventQueueCursorPosCallback);
-    glfwSetCursorEnterCallback(window, eventQueueCursorEnterCallback);
-    glfwSetScrollCallback(window, eventQueueScrollCallback);
-    glfwSetKeyCallback(window, eventQueueKeyCallback);
-    glfwSetCharCallback(window, eventQueueCharCallback);
-    glfwSetDropCallback(window, eventQueueFileDropCallback);
-    glfwSetWindowMaximizeCallback(window, eventQueueWindowMaximizeCallback);
-    glfwSetWindowContentScaleCallback(window, eventQueueWindowContentScaleCallback);
+    {
+        const char *cache_dir_name = "asset_cache";
+        size_t path_size = strlen(engine->exe_dir) + 1 + strlen(cache_dir_name) + 1;
+        char *path = (char *)egAllocate(allocator, path_size);
+        snprintf(path, path_size, "%s/%s", engine->exe_dir, cache_dir_name);
+        engine->asset_cache = egAssetCacheCreate(allocator, path);
+        egFree(allocator, path);
+    }
 
-    engine->window = window;
+    engine->headless = info->headless;
+    engine->enable_capture = info->enable_capture;
+    engine->width = info->width ? info->width : DEFAULT_WIDTH;
+    engine->height = info->height ? info->height : DEFAULT_HEIGHT;
+    engine->start_time = GetMonotonicTime();
 
     RgDeviceInfo device_info = {};
-    device_info.enable_validation = true;
+    device_info.enable_validation = info->enable_validation;
+    device_info.headless = info->headless;
+    device_info.enable_capture = info->enable_capture;
+
+    if (!engine->headless)
+    {
+        EgEngineCreateWindow(engine);
+    }
+
     engine->device = rgDeviceCreate(&device_info);
 
-    EgEngineResizeResources(engine);
+    if (!engine->headless)
+    {
+        EgEngineResizeResources(engine);
+    }
 
     RgDevice *device = engine->device;
 
+
+    engine->descriptor_mutex = egMutexCreate(engine->allocator);
     engine->storage_buffer_pool = egPoolCreate(engine->allocator, 4 * 1024);
     engine->texture_pool = egPoolCreate(engine->allocator, 4 * 1024);
     engine->sampler_pool = egPoolCreate(engine->allocator, 4 * 1024);
@@ -252,6 +379,38 @@ EgEngine *egEngineCreate(EgAllocator *allocator)
     engine->transfer_cmd_pool = rgCmdPoolCreate(device, RG_QUEUE_TYPE_TRANSFER);
     engine->graphics_cmd_pool = rgCmdPoolCreate(device, RG_QUEUE_TYPE_GRAPHICS);
 
+    // Uploaded images are used by the graphics queue, so recording their copies
+    // there avoids queue family ownership transfers
+    RgUploadContextInfo upload_context_info = {};
+    upload_context_info.queue_type = RG_QUEUE_TYPE_GRAPHICS;
+    engine->upload_context = rgUploadContextCreate(device, &upload_context_info);
+
+    {
+        RgBufferInfo vertex_buffer_info = {};
+        vertex_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
+        vertex_buffer_info.usage = RG_BUFFER_USAGE_VERTEX | RG_BUFFER_USAGE_STORAGE |
+                                   RG_BUFFER_USAGE_TRANSFER_DST;
+        vertex_buffer_info.size = sizeof(EgCompactVertex) * GEOMETRY_VERTEX_CAPACITY;
+        engine->vertex_buffer =
+            egEngineAllocateStorageBuffer(engine, &vertex_buffer_info);
+
+        RgBufferInfo index_buffer_info = {};
+        index_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
+        index_buffer_info.usage = RG_BUFFER_USAGE_INDEX | RG_BUFFER_USAGE_TRANSFER_DST;
+        index_buffer_info.size = GEOMETRY_INDEX_CAPACITY;
+        engine->index_buffer = rgBufferCreate(device, &index_buffer_info);
+
+        engine->vertex_allocator =
+            egOffsetAllocatorCreate(engine->allocator, GEOMETRY_VERTEX_CAPACITY);
+        engine->index_allocator =
+            egOffsetAllocatorCreate(engine->allocator, GEOMETRY_INDEX_CAPACITY);
+
+        for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+        {
+            engine->freed_geometry[f] = egArrayCreate(engine->allocator, EgGeometry);
+        }
+    }
+
     RgImageInfo image_info = {};
     image_info.extent = (RgExtent3D){1, 1, 1};
     image_info.format = RG_FORMAT_RGBA8_UNORM;
@@ -271,22 +430,15 @@ EgEngine *egEngineCreate(EgAllocator *allocator)
     RgExtent3D extent = {1, 1, 1};
 
     image_copy.image = engine->white_image.image;
-    rgImageUpload(
-        device,
-        engine->transfer_cmd_pool,
-        &image_copy,
-        &extent,
-        sizeof(white_data),
-        white_data);
+    rgUploadImage(
+        engine->upload_context, &image_copy, &extent, sizeof(white_data), white_data);
 
     image_copy.image = engine->black_image.image;
-    rgImageUpload(
-        device,
-        engine->transfer_cmd_pool,
-        &image_copy,
-        &extent,
-        sizeof(black_data),
-        black_data);
+    rgUploadImage(
+        engine->upload_context, &image_copy, &extent, sizeof(black_data), black_data);
+
+    uint64_t upload_batch = rgUploadContextSubmit(engine->upload_context);
+    rgUploadContextWait(engine->upload_context, upload_batch);
 
     RgSamplerInfo sampler_info = {};
     sampler_info.anisotropy = true;
@@ -299,6 +451,11 @@ EgEngine *egEngineCreate(EgAllocator *allocator)
 
     engine->brdf_image = egGenerateBRDFLUT(engine, engine->graphics_cmd_pool, 512);
 
+    if (engine->headless)
+    {
+        EgEngineCreateBackbuffer(engine, info->readback);
+    }
+
     return engine;
 }
 
@@ -314,21 +471,52 @@ void egEngineDestroy(EgEngine *engine)
     egEngineFreeImage(engine, &engine->white_image);
     egEngineFreeImage(engine, &engine->black_image);
     egEngineFreeSampler(engine, &engine->default_sampler);
+    rgUploadContextDestroy(device, engine->upload_context);
+    egEngineFreeStorageBuffer(engine, &engine->vertex_buffer);
+    rgBufferDestroy(device, engine->index_buffer);
+    egOffsetAllocatorDestroy(engine->vertex_allocator);
+    egOffsetAllocatorDestroy(engine->index_allocator);
+    for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+    {
+        egArrayFree(&engine->freed_geometry[f]);
+    }
     rgCmdPoolDestroy(device, engine->transfer_cmd_pool);
     rgCmdPoolDestroy(device, engine->graphics_cmd_pool);
 
+    if (engine->headless)
+    {
+        if (engine->readback_buffer)
+        {
+            rgBufferUnmap(device, engine->readback_buffer);
+            rgBufferDestroy(device, engine->readback_buffer);
+        }
+        rgRenderPassDestroy(device, engine->backbuffer_pass);
+        egEngineFreeImage(engine, &engine->backbuffer_image);
+    }
+    else
+    {
+        rgSwapchainDestroy(engine->device, engine->swapchain);
+    }
+
     egPoolDestroy(engine->storage_buffer_pool);
     egPoolDestroy(engine->texture_pool);
     egPoolDestroy(engine->sampler_pool);
+    egMutexDestroy(engine->descriptor_mutex);
 
-    rgSwapchainDestroy(engine->device, engine->swapchain);
     rgDeviceDestroy(engine->device);
 
-    glfwDestroyWindow(engine->window);
-    glfwTerminate();
+    if (!engine->headless)
+    {
+        glfwDestroyWindow(engine->window);
+        glfwTerminate();
+    }
+
+    if (engine->asset_cache) egAssetCacheDestroy(engine->asset_cache);
+    egJobSystemDestroy(engine->job_system);
 
     egArenaDestroy(engine->arena);
 
+    if (engine->capture_path) egFree(engine->allocator, engine->capture_path);
     egFree(engine->allocator, (void *)engine->exe_dir);
     egFree(engine->allocator, engine);
 }
@@ -343,14 +531,139 @@ RgSwapchain *egEngineGetSwapchain(EgEngine *engine)
     return engine->swapchain;
 }
 
+bool egEngineIsHeadless(EgEngine *engine)
+{
+    return engine->headless;
+}
+
+RgRenderPass *egEngineGetBackbufferRenderPass(EgEngine *engine)
+{
+    if (engine->headless) return engine->backbuffer_pass;
+    return rgSwapchainGetRenderPass(engine->swapchain);
+}
+
+static void EgEngineReleaseGeometry(EgEngine *engine, uint32_t frame_index)
+{
+    EgArray(EgGeometry) freed = engine->freed_geometry[frame_index];
+    for (size_t i = 0; i < egArrayLength(freed); ++i)
+    {
+        if (freed[i].vertex_count > 0)
+        {
+            egOffsetAllocatorFree(
+                engine->vertex_allocator, freed[i].first_vertex, freed[i].vertex_count);
+        }
+        if (freed[i].index_size > 0)
+        {
+            egOffsetAllocatorFree(
+                engine->index_allocator, freed[i].index_offset, freed[i].index_size);
+        }
+    }
+    egArrayResize(&engine->freed_geometry[frame_index], 0);
+}
+
+void egEngineBeginFrame(EgEngine *engine)
+{
+    // The frame that last used this slot has been presented or waited for
+    engine->frame_index = (engine->frame_index + 1) % FRAMES_IN_FLIGHT;
+    EgEngineReleaseGeometry(engine, engine->frame_index);
+
+    if (engine->capture_path)
+    {
+        engine->capturing = rgDeviceBeginCapture(engine->device);
+    }
+
+    if (!engine->headless)
+    {
+        rgSwapchainAcquireImage(engine->swapchain);
+    }
+}
+
+static void EgEngineEndCapture(EgEngine *engine)
+{
+    if (!engine->capturing) return;
+
+    if (!rgDeviceEndCapture(engine->device, engine->capture_path))
+    {
+        fprintf(stderr, "Could not write capture to %s\n", engine->capture_path);
+    }
+
+    egFree(engine->allocator, engine->capture_path);
+    engine->capture_path = NULL;
+    engine->capturing = false;
+}
+
+void egEngineEndFrame(EgEngine *engine, RgCmdBuffer *cmd_buffer)
+{
+    if (engine->headless)
+    {
+        if (engine->readback_buffer)
+        {
+            RgImageCopy src = {};
+            src.image = engine->backbuffer_image.image;
+            RgBufferCopy dst = {};
+            dst.buffer = engine->readback_buffer;
+            rgCmdCopyImageToBuffer(
+                cmd_buffer, &src, &dst, (RgExtent3D){engine->width, engine->height, 1});
+        }
+
+        rgCmdBufferEnd(cmd_buffer);
+        rgCmdBufferSubmitFenceOnly(cmd_buffer);
+        rgCmdBufferWait(engine->device, cmd_buffer);
+        EgEngineEndCapture(engine);
+        return;
+    }
+
+    rgCmdBufferEnd(cmd_buffer);
+
+    rgCmdBufferWaitForPresent(cmd_buffer, engine->swapchain);
+    rgCmdBufferSubmit(cmd_buffer);
+
+    rgSwapchainWaitForCommands(engine->swapchain, cmd_buffer);
+    rgSwapchainPresent(engine->swapchain);
+    EgEngineEndCapture(engine);
+}
+
+bool egEngineCaptureFrame(EgEngine *engine, const char *path)
+{
+    if (!engine->enable_capture) return false;
+
+    if (engine->capture_path) egFree(engine->allocator, engine->capture_path);
+    size_t path_size = strlen(path) + 1;
+    engine->capture_path = (char *)egAllocate(engine->allocator, path_size);
+    memcpy(engine->capture_path, path, path_size);
+    return true;
+}
+
+const uint8_t *egEngineGetReadback(EgEngine *engine)
+{
+    return engine->readback_mapping;
+}
+
+EgJobSystem *egEngineGetJobSystem(EgEngine *engine)
+{
+    return engine->job_system;
+}
+
+EgAssetCache *egEngineGetAssetCache(EgEngine *engine)
+{
+    return engine->asset_cache;
+}
+
 double egEngineGetTime(EgEngine *engine)
 {
-    (void)engine;
+    if (engine->headless) return GetMonotonicTime() - engine->start_time;
     return glfwGetTime();
 }
 
 void egEngineGetWindowSize(EgEngine *engine, uint32_t *width, uint32_t *height)
 {
+    if (engine->headless)
+    {
+        *width = engine->width;
+        *height = engine->height;
+        return;
+    }
+
     int iwidth, iheight;
     glfwGetFramebufferSize(engine->window, &iwidth, &iheight);
     *width = (uint32_t)iwidth;
@@ -359,22 +672,31 @@ void egEngineGetWindowSize(EgEngine *engine, uint32_t *width, uint32_t *height)
 
 bool egEngineGetCursorEnabled(EgEngine *engine)
 {
+    if (engine->headless) return true;
     return glfwGetInputMode(engine->window, GLFW_CURSOR) == GLFW_CURSOR_NORMAL;
 }
 
 void egEngineSetCursorEnabled(EgEngine *engine, bool enabled)
 {
+    if (engine->headless) return;
     int mode = enabled ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED;
     glfwSetInputMode(engine->window, GLFW_CURSOR, mode);
 }
 
 void egEngineGetCursorPos(EgEngine *engine, double *x, double *y)
 {
+    if (engine->headless)
+    {
+        *x = 0.0;
+        *y = 0.0;
+        return;
+    }
     glfwGetCursorPos(engine->window, x, y);
 }
 
 bool egEngineGetKeyState(EgEngine *engine, EgKey key)
 {
+    if (engine->headless) return false;
     int state = glfwGetKey(engine->window, key);
     switch (state)
     {
@@ -387,6 +709,7 @@ bool egEngineGetKeyState(EgEngine *engine, EgKey key)
 
 bool egEngineGetButtonState(EgEngine *engine, EgButton button)
 {
+    if (engine->headless) return false;
     int state = glfwGetMouseButton(engine->window, button);
     switch (state)
     {
@@ -399,12 +722,13 @@ bool egEngineGetButtonState(EgEngine *engine, EgButton button)
 
 bool egEngineShouldClose(EgEngine *engine)
 {
+    if (engine->headless) return false;
     return glfwWindowShouldClose(engine->window);
 }
 
 void egEnginePollEvents(EgEngine *engine)
 {
-    (void)engine;
+    if (engine->headless) return;
     glfwPollEvents();
 }
 
@@ -462,6 +786,11 @@ RgCmdPool *egEngineGetTransferCmdPool(EgEngine *engine)
     return engine->transfer_cmd_pool;
 }
 
+RgUploadContext *egEngineGetUploadContext(EgEngine *engine)
+{
+    return engine->upload_context;
+}
+
 EgImage egEngineGetWhiteImage(EgEngine *engine)
 {
     return engine->white_image;
@@ -503,8 +832,6 @@ RgPipeline *egEngineCreateGraphicsPipeline(EgEngine *engine, const char *path)
 
 RgPipeline *egEngineCreateComputePipeline(EgEngine *engine, const char *path)
 {
-    RgDevice *device = egEngineGetDevice(engine);
-
     RgPipelineLayout *pipeline_layout = engine->global_pipeline_layout;
     EG_ASSERT(pipeline_layout);
 
@@ -513,46 +840,10 @@ RgPipeline *egEngineCreateComputePipeline(EgEngine *engine, const char *path)
         (char *)egEngineLoadFileRelative(engine, engine->allocator, path, &hlsl_size);
     EG_ASSERT(hlsl);
 
-    uint8_t *spv_code = NULL;
-    size_t spv_code_size = 0;
-
-    {
-        TsCompilerOptions *options = tsCompilerOptionsCreate();
-        tsCompilerOptionsSetStage(options, TS_SHADER_STAGE_VERTEX);
-        const char *entry_point = "main";
-        tsCompilerOptionsSetEntryPoint(options, entry_point, strlen(entry_point));
-        tsCompilerOptionsSetSource(options, hlsl, hlsl_size, NULL, 0);
-
-        TsCompilerOutput *output = tsCompile(options);
-        const char *errors = tsCompilerOutputGetErrors(output);
-        if (errors)
-        {
-            fprintf(stderr, "Shader compilation error:\n%s\n", errors);
-
-            tsCompilerOutputDestroy(output);
-            tsCompilerOptionsDestroy(options);
-            exit(1);
-        }
-
-        size_t spirv_size = 0;
-        const uint8_t *spirv = tsCompilerOutputGetSpirv(output, &spirv_size);
-
-        spv_code = (uint8_t *)egAllocate(engine->allocator, spirv_size);
-        memcpy(spv_code, spirv, spirv_size);
-        spv_code_size = spirv_size;
-
-        tsCompilerOutputDestroy(output);
-        tsCompilerOptionsDestroy(options);
-    }
-
-    RgComputePipelineInfo info = {};
-    info.pipeline_layout = pipeline_layout;
-    info.code = spv_code;
-    info.code_size = spv_code_size;
-    RgPipeline *pipeline = rgComputePipelineCreate(device, &info);
+    RgPipeline *pipeline = egPipelineUtilCreateComputePipeline(
+        engine, engine->allocator, pipeline_layout, hlsl, hlsl_size);
     EG_ASSERT(pipeline);
 
-    egFree(engine->allocator, spv_code);
     egFree(engine->allocator, hlsl);
 
     return pipeline;
@@ -573,26 +864,32 @@ static uint32_t EgEngineAllocateDescriptor(
 {
     EG_ASSERT(engine->global_descriptor_set);
 
+    egMutexLock(engine->descriptor_mutex);
+
     uint32_t handle = egPoolAllocateSlot(pool);
-    if (handle == UINT32_MAX) return handle;
+    if (handle != UINT32_MAX)
+    {
+        RgDevice *device = egEngineGetDevice(engine);
 
-    RgDevice *device = egEngineGetDevice(engine);
+        RgDescriptorUpdateInfo entry = {};
+        entry.binding = binding;
+        entry.base_index = handle;
+        entry.descriptor_count = 1;
+        entry.descriptors = descriptor;
 
-    RgDescriptorUpdateInfo entry = {};
-    entry.binding = binding;
-    entry.base_index = handle;
-    entry.descriptor_count = 1;
-    entry.descriptors = descriptor;
+        rgDescriptorSetUpdate(device, engine->global_descriptor_set, &entry, 1);
+    }
 
-    rgDescriptorSetUpdate(device, engine->global_descriptor_set, &entry, 1);
+    egMutexUnlock(engine->descriptor_mutex);
 
     return handle;
 }
 
 static void EgEngineFreeDescriptor(EgEngine *engine, EgPool *pool, uint32_t handle)
 {
-    (void)engine;
+    egMutexLock(engine->descriptor_mutex);
     egPoolFreeSlot(pool, handle);
+    egMutexUnlock(engine->descriptor_mutex);
 }
 
 EgBuffer
@@ -620,6 +917,88 @@ void egEngineFreeStorageBuffer(EgEngine *engine, EgBuffer *handle)
     rgBufferDestroy(engine->device, handle->buffer);
 }
 
+static bool EgEngineTryAllocateGeometry(
+    EgEngine *engine, size_t vertex_count, size_t index_size, EgGeometry *geometry)
+{
+    *geometry = (EgGeometry){};
+
+    // Keeps 32-bit indices aligned, whatever the other allocations hold
+    index_size = (index_size + 3) & ~(size_t)3;
+
+    uint64_t first_vertex = 0;
+    if (vertex_count > 0)
+    {
+        first_vertex =
+            egOffsetAllocatorAllocate(engine->vertex_allocator, vertex_count, 1);
+        if (first_vertex == EG_OFFSET_ALLOCATOR_INVALID) return false;
+    }
+
+    uint64_t index_offset = 0;
+    if (index_size > 0)
+    {
+        index_offset = egOffsetAllocatorAllocate(engine->index_allocator, index_size, 4);
+        if (index_offset == EG_OFFSET_ALLOCATOR_INVALID)
+        {
+            if (vertex_count > 0)
+            {
+                egOffsetAllocatorFree(
+                    engine->vertex_allocator, first_vertex, vertex_count);
+            }
+            return false;
+        }
+    }
+
+    geometry->first_vertex = (uint32_t)first_vertex;
+    geometry->vertex_count = (uint32_t)vertex_count;
+    geometry->index_offset = index_offset;
+    geometry->index_size = index_size;
+    return true;
+}
+
+bool egEngineAllocateGeometry(
+    EgEngine *engine, size_t vertex_count, size_t index_size, EgGeometry *geometry)
+{
+    if (EgEngineTryAllocateGeometry(engine, vertex_count, index_size, geometry))
+    {
+        return true;
+    }
+
+    // Without frames going by, such as while loading, freed ranges would only
+    // come back once the device is idle
+    bool has_freed = false;
+    for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+    {
+        has_freed = has_freed || egArrayLength(engine->freed_geometry[f]) > 0;
+    }
+    if (!has_freed) return false;
+
+    rgDeviceWaitIdle(engine->device);
+    for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+    {
+        EgEngineReleaseGeometry(engine, f);
+    }
+    return EgEngineTryAllocateGeometry(engine, vertex_count, index_size, geometry);
+}
+
+void egEngineFreeGeometry(EgEngine *engine, EgGeometry *geometry)
+{
+    if (geometry->vertex_count > 0 || geometry->index_size > 0)
+    {
+        egArrayPush(&engine->freed_geometry[engine->frame_index], *geometry);
+    }
+    *geometry = (EgGeometry){};
+}
+
+EgBuffer egEngineGetVertexBuffer(EgEngine *engine)
+{
+    return engine->vertex_buffer;
+}
+
+RgBuffer *egEngineGetIndexBuffer(EgEngine *engine)
+{
+    return engine->index_buffer;
+}
+
 EgImage egEngineAllocateImage(EgEngine *engine, RgImageInfo *info)
 {
     EgImage handle = {};
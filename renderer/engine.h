@@ -9,6 +9,9 @@ extern "C" {
 
 typedef struct EgAllocator EgAllocator;
 typedef struct RgCmdPool RgCmdPool;
+typedef struct RgCmdBuffer RgCmdBuffer;
+typedef struct RgRenderPass RgRenderPass;
+typedef struct RgUploadContext RgUploadContext;
 typedef struct RgBuffer RgBuffer;
 typedef struct RgImage RgImage;
 typedef struct RgSampler RgSampler;
@@ -21,6 +24,8 @@ typedef struct RgImageInfo RgImageInfo;
 typedef struct RgSamplerInfo RgSamplerInfo;
 typedef struct RgDevice RgDevice;
 typedef struct RgSwapchain RgSwapchain;
+typedef struct EgJobSystem EgJobSystem;
+typedef struct EgAssetCache EgAssetCache;
 
 typedef struct EgEngine EgEngine;
 
@@ -32,6 +37,50 @@ typedef struct EgVertex
     float2 uv;
 } EgVertex;
 
+// What vertex buffers hold, see vertex_format.h. Shaders opt in with
+// "#pragma vertex_format compact".
+typedef struct EgCompactVertex
+{
+    // RGBA16_UNORM, xyz quantized to the mesh bounds, w is the tangent sign
+    // (0 for -1, 65535 for +1)
+    uint16_t pos[4];
+    // RG16_SNORM, octahedral encoded
+    int16_t normal[2];
+    int16_t tangent[2];
+    // RG16_UNORM, quantized to the mesh UV bounds
+    uint16_t uv[2];
+} EgCompactVertex;
+
+// Joints and weights of a skinned EgCompactVertex, stored next to the model
+// instead of in the engine vertex buffer
+typedef struct EgSkinVertex
+{
+    // Into the palette of the model, see EgSkeleton
+    uint16_t joints[4];
+    // UNORM16, they add up to 65535
+    uint16_t weights[4];
+} EgSkinVertex;
+
+// Written by the skinning compute pass, the position is in model space and
+// the rest is encoded like in EgCompactVertex
+typedef struct EgSkinnedVertex
+{
+    float pos[3];
+    int16_t normal[2];
+    int16_t tangent[2];
+    uint16_t uv[2];
+    float tangent_sign; // -1 or +1
+    uint32_t padding;
+} EgSkinnedVertex;
+
+// Layouts of the engine vertex buffer, for shaders that read their vertices
+// from it ("#pragma vertex_format pulled"). Passed with every draw.
+typedef enum EgVertexFormat
+{
+    EG_VERTEX_FORMAT_COMPACT = 0, // EgCompactVertex
+    EG_VERTEX_FORMAT_SKINNED = 1, // EgSkinnedVertex
+} EgVertexFormat;
+
 typedef struct EgImage
 {
 	RgImage *image;
@@ -50,6 +99,32 @@ typedef struct EgBuffer
 	uint32_t index;
 } EgBuffer;
 
+// Range of the engine geometry buffers, see egEngineAllocateGeometry
+typedef struct EgGeometry
+{
+    uint32_t first_vertex; // In units of EgCompactVertex
+    uint32_t vertex_count;
+    uint64_t index_offset; // In bytes, a multiple of 4
+    uint64_t index_size;   // Rounded up to a multiple of 4
+} EgGeometry;
+
+typedef struct EgEngineInfo
+{
+    // No window, surface or swapchain, frames are rendered into an offscreen
+    // backbuffer. For benchmarks and regression runs on machines without a
+    // display.
+    bool headless;
+    // Keeps a copy of each headless frame, see egEngineGetReadback
+    bool readback;
+    bool enable_validation;
+    // Lets egEngineCaptureFrame record frames for tools/rg_replay, at the cost
+    // of keeping a copy of everything uploaded to the device
+    bool enable_capture;
+    // Of the window, or of the headless backbuffer. 0 means 800x600.
+    uint32_t width;
+    uint32_t height;
+} EgEngineInfo;
+
 // Events {{{
 typedef enum EgEventType
 {
@@ -273,10 +348,32 @@ typedef enum EgKey
 } EgKey;
 // }}}
 
-EgEngine *egEngineCreate(EgAllocator *allocator);
+EgEngine *egEngineCreate(EgAllocator *allocator, const EgEngineInfo *info);
 void egEngineDestroy(EgEngine *engine);
 RgDevice *egEngineGetDevice(EgEngine *engine);
+// NULL for headless engines
 RgSwapchain *egEngineGetSwapchain(EgEngine *engine);
+bool egEngineIsHeadless(EgEngine *engine);
+
+// Render pass of the swapchain image, or of the offscreen backbuffer (an
+// RGBA8_UNORM image) when headless
+RgRenderPass *egEngineGetBackbufferRenderPass(EgEngine *engine);
+// Acquires the next swapchain image, call it before recording the backbuffer
+// pass
+void egEngineBeginFrame(EgEngine *engine);
+// Ends cmd_buffer, submits it and presents. Headless engines wait for the frame
+// to complete instead, after copying the backbuffer when readback is enabled.
+void egEngineEndFrame(EgEngine *engine, RgCmdBuffer *cmd_buffer);
+// Records the next frame, from egEngineBeginFrame to egEngineEndFrame, into
+// the capture file at path. Returns false if enable_capture wasn't set.
+bool egEngineCaptureFrame(EgEngine *engine, const char *path);
+// Pixels of the last headless frame, rows of egEngineGetWindowSize width RGBA8
+// texels with no padding. NULL unless readback is enabled.
+const uint8_t *egEngineGetReadback(EgEngine *engine);
+EgJobSystem *egEngineGetJobSystem(EgEngine *engine);
+// Cache for derived asset data next to the executable, NULL if it can't be
+// created
+EgAssetCache *egEngineGetAssetCache(EgEngine *engine);
 
 double egEngineGetTime(EgEngine *platform);
 void egEngineGetWindowSize(EgEngine *platform, uint32_t *width, uint32_t *height);
@@ -297,6 +394,8 @@ uint8_t *
 egEngineLoadFileRelative(EgEngine *engine, EgAllocator *allocator, const char *relative_path, size_t *size);
 
 RgCmdPool *egEngineGetTransferCmdPool(EgEngine *engine);
+// Shared by every asset loader, only use it from the main thread
+RgUploadContext *egEngineGetUploadContext(EgEngine *engine);
 EgImage egEngineGetWhiteImage(EgEngine *engine);
 EgImage egEngineGetBlackImage(EgEngine *engine);
 EgSampler egEngineGetDefaultSampler(EgEngine *engine);
@@ -308,9 +407,23 @@ RgPipeline *egEngineCreateComputePipeline(EgEngine *engine, const char *path);
 RgPipelineLayout *egEngineGetGlobalPipelineLayout(EgEngine *engine);
 RgDescriptorSet *egEngineGetGlobalDescriptorSet(EgEngine *engine);
 
+// Storage buffers can be allocated and freed from several threads at once
 EgBuffer egEngineAllocateStorageBuffer(EgEngine *engine, RgBufferInfo *info);
 void egEngineFreeStorageBuffer(EgEngine *engine, EgBuffer *handle);
 
+// Vertices and indices of every model and mesh live in one vertex buffer and
+// one index buffer, so all draws share a single binding. The vertex buffer is
+// also a bindless storage buffer for vertex pulling. Returns false when the
+// buffers are full. Only use them from the main thread.
+bool egEngineAllocateGeometry(
+    EgEngine *engine, size_t vertex_count, size_t index_size, EgGeometry *geometry);
+// The ranges are reused two egEngineBeginFrame calls later, once the frames
+// that may still draw from them are done. Allocating waits for the device
+// instead when it only fits in ranges that are still held back.
+void egEngineFreeGeometry(EgEngine *engine, EgGeometry *geometry);
+EgBuffer egEngineGetVertexBuffer(EgEngine *engine);
+RgBuffer *egEngineGetIndexBuffer(EgEngine *engine);
+
 EgImage egEngineAllocateImage(EgEngine *engine, RgImageInfo *info);
 void egEngineFreeImage(EgEngine *engine, EgImage *handle);
 
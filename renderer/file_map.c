@@ -0,0 +1,117 @@
+#include "file_map.h"
+
+#include "allocator.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct EgFileMap
+{
+    EgAllocator *allocator;
+    const uint8_t *data;
+    size_t size;
+#if defined(_WIN32)
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+EgFileMap *egFileMapOpen(EgAllocator *allocator, const char *path)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(
+        path,
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        NULL,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+        NULL);
+    if (file == INVALID_HANDLE_VALUE) return NULL;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        CloseHandle(file);
+        return NULL;
+    }
+
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == NULL)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return NULL;
+    }
+
+    EgFileMap *file_map = (EgFileMap *)egAllocate(allocator, sizeof(*file_map));
+    *file_map = (EgFileMap){0};
+    file_map->file = file;
+    file_map->mapping = mapping;
+    file_map->size = (size_t)file_size.QuadPart;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    // The mapping keeps the file referenced, the descriptor isn't needed anymore
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return NULL;
+
+    // Files are read front to back once, so start reading ahead right away
+    madvise(data, (size_t)st.st_size, MADV_WILLNEED);
+
+    EgFileMap *file_map = (EgFileMap *)egAllocate(allocator, sizeof(*file_map));
+    *file_map = (EgFileMap){0};
+    file_map->size = (size_t)st.st_size;
+#endif
+
+    file_map->allocator = allocator;
+    file_map->data = (const uint8_t *)data;
+
+    return file_map;
+}
+
+void egFileMapClose(EgFileMap *file_map)
+{
+#if defined(_WIN32)
+    UnmapViewOfFile(file_map->data);
+    CloseHandle(file_map->mapping);
+    CloseHandle(file_map->file);
+#else
+    munmap((void *)file_map->data, file_map->size);
+#endif
+
+    egFree(file_map->allocator, file_map);
+}
+
+const uint8_t *egFileMapGetData(EgFileMap *file_map)
+{
+    return file_map->data;
+}
+
+size_t egFileMapGetSize(EgFileMap *file_map)
+{
+    return file_map->size;
+}
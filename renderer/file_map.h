@@ -0,0 +1,22 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgFileMap EgFileMap;
+
+// Maps a whole file read-only into memory, returns NULL if it can't be opened
+// or is empty
+EgFileMap *egFileMapOpen(EgAllocator *allocator, const char *path);
+void egFileMapClose(EgFileMap *file_map);
+
+const uint8_t *egFileMapGetData(EgFileMap *file_map);
+size_t egFileMapGetSize(EgFileMap *file_map);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,264 @@
+#include "frame_allocator.h"
+
+#include "rg.h"
+#include "math.h"
+#include "allocator.h"
+#include "engine.h"
+#include "thread.h"
+
+// Overflow chunks a region can have
+#define MAX_REGION_CHUNKS 32
+
+typedef struct FrameChunk
+{
+    EgBuffer buffer;
+    // Mapping of the whole buffer, offsets are from its start
+    uint8_t *mapping;
+    uint32_t begin;
+    uint32_t end;
+    volatile uint32_t offset;
+} FrameChunk;
+
+typedef struct FrameRegion
+{
+    // Range of the shared buffer
+    FrameChunk primary;
+    // chunks[0] is the primary chunk, the others are overflow chunks. Chunks
+    // are only ever appended, under the mutex, before current moves to them.
+    FrameChunk *chunks[MAX_REGION_CHUNKS];
+    uint32_t chunk_count;
+    volatile uint32_t current;
+} FrameRegion;
+
+struct EgFrameAllocator
+{
+    EgAllocator *allocator;
+    EgEngine *engine;
+    EgMutex *mutex;
+
+    EgBuffer buffer;
+    uint8_t *mapping;
+
+    uint32_t frames_in_flight;
+    uint32_t frame_size;
+    uint32_t frame_index;
+    FrameRegion *regions;
+
+    uint64_t capacity;
+    uint64_t peak_frame_used;
+    uint32_t chunk_count;
+    uint32_t overflow_count;
+};
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static EgBuffer CreateChunkBuffer(EgEngine *engine, uint64_t size, uint8_t **mapping)
+{
+    RgBufferInfo buffer_info = {};
+    buffer_info.size = size;
+    buffer_info.usage = RG_BUFFER_USAGE_STORAGE | RG_BUFFER_USAGE_TRANSFER_DST;
+    buffer_info.memory = RG_BUFFER_MEMORY_HOST;
+    EgBuffer buffer = egEngineAllocateStorageBuffer(engine, &buffer_info);
+
+    *mapping = (uint8_t *)rgBufferMap(egEngineGetDevice(engine), buffer.buffer);
+    return buffer;
+}
+
+EgFrameAllocator *egFrameAllocatorCreate(
+    EgAllocator *allocator, EgEngine *engine, const EgFrameAllocatorInfo *info)
+{
+    EG_ASSERT(info->frames_in_flight > 0);
+    EG_ASSERT(info->frame_size > 0);
+    EG_ASSERT((uint64_t)info->frame_size * info->frames_in_flight <= UINT32_MAX);
+
+    EgFrameAllocator *frame_allocator =
+        (EgFrameAllocator *)egAllocate(allocator, sizeof(*frame_allocator));
+    *frame_allocator = (EgFrameAllocator){};
+
+    frame_allocator->allocator = allocator;
+    frame_allocator->engine = engine;
+    frame_allocator->mutex = egMutexCreate(allocator);
+    frame_allocator->frames_in_flight = info->frames_in_flight;
+    frame_allocator->frame_size = (uint32_t)info->frame_size;
+    frame_allocator->capacity = (uint64_t)info->frame_size * info->frames_in_flight;
+
+    frame_allocator->buffer = CreateChunkBuffer(
+        engine, frame_allocator->capacity, &frame_allocator->mapping);
+
+    frame_allocator->regions = (FrameRegion *)egAllocate(
+        allocator, sizeof(FrameRegion) * info->frames_in_flight);
+    for (uint32_t f = 0; f < info->frames_in_flight; ++f)
+    {
+        FrameRegion *region = &frame_allocator->regions[f];
+        *region = (FrameRegion){};
+
+        region->primary.buffer = frame_allocator->buffer;
+        region->primary.mapping = frame_allocator->mapping;
+        region->primary.begin = f * frame_allocator->frame_size;
+        region->primary.end = region->primary.begin + frame_allocator->frame_size;
+        region->primary.offset = region->primary.begin;
+
+        region->chunks[0] = &region->primary;
+        region->chunk_count = 1;
+    }
+
+    return frame_allocator;
+}
+
+void egFrameAllocatorDestroy(EgFrameAllocator *frame_allocator)
+{
+    EgEngine *engine = frame_allocator->engine;
+    RgDevice *device = egEngineGetDevice(engine);
+
+    for (uint32_t f = 0; f < frame_allocator->frames_in_flight; ++f)
+    {
+        FrameRegion *region = &frame_allocator->regions[f];
+        for (uint32_t c = 1; c < region->chunk_count; ++c)
+        {
+            FrameChunk *chunk = region->chunks[c];
+            rgBufferUnmap(device, chunk->buffer.buffer);
+            egEngineFreeStorageBuffer(engine, &chunk->buffer);
+            egFree(frame_allocator->allocator, chunk);
+        }
+    }
+
+    rgBufferUnmap(device, frame_allocator->buffer.buffer);
+    egEngineFreeStorageBuffer(engine, &frame_allocator->buffer);
+
+    egFree(frame_allocator->allocator, frame_allocator->regions);
+    egMutexDestroy(frame_allocator->mutex);
+    egFree(frame_allocator->allocator, frame_allocator);
+}
+
+static uint64_t RegionUsed(FrameRegion *region)
+{
+    uint64_t used = 0;
+    uint32_t current = egAtomicLoadU32(&region->current);
+    for (uint32_t c = 0; c <= current; ++c)
+    {
+        FrameChunk *chunk = region->chunks[c];
+        used += egAtomicLoadU32(&chunk->offset) - chunk->begin;
+    }
+    return used;
+}
+
+void egFrameAllocatorNextFrame(EgFrameAllocator *frame_allocator)
+{
+    FrameRegion *region = &frame_allocator->regions[frame_allocator->frame_index];
+    frame_allocator->peak_frame_used =
+        EG_MAX(frame_allocator->peak_frame_used, RegionUsed(region));
+
+    frame_allocator->frame_index =
+        (frame_allocator->frame_index + 1) % frame_allocator->frames_in_flight;
+
+    region = &frame_allocator->regions[frame_allocator->frame_index];
+    for (uint32_t c = 0; c < region->chunk_count; ++c)
+    {
+        region->chunks[c]->offset = region->chunks[c]->begin;
+    }
+    region->current = 0;
+}
+
+// Called once chunk current of region is full. Moves the region to a chunk
+// with room for the allocation, unless another thread already moved it.
+static void Overflow(
+    EgFrameAllocator *frame_allocator,
+    FrameRegion *region,
+    uint32_t current,
+    uint64_t size,
+    uint64_t alignment)
+{
+    egMutexLock(frame_allocator->mutex);
+
+    if (egAtomicLoadU32(&region->current) == current)
+    {
+        // Chunks kept from earlier frames are empty, but may be too small for
+        // an unusually large allocation
+        uint32_t next = current + 1;
+        while (next < region->chunk_count &&
+               AlignUp(region->chunks[next]->begin, alignment) + size >
+                   region->chunks[next]->end)
+        {
+            ++next;
+        }
+
+        if (next == region->chunk_count)
+        {
+            EG_ASSERT(region->chunk_count < MAX_REGION_CHUNKS);
+
+            // Each chunk doubles the room of the region, so a frame that
+            // needs much more than frame_size only takes a few of them
+            FrameChunk *last = region->chunks[region->chunk_count - 1];
+            uint64_t chunk_size = EG_MAX(2 * (uint64_t)(last->end - last->begin), size);
+            EG_ASSERT(chunk_size <= UINT32_MAX);
+
+            FrameChunk *chunk =
+                (FrameChunk *)egAllocate(frame_allocator->allocator, sizeof(*chunk));
+            *chunk = (FrameChunk){};
+            chunk->buffer =
+                CreateChunkBuffer(frame_allocator->engine, chunk_size, &chunk->mapping);
+            chunk->end = (uint32_t)chunk_size;
+
+            region->chunks[region->chunk_count++] = chunk;
+            frame_allocator->capacity += chunk_size;
+            frame_allocator->chunk_count++;
+        }
+
+        frame_allocator->overflow_count++;
+        egAtomicStoreU32(&region->current, next);
+    }
+
+    egMutexUnlock(frame_allocator->mutex);
+}
+
+EgFrameAllocation egFrameAllocatorAllocate(
+    EgFrameAllocator *frame_allocator, size_t size, size_t alignment)
+{
+    EG_ASSERT(size > 0);
+    EG_ASSERT(alignment > 0);
+
+    FrameRegion *region = &frame_allocator->regions[frame_allocator->frame_index];
+
+    while (true)
+    {
+        uint32_t current = egAtomicLoadU32(&region->current);
+        FrameChunk *chunk = region->chunks[current];
+
+        uint32_t offset = egAtomicLoadU32(&chunk->offset);
+        uint64_t aligned_offset = AlignUp(offset, alignment);
+        if (aligned_offset + size > chunk->end)
+        {
+            Overflow(frame_allocator, region, current, size, alignment);
+            continue;
+        }
+
+        // Allocations can come from several recording threads at once
+        if (egAtomicCompareExchangeU32(
+                &chunk->offset, offset, (uint32_t)(aligned_offset + size)))
+        {
+            EgFrameAllocation allocation;
+            allocation.data = chunk->mapping + aligned_offset;
+            allocation.buffer_index = chunk->buffer.index;
+            allocation.offset = (uint32_t)aligned_offset;
+            return allocation;
+        }
+    }
+}
+
+void egFrameAllocatorGetStats(
+    EgFrameAllocator *frame_allocator, EgFrameAllocatorStats *stats)
+{
+    FrameRegion *region = &frame_allocator->regions[frame_allocator->frame_index];
+
+    egMutexLock(frame_allocator->mutex);
+    *stats = (EgFrameAllocatorStats){};
+    stats->capacity = frame_allocator->capacity;
+    stats->frame_used = RegionUsed(region);
+    stats->peak_frame_used = EG_MAX(frame_allocator->peak_frame_used, stats->frame_used);
+    stats->chunk_count = frame_allocator->chunk_count;
+    stats->overflow_count = frame_allocator->overflow_count;
+    egMutexUnlock(frame_allocator->mutex);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgEngine EgEngine;
+typedef struct EgFrameAllocator EgFrameAllocator;
+
+typedef struct EgFrameAllocatorInfo
+{
+    // Number of frames the GPU can still be reading from, each one gets its
+    // own region of the buffer
+    uint32_t frames_in_flight;
+    // Bytes of a region. A frame that needs more overflows into extra chunks,
+    // each twice the size of the one before, which are kept for the next time
+    // the region is used.
+    size_t frame_size;
+} EgFrameAllocatorInfo;
+
+typedef struct EgFrameAllocation
+{
+    // Persistently mapped, write only
+    void *data;
+    // Bindless index of the storage buffer holding the allocation
+    uint32_t buffer_index;
+    // From the start of that buffer, a multiple of the requested alignment
+    uint32_t offset;
+} EgFrameAllocation;
+
+typedef struct EgFrameAllocatorStats
+{
+    // Bytes of every region and overflow chunk
+    uint64_t capacity;
+    // Bytes allocated in the current frame, alignment padding included
+    uint64_t frame_used;
+    // Most bytes any frame has allocated
+    uint64_t peak_frame_used;
+    // Overflow chunks alive, and the number of times a frame moved to another
+    // chunk because the current one was full
+    uint32_t chunk_count;
+    uint32_t overflow_count;
+} EgFrameAllocatorStats;
+
+// Linear allocator for data written by the CPU and read by the GPU in the
+// same frame, such as uniforms and instance data, over host visible storage
+// buffers
+EgFrameAllocator *egFrameAllocatorCreate(
+    EgAllocator *allocator, EgEngine *engine, const EgFrameAllocatorInfo *info);
+void egFrameAllocatorDestroy(EgFrameAllocator *frame_allocator);
+
+// Moves to the next region and frees everything allocated in it. The GPU must
+// be done with the frame that last used it, frames_in_flight frames ago. Not
+// thread safe.
+void egFrameAllocatorNextFrame(EgFrameAllocator *frame_allocator);
+
+// alignment can be any non zero value, such as the stride of a structured
+// buffer so that offset / stride is the element index. Safe to call from
+// several threads at once. Allocations that don't fit the current chunk take
+// a lock, and may create a new storage buffer on the engine, which serializes
+// its descriptor updates against other threads.
+EgFrameAllocation egFrameAllocatorAllocate(
+    EgFrameAllocator *frame_allocator, size_t size, size_t alignment);
+
+void egFrameAllocatorGetStats(
+    EgFrameAllocator *frame_allocator, EgFrameAllocatorStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// 64 bit XXH64 hash, fast enough to run over whole source assets
+uint64_t egHash64(const void *data, size_t size, uint64_t seed);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,548 @@
+#include "job_system.h"
+
+#include <string.h>
+#include "allocator.h"
+#include "array.h"
+#include "thread.h"
+
+enum {
+    DEQUE_CAPACITY = 4096, // Must be a power of two
+    SPIN_COUNT = 256,
+    CACHE_LINE_SIZE = 64,
+};
+
+typedef struct Job
+{
+    EgJobProc proc;
+    void *user_data;
+    EgJobCounter *counter;
+} Job;
+
+typedef struct PendingJob
+{
+    Job job;
+    EgJobCounter *dependency;
+} PendingJob;
+
+// Chase–Lev work stealing deque: the owner pushes and pops at the bottom,
+// other threads steal from the top
+typedef struct WorkDeque
+{
+    volatile uint32_t top;
+    uint8_t top_padding[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    volatile uint32_t bottom;
+    uint8_t bottom_padding[CACHE_LINE_SIZE - sizeof(uint32_t)];
+    Job jobs[DEQUE_CAPACITY];
+} WorkDeque;
+
+typedef struct Worker
+{
+    EgJobSystem *job_system;
+    uint32_t index;
+    uint32_t rng_state;
+    EgThread *thread;
+    WorkDeque deque;
+} Worker;
+
+struct EgJobSystem
+{
+    EgAllocator *allocator;
+    bool pin_threads;
+
+    uint32_t thread_count;
+    Worker **workers;
+
+    volatile uint32_t running;
+    volatile uint32_t sleeping_count;
+    EgSemaphore *wake_semaphore;
+
+    // Jobs pushed from threads that don't own a deque
+    EgMutex *injected_mutex;
+    volatile uint32_t injected_count;
+    EgArray(Job) injected;
+
+    // Jobs waiting for their dependency counter to reach zero
+    EgMutex *pending_mutex;
+    EgArray(PendingJob) pending;
+};
+
+static EG_THREAD_LOCAL EgJobSystem *tls_job_system = NULL;
+static EG_THREAD_LOCAL uint32_t tls_thread_index = UINT32_MAX;
+
+static bool DequePush(WorkDeque *deque, const Job *job)
+{
+    uint32_t bottom = egAtomicLoadU32(&deque->bottom);
+    uint32_t top = egAtomicLoadU32(&deque->top);
+    if ((int32_t)(bottom - top) >= DEQUE_CAPACITY)
+    {
+        return false;
+    }
+
+    deque->jobs[bottom & (DEQUE_CAPACITY - 1)] = *job;
+    egAtomicStoreU32(&deque->bottom, bottom + 1);
+    return true;
+}
+
+static bool DequePop(WorkDeque *deque, Job *job)
+{
+    uint32_t bottom = egAtomicLoadU32(&deque->bottom) - 1;
+    egAtomicStoreU32(&deque->bottom, bottom);
+    uint32_t top = egAtomicLoadU32(&deque->top);
+
+    int32_t size = (int32_t)(bottom - top);
+    if (size < 0)
+    {
+        egAtomicStoreU32(&deque->bottom, top);
+        return false;
+    }
+
+    *job = deque->jobs[bottom & (DEQUE_CAPACITY - 1)];
+    if (size > 0)
+    {
+        return true;
+    }
+
+    // Last job in the deque, race against thieves for it
+    bool won = egAtomicCompareExchangeU32(&deque->top, top, top + 1);
+    egAtomicStoreU32(&deque->bottom, top + 1);
+    return won;
+}
+
+static bool DequeSteal(WorkDeque *deque, Job *job)
+{
+    uint32_t top = egAtomicLoadU32(&deque->top);
+    uint32_t bottom = egAtomicLoadU32(&deque->bottom);
+    if ((int32_t)(bottom - top) <= 0)
+    {
+        return false;
+    }
+
+    *job = deque->jobs[top & (DEQUE_CAPACITY - 1)];
+    return egAtomicCompareExchangeU32(&deque->top, top, top + 1);
+}
+
+static uint32_t NextRandom(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static uint32_t CurrentThreadIndex(EgJobSystem *job_system)
+{
+    return (tls_job_system == job_system) ? tls_thread_index : UINT32_MAX;
+}
+
+static bool FindJob(EgJobSystem *job_system, uint32_t thread_index, Job *job)
+{
+    if (thread_index != UINT32_MAX)
+    {
+        if (DequePop(&job_system->workers[thread_index]->deque, job))
+        {
+            return true;
+        }
+    }
+
+    if (egAtomicLoadU32(&job_system->injected_count) > 0)
+    {
+        bool found = false;
+        egMutexLock(job_system->injected_mutex);
+        if (egArrayLength(job_system->injected) > 0)
+        {
+            *job = job_system->injected[egArrayLength(job_system->injected) - 1];
+            egArrayPop(&job_system->injected);
+            egAtomicFetchAddU32(&job_system->injected_count, (uint32_t)-1);
+            found = true;
+        }
+        egMutexUnlock(job_system->injected_mutex);
+        if (found) return true;
+    }
+
+    uint32_t thread_count = job_system->thread_count;
+    uint32_t start = 0;
+    if (thread_index != UINT32_MAX)
+    {
+        start = NextRandom(&job_system->workers[thread_index]->rng_state) % thread_count;
+    }
+
+    for (uint32_t i = 0; i < thread_count; ++i)
+    {
+        uint32_t victim = (start + i) % thread_count;
+        if (victim == thread_index) continue;
+
+        if (DequeSteal(&job_system->workers[victim]->deque, job))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void WakeWorker(EgJobSystem *job_system)
+{
+    if (egAtomicLoadU32(&job_system->sleeping_count) > 0)
+    {
+        egSemaphoreSignal(job_system->wake_semaphore, 1);
+    }
+}
+
+static void PushJob(EgJobSystem *job_system, const Job *job);
+
+static void ReleaseDependents(EgJobSystem *job_system, EgJobCounter *counter)
+{
+    EgArray(Job) ready = NULL;
+
+    egMutexLock(job_system->pending_mutex);
+    for (size_t i = 0; i < egArrayLength(job_system->pending);)
+    {
+        PendingJob *pending = &job_system->pending[i];
+        if (pending->dependency == counter)
+        {
+            if (!ready) ready = egArrayCreate(job_system->allocator, Job);
+            egArrayPush(&ready, pending->job);
+
+            // Swap remove
+            *pending = job_system->pending[egArrayLength(job_system->pending) - 1];
+            egArrayPop(&job_system->pending);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    egMutexUnlock(job_system->pending_mutex);
+
+    for (size_t i = 0; i < egArrayLength(ready); ++i)
+    {
+        PushJob(job_system, &ready[i]);
+    }
+
+    egArrayFree(&ready);
+}
+
+static void RunJob(EgJobSystem *job_system, const Job *job)
+{
+    job->proc(job->user_data);
+
+    if (job->counter)
+    {
+        if (egAtomicFetchAddU32(&job->counter->value, (uint32_t)-1) == 1)
+        {
+            ReleaseDependents(job_system, job->counter);
+        }
+    }
+}
+
+static void PushJob(EgJobSystem *job_system, const Job *job)
+{
+    uint32_t thread_index = CurrentThreadIndex(job_system);
+    if (thread_index != UINT32_MAX)
+    {
+        if (!DequePush(&job_system->workers[thread_index]->deque, job))
+        {
+            // Deque is full, the caller is better off doing the work itself
+            RunJob(job_system, job);
+            return;
+        }
+    }
+    else
+    {
+        egMutexLock(job_system->injected_mutex);
+        egArrayPush(&job_system->injected, *job);
+        egAtomicFetchAddU32(&job_system->injected_count, 1);
+        egMutexUnlock(job_system->injected_mutex);
+    }
+
+    WakeWorker(job_system);
+}
+
+static void WorkerProc(void *user_data)
+{
+    Worker *worker = (Worker *)user_data;
+    EgJobSystem *job_system = worker->job_system;
+
+    tls_job_system = job_system;
+    tls_thread_index = worker->index;
+
+    if (job_system->pin_threads)
+    {
+        egThreadPinCurrent(worker->index);
+    }
+
+    uint32_t spins = 0;
+    while (egAtomicLoadU32(&job_system->running))
+    {
+        Job job;
+        if (FindJob(job_system, worker->index, &job))
+        {
+            RunJob(job_system, &job);
+            spins = 0;
+            continue;
+        }
+
+        if (++spins < SPIN_COUNT)
+        {
+            egCpuPause();
+            continue;
+        }
+
+        // Announce that we're going to sleep before checking for work one last
+        // time, so a job pushed in between always gets a wake up signal
+        egAtomicFetchAddU32(&job_system->sleeping_count, 1);
+        if (FindJob(job_system, worker->index, &job))
+        {
+            egAtomicFetchAddU32(&job_system->sleeping_count, (uint32_t)-1);
+            RunJob(job_system, &job);
+        }
+        else if (egAtomicLoadU32(&job_system->running))
+        {
+            egSemaphoreWait(job_system->wake_semaphore);
+            egAtomicFetchAddU32(&job_system->sleeping_count, (uint32_t)-1);
+        }
+        else
+        {
+            egAtomicFetchAddU32(&job_system->sleeping_count, (uint32_t)-1);
+        }
+        spins = 0;
+    }
+}
+
+EgJobSystem *egJobSystemCreate(EgAllocator *allocator, const EgJobSystemInfo *info)
+{
+    EgJobSystem *job_system = (EgJobSystem *)egAllocate(allocator, sizeof(*job_system));
+    *job_system = (EgJobSystem){0};
+
+    uint32_t worker_count = info->worker_count;
+    if (worker_count == 0)
+    {
+        uint32_t cpu_count = egGetCpuCount();
+        worker_count = cpu_count > 1 ? cpu_count - 1 : 0;
+    }
+
+    job_system->allocator = allocator;
+    job_system->pin_threads = info->pin_threads;
+    job_system->thread_count = worker_count + 1;
+    job_system->running = 1;
+    job_system->wake_semaphore = egSemaphoreCreate(allocator, 0);
+    job_system->injected_mutex = egMutexCreate(allocator);
+    job_system->injected = egArrayCreate(allocator, Job);
+    job_system->pending_mutex = egMutexCreate(allocator);
+    job_system->pending = egArrayCreate(allocator, PendingJob);
+
+    job_system->workers =
+        (Worker **)egAllocate(allocator, sizeof(Worker *) * job_system->thread_count);
+    for (uint32_t i = 0; i < job_system->thread_count; ++i)
+    {
+        Worker *worker = (Worker *)egAllocate(allocator, sizeof(Worker));
+        memset(worker, 0, sizeof(*worker));
+        worker->job_system = job_system;
+        worker->index = i;
+        worker->rng_state = 0x9E3779B9u * (i + 1);
+        job_system->workers[i] = worker;
+    }
+
+    // The creating thread is worker 0
+    tls_job_system = job_system;
+    tls_thread_index = 0;
+    if (job_system->pin_threads)
+    {
+        egThreadPinCurrent(0);
+    }
+
+    for (uint32_t i = 1; i < job_system->thread_count; ++i)
+    {
+        Worker *worker = job_system->workers[i];
+        worker->thread = egThreadCreate(allocator, WorkerProc, worker);
+    }
+
+    return job_system;
+}
+
+void egJobSystemDestroy(EgJobSystem *job_system)
+{
+    EgAllocator *allocator = job_system->allocator;
+
+    egAtomicStoreU32(&job_system->running, 0);
+    egSemaphoreSignal(job_system->wake_semaphore, job_system->thread_count);
+
+    for (uint32_t i = 1; i < job_system->thread_count; ++i)
+    {
+        egThreadJoin(job_system->workers[i]->thread);
+    }
+
+    for (uint32_t i = 0; i < job_system->thread_count; ++i)
+    {
+        egFree(allocator, job_system->workers[i]);
+    }
+    egFree(allocator, job_system->workers);
+
+    if (tls_job_system == job_system)
+    {
+        tls_job_system = NULL;
+        tls_thread_index = UINT32_MAX;
+    }
+
+    egArrayFree(&job_system->injected);
+    egArrayFree(&job_system->pending);
+    egMutexDestroy(job_system->injected_mutex);
+    egMutexDestroy(job_system->pending_mutex);
+    egSemaphoreDestroy(job_system->wake_semaphore);
+
+    egFree(allocator, job_system);
+}
+
+uint32_t egJobSystemGetThreadCount(EgJobSystem *job_system)
+{
+    return job_system->thread_count;
+}
+
+uint32_t egJobSystemGetThreadIndex(EgJobSystem *job_system)
+{
+    return CurrentThreadIndex(job_system);
+}
+
+void egJobSystemRun(
+    EgJobSystem *job_system, EgJobProc proc, void *user_data, EgJobCounter *counter)
+{
+    if (counter)
+    {
+        egAtomicFetchAddU32(&counter->value, 1);
+    }
+
+    Job job = {
+        .proc = proc,
+        .user_data = user_data,
+        .counter = counter,
+    };
+    PushJob(job_system, &job);
+}
+
+void egJobSystemRunAfter(
+    EgJobSystem *job_system,
+    EgJobCounter *dependency,
+    EgJobProc proc,
+    void *user_data,
+    EgJobCounter *counter)
+{
+    if (counter)
+    {
+        egAtomicFetchAddU32(&counter->value, 1);
+    }
+
+    Job job = {
+        .proc = proc,
+        .user_data = user_data,
+        .counter = counter,
+    };
+
+    // The dependency is checked under the lock, so it either reaches zero
+    // before this point or ReleaseDependents will find the pending job
+    bool ready = false;
+    egMutexLock(job_system->pending_mutex);
+    if (egAtomicLoadU32(&dependency->value) == 0)
+    {
+        ready = true;
+    }
+    else
+    {
+        PendingJob pending = {
+            .job = job,
+            .dependency = dependency,
+        };
+        egArrayPush(&job_system->pending, pending);
+    }
+    egMutexUnlock(job_system->pending_mutex);
+
+    if (ready)
+    {
+        PushJob(job_system, &job);
+    }
+}
+
+bool egJobCounterIsDone(EgJobCounter *counter)
+{
+    return egAtomicLoadU32(&counter->value) == 0;
+}
+
+void egJobSystemWait(EgJobSystem *job_system, EgJobCounter *counter)
+{
+    uint32_t thread_index = CurrentThreadIndex(job_system);
+
+    uint32_t spins = 0;
+    while (egAtomicLoadU32(&counter->value) != 0)
+    {
+        Job job;
+        if (FindJob(job_system, thread_index, &job))
+        {
+            RunJob(job_system, &job);
+            spins = 0;
+        }
+        else if (++spins < SPIN_COUNT)
+        {
+            egCpuPause();
+        }
+        else
+        {
+            egThreadYield();
+        }
+    }
+}
+
+typedef struct ParallelForChunk
+{
+    EgParallelForProc proc;
+    void *user_data;
+    size_t begin;
+    size_t end;
+} ParallelForChunk;
+
+static void ParallelForChunkProc(void *user_data)
+{
+    ParallelForChunk *chunk = (ParallelForChunk *)user_data;
+    chunk->proc(chunk->user_data, chunk->begin, chunk->end);
+}
+
+void egJobSystemParallelFor(
+    EgJobSystem *job_system,
+    size_t count,
+    size_t grain_size,
+    EgParallelForProc proc,
+    void *user_data)
+{
+    if (count == 0) return;
+    if (grain_size == 0) grain_size = 1;
+
+    size_t chunk_count = (count + grain_size - 1) / grain_size;
+    if (chunk_count == 1)
+    {
+        proc(user_data, 0, count);
+        return;
+    }
+
+    ParallelForChunk *chunks = (ParallelForChunk *)egAllocate(
+        job_system->allocator, sizeof(ParallelForChunk) * chunk_count);
+
+    EgJobCounter counter = {0};
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        size_t begin = i * grain_size;
+        size_t end = begin + grain_size;
+        if (end > count) end = count;
+
+        chunks[i] = (ParallelForChunk){
+            .proc = proc,
+            .user_data = user_data,
+            .begin = begin,
+            .end = end,
+        };
+        egJobSystemRun(job_system, ParallelForChunkProc, &chunks[i], &counter);
+    }
+
+    egJobSystemWait(job_system, &counter);
+
+    egFree(job_system->allocator, chunks);
+}
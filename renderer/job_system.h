@@ -0,0 +1,69 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgJobSystem EgJobSystem;
+
+typedef void (*EgJobProc)(void *user_data);
+typedef void (*EgParallelForProc)(void *user_data, size_t begin, size_t end);
+
+// Counts the jobs that still have to finish. Zero initialize it before use,
+// it must stay alive until egJobSystemWait returns.
+typedef struct EgJobCounter
+{
+    volatile uint32_t value;
+} EgJobCounter;
+
+typedef struct EgJobSystemInfo
+{
+    // Number of worker threads besides the calling thread, 0 means one per
+    // remaining logical processor
+    uint32_t worker_count;
+    // Pins the calling thread to the first processor and each worker to the
+    // following ones
+    bool pin_threads;
+} EgJobSystemInfo;
+
+// The thread that creates the job system becomes worker 0, it only runs jobs
+// while it's waiting on a counter
+EgJobSystem *egJobSystemCreate(EgAllocator *allocator, const EgJobSystemInfo *info);
+void egJobSystemDestroy(EgJobSystem *job_system);
+
+// Includes the thread that created the job system
+uint32_t egJobSystemGetThreadCount(EgJobSystem *job_system);
+// Index of the calling thread in [0, thread count), or UINT32_MAX for threads
+// that don't belong to the job system
+uint32_t egJobSystemGetThreadIndex(EgJobSystem *job_system);
+
+// Increments counter (if not NULL) and decrements it once the job has run
+void egJobSystemRun(
+    EgJobSystem *job_system, EgJobProc proc, void *user_data, EgJobCounter *counter);
+// Like egJobSystemRun, but the job is only started once dependency reaches zero
+void egJobSystemRunAfter(
+    EgJobSystem *job_system,
+    EgJobCounter *dependency,
+    EgJobProc proc,
+    void *user_data,
+    EgJobCounter *counter);
+
+// Runs other jobs until counter reaches zero
+void egJobSystemWait(EgJobSystem *job_system, EgJobCounter *counter);
+bool egJobCounterIsDone(EgJobCounter *counter);
+
+// Splits [0, count) in chunks of at most grain_size items, runs them on every
+// thread and waits for all of them to finish
+void egJobSystemParallelFor(
+    EgJobSystem *job_system,
+    size_t count,
+    size_t grain_size,
+    EgParallelForProc proc,
+    void *user_data);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,302 @@
+#include "ktx2.h"
+
+#include <string.h>
+#include "allocator.h"
+#include "texture_compression.h"
+
+static const uint8_t ktx2_identifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+// Values from the Vulkan and Khronos data format specifications, so that this
+// doesn't depend on the Vulkan headers
+enum {
+    VK_FORMAT_R8G8B8A8_UNORM_ = 37,
+    VK_FORMAT_BC1_RGB_UNORM_BLOCK_ = 131,
+    VK_FORMAT_BC1_RGB_SRGB_BLOCK_ = 132,
+    VK_FORMAT_BC5_UNORM_BLOCK_ = 141,
+    VK_FORMAT_BC7_UNORM_BLOCK_ = 145,
+    VK_FORMAT_BC7_SRGB_BLOCK_ = 146,
+
+    KHR_DF_MODEL_RGBSDA = 1,
+    KHR_DF_MODEL_BC1A = 128,
+    KHR_DF_MODEL_BC5 = 132,
+    KHR_DF_MODEL_BC7 = 134,
+
+    KHR_DF_PRIMARIES_BT709 = 1,
+    KHR_DF_TRANSFER_LINEAR = 1,
+    KHR_DF_TRANSFER_SRGB = 2,
+
+    KHR_DF_CHANNEL_RED = 0,
+    KHR_DF_CHANNEL_GREEN = 1,
+    KHR_DF_CHANNEL_BLUE = 2,
+    KHR_DF_CHANNEL_ALPHA = 15,
+};
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+
+static uint32_t ReadU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+           ((uint32_t)p[3] << 24);
+}
+
+static uint64_t ReadU64(const uint8_t *p)
+{
+    return (uint64_t)ReadU32(p) | ((uint64_t)ReadU32(p + 4) << 32);
+}
+
+static void WriteU32(uint8_t *p, uint32_t value)
+{
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static void WriteU64(uint8_t *p, uint64_t value)
+{
+    WriteU32(p, (uint32_t)value);
+    WriteU32(p + 4, (uint32_t)(value >> 32));
+}
+
+static RgFormat FormatFromVk(uint32_t vk_format)
+{
+    switch (vk_format)
+    {
+    case VK_FORMAT_R8G8B8A8_UNORM_: return RG_FORMAT_RGBA8_UNORM;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK_: return RG_FORMAT_BC1_RGB_UNORM;
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK_: return RG_FORMAT_BC1_RGB_SRGB;
+    case VK_FORMAT_BC5_UNORM_BLOCK_: return RG_FORMAT_BC5_UNORM;
+    case VK_FORMAT_BC7_UNORM_BLOCK_: return RG_FORMAT_BC7_UNORM;
+    case VK_FORMAT_BC7_SRGB_BLOCK_: return RG_FORMAT_BC7_SRGB;
+    default: return RG_FORMAT_UNDEFINED;
+    }
+}
+
+static uint32_t FormatToVk(RgFormat format)
+{
+    switch (format)
+    {
+    case RG_FORMAT_RGBA8_UNORM: return VK_FORMAT_R8G8B8A8_UNORM_;
+    case RG_FORMAT_BC1_RGB_UNORM: return VK_FORMAT_BC1_RGB_UNORM_BLOCK_;
+    case RG_FORMAT_BC1_RGB_SRGB: return VK_FORMAT_BC1_RGB_SRGB_BLOCK_;
+    case RG_FORMAT_BC5_UNORM: return VK_FORMAT_BC5_UNORM_BLOCK_;
+    case RG_FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK_;
+    case RG_FORMAT_BC7_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK_;
+    default: EG_ASSERT(0); return 0;
+    }
+}
+
+static uint32_t MipExtent(uint32_t extent, uint32_t level)
+{
+    extent >>= level;
+    return extent > 0 ? extent : 1;
+}
+
+bool egKtx2Parse(const uint8_t *data, size_t size, EgKtx2Image *image)
+{
+    memset(image, 0, sizeof(*image));
+
+    if (size < KTX2_HEADER_SIZE) return false;
+    if (memcmp(data, ktx2_identifier, sizeof(ktx2_identifier)) != 0) return false;
+
+    const uint8_t *header = data + sizeof(ktx2_identifier);
+    uint32_t vk_format = ReadU32(header + 0);
+    uint32_t width = ReadU32(header + 8);
+    uint32_t height = ReadU32(header + 12);
+    uint32_t depth = ReadU32(header + 16);
+    uint32_t layer_count = ReadU32(header + 20);
+    uint32_t face_count = ReadU32(header + 24);
+    uint32_t level_count = ReadU32(header + 28);
+    uint32_t supercompression = ReadU32(header + 32);
+
+    image->format = FormatFromVk(vk_format);
+    if (image->format == RG_FORMAT_UNDEFINED) return false;
+    if (width == 0 || height == 0 || depth > 1) return false;
+    if (layer_count > 1 || face_count != 1 || supercompression != 0) return false;
+
+    // A level count of 0 asks the loader to generate mips, only level 0 is stored
+    if (level_count == 0) level_count = 1;
+    if (level_count > EG_KTX2_MAX_LEVELS) return false;
+
+    size_t level_index_end =
+        KTX2_HEADER_SIZE + (size_t)level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    if (size < level_index_end) return false;
+
+    image->width = width;
+    image->height = height;
+    image->level_count = level_count;
+
+    for (uint32_t level = 0; level < level_count; ++level)
+    {
+        const uint8_t *entry =
+            data + KTX2_HEADER_SIZE + (size_t)level * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        uint64_t offset = ReadU64(entry);
+        uint64_t length = ReadU64(entry + 8);
+
+        size_t expected = egFormatImageSize(
+            image->format, MipExtent(width, level), MipExtent(height, level));
+        if (length != expected) return false;
+        if (offset > size || length > size - offset) return false;
+
+        image->levels[level].data = data + offset;
+        image->levels[level].size = (size_t)length;
+    }
+
+    return true;
+}
+
+// Basic data format descriptor, see the Khronos data format specification
+static size_t WriteDfd(uint8_t *dst, RgFormat format)
+{
+    uint32_t model = KHR_DF_MODEL_RGBSDA;
+    uint32_t transfer = KHR_DF_TRANSFER_LINEAR;
+    uint32_t block_dimension = 0; // Each dimension minus one, 8 bits each
+    uint32_t bytes_plane0 = 4;
+
+    // Channel, bit offset and bit length of every sample
+    uint32_t samples[4][3];
+    uint32_t sample_count = 0;
+
+    switch (format)
+    {
+    case RG_FORMAT_RGBA8_UNORM:
+        samples[sample_count][0] = KHR_DF_CHANNEL_RED;
+        samples[sample_count][1] = 0;
+        samples[sample_count++][2] = 8;
+        samples[sample_count][0] = KHR_DF_CHANNEL_GREEN;
+        samples[sample_count][1] = 8;
+        samples[sample_count++][2] = 8;
+        samples[sample_count][0] = KHR_DF_CHANNEL_BLUE;
+        samples[sample_count][1] = 16;
+        samples[sample_count++][2] = 8;
+        samples[sample_count][0] = KHR_DF_CHANNEL_ALPHA;
+        samples[sample_count][1] = 24;
+        samples[sample_count++][2] = 8;
+        break;
+    case RG_FORMAT_BC1_RGB_SRGB: transfer = KHR_DF_TRANSFER_SRGB; // fallthrough
+    case RG_FORMAT_BC1_RGB_UNORM:
+        model = KHR_DF_MODEL_BC1A;
+        block_dimension = 3 | (3 << 8);
+        bytes_plane0 = 8;
+        samples[sample_count][0] = 0;
+        samples[sample_count][1] = 0;
+        samples[sample_count++][2] = 64;
+        break;
+    case RG_FORMAT_BC5_UNORM:
+        model = KHR_DF_MODEL_BC5;
+        block_dimension = 3 | (3 << 8);
+        bytes_plane0 = 16;
+        samples[sample_count][0] = KHR_DF_CHANNEL_RED;
+        samples[sample_count][1] = 0;
+        samples[sample_count++][2] = 64;
+        samples[sample_count][0] = KHR_DF_CHANNEL_GREEN;
+        samples[sample_count][1] = 64;
+        samples[sample_count++][2] = 64;
+        break;
+    case RG_FORMAT_BC7_SRGB: transfer = KHR_DF_TRANSFER_SRGB; // fallthrough
+    case RG_FORMAT_BC7_UNORM:
+        model = KHR_DF_MODEL_BC7;
+        block_dimension = 3 | (3 << 8);
+        bytes_plane0 = 16;
+        samples[sample_count][0] = 0;
+        samples[sample_count][1] = 0;
+        samples[sample_count++][2] = 128;
+        break;
+    default: EG_ASSERT(0); break;
+    }
+
+    uint32_t block_size = 24 + 16 * sample_count;
+    size_t total_size = 4 + block_size;
+
+    if (dst)
+    {
+        memset(dst, 0, total_size);
+        WriteU32(dst, (uint32_t)total_size);
+
+        uint8_t *block = dst + 4;
+        WriteU32(block + 0, 0); // Khronos vendor, basic descriptor type
+        WriteU32(block + 4, 2 | (block_size << 16)); // Version 1.3
+        WriteU32(
+            block + 8, model | (KHR_DF_PRIMARIES_BT709 << 8) | (transfer << 16));
+        WriteU32(block + 12, block_dimension);
+        WriteU32(block + 16, bytes_plane0);
+
+        bool is_compressed = egFormatIsBlockCompressed(format);
+        for (uint32_t i = 0; i < sample_count; ++i)
+        {
+            uint8_t *sample = block + 24 + 16 * i;
+            WriteU32(
+                sample + 0,
+                samples[i][1] | ((samples[i][2] - 1) << 16) | (samples[i][0] << 24));
+            WriteU32(sample + 4, 0); // Sample position
+            WriteU32(sample + 8, 0);
+            WriteU32(sample + 12, is_compressed ? UINT32_MAX : 255);
+        }
+    }
+
+    return total_size;
+}
+
+uint8_t *egKtx2Write(EgAllocator *allocator, const EgKtx2Image *image, size_t *size)
+{
+    EG_ASSERT(image->level_count > 0 && image->level_count <= EG_KTX2_MAX_LEVELS);
+
+    size_t dfd_offset =
+        KTX2_HEADER_SIZE + (size_t)image->level_count * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+    size_t dfd_size = WriteDfd(NULL, image->format);
+
+    // Levels go from the smallest to the largest, each aligned to the least
+    // common multiple of the block size and 4
+    size_t alignment = egFormatIsBlockCompressed(image->format)
+                           ? egFormatImageSize(image->format, 4, 4)
+                           : 4;
+
+    size_t level_offsets[EG_KTX2_MAX_LEVELS];
+    size_t offset = dfd_offset + dfd_size;
+    for (uint32_t i = image->level_count; i-- > 0;)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        level_offsets[i] = offset;
+        offset += image->levels[i].size;
+    }
+
+    *size = offset;
+    uint8_t *data = (uint8_t *)egAllocate(allocator, *size);
+    memset(data, 0, *size);
+
+    memcpy(data, ktx2_identifier, sizeof(ktx2_identifier));
+    uint8_t *header = data + sizeof(ktx2_identifier);
+    WriteU32(header + 0, FormatToVk(image->format));
+    WriteU32(header + 4, 1); // Type size, 1 for 8 bit and block compressed formats
+    WriteU32(header + 8, image->width);
+    WriteU32(header + 12, image->height);
+    WriteU32(header + 16, 0); // Depth
+    WriteU32(header + 20, 0); // Layers
+    WriteU32(header + 24, 1); // Faces
+    WriteU32(header + 28, image->level_count);
+    WriteU32(header + 32, 0); // Supercompression
+
+    WriteU32(header + 36, (uint32_t)dfd_offset);
+    WriteU32(header + 40, (uint32_t)dfd_size);
+    WriteU32(header + 44, 0); // Key/value data
+    WriteU32(header + 48, 0);
+    WriteU64(header + 52, 0); // Supercompression global data
+    WriteU64(header + 60, 0);
+
+    for (uint32_t i = 0; i < image->level_count; ++i)
+    {
+        uint8_t *entry =
+            data + KTX2_HEADER_SIZE + (size_t)i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        WriteU64(entry + 0, level_offsets[i]);
+        WriteU64(entry + 8, image->levels[i].size);
+        WriteU64(entry + 16, image->levels[i].size);
+
+        memcpy(data + level_offsets[i], image->levels[i].data, image->levels[i].size);
+    }
+
+    WriteDfd(data + dfd_offset, image->format);
+
+    return data;
+}
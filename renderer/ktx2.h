@@ -0,0 +1,38 @@
+#pragma once
+
+#include <rg.h>
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+
+#define EG_KTX2_MAX_LEVELS 16
+
+typedef struct EgKtx2Level
+{
+    const uint8_t *data;
+    size_t size;
+} EgKtx2Level;
+
+// Single 2D image with its mip chain, level 0 is the largest
+typedef struct EgKtx2Image
+{
+    RgFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    EgKtx2Level levels[EG_KTX2_MAX_LEVELS];
+} EgKtx2Image;
+
+// Only supports non-supercompressed 2D images in RGBA8, BC1, BC5 and BC7. The
+// levels point into data, which has to outlive the image.
+bool egKtx2Parse(const uint8_t *data, size_t size, EgKtx2Image *image);
+// Returns a KTX2 file allocated with allocator
+uint8_t *egKtx2Write(EgAllocator *allocator, const EgKtx2Image *image, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,79 +4,133 @@
 #include "allocator.h"
 #include "engine.h"
 #include "array.h"
+#include "vertex_format.h"
+#include "mesh_optimizer.h"
+#include "hash.h"
 
 struct EgMesh
 {
     EgAllocator *allocator;
     EgEngine *engine;
-    RgBuffer *vertex_buffer;
-    RgBuffer *index_buffer;
+    EgGeometry geometry;
     uint32_t index_count;
+    RgIndexType index_type;
+    EgVertexQuantization quantization;
 };
 
-EgMesh *egMeshCreateCube(EgAllocator *allocator, EgEngine *engine, RgCmdPool *cmd_pool)
+static EgArray(EgCompactVertex)
+    CompressVertices(EgMesh *mesh, const EgVertex *vertices, size_t count)
 {
-    EgMesh *mesh = (EgMesh*)egAllocate(allocator, sizeof(EgMesh));
-    *mesh = (EgMesh){0};
-
-    mesh->allocator = allocator;
-    mesh->engine = engine;
-
-    EgVertex vertices[8] = {
-        {V3( 0.5, 0.5,  0.5), {}, {}, {}},
-        {V3(-0.5, 0.5,  0.5), {}, {}, {}},
-        {V3(-0.5, 0.5, -0.5), {}, {}, {}},
-        {V3( 0.5, 0.5, -0.5), {}, {}, {}},
+    egVertexQuantizationCompute(vertices, count, &mesh->quantization);
 
-        {V3( 0.5, -0.5,  0.5), {}, {}, {}},
-        {V3(-0.5, -0.5,  0.5), {}, {}, {}},
-        {V3(-0.5, -0.5, -0.5), {}, {}, {}},
-        {V3( 0.5, -0.5, -0.5), {}, {}, {}},
-    };
+    EgArray(EgCompactVertex) compact_vertices =
+        egArrayCreate(mesh->allocator, EgCompactVertex);
+    egArrayResize(&compact_vertices, count);
+    egVertexCompress(vertices, count, &mesh->quantization, compact_vertices);
+    return compact_vertices;
+}
 
-    uint32_t indices[36] = {
-        0, 3, 2,
-        2, 1, 0,
+// Uploads the geometry to the engine buffers, with 16-bit indices when the
+// vertex count allows it
+static void UploadGeometry(
+    EgMesh *mesh,
+    RgCmdPool *cmd_pool,
+    EgCompactVertex *vertices,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count)
+{
+    EgEngine *engine = mesh->engine;
+    RgDevice *device = egEngineGetDevice(engine);
 
-        6, 7, 4,
-        4, 5, 6,
+    EgArray(uint16_t) short_indices = NULL;
+    void *data = indices;
+    size_t indices_size = index_count * sizeof(uint32_t);
+    mesh->index_type = RG_INDEX_TYPE_UINT32;
 
-        6, 2, 3,
-        3, 7, 6,
+    if (vertex_count <= UINT16_MAX)
+    {
+        short_indices = egArrayCreate(mesh->allocator, uint16_t);
+        egArrayResize(&short_indices, index_count);
+        for (size_t i = 0; i < index_count; ++i)
+        {
+            short_indices[i] = (uint16_t)indices[i];
+        }
 
-        7, 3, 0,
-        0, 4, 7,
+        data = short_indices;
+        indices_size = index_count * sizeof(uint16_t);
+        mesh->index_type = RG_INDEX_TYPE_UINT16;
+    }
 
-        4, 0, 1,
-        1, 5, 4,
+    bool allocated =
+        egEngineAllocateGeometry(engine, vertex_count, indices_size, &mesh->geometry);
+    EG_ASSERT(allocated);
+
+    rgBufferUpload(
+        device,
+        cmd_pool,
+        egEngineGetVertexBuffer(engine).buffer,
+        sizeof(EgCompactVertex) * mesh->geometry.first_vertex,
+        sizeof(EgCompactVertex) * vertex_count,
+        vertices);
+    rgBufferUpload(
+        device,
+        cmd_pool,
+        egEngineGetIndexBuffer(engine),
+        mesh->geometry.index_offset,
+        indices_size,
+        data);
+
+    mesh->index_count = (uint32_t)index_count;
+
+    egArrayFree(&short_indices);
+}
 
-        5, 1, 2,
-        2, 6, 5,
-    };
+EgMesh *egMeshCreateProcedural(
+    EgAllocator *allocator,
+    EgEngine *engine,
+    RgCmdPool *cmd_pool,
+    const EgProceduralMeshInfo *info)
+{
+    EgMesh *mesh = (EgMesh*)egAllocate(allocator, sizeof(EgMesh));
+    *mesh = (EgMesh){0};
+    mesh->allocator = allocator;
+    mesh->engine = engine;
 
-    RgBufferInfo vertex_buffer_info = {};
-    vertex_buffer_info.size = sizeof(vertices);
-    vertex_buffer_info.usage = RG_BUFFER_USAGE_VERTEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    vertex_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
+    size_t vertex_count, index_count;
+    egProceduralMeshCount(info, &vertex_count, &index_count);
 
-    RgBufferInfo index_buffer_info = {};
-    index_buffer_info.size = sizeof(indices);
-    index_buffer_info.usage = RG_BUFFER_USAGE_INDEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    index_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
+    EgArray(EgVertex) vertices = egArrayCreate(allocator, EgVertex);
+    EgArray(uint32_t) indices = egArrayCreate(allocator, uint32_t);
+    egArrayResize(&vertices, vertex_count);
+    egArrayResize(&indices, index_count);
 
-    RgDevice *device = egEngineGetDevice(engine);
+    egProceduralMeshGenerate(info, egEngineGetJobSystem(engine), vertices, indices);
 
-    mesh->vertex_buffer = rgBufferCreate(device, &vertex_buffer_info);
-    mesh->index_buffer = rgBufferCreate(device, &index_buffer_info);
+    vertex_count = egMeshOptimize(
+        allocator, vertices, NULL, 0, vertex_count, indices, index_count, NULL);
 
-    rgBufferUpload(device, cmd_pool, mesh->vertex_buffer, 0, sizeof(vertices), vertices);
-    rgBufferUpload(device, cmd_pool, mesh->index_buffer, 0, sizeof(indices), indices);
+    EgArray(EgCompactVertex) compact_vertices =
+        CompressVertices(mesh, vertices, vertex_count);
+    egArrayFree(&vertices);
 
-    mesh->index_count = sizeof(indices) / sizeof(indices[0]);
+    UploadGeometry(mesh, cmd_pool, compact_vertices, vertex_count, indices, index_count);
 
+    egArrayFree(&indices);
+    egArrayFree(&compact_vertices);
     return mesh;
 }
 
+EgMesh *egMeshCreateCube(EgAllocator *allocator, EgEngine *engine, RgCmdPool *cmd_pool)
+{
+    EgProceduralMeshInfo info = {
+        .shape = EG_PROCEDURAL_SHAPE_CUBE,
+        .radius = 0.5f,
+        .segments = 1,
+    };
+    return egMeshCreateProcedural(allocator, engine, cmd_pool, &info);
+}
+
 EgMesh *egMeshCreateUVSphere(
         EgAllocator *allocator,
         EgEngine *engine,
@@ -84,160 +138,146 @@ EgMesh *egMeshCreateUVSphere(
         float radius,
         uint32_t divisions)
 {
-    EgMesh *mesh = (EgMesh*)egAllocate(allocator, sizeof(EgMesh));
-    *mesh = (EgMesh){0};
-    mesh->allocator = allocator;
-    mesh->engine = engine;
-
-    EgArray(EgVertex) vertices = egArrayCreate(allocator, EgVertex);
-    EgArray(uint32_t) indices = egArrayCreate(allocator, uint32_t);
-
-    float step = 1.0f / (float)divisions;
-    float3 step3 = V3(step, step, step);
-
-    float3 origins[6] = {
-        V3(-1.0, -1.0, -1.0),
-        V3(1.0, -1.0, -1.0),
-        V3(1.0, -1.0, 1.0),
-        V3(-1.0, -1.0, 1.0),
-        V3(-1.0, 1.0, -1.0),
-        V3(-1.0, -1.0, 1.0),
-    };
-    float3 rights[6] = {
-        V3(2.0, 0.0, 0.0),
-        V3(0.0, 0.0, 2.0),
-        V3(-2.0, 0.0, 0.0),
-        V3(0.0, 0.0, -2.0),
-        V3(2.0, 0.0, 0.0),
-        V3(2.0, 0.0, 0.0),
-    };
-    float3 ups[6] = {
-        V3(0.0, 2.0, 0.0),
-        V3(0.0, 2.0, 0.0),
-        V3(0.0, 2.0, 0.0),
-        V3(0.0, 2.0, 0.0),
-        V3(0.0, 0.0, 2.0),
-        V3(0.0, 0.0, -2.0),
+    EgProceduralMeshInfo info = {
+        .shape = EG_PROCEDURAL_SHAPE_CUBE_SPHERE,
+        .radius = radius,
+        .segments = divisions,
     };
+    return egMeshCreateProcedural(allocator, engine, cmd_pool, &info);
+}
 
-    {
-        for (uint32_t face = 0; face < 6; ++face)
-        {
-            float3 origin = origins[face];
-            float3 right = rights[face];
-            float3 up = ups[face];
+void egMeshDestroy(EgMesh *mesh)
+{
+    egEngineFreeGeometry(mesh->engine, &mesh->geometry);
 
-            for (uint32_t j = 0; j < divisions + 1; ++j)
-            {
-                float3 jv = V3((float)j, (float)j, (float)j);
+    egFree(mesh->allocator, mesh);
+}
 
-                for (uint32_t i = 0; i < divisions + 1; ++i)
-                {
-                    float3 iv = V3((float)i, (float)i, (float)i);
+const EgGeometry *egMeshGetGeometry(EgMesh* mesh)
+{
+    return &mesh->geometry;
+}
 
-                    float3 ivright = egFloat3Mul(iv, right);
-                    float3 jvup = egFloat3Mul(jv, up);
-                    float3 sum = egFloat3Add(ivright, jvup);
+uint32_t egMeshGetIndexCount(EgMesh* mesh)
+{
+    return mesh->index_count;
+}
 
-                    float3 p = egFloat3Add(origin, egFloat3Mul(step3, sum));
-                    p = egFloat3MulScalar(egFloat3Normalize(p), radius);
+const EgVertexQuantization *egMeshGetQuantization(EgMesh* mesh)
+{
+    return &mesh->quantization;
+}
 
+RgIndexType egMeshGetIndexType(EgMesh* mesh)
+{
+    return mesh->index_type;
+}
 
-                    EgVertex vertex = {p, {}, {}, {}};
-                    egArrayPush(&vertices, vertex);
-                }
-            }
-        }
-    }
+typedef struct MeshCacheEntry
+{
+    uint64_t hash;
+    EgProceduralMeshInfo key;
+    EgMesh *mesh;
+} MeshCacheEntry;
 
-    uint32_t k = divisions + 1;
+// Copy of info with only the fields its shape reads, the others are zero
+static EgProceduralMeshInfo ProceduralMeshKey(const EgProceduralMeshInfo *info)
+{
+    EgProceduralMeshInfo key = {
+        .shape = info->shape,
+        .radius = info->radius,
+        .segments = info->segments,
+    };
 
+    switch (info->shape)
     {
-        for (uint32_t face = 0; face < 6; ++face)
-        {
-            for (uint32_t j = 0; j < divisions; ++j)
-            {
-                bool bottom = j < (divisions / 2);
-
-                for (uint32_t i = 0; i < divisions; ++i)
-                {
-                    bool left = i < (divisions / 2);
-                    uint32_t a = (face * k + j) * k + i;
-                    uint32_t b = (face * k + j) * k + i + 1;
-                    uint32_t c = (face * k + j + 1) * k + i;
-                    uint32_t d = (face * k + j + 1) * k + i + 1;
-                    if ((bottom ^ left) != 0)
-                    {
-                        egArrayPush(&indices, a);
-                        egArrayPush(&indices, c);
-                        egArrayPush(&indices, b);
-                        egArrayPush(&indices, c);
-                        egArrayPush(&indices, d);
-                        egArrayPush(&indices, b);
-                    }
-                    else
-                    {
-                        egArrayPush(&indices, a);
-                        egArrayPush(&indices, c);
-                        egArrayPush(&indices, d);
-                        egArrayPush(&indices, a);
-                        egArrayPush(&indices, d);
-                        egArrayPush(&indices, b);
-                    }
-                }
-            }
-        }
+    case EG_PROCEDURAL_SHAPE_CUBE:
+    case EG_PROCEDURAL_SHAPE_CUBE_SPHERE:
+        break;
+    case EG_PROCEDURAL_SHAPE_UV_SPHERE:
+    case EG_PROCEDURAL_SHAPE_PLANE:
+        key.rings = info->rings;
+        break;
+    case EG_PROCEDURAL_SHAPE_CYLINDER:
+    case EG_PROCEDURAL_SHAPE_CAPSULE:
+        key.height = info->height;
+        key.rings = info->rings;
+        break;
+    case EG_PROCEDURAL_SHAPE_TORUS:
+        key.minor_radius = info->minor_radius;
+        key.rings = info->rings;
+        break;
     }
 
-    size_t vertices_size = egArrayLength(vertices) * sizeof(EgVertex);
-    size_t indices_size = egArrayLength(indices) * sizeof(uint32_t);
-
-    RgBufferInfo vertex_buffer_info = {};
-    vertex_buffer_info.size = vertices_size;
-    vertex_buffer_info.usage = RG_BUFFER_USAGE_VERTEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    vertex_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
-
-    RgBufferInfo index_buffer_info = {};
-    index_buffer_info.size = indices_size;
-    index_buffer_info.usage = RG_BUFFER_USAGE_INDEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    index_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
-
-    RgDevice *device = egEngineGetDevice(mesh->engine);
-
-    mesh->vertex_buffer = rgBufferCreate(device, &vertex_buffer_info);
-    mesh->index_buffer = rgBufferCreate(device, &index_buffer_info);
-
-    rgBufferUpload(device, cmd_pool, mesh->vertex_buffer, 0, vertices_size, vertices);
-    rgBufferUpload(device, cmd_pool, mesh->index_buffer, 0, indices_size, indices);
-
-    mesh->index_count = (uint32_t)egArrayLength(indices);
-
-    egArrayFree(&indices);
-    egArrayFree(&vertices);
-    return mesh;
+    return key;
 }
 
-void egMeshDestroy(EgMesh *mesh)
+static uint64_t HashProceduralMeshKey(const EgProceduralMeshInfo *key)
 {
-    RgDevice *device = egEngineGetDevice(mesh->engine);
-
-    rgBufferDestroy(device, mesh->vertex_buffer);
-    rgBufferDestroy(device, mesh->index_buffer);
+    uint64_t hash = egHash64(&key->shape, sizeof(key->shape), 0);
+    hash = egHash64(&key->radius, sizeof(key->radius), hash);
+    hash = egHash64(&key->height, sizeof(key->height), hash);
+    hash = egHash64(&key->minor_radius, sizeof(key->minor_radius), hash);
+    hash = egHash64(&key->segments, sizeof(key->segments), hash);
+    hash = egHash64(&key->rings, sizeof(key->rings), hash);
+    return hash;
+}
 
-    egFree(mesh->allocator, mesh);
+static bool ProceduralMeshKeyEqual(
+    const EgProceduralMeshInfo *a, const EgProceduralMeshInfo *b)
+{
+    return a->shape == b->shape && a->radius == b->radius && a->height == b->height &&
+           a->minor_radius == b->minor_radius && a->segments == b->segments &&
+           a->rings == b->rings;
 }
 
-RgBuffer *egMeshGetVertexBuffer(EgMesh* mesh)
+struct EgMeshCache
+{
+    EgAllocator *allocator;
+    EgEngine *engine;
+    EgArray(MeshCacheEntry) entries;
+};
+
+EgMeshCache *egMeshCacheCreate(EgAllocator *allocator, EgEngine *engine)
 {
-    return mesh->vertex_buffer;
+    EgMeshCache *cache = (EgMeshCache*)egAllocate(allocator, sizeof(EgMeshCache));
+    *cache = (EgMeshCache){
+        .allocator = allocator,
+        .engine = engine,
+        .entries = egArrayCreate(allocator, MeshCacheEntry),
+    };
+    return cache;
 }
 
-RgBuffer *egMeshGetIndexBuffer(EgMesh* mesh)
+void egMeshCacheDestroy(EgMeshCache *cache)
 {
-    return mesh->index_buffer;
+    for (size_t i = 0; i < egArrayLength(cache->entries); ++i)
+    {
+        egMeshDestroy(cache->entries[i].mesh);
+    }
+    egArrayFree(&cache->entries);
+    egFree(cache->allocator, cache);
 }
 
-uint32_t egMeshGetIndexCount(EgMesh* mesh)
+EgMesh *egMeshCacheGetProcedural(
+    EgMeshCache *cache, RgCmdPool *cmd_pool, const EgProceduralMeshInfo *info)
 {
-    return mesh->index_count;
+    EgProceduralMeshInfo key = ProceduralMeshKey(info);
+    uint64_t hash = HashProceduralMeshKey(&key);
+    for (size_t i = 0; i < egArrayLength(cache->entries); ++i)
+    {
+        MeshCacheEntry *entry = &cache->entries[i];
+        if (entry->hash == hash && ProceduralMeshKeyEqual(&entry->key, &key))
+        {
+            return entry->mesh;
+        }
+    }
+
+    MeshCacheEntry entry = {
+        .hash = hash,
+        .key = key,
+        .mesh = egMeshCreateProcedural(cache->allocator, cache->engine, cmd_pool, info),
+    };
+    egArrayPush(&cache->entries, entry);
+    return entry.mesh;
 }
@@ -2,6 +2,7 @@
 
 #include <rg.h>
 #include "math_types.h"
+#include "procedural_mesh.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -10,8 +11,19 @@ extern "C" {
 typedef struct EgEngine EgEngine;
 typedef struct EgMesh EgMesh;
 typedef struct EgAllocator EgAllocator;
+typedef struct EgVertexQuantization EgVertexQuantization;
+typedef struct EgGeometry EgGeometry;
+typedef struct EgMeshCache EgMeshCache;
 
+// Generates the shape on the engine job system and uploads it
+EgMesh *egMeshCreateProcedural(
+    EgAllocator *allocator,
+    EgEngine *engine,
+    RgCmdPool *cmd_pool,
+    const EgProceduralMeshInfo *info);
+// Unit cube
 EgMesh *egMeshCreateCube(EgAllocator *allocator, EgEngine *engine, RgCmdPool *cmd_pool);
+// Cube sphere with divisions cells along each edge of the cube faces
 EgMesh *egMeshCreateUVSphere(
         EgAllocator *allocator,
         EgEngine *engine,
@@ -20,9 +32,21 @@ EgMesh *egMeshCreateUVSphere(
         uint32_t divisions);
 void egMeshDestroy(EgMesh *mesh);
 
-RgBuffer *egMeshGetVertexBuffer(EgMesh* mesh);
-RgBuffer *egMeshGetIndexBuffer(EgMesh* mesh);
+// Range of the engine geometry buffers holding the mesh
+const EgGeometry *egMeshGetGeometry(EgMesh* mesh);
 uint32_t egMeshGetIndexCount(EgMesh* mesh);
+RgIndexType egMeshGetIndexType(EgMesh* mesh);
+// Maps the compact vertices in the vertex buffer back to model space
+const EgVertexQuantization *egMeshGetQuantization(EgMesh* mesh);
+
+// Procedural meshes shared by everything that asks for the same shape, so
+// repeated shapes are only generated and uploaded once. Not thread safe.
+EgMeshCache *egMeshCacheCreate(EgAllocator *allocator, EgEngine *engine);
+// Destroys every mesh the cache returned
+void egMeshCacheDestroy(EgMeshCache *cache);
+// The returned mesh belongs to the cache and must not be destroyed
+EgMesh *egMeshCacheGetProcedural(
+    EgMeshCache *cache, RgCmdPool *cmd_pool, const EgProceduralMeshInfo *info);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,595 @@
+#include "mesh_optimizer.h"
+
+#include <stdlib.h>
+#include "math.h"
+#include "allocator.h"
+#include "engine.h"
+#include "hash.h"
+
+// Scoring from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRIANGLE_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+size_t egMeshWeldVertices(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count)
+{
+    if (vertex_count == 0) return 0;
+
+    size_t table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size <<= 1;
+
+    uint32_t *table = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * table_size);
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+    uint32_t *remap = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    uint8_t *attribute_bytes = (uint8_t *)attributes;
+
+    // The table points at the compacted vertices, which always come before the
+    // one being inserted
+    size_t unique_count = 0;
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        uint64_t hash = egHash64(&vertices[i], sizeof(EgVertex), 0);
+        if (attributes)
+        {
+            hash = egHash64(&attribute_bytes[i * attribute_size], attribute_size, hash);
+        }
+
+        size_t slot = (size_t)hash & (table_size - 1);
+        while (table[slot] != UINT32_MAX)
+        {
+            size_t other = table[slot];
+            if (memcmp(&vertices[other], &vertices[i], sizeof(EgVertex)) == 0 &&
+                (!attributes || memcmp(
+                                    &attribute_bytes[other * attribute_size],
+                                    &attribute_bytes[i * attribute_size],
+                                    attribute_size) == 0))
+            {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == UINT32_MAX)
+        {
+            table[slot] = (uint32_t)unique_count;
+            if (attributes)
+            {
+                memmove(
+                    &attribute_bytes[unique_count * attribute_size],
+                    &attribute_bytes[i * attribute_size],
+                    attribute_size);
+            }
+            vertices[unique_count++] = vertices[i];
+        }
+
+        remap[i] = table[slot];
+    }
+
+    for (size_t i = 0; i < index_count; ++i)
+    {
+        indices[i] = remap[indices[i]];
+    }
+
+    egFree(allocator, remap);
+    egFree(allocator, table);
+
+    return unique_count;
+}
+
+static float ForsythVertexScore(int32_t cache_position, uint32_t live_triangles)
+{
+    if (live_triangles == 0) return -1.0f;
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+        if (cache_position < 3)
+        {
+            // The last triangle's vertices get a fixed score, so the next one
+            // doesn't just reuse the same edge
+            score = FORSYTH_LAST_TRIANGLE_SCORE;
+        }
+        else
+        {
+            float scaler = 1.0f / (float)(FORSYTH_CACHE_SIZE - 3);
+            score = powf(
+                1.0f - (float)(cache_position - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+        }
+    }
+
+    // Vertices with few triangles left get a boost, to finish them off
+    score += FORSYTH_VALENCE_BOOST_SCALE *
+             powf((float)live_triangles, -FORSYTH_VALENCE_BOOST_POWER);
+    return score;
+}
+
+void egMeshOptimizeVertexCache(
+    EgAllocator *allocator, uint32_t *indices, size_t index_count, size_t vertex_count)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) return;
+
+    uint32_t *live = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    uint32_t *offsets =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    uint32_t *adjacency =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * triangle_count * 3);
+    int32_t *cache_position =
+        (int32_t *)egAllocate(allocator, sizeof(int32_t) * vertex_count);
+    float *vertex_score = (float *)egAllocate(allocator, sizeof(float) * vertex_count);
+    float *triangle_score =
+        (float *)egAllocate(allocator, sizeof(float) * triangle_count);
+    uint8_t *emitted = (uint8_t *)egAllocate(allocator, triangle_count);
+    uint32_t *output =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * triangle_count * 3);
+
+    memset(live, 0, sizeof(uint32_t) * vertex_count);
+    memset(emitted, 0, triangle_count);
+
+    // Triangles using each vertex, live[v] of them starting at offsets[v]
+    for (size_t i = 0; i < triangle_count * 3; ++i)
+    {
+        live[indices[i]]++;
+    }
+
+    uint32_t offset = 0;
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        offsets[v] = offset;
+        offset += live[v];
+        live[v] = 0;
+    }
+
+    for (size_t i = 0; i < triangle_count * 3; ++i)
+    {
+        uint32_t v = indices[i];
+        adjacency[offsets[v] + live[v]++] = (uint32_t)(i / 3);
+    }
+
+    for (size_t v = 0; v < vertex_count; ++v)
+    {
+        cache_position[v] = -1;
+        vertex_score[v] = ForsythVertexScore(-1, live[v]);
+    }
+
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        const uint32_t *triangle = &indices[t * 3];
+        triangle_score[t] = vertex_score[triangle[0]] + vertex_score[triangle[1]] +
+                            vertex_score[triangle[2]];
+    }
+
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    size_t cache_count = 0;
+
+    size_t scan_cursor = 0;
+    size_t best = SIZE_MAX;
+
+    for (size_t out = 0; out < triangle_count; ++out)
+    {
+        if (best == SIZE_MAX)
+        {
+            // Nothing left around the cache, continue with the next triangle in
+            // input order instead of searching all of them
+            while (emitted[scan_cursor])
+                scan_cursor++;
+            best = scan_cursor;
+        }
+
+        const uint32_t *triangle = &indices[best * 3];
+        memcpy(&output[out * 3], triangle, sizeof(uint32_t) * 3);
+        emitted[best] = 1;
+
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            uint32_t v = triangle[k];
+            uint32_t *triangles = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < live[v]; ++j)
+            {
+                if (triangles[j] == best)
+                {
+                    triangles[j] = triangles[live[v] - 1];
+                    break;
+                }
+            }
+            live[v]--;
+        }
+
+        // The triangle's vertices move to the front of the cache, the ones
+        // pushed past the end still get their score updated below
+        uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+        size_t new_count = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            bool duplicate = false;
+            for (size_t j = 0; j < new_count; ++j)
+                duplicate |= new_cache[j] == triangle[k];
+            if (!duplicate) new_cache[new_count++] = triangle[k];
+        }
+        for (size_t j = 0; j < cache_count; ++j)
+        {
+            uint32_t v = cache[j];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2])
+                new_cache[new_count++] = v;
+        }
+
+        for (size_t j = 0; j < new_count; ++j)
+        {
+            uint32_t v = new_cache[j];
+            cache_position[v] = j < FORSYTH_CACHE_SIZE ? (int32_t)j : -1;
+            vertex_score[v] = ForsythVertexScore(cache_position[v], live[v]);
+        }
+
+        best = SIZE_MAX;
+        float best_score = -1.0f;
+        for (size_t j = 0; j < new_count; ++j)
+        {
+            uint32_t v = new_cache[j];
+            for (uint32_t i = 0; i < live[v]; ++i)
+            {
+                uint32_t t = adjacency[offsets[v] + i];
+                const uint32_t *candidate = &indices[t * 3];
+                triangle_score[t] = vertex_score[candidate[0]] +
+                                    vertex_score[candidate[1]] +
+                                    vertex_score[candidate[2]];
+                if (triangle_score[t] > best_score)
+                {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        cache_count = EG_MIN(new_count, (size_t)FORSYTH_CACHE_SIZE);
+        memcpy(cache, new_cache, sizeof(uint32_t) * cache_count);
+    }
+
+    memcpy(indices, output, sizeof(uint32_t) * triangle_count * 3);
+
+    egFree(allocator, output);
+    egFree(allocator, emitted);
+    egFree(allocator, triangle_score);
+    egFree(allocator, vertex_score);
+    egFree(allocator, cache_position);
+    egFree(allocator, adjacency);
+    egFree(allocator, offsets);
+    egFree(allocator, live);
+}
+
+// A vertex is in the cache while fewer than EG_MESH_FIFO_CACHE_SIZE misses
+// happened since it was loaded. Timestamps start at zero and time past the
+// cache size, so the cache starts out empty.
+static uint32_t FifoTriangleMisses(
+    const uint32_t *triangle, uint32_t *timestamps, uint32_t *time)
+{
+    uint32_t misses = 0;
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        uint32_t v = triangle[k];
+        if (*time - timestamps[v] > EG_MESH_FIFO_CACHE_SIZE)
+        {
+            timestamps[v] = (*time)++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+static void FifoReset(uint32_t *time)
+{
+    *time += EG_MESH_FIFO_CACHE_SIZE + 1;
+}
+
+uint64_t egMeshCountCacheMisses(
+    EgAllocator *allocator,
+    const uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count)
+{
+    uint32_t *timestamps =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    memset(timestamps, 0, sizeof(uint32_t) * vertex_count);
+    uint32_t time = EG_MESH_FIFO_CACHE_SIZE + 1;
+
+    uint64_t misses = 0;
+    for (size_t t = 0; t < index_count / 3; ++t)
+    {
+        misses += FifoTriangleMisses(&indices[t * 3], timestamps, &time);
+    }
+
+    egFree(allocator, timestamps);
+    return misses;
+}
+
+typedef struct OverdrawCluster
+{
+    uint32_t first_triangle;
+    uint32_t triangle_count;
+    float sort_key;
+} OverdrawCluster;
+
+static int CompareClusters(const void *a, const void *b)
+{
+    const OverdrawCluster *left = (const OverdrawCluster *)a;
+    const OverdrawCluster *right = (const OverdrawCluster *)b;
+    if (left->sort_key != right->sort_key)
+        return left->sort_key > right->sort_key ? -1 : 1;
+    return left->first_triangle < right->first_triangle ? -1 : 1;
+}
+
+// Twice the area weighted normal and the centroid of a triangle
+static void TriangleGeometry(
+    const uint32_t *triangle, const EgVertex *vertices, float3 *normal, float3 *centroid)
+{
+    float3 p0 = vertices[triangle[0]].pos;
+    float3 p1 = vertices[triangle[1]].pos;
+    float3 p2 = vertices[triangle[2]].pos;
+
+    *normal = egFloat3Cross(egFloat3Sub(p1, p0), egFloat3Sub(p2, p0));
+    *centroid = egFloat3MulScalar(egFloat3Add(egFloat3Add(p0, p1), p2), 1.0f / 3.0f);
+}
+
+// Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw"
+void egMeshOptimizeOverdraw(
+    EgAllocator *allocator,
+    uint32_t *indices,
+    size_t index_count,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    float threshold)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count < 2) return;
+
+    uint32_t *timestamps =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    memset(timestamps, 0, sizeof(uint32_t) * vertex_count);
+    uint32_t time = EG_MESH_FIFO_CACHE_SIZE + 1;
+
+    // Hard boundaries: triangles missing all of their vertices don't benefit
+    // from what came before them
+    uint32_t *hard_starts =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * (triangle_count + 1));
+    size_t hard_count = 0;
+    uint64_t total_misses = 0;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        uint32_t misses = FifoTriangleMisses(&indices[t * 3], timestamps, &time);
+        if (t == 0 || misses == 3) hard_starts[hard_count++] = (uint32_t)t;
+        total_misses += misses;
+    }
+    hard_starts[hard_count] = (uint32_t)triangle_count;
+
+    // Soft boundaries: split the hard clusters wherever the cache restarting
+    // keeps their ACMR under the threshold
+    float acmr_threshold = threshold * (float)total_misses / (float)triangle_count;
+
+    OverdrawCluster *clusters = (OverdrawCluster *)egAllocate(
+        allocator, sizeof(OverdrawCluster) * triangle_count);
+    size_t cluster_count = 0;
+    for (size_t h = 0; h < hard_count; ++h)
+    {
+        uint32_t start = hard_starts[h];
+        uint32_t end = hard_starts[h + 1];
+
+        FifoReset(&time);
+        uint32_t cluster_start = start;
+        uint32_t misses = 0;
+        for (uint32_t t = start; t < end; ++t)
+        {
+            misses += FifoTriangleMisses(&indices[t * 3], timestamps, &time);
+
+            uint32_t count = t + 1 - cluster_start;
+            if (t + 1 == end || (float)misses <= acmr_threshold * (float)count)
+            {
+                clusters[cluster_count++] = (OverdrawCluster){
+                    .first_triangle = cluster_start,
+                    .triangle_count = count,
+                };
+                cluster_start = t + 1;
+                misses = 0;
+                FifoReset(&time);
+            }
+        }
+    }
+
+    // Clusters far out along their own normal are the likeliest to occlude
+    // the rest of the mesh, so they get drawn first
+    float3 mesh_centroid = V3(0.0f, 0.0f, 0.0f);
+    float mesh_area = 0.0f;
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        float3 normal, centroid;
+        TriangleGeometry(&indices[t * 3], vertices, &normal, &centroid);
+        float area = egFloat3Length(normal);
+        mesh_centroid = egFloat3Add(mesh_centroid, egFloat3MulScalar(centroid, area));
+        mesh_area += area;
+    }
+    if (mesh_area > 0.0f)
+    {
+        mesh_centroid = egFloat3MulScalar(mesh_centroid, 1.0f / mesh_area);
+    }
+
+    for (size_t c = 0; c < cluster_count; ++c)
+    {
+        OverdrawCluster *cluster = &clusters[c];
+
+        float3 cluster_normal = V3(0.0f, 0.0f, 0.0f);
+        float3 cluster_centroid = V3(0.0f, 0.0f, 0.0f);
+        float cluster_area = 0.0f;
+        for (uint32_t i = 0; i < cluster->triangle_count; ++i)
+        {
+            size_t t = cluster->first_triangle + i;
+            float3 normal, centroid;
+            TriangleGeometry(&indices[t * 3], vertices, &normal, &centroid);
+            float area = egFloat3Length(normal);
+
+            cluster_normal = egFloat3Add(cluster_normal, normal);
+            cluster_centroid =
+                egFloat3Add(cluster_centroid, egFloat3MulScalar(centroid, area));
+            cluster_area += area;
+        }
+
+        cluster->sort_key = 0.0f;
+        if (cluster_area > 0.0f)
+        {
+            cluster_centroid = egFloat3MulScalar(cluster_centroid, 1.0f / cluster_area);
+            cluster->sort_key = egFloat3Dot(
+                egFloat3Sub(cluster_centroid, mesh_centroid),
+                egFloat3Normalize(cluster_normal));
+        }
+    }
+
+    qsort(clusters, cluster_count, sizeof(OverdrawCluster), CompareClusters);
+
+    uint32_t *output =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * triangle_count * 3);
+    size_t out = 0;
+    for (size_t c = 0; c < cluster_count; ++c)
+    {
+        size_t count = (size_t)clusters[c].triangle_count * 3;
+        memcpy(
+            &output[out],
+            &indices[(size_t)clusters[c].first_triangle * 3],
+            sizeof(uint32_t) * count);
+        out += count;
+    }
+    memcpy(indices, output, sizeof(uint32_t) * triangle_count * 3);
+
+    egFree(allocator, output);
+    egFree(allocator, clusters);
+    egFree(allocator, hard_starts);
+    egFree(allocator, timestamps);
+}
+
+size_t egMeshOptimizeVertexFetch(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count)
+{
+    if (vertex_count == 0) return 0;
+
+    uint32_t *remap = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    memset(remap, 0xff, sizeof(uint32_t) * vertex_count);
+    EgVertex *sorted = (EgVertex *)egAllocate(allocator, sizeof(EgVertex) * vertex_count);
+    uint8_t *sorted_attributes = NULL;
+    if (attributes)
+    {
+        sorted_attributes =
+            (uint8_t *)egAllocate(allocator, attribute_size * vertex_count);
+    }
+
+    size_t used_count = 0;
+    for (size_t i = 0; i < index_count; ++i)
+    {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX)
+        {
+            if (attributes)
+            {
+                memcpy(
+                    &sorted_attributes[used_count * attribute_size],
+                    (uint8_t *)attributes + v * attribute_size,
+                    attribute_size);
+            }
+            remap[v] = (uint32_t)used_count;
+            sorted[used_count++] = vertices[v];
+        }
+        indices[i] = remap[v];
+    }
+
+    memcpy(vertices, sorted, sizeof(EgVertex) * used_count);
+    if (attributes)
+    {
+        memcpy(attributes, sorted_attributes, attribute_size * used_count);
+        egFree(allocator, sorted_attributes);
+    }
+
+    egFree(allocator, sorted);
+    egFree(allocator, remap);
+
+    return used_count;
+}
+
+size_t egMeshOptimize(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count,
+    EgMeshOptimizeStats *stats)
+{
+    if (stats)
+    {
+        stats->vertex_count_before += vertex_count;
+        stats->triangle_count += index_count / 3;
+        stats->cache_misses_before +=
+            egMeshCountCacheMisses(allocator, indices, index_count, vertex_count);
+    }
+
+    vertex_count = egMeshWeldVertices(
+        allocator,
+        vertices,
+        attributes,
+        attribute_size,
+        vertex_count,
+        indices,
+        index_count);
+
+    // Forsyth's greedy order can lose to an input that is already laid out in
+    // strips, as small regular grids often are, so the input order is kept
+    // unless the new one has fewer misses
+    uint64_t input_misses =
+        egMeshCountCacheMisses(allocator, indices, index_count, vertex_count);
+    uint32_t *input_indices =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * index_count);
+    memcpy(input_indices, indices, sizeof(uint32_t) * index_count);
+
+    egMeshOptimizeVertexCache(allocator, indices, index_count, vertex_count);
+    egMeshOptimizeOverdraw(
+        allocator, indices, index_count, vertices, vertex_count, 1.05f);
+
+    uint64_t misses =
+        egMeshCountCacheMisses(allocator, indices, index_count, vertex_count);
+    if (misses > input_misses)
+    {
+        memcpy(indices, input_indices, sizeof(uint32_t) * index_count);
+        misses = input_misses;
+    }
+    egFree(allocator, input_indices);
+
+    // Only renames the vertices, which doesn't change the misses
+    vertex_count = egMeshOptimizeVertexFetch(
+        allocator,
+        vertices,
+        attributes,
+        attribute_size,
+        vertex_count,
+        indices,
+        index_count);
+
+    if (stats)
+    {
+        stats->vertex_count_after += vertex_count;
+        stats->cache_misses_after += misses;
+    }
+
+    return vertex_count;
+}
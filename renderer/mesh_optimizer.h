@@ -0,0 +1,96 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgVertex EgVertex;
+
+// Size of the FIFO cache used to count cache misses, close to what current
+// GPUs reuse between neighbouring triangles
+#define EG_MESH_FIFO_CACHE_SIZE 16
+
+// Running totals, the ACMR (average cache miss ratio) is the number of cache
+// misses divided by the number of triangles. It ranges from 3 (no reuse) down
+// to about 0.5 for large regular grids.
+typedef struct EgMeshOptimizeStats
+{
+    uint64_t vertex_count_before;
+    uint64_t vertex_count_after;
+    uint64_t triangle_count;
+    uint64_t cache_misses_before;
+    uint64_t cache_misses_after;
+} EgMeshOptimizeStats;
+
+// Every function works on triangle lists, indices are relative to vertices.
+// They only allocate scratch memory and can run on any thread.
+//
+// attributes, when not NULL, is a second vertex stream of attribute_size
+// bytes per vertex (such as EgSkinVertex). It moves with the vertices, and
+// vertices only merge when their attributes are identical too.
+
+// Merges bitwise identical vertices. Vertices are compacted in place, keeping
+// the order of their first occurrence, and the new count is returned.
+size_t egMeshWeldVertices(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count);
+
+// Reorders triangles for the post-transform vertex cache with Forsyth's
+// algorithm
+void egMeshOptimizeVertexCache(
+    EgAllocator *allocator, uint32_t *indices, size_t index_count, size_t vertex_count);
+
+// Splits the triangles in clusters wherever the cache order allows it, with a
+// cost of at most threshold times the current ACMR (1.05 is a good value), and
+// sorts the clusters so the outward facing ones come first. Run it after
+// egMeshOptimizeVertexCache.
+void egMeshOptimizeOverdraw(
+    EgAllocator *allocator,
+    uint32_t *indices,
+    size_t index_count,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    float threshold);
+
+// Sorts vertices by first use in the index buffer and drops unused ones,
+// returns the new count
+size_t egMeshOptimizeVertexFetch(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count);
+
+// Misses of a EG_MESH_FIFO_CACHE_SIZE entry FIFO cache
+uint64_t egMeshCountCacheMisses(
+    EgAllocator *allocator,
+    const uint32_t *indices,
+    size_t index_count,
+    size_t vertex_count);
+
+// Runs all of the above in order and adds the results to stats (if not NULL).
+// The triangles keep their input order when the optimized one has more cache
+// misses. Returns the new vertex count.
+size_t egMeshOptimize(
+    EgAllocator *allocator,
+    EgVertex *vertices,
+    void *attributes,
+    size_t attribute_size,
+    size_t vertex_count,
+    uint32_t *indices,
+    size_t index_count,
+    EgMeshOptimizeStats *stats);
+
+#ifdef __cplusplus
+}
+#endif
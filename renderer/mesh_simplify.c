@@ -0,0 +1,416 @@
+#include "mesh_simplify.h"
+
+#include <stdlib.h>
+#include "math.h"
+#include "allocator.h"
+#include "engine.h"
+#include "hash.h"
+
+// Collapses that would turn a triangle by more than this (cosine between the
+// normals before and after) are rejected
+#define SIMPLIFY_MIN_NORMAL_DOT 0.25f
+
+// Symmetric 4x4 matrix of the squared distances to a set of planes, weighted
+// by the areas of their triangles
+typedef struct Quadric
+{
+    float a00, a11, a22;
+    float a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float weight;
+} Quadric;
+
+typedef struct Collapse
+{
+    uint32_t from;
+    uint32_t to;
+    float error;
+} Collapse;
+
+static void QuadricAdd(Quadric *quadric, const Quadric *other)
+{
+    quadric->a00 += other->a00;
+    quadric->a11 += other->a11;
+    quadric->a22 += other->a22;
+    quadric->a01 += other->a01;
+    quadric->a02 += other->a02;
+    quadric->a12 += other->a12;
+    quadric->b0 += other->b0;
+    quadric->b1 += other->b1;
+    quadric->b2 += other->b2;
+    quadric->c += other->c;
+    quadric->weight += other->weight;
+}
+
+static Quadric QuadricFromTriangle(float3 p0, float3 p1, float3 p2)
+{
+    float3 normal = egFloat3Cross(egFloat3Sub(p1, p0), egFloat3Sub(p2, p0));
+    float length = egFloat3Length(normal);
+
+    Quadric quadric = {0};
+    if (!(length > 0.0f)) return quadric;
+
+    normal = egFloat3MulScalar(normal, 1.0f / length);
+    float d = -egFloat3Dot(normal, p0);
+    float weight = length * 0.5f;
+
+    quadric.a00 = weight * normal.x * normal.x;
+    quadric.a11 = weight * normal.y * normal.y;
+    quadric.a22 = weight * normal.z * normal.z;
+    quadric.a01 = weight * normal.x * normal.y;
+    quadric.a02 = weight * normal.x * normal.z;
+    quadric.a12 = weight * normal.y * normal.z;
+    quadric.b0 = weight * normal.x * d;
+    quadric.b1 = weight * normal.y * d;
+    quadric.b2 = weight * normal.z * d;
+    quadric.c = weight * d * d;
+    quadric.weight = weight;
+    return quadric;
+}
+
+// Mean squared distance of p to the planes
+static float QuadricError(const Quadric *q, float3 p)
+{
+    float rx = q->a00 * p.x + q->a01 * p.y + q->a02 * p.z + q->b0;
+    float ry = q->a01 * p.x + q->a11 * p.y + q->a12 * p.z + q->b1;
+    float rz = q->a02 * p.x + q->a12 * p.y + q->a22 * p.z + q->b2;
+    float error = rx * p.x + ry * p.y + rz * p.z + q->b0 * p.x + q->b1 * p.y +
+                  q->b2 * p.z + q->c;
+
+    if (!(q->weight > 0.0f)) return 0.0f;
+    return fabsf(error) / q->weight;
+}
+
+static int CompareCollapses(const void *a, const void *b)
+{
+    float error_a = ((const Collapse *)a)->error;
+    float error_b = ((const Collapse *)b)->error;
+    return (error_a > error_b) - (error_a < error_b);
+}
+
+// Maps every vertex to the first one with the same position
+static void BuildPositionRemap(
+    EgAllocator *allocator,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    uint32_t *remap)
+{
+    size_t table_size = 1;
+    while (table_size < vertex_count * 2)
+        table_size <<= 1;
+
+    uint32_t *table = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * table_size);
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        const float3 *pos = &vertices[i].pos;
+        size_t slot = (size_t)egHash64(pos, sizeof(*pos), 0) & (table_size - 1);
+        while (table[slot] != UINT32_MAX &&
+               memcmp(&vertices[table[slot]].pos, pos, sizeof(*pos)) != 0)
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == UINT32_MAX) table[slot] = (uint32_t)i;
+        remap[i] = table[slot];
+    }
+
+    egFree(allocator, table);
+}
+
+static uint64_t EdgeKey(uint32_t a, uint32_t b)
+{
+    return ((uint64_t)a << 32) | (uint64_t)b;
+}
+
+// Locks the vertices of edges used by a single triangle, using positions so
+// attribute seams don't count as borders
+static void LockBorders(
+    EgAllocator *allocator,
+    const uint32_t *indices,
+    size_t index_count,
+    const uint32_t *remap,
+    uint8_t *locked)
+{
+    size_t table_size = 1;
+    while (table_size < index_count * 2)
+        table_size <<= 1;
+
+    uint64_t *table = (uint64_t *)egAllocate(allocator, sizeof(uint64_t) * table_size);
+    memset(table, 0xff, sizeof(uint64_t) * table_size);
+
+    for (size_t i = 0; i < index_count; ++i)
+    {
+        uint32_t a = remap[indices[i]];
+        uint32_t b = remap[indices[i - i % 3 + (i + 1) % 3]];
+        uint64_t key = EdgeKey(a, b);
+
+        size_t slot = (size_t)egHash64(&key, sizeof(key), 0) & (table_size - 1);
+        while (table[slot] != UINT64_MAX && table[slot] != key)
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+        table[slot] = key;
+    }
+
+    for (size_t i = 0; i < index_count; ++i)
+    {
+        uint32_t a = remap[indices[i]];
+        uint32_t b = remap[indices[i - i % 3 + (i + 1) % 3]];
+        uint64_t key = EdgeKey(b, a);
+
+        size_t slot = (size_t)egHash64(&key, sizeof(key), 0) & (table_size - 1);
+        while (table[slot] != UINT64_MAX && table[slot] != key)
+        {
+            slot = (slot + 1) & (table_size - 1);
+        }
+
+        if (table[slot] == UINT64_MAX)
+        {
+            locked[a] = 1;
+            locked[b] = 1;
+        }
+    }
+
+    egFree(allocator, table);
+}
+
+// Checks that moving from onto to doesn't flip any triangle around from
+static bool CollapseFlips(
+    const EgVertex *vertices,
+    const uint32_t *indices,
+    const uint32_t *adjacency_offsets,
+    const uint32_t *adjacency,
+    const uint32_t *collapse,
+    uint32_t from,
+    uint32_t to)
+{
+    float3 target = vertices[to].pos;
+
+    for (uint32_t i = adjacency_offsets[from]; i < adjacency_offsets[from + 1]; ++i)
+    {
+        const uint32_t *triangle = &indices[adjacency[i] * 3];
+        uint32_t corners[3] = {
+            collapse[triangle[0]],
+            collapse[triangle[1]],
+            collapse[triangle[2]],
+        };
+
+        // Triangles on the edge disappear
+        if (corners[0] == to || corners[1] == to || corners[2] == to) continue;
+
+        float3 before[3], after[3];
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            before[k] = vertices[corners[k]].pos;
+            after[k] = corners[k] == from ? target : before[k];
+        }
+
+        float3 normal_before = egFloat3Cross(
+            egFloat3Sub(before[1], before[0]), egFloat3Sub(before[2], before[0]));
+        float3 normal_after = egFloat3Cross(
+            egFloat3Sub(after[1], after[0]), egFloat3Sub(after[2], after[0]));
+
+        float length_before = egFloat3Length(normal_before);
+        float length_after = egFloat3Length(normal_after);
+        if (!(length_after > 0.0f)) return true;
+        if (!(length_before > 0.0f)) continue;
+
+        float dot = egFloat3Dot(normal_before, normal_after);
+        if (dot < SIMPLIFY_MIN_NORMAL_DOT * length_before * length_after) return true;
+    }
+
+    return false;
+}
+
+size_t egMeshSimplify(
+    EgAllocator *allocator,
+    uint32_t *destination,
+    const uint32_t *indices,
+    size_t index_count,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    size_t target_index_count,
+    float target_error,
+    float *result_error)
+{
+    float max_error = 0.0f;
+    float error_limit = target_error * target_error;
+
+    memmove(destination, indices, sizeof(uint32_t) * index_count);
+    indices = destination;
+
+    if (index_count <= target_index_count || vertex_count == 0)
+    {
+        if (result_error) *result_error = 0.0f;
+        return index_count;
+    }
+
+    uint32_t *remap = (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    uint8_t *locked = (uint8_t *)egAllocate(allocator, vertex_count);
+    uint32_t *wedge_count =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    Quadric *quadrics = (Quadric *)egAllocate(allocator, sizeof(Quadric) * vertex_count);
+    uint32_t *collapse =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    uint8_t *touched = (uint8_t *)egAllocate(allocator, vertex_count);
+    uint32_t *adjacency_offsets =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * (vertex_count + 1));
+    uint32_t *adjacency =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * index_count);
+    Collapse *collapses =
+        (Collapse *)egAllocate(allocator, sizeof(Collapse) * index_count);
+
+    BuildPositionRemap(allocator, vertices, vertex_count, remap);
+
+    // Positions shared by several vertices are seams, moving them would need
+    // every copy to move together
+    memset(locked, 0, vertex_count);
+    memset(wedge_count, 0, sizeof(uint32_t) * vertex_count);
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        wedge_count[remap[i]]++;
+    }
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        if (wedge_count[remap[i]] > 1) locked[i] = 1;
+    }
+
+    LockBorders(allocator, indices, index_count, remap, locked);
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        if (locked[remap[i]]) locked[i] = 1;
+    }
+
+    memset(quadrics, 0, sizeof(Quadric) * vertex_count);
+    for (size_t i = 0; i < index_count; i += 3)
+    {
+        Quadric quadric = QuadricFromTriangle(
+            vertices[indices[i + 0]].pos,
+            vertices[indices[i + 1]].pos,
+            vertices[indices[i + 2]].pos);
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            QuadricAdd(&quadrics[remap[indices[i + k]]], &quadric);
+        }
+    }
+
+    // Each pass collapses the cheapest edges that don't share a vertex, then
+    // drops the triangles that became degenerate
+    while (index_count > target_index_count)
+    {
+        memset(adjacency_offsets, 0, sizeof(uint32_t) * (vertex_count + 1));
+        for (size_t i = 0; i < index_count; ++i)
+        {
+            adjacency_offsets[indices[i] + 1]++;
+        }
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            adjacency_offsets[v + 1] += adjacency_offsets[v];
+        }
+        for (size_t i = 0; i < index_count; ++i)
+        {
+            adjacency[adjacency_offsets[indices[i]]++] = (uint32_t)(i / 3);
+        }
+        for (size_t v = vertex_count; v > 0; --v)
+        {
+            adjacency_offsets[v] = adjacency_offsets[v - 1];
+        }
+        adjacency_offsets[0] = 0;
+
+        size_t collapse_count = 0;
+        for (size_t i = 0; i < index_count; ++i)
+        {
+            uint32_t a = indices[i];
+            uint32_t b = indices[i - i % 3 + (i + 1) % 3];
+
+            Quadric quadric = quadrics[remap[a]];
+            QuadricAdd(&quadric, &quadrics[remap[b]]);
+
+            if (locked[a] && locked[b]) continue;
+
+            float3 pos_a = vertices[a].pos;
+            float3 pos_b = vertices[b].pos;
+            float error_ab = locked[a] ? INFINITY : QuadricError(&quadric, pos_b);
+            float error_ba = locked[b] ? INFINITY : QuadricError(&quadric, pos_a);
+
+            collapses[collapse_count++] = error_ab <= error_ba
+                                              ? (Collapse){a, b, error_ab}
+                                              : (Collapse){b, a, error_ba};
+        }
+
+        qsort(collapses, collapse_count, sizeof(Collapse), CompareCollapses);
+
+        for (size_t v = 0; v < vertex_count; ++v)
+        {
+            collapse[v] = (uint32_t)v;
+        }
+        memset(touched, 0, vertex_count);
+
+        // Interior collapses remove two triangles each
+        size_t removable_triangles = (index_count - target_index_count) / 3;
+        size_t removed_triangles = 0;
+        size_t performed = 0;
+
+        for (size_t i = 0; i < collapse_count && removed_triangles < removable_triangles;
+             ++i)
+        {
+            Collapse *candidate = &collapses[i];
+            if (candidate->error > error_limit) break;
+            if (touched[candidate->from] || touched[candidate->to]) continue;
+
+            if (CollapseFlips(
+                    vertices,
+                    indices,
+                    adjacency_offsets,
+                    adjacency,
+                    collapse,
+                    candidate->from,
+                    candidate->to))
+            {
+                continue;
+            }
+
+            collapse[candidate->from] = candidate->to;
+            Quadric *to_quadric = &quadrics[remap[candidate->to]];
+            QuadricAdd(to_quadric, &quadrics[remap[candidate->from]]);
+            touched[candidate->from] = 1;
+            touched[candidate->to] = 1;
+
+            max_error = EG_MAX(max_error, candidate->error);
+            removed_triangles += 2;
+            performed++;
+        }
+
+        if (performed == 0) break;
+
+        size_t write = 0;
+        for (size_t i = 0; i < index_count; i += 3)
+        {
+            uint32_t a = collapse[indices[i + 0]];
+            uint32_t b = collapse[indices[i + 1]];
+            uint32_t c = collapse[indices[i + 2]];
+            if (a == b || b == c || c == a) continue;
+
+            destination[write++] = a;
+            destination[write++] = b;
+            destination[write++] = c;
+        }
+        index_count = write;
+    }
+
+    egFree(allocator, collapses);
+    egFree(allocator, adjacency);
+    egFree(allocator, adjacency_offsets);
+    egFree(allocator, touched);
+    egFree(allocator, collapse);
+    egFree(allocator, quadrics);
+    egFree(allocator, wedge_count);
+    egFree(allocator, locked);
+    egFree(allocator, remap);
+
+    if (result_error) *result_error = sqrtf(max_error);
+    return index_count;
+}
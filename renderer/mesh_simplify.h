@@ -0,0 +1,35 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgVertex EgVertex;
+
+// Simplifies a triangle list by collapsing edges in order of their quadric
+// error (Garland and Heckbert), until at most target_index_count indices are
+// left or every remaining collapse would move the surface by more than
+// target_error, a distance in the units of the positions. Vertices are only
+// ever moved onto other vertices, so the result indexes the same vertex
+// buffer. Borders and UV or normal seams are kept as they are so LODs don't
+// open cracks.
+//
+// Writes up to index_count indices to destination and returns their count.
+// result_error (if not NULL) receives the largest error of a collapse.
+size_t egMeshSimplify(
+    EgAllocator *allocator,
+    uint32_t *destination,
+    const uint32_t *indices,
+    size_t index_count,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    size_t target_index_count,
+    float target_error,
+    float *result_error);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,285 @@
+#include "meshlet.h"
+
+#include "math.h"
+#include "allocator.h"
+#include "engine.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define EG_MESHLET_SSE
+#include <xmmintrin.h>
+#endif
+
+// A meshlet is only closed early when its vertices are full, so every meshlet
+// but the last has at least this many triangles
+#define MESHLET_MIN_TRIANGLES ((EG_MESHLET_MAX_VERTICES - 2) / 3)
+
+// Normal cones wider than this (cosine of the half angle with the axis) can't
+// cull anything useful
+#define MESHLET_CONE_MIN_DOT 0.1f
+
+size_t egMeshletBuildBound(size_t index_count)
+{
+    size_t triangle_count = index_count / 3;
+    return triangle_count / MESHLET_MIN_TRIANGLES + 1;
+}
+
+static void ComputeMeshletBounds(
+    EgMeshlet *meshlet,
+    const EgVertex *vertices,
+    const uint32_t *indices,
+    const uint32_t *meshlet_vertices,
+    size_t meshlet_vertex_count)
+{
+    float3 min = vertices[meshlet_vertices[0]].pos;
+    float3 max = min;
+    for (size_t i = 1; i < meshlet_vertex_count; ++i)
+    {
+        float3 pos = vertices[meshlet_vertices[i]].pos;
+        min = V3(EG_MIN(min.x, pos.x), EG_MIN(min.y, pos.y), EG_MIN(min.z, pos.z));
+        max = V3(EG_MAX(max.x, pos.x), EG_MAX(max.y, pos.y), EG_MAX(max.z, pos.z));
+    }
+
+    meshlet->center = egFloat3MulScalar(egFloat3Add(min, max), 0.5f);
+    meshlet->radius = 0.0f;
+    for (size_t i = 0; i < meshlet_vertex_count; ++i)
+    {
+        float3 offset = egFloat3Sub(vertices[meshlet_vertices[i]].pos, meshlet->center);
+        meshlet->radius = EG_MAX(meshlet->radius, egFloat3Length(offset));
+    }
+
+    // The cone contains the normal of every triangle, degenerate triangles
+    // face nowhere and are skipped
+    const uint32_t *triangles = &indices[meshlet->first_index];
+    size_t triangle_count = meshlet->index_count / 3;
+
+    float3 normal_sum = V3(0.0f, 0.0f, 0.0f);
+    for (size_t i = 0; i < triangle_count; ++i)
+    {
+        float3 a = vertices[triangles[i * 3 + 0]].pos;
+        float3 b = vertices[triangles[i * 3 + 1]].pos;
+        float3 c = vertices[triangles[i * 3 + 2]].pos;
+        float3 normal = egFloat3Cross(egFloat3Sub(b, a), egFloat3Sub(c, a));
+        float length = egFloat3Length(normal);
+        if (length > 0.0f)
+        {
+            normal = egFloat3MulScalar(normal, 1.0f / length);
+            normal_sum = egFloat3Add(normal_sum, normal);
+        }
+    }
+
+    meshlet->cone_axis = V3(0.0f, 0.0f, 0.0f);
+    meshlet->cone_cutoff = 1.0f;
+
+    float axis_length = egFloat3Length(normal_sum);
+    if (!(axis_length > 0.0f)) return;
+    float3 axis = egFloat3MulScalar(normal_sum, 1.0f / axis_length);
+
+    float min_dot = 1.0f;
+    for (size_t i = 0; i < triangle_count; ++i)
+    {
+        float3 a = vertices[triangles[i * 3 + 0]].pos;
+        float3 b = vertices[triangles[i * 3 + 1]].pos;
+        float3 c = vertices[triangles[i * 3 + 2]].pos;
+        float3 normal = egFloat3Cross(egFloat3Sub(b, a), egFloat3Sub(c, a));
+        float length = egFloat3Length(normal);
+        if (length > 0.0f)
+        {
+            min_dot = EG_MIN(min_dot, egFloat3Dot(normal, axis) / length);
+        }
+    }
+
+    if (min_dot <= MESHLET_CONE_MIN_DOT) return;
+
+    // Every triangle faces away when the view direction is within 90 degrees
+    // minus the cone angle of the axis, the cosine of which is the sine of
+    // the cone angle
+    meshlet->cone_axis = axis;
+    meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
+
+size_t egMeshletBuild(
+    EgAllocator *allocator,
+    EgMeshlet *meshlets,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    const uint32_t *indices,
+    size_t index_count)
+{
+    size_t triangle_count = index_count / 3;
+    if (triangle_count == 0) return 0;
+
+    // Meshlet that last used each vertex, plus one
+    uint32_t *vertex_meshlet =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * vertex_count);
+    memset(vertex_meshlet, 0, sizeof(uint32_t) * vertex_count);
+
+    uint32_t meshlet_vertices[EG_MESHLET_MAX_VERTICES];
+    size_t meshlet_vertex_count = 0;
+
+    size_t meshlet_count = 0;
+    EgMeshlet *meshlet = &meshlets[0];
+    *meshlet = (EgMeshlet){0};
+
+    for (size_t i = 0; i < triangle_count; ++i)
+    {
+        const uint32_t *triangle = &indices[i * 3];
+        uint32_t tag = (uint32_t)meshlet_count + 1;
+
+        size_t new_vertices = 0;
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            // Repeated corners of degenerate triangles count once
+            bool repeated = (k > 0 && triangle[k] == triangle[0]) ||
+                            (k > 1 && triangle[k] == triangle[1]);
+            if (vertex_meshlet[triangle[k]] != tag && !repeated) new_vertices++;
+        }
+
+        if (meshlet_vertex_count + new_vertices > EG_MESHLET_MAX_VERTICES ||
+            meshlet->index_count / 3 == EG_MESHLET_MAX_TRIANGLES)
+        {
+            ComputeMeshletBounds(
+                meshlet, vertices, indices, meshlet_vertices, meshlet_vertex_count);
+
+            meshlet_count++;
+            tag++;
+            meshlet = &meshlets[meshlet_count];
+            *meshlet = (EgMeshlet){0};
+            meshlet->first_index = (uint32_t)(i * 3);
+            meshlet_vertex_count = 0;
+        }
+
+        for (uint32_t k = 0; k < 3; ++k)
+        {
+            if (vertex_meshlet[triangle[k]] != tag)
+            {
+                vertex_meshlet[triangle[k]] = tag;
+                meshlet_vertices[meshlet_vertex_count++] = triangle[k];
+            }
+        }
+        meshlet->index_count += 3;
+    }
+
+    ComputeMeshletBounds(
+        meshlet, vertices, indices, meshlet_vertices, meshlet_vertex_count);
+    meshlet_count++;
+
+    egFree(allocator, vertex_meshlet);
+
+    EG_ASSERT(meshlet_count <= egMeshletBuildBound(index_count));
+    return meshlet_count;
+}
+
+static void SetPlane(EgMeshletCuller *culler, uint32_t index, float4 plane)
+{
+    float length = sqrtf(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+    if (length > 0.0f)
+    {
+        plane = egFloat4MulScalar(plane, 1.0f / length);
+    }
+    else
+    {
+        // Planes at infinity, such as the far plane of a reversed Z
+        // projection, contain everything
+        plane = V4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    culler->plane_x[index] = plane.x;
+    culler->plane_y[index] = plane.y;
+    culler->plane_z[index] = plane.z;
+    culler->plane_w[index] = plane.w;
+}
+
+void egMeshletCullerInit(
+    EgMeshletCuller *culler, const float4x4 *model_view_proj, float3 camera_pos)
+{
+    // Rows of the matrix, which is stored by columns
+    const float *m = &model_view_proj->xx;
+    float4 rows[4];
+    for (uint32_t r = 0; r < 4; ++r)
+    {
+        rows[r] = V4(m[r], m[4 + r], m[8 + r], m[12 + r]);
+    }
+
+    // Gribb and Hartmann: -w <= x <= w, -w <= y <= w, 0 <= z <= w
+    SetPlane(culler, 0, egFloat4Add(rows[3], rows[0]));
+    SetPlane(culler, 1, egFloat4Sub(rows[3], rows[0]));
+    SetPlane(culler, 2, egFloat4Add(rows[3], rows[1]));
+    SetPlane(culler, 3, egFloat4Sub(rows[3], rows[1]));
+    SetPlane(culler, 4, rows[2]);
+    SetPlane(culler, 5, egFloat4Sub(rows[3], rows[2]));
+    SetPlane(culler, 6, V4(0.0f, 0.0f, 0.0f, 1.0f));
+    SetPlane(culler, 7, V4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    culler->camera_pos = camera_pos;
+}
+
+static bool MeshletFacesCamera(const EgMeshletCuller *culler, const EgMeshlet *meshlet)
+{
+    float3 view = egFloat3Sub(meshlet->center, culler->camera_pos);
+    return egFloat3Dot(view, meshlet->cone_axis) <
+           meshlet->cone_cutoff * egFloat3Length(view) + meshlet->radius;
+}
+
+size_t egMeshletCull(
+    const EgMeshletCuller *culler,
+    const EgMeshlet *meshlets,
+    size_t meshlet_count,
+    uint8_t *visible)
+{
+    size_t visible_count = 0;
+
+#if defined(EG_MESHLET_SSE)
+    const __m128 plane_x0 = _mm_loadu_ps(&culler->plane_x[0]);
+    const __m128 plane_y0 = _mm_loadu_ps(&culler->plane_y[0]);
+    const __m128 plane_z0 = _mm_loadu_ps(&culler->plane_z[0]);
+    const __m128 plane_w0 = _mm_loadu_ps(&culler->plane_w[0]);
+    const __m128 plane_x1 = _mm_loadu_ps(&culler->plane_x[4]);
+    const __m128 plane_y1 = _mm_loadu_ps(&culler->plane_y[4]);
+    const __m128 plane_z1 = _mm_loadu_ps(&culler->plane_z[4]);
+    const __m128 plane_w1 = _mm_loadu_ps(&culler->plane_w[4]);
+
+    for (size_t i = 0; i < meshlet_count; ++i)
+    {
+        const EgMeshlet *meshlet = &meshlets[i];
+        __m128 x = _mm_set1_ps(meshlet->center.x);
+        __m128 y = _mm_set1_ps(meshlet->center.y);
+        __m128 z = _mm_set1_ps(meshlet->center.z);
+        __m128 neg_radius = _mm_set1_ps(-meshlet->radius);
+
+        // Signed distance of the center to all eight planes
+        __m128 distance0 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(plane_x0, x), _mm_mul_ps(plane_y0, y)),
+            _mm_add_ps(_mm_mul_ps(plane_z0, z), plane_w0));
+        __m128 distance1 = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(plane_x1, x), _mm_mul_ps(plane_y1, y)),
+            _mm_add_ps(_mm_mul_ps(plane_z1, z), plane_w1));
+
+        __m128 outside = _mm_or_ps(
+            _mm_cmplt_ps(distance0, neg_radius), _mm_cmplt_ps(distance1, neg_radius));
+
+        bool is_visible =
+            _mm_movemask_ps(outside) == 0 && MeshletFacesCamera(culler, meshlet);
+        visible[i] = is_visible;
+        visible_count += is_visible;
+    }
+#else
+    for (size_t i = 0; i < meshlet_count; ++i)
+    {
+        const EgMeshlet *meshlet = &meshlets[i];
+        bool is_visible = true;
+        for (uint32_t p = 0; p < 8; ++p)
+        {
+            float distance = culler->plane_x[p] * meshlet->center.x +
+                             culler->plane_y[p] * meshlet->center.y +
+                             culler->plane_z[p] * meshlet->center.z + culler->plane_w[p];
+            if (distance < -meshlet->radius) is_visible = false;
+        }
+
+        is_visible = is_visible && MeshletFacesCamera(culler, meshlet);
+        visible[i] = is_visible;
+        visible_count += is_visible;
+    }
+#endif
+
+    return visible_count;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgVertex EgVertex;
+
+#define EG_MESHLET_MAX_VERTICES 64
+#define EG_MESHLET_MAX_TRIANGLES 124
+
+// A run of consecutive triangles in a primitive's index buffer, so visible
+// neighbours can still be drawn with a single call. Bounds are in model space.
+typedef struct EgMeshlet
+{
+    float3 center;
+    float radius;
+    // Every triangle faces away from cameras where
+    // dot(center - camera, cone_axis) >= cone_cutoff * length(center - camera) + radius,
+    // a zero axis with a cutoff of 1 never passes
+    float3 cone_axis;
+    float cone_cutoff;
+    uint32_t first_index; // Relative to the primitive
+    uint32_t index_count;
+} EgMeshlet;
+
+// Upper bound on the number of meshlets egMeshletBuild writes
+size_t egMeshletBuildBound(size_t index_count);
+
+// Splits a triangle list in meshlets of at most EG_MESHLET_MAX_VERTICES
+// vertices and EG_MESHLET_MAX_TRIANGLES triangles, keeping the triangle order
+// so the vertex cache optimization still applies. Returns the meshlet count.
+size_t egMeshletBuild(
+    EgAllocator *allocator,
+    EgMeshlet *meshlets,
+    const EgVertex *vertices,
+    size_t vertex_count,
+    const uint32_t *indices,
+    size_t index_count);
+
+typedef struct EgMeshletCuller
+{
+    // Frustum planes in model space, normalized and split in two groups of
+    // four so each group is tested at once
+    float plane_x[8];
+    float plane_y[8];
+    float plane_z[8];
+    float plane_w[8];
+    float3 camera_pos;
+} EgMeshletCuller;
+
+// model_view_proj maps model space to clip space with a [0, 1] depth range,
+// camera_pos is in model space
+void egMeshletCullerInit(
+    EgMeshletCuller *culler, const float4x4 *model_view_proj, float3 camera_pos);
+
+// Sets visible[i] to 1 for the meshlets that are at least partly inside the
+// frustum and have triangles facing the camera, 0 otherwise. Returns the
+// number of visible meshlets.
+size_t egMeshletCull(
+    const EgMeshletCuller *culler,
+    const EgMeshlet *meshlets,
+    size_t meshlet_count,
+    uint8_t *visible);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,238 @@
+#include "mipmap.h"
+
+#include <math.h>
+#include "allocator.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EG_MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+// Taps on each side of the destination texel center, in source texels
+#define KAISER_RADIUS 4
+#define KAISER_BETA 4.0f
+
+uint32_t egMipCount(uint32_t width, uint32_t height)
+{
+    uint32_t max_extent = width > height ? width : height;
+    uint32_t count = 1;
+    while (max_extent > 1)
+    {
+        max_extent >>= 1;
+        count++;
+    }
+    return count;
+}
+
+uint32_t egMipExtent(uint32_t extent, uint32_t level)
+{
+    extent >>= level;
+    return extent > 0 ? extent : 1;
+}
+
+static void BoxTexel(
+    const uint8_t *row0,
+    const uint8_t *row1,
+    uint32_t x0,
+    uint32_t x1,
+    uint8_t *dst)
+{
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        uint32_t sum = (uint32_t)row0[x0 * 4 + c] + (uint32_t)row0[x1 * 4 + c] +
+                       (uint32_t)row1[x0 * 4 + c] + (uint32_t)row1[x1 * 4 + c];
+        dst[c] = (uint8_t)((sum + 2) / 4);
+    }
+}
+
+static void DownsampleBox(
+    const uint8_t *src, uint32_t src_width, uint32_t src_height, uint8_t *dst)
+{
+    uint32_t dst_width = egMipExtent(src_width, 1);
+    uint32_t dst_height = egMipExtent(src_height, 1);
+
+    for (uint32_t y = 0; y < dst_height; ++y)
+    {
+        uint32_t y0 = y * 2;
+        uint32_t y1 = src_height > 1 ? y0 + 1 : y0;
+        const uint8_t *row0 = &src[(size_t)y0 * src_width * 4];
+        const uint8_t *row1 = &src[(size_t)y1 * src_width * 4];
+        uint8_t *dst_row = &dst[(size_t)y * dst_width * 4];
+
+        uint32_t x = 0;
+
+        if (src_width > 1)
+        {
+#if defined(EG_MIPMAP_SSE2)
+            // Two destination texels per iteration, from 4x2 source texels
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i rounding = _mm_set1_epi16(2);
+            for (; x + 2 <= dst_width; x += 2)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i *)&row0[x * 8]);
+                __m128i b = _mm_loadu_si128((const __m128i *)&row1[x * 8]);
+
+                // Vertical sums, texels 0 and 1 in lo, 2 and 3 in hi
+                __m128i lo = _mm_add_epi16(
+                    _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i hi = _mm_add_epi16(
+                    _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+
+                // Horizontal sums of each pair
+                __m128i sum = _mm_add_epi16(
+                    _mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+                sum = _mm_srli_epi16(_mm_add_epi16(sum, rounding), 2);
+
+                _mm_storel_epi64((__m128i *)&dst_row[x * 4], _mm_packus_epi16(sum, zero));
+            }
+#endif
+            for (; x < dst_width; ++x)
+            {
+                BoxTexel(row0, row1, x * 2, x * 2 + 1, &dst_row[x * 4]);
+            }
+        }
+        else
+        {
+            BoxTexel(row0, row1, 0, 0, &dst_row[0]);
+        }
+    }
+}
+
+// Zeroth order modified Bessel function of the first kind
+static float BesselI0(float x)
+{
+    float sum = 1.0f;
+    float term = 1.0f;
+    float half_x = x * 0.5f;
+    for (uint32_t k = 1; k < 16; ++k)
+    {
+        term *= (half_x / (float)k) * (half_x / (float)k);
+        sum += term;
+    }
+    return sum;
+}
+
+static void KaiserWeights(float weights[KAISER_RADIUS * 2])
+{
+    const float pi = 3.14159265358979f;
+
+    float total = 0.0f;
+    for (int32_t i = 0; i < KAISER_RADIUS * 2; ++i)
+    {
+        // Distance from the destination texel center, in source texels
+        float d = (float)(i - KAISER_RADIUS) + 0.5f;
+
+        // Low pass at half the source frequency
+        float x = d * 0.5f;
+        float sinc = sinf(pi * x) / (pi * x);
+
+        float t = d / (float)KAISER_RADIUS;
+        float window = BesselI0(KAISER_BETA * sqrtf(fmaxf(1.0f - t * t, 0.0f))) /
+                       BesselI0(KAISER_BETA);
+
+        weights[i] = sinc * window;
+        total += weights[i];
+    }
+
+    for (int32_t i = 0; i < KAISER_RADIUS * 2; ++i)
+    {
+        weights[i] /= total;
+    }
+}
+
+static int32_t ClampIndex(int32_t i, uint32_t extent)
+{
+    if (i < 0) return 0;
+    if (i >= (int32_t)extent) return (int32_t)extent - 1;
+    return i;
+}
+
+static void DownsampleKaiser(
+    EgAllocator *allocator,
+    const uint8_t *src,
+    uint32_t src_width,
+    uint32_t src_height,
+    uint8_t *dst)
+{
+    uint32_t dst_width = egMipExtent(src_width, 1);
+    uint32_t dst_height = egMipExtent(src_height, 1);
+
+    float weights[KAISER_RADIUS * 2];
+    KaiserWeights(weights);
+
+    // Separable: filter rows into a dst_width x src_height buffer first
+    float *tmp = (float *)egAllocate(
+        allocator, sizeof(float) * 4 * (size_t)dst_width * (size_t)src_height);
+
+    for (uint32_t y = 0; y < src_height; ++y)
+    {
+        const uint8_t *src_row = &src[(size_t)y * src_width * 4];
+        float *tmp_row = &tmp[(size_t)y * dst_width * 4];
+
+        for (uint32_t x = 0; x < dst_width; ++x)
+        {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            int32_t first = (int32_t)(x * 2) + 1 - KAISER_RADIUS;
+            for (int32_t i = 0; i < KAISER_RADIUS * 2; ++i)
+            {
+                const uint8_t *texel = &src_row[ClampIndex(first + i, src_width) * 4];
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    sum[c] += weights[i] * (float)texel[c];
+                }
+            }
+
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                tmp_row[x * 4 + c] = sum[c];
+            }
+        }
+    }
+
+    for (uint32_t y = 0; y < dst_height; ++y)
+    {
+        int32_t first = (int32_t)(y * 2) + 1 - KAISER_RADIUS;
+        uint8_t *dst_row = &dst[(size_t)y * dst_width * 4];
+
+        for (uint32_t x = 0; x < dst_width; ++x)
+        {
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for (int32_t i = 0; i < KAISER_RADIUS * 2; ++i)
+            {
+                size_t row = (size_t)ClampIndex(first + i, src_height);
+                const float *texel = &tmp[(row * dst_width + x) * 4];
+                for (uint32_t c = 0; c < 4; ++c)
+                {
+                    sum[c] += weights[i] * texel[c];
+                }
+            }
+
+            // The negative lobes can overshoot
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                float value = sum[c] + 0.5f;
+                value = value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+                dst_row[x * 4 + c] = (uint8_t)value;
+            }
+        }
+    }
+
+    egFree(allocator, tmp);
+}
+
+void egDownsampleRGBA8(
+    EgAllocator *allocator,
+    EgMipFilter filter,
+    const uint8_t *src,
+    uint32_t src_width,
+    uint32_t src_height,
+    uint8_t *dst)
+{
+    switch (filter)
+    {
+    case EG_MIP_FILTER_BOX: DownsampleBox(src, src_width, src_height, dst); break;
+    case EG_MIP_FILTER_KAISER:
+        DownsampleKaiser(allocator, src, src_width, src_height, dst);
+        break;
+    }
+}
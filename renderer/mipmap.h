@@ -0,0 +1,36 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+
+typedef enum EgMipFilter
+{
+    // 2x2 average, cheap and free of ringing, suited to normal and data maps
+    EG_MIP_FILTER_BOX,
+    // Kaiser windowed sinc, keeps color textures sharper at a higher cost
+    EG_MIP_FILTER_KAISER,
+} EgMipFilter;
+
+// Number of levels in a full mip chain
+uint32_t egMipCount(uint32_t width, uint32_t height);
+uint32_t egMipExtent(uint32_t extent, uint32_t level);
+
+// CPU fallback for when the GPU can't blit a format with linear filtering.
+// Writes the next level of an RGBA8 image, half the size (at least 1) on each
+// axis, to dst.
+void egDownsampleRGBA8(
+    EgAllocator *allocator,
+    EgMipFilter filter,
+    const uint8_t *src,
+    uint32_t src_width,
+    uint32_t src_height,
+    uint8_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
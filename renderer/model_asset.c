@@ -9,25 +9,92 @@
 #include "array.h"
 #include "allocator.h"
 #include "engine.h"
+#include "frame_allocator.h"
 #include "mesh.h"
-#include "buffer_pool.h"
 #include "camera.h"
+#include "job_system.h"
+#include "thread.h"
+#include "mipmap.h"
+#include "texture_compression.h"
+#include "ktx2.h"
+#include "file_map.h"
+#include "model_file.h"
+#include "model_asset_internal.h"
+#include "asset_cache.h"
+#include "vertex_format.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "animation.h"
+#include "skinning.h"
+
+enum {
+    MAX_RECORDING_THREADS = 8,
+    FRAMES_IN_FLIGHT = 2,
+    // Smaller primitives aren't worth simplifying
+    LOD_MIN_TRIANGLES = 128,
+};
+
+// The chain stops once a collapse would move the surface by more than this
+// fraction of the primitive radius, or a level keeps more than
+// LOD_MAX_TRIANGLE_RATIO of the triangles of the previous one
+#define LOD_MAX_RELATIVE_ERROR 0.05f
+#define LOD_MAX_TRIANGLE_RATIO 0.8f
+// Largest error, in pixels, a LOD can show on screen
+#define LOD_MAX_PIXEL_ERROR 1.0f
+
+// Draws skinned meshes in their bind pose, straight from the vertex buffer
+#define NO_SKINNED_VERTICES UINT32_MAX
+
+typedef struct QueuedDraw
+{
+    EgModelAsset *model;
+    float4x4 transform;
+    // Of the instance in the skinned vertex buffer, or NO_SKINNED_VERTICES
+    uint32_t skinned_first_vertex;
+} QueuedDraw;
 
 struct EgModelManager
 {
     EgAllocator *allocator;
     EgEngine *engine;
 
-    EgBufferPool *camera_buffer_pool;
-    EgBufferPool *model_buffer_pool;
-    EgBufferPool *material_buffer_pool;
+    // One per uniform type, so allocations are aligned to their own stride
+    // and the shaders index them as structured buffers
+    EgFrameAllocator *camera_uniforms;
+    EgFrameAllocator *model_uniforms;
+    EgFrameAllocator *material_uniforms;
 
+    uint32_t current_camera_buffer_index;
     uint32_t current_camera_index;
+    // Of the current camera, for meshlet culling and LOD selection
+    float4x4 view_proj;
+    float4 camera_pos;
+    // Pixels covered by an error of one unit at a distance of one unit
+    float lod_scale;
+
+    // Each recording slice gets its own command pool per frame in flight,
+    // command pools can't be used from more than one thread at a time
+    uint32_t thread_count;
+    uint32_t frame_index;
+    RgCmdPool *cmd_pools[FRAMES_IN_FLIGHT][MAX_RECORDING_THREADS];
+    RgCmdBuffer *secondary_cmd_buffers[FRAMES_IN_FLIGHT][MAX_RECORDING_THREADS];
+
+    EgArray(QueuedDraw) queued_draws;
+
+    EgArray(EgModelAsset *) loading_models;
+
+    // Skinned draws past its limits fall back to the bind pose
+    EgSkinningManager *skinning;
 };
 
 typedef struct ModelUniform
 {
     float4x4 transform;
+    // Dequantization of EgCompactVertex, see EgVertexQuantization
+    float4 position_offset;
+    float4 position_scale;
+    float4 uv_offset_scale;
 } ModelUniform;
 
 typedef struct MaterialUniform
@@ -46,6 +113,8 @@ typedef struct MaterialUniform
     uint32_t occlusion_image_index;
     uint32_t emissive_image_index;
     uint32_t brdf_image_index;
+
+    uint32_t is_normal_two_channel;
 } MaterialUniform;
 
 typedef enum ModelType {
@@ -61,6 +130,8 @@ typedef struct Material
     float metallic;
     float roughness;
     uint32_t is_normal_mapped;
+    // The normal map only stores X and Y, Z gets reconstructed in the shader
+    uint32_t is_normal_two_channel;
 
     EgSampler sampler;
 
@@ -71,43 +142,33 @@ typedef struct Material
     EgImage emissive_image;
 } Material;
 
-typedef struct Primitive
-{
-    uint32_t first_index;
-    uint32_t index_count;
-    uint32_t vertex_count;
-    int32_t material_index;
-    bool has_indices;
-    bool is_normal_mapped;
-} Primitive;
-
-typedef struct ModelMesh
-{
-    EgArray(Primitive) primitives;
-} ModelMesh;
-
-typedef struct Node
+// Skeleton and animations of a skinned glTF model. Nodes are reordered so
+// parents come before their children, the skeleton points into the arrays.
+typedef struct ModelAnimation
 {
-    int64_t parent_index;
-    EgArray(size_t) children_indices;
+    EgSkeleton skeleton;
+    EgArray(int32_t) parents;
+    EgArray(EgJointPose) rest_pose;
+    EgArray(float4x4) node_matrices; // Empty if no node has a matrix
+    EgArray(uint32_t) joint_nodes;
+    EgArray(float4x4) inverse_bind_matrices;
 
-    float4x4 matrix;
-    float4x4 resolved_matrix;
-    int64_t mesh_index;
+    EgArray(EgCompressedAnimationClip *) clips;
+} ModelAnimation;
 
-    float3 translation;
-    float3 scale;
-    quat128 rotation;
-} Node;
+typedef struct GltfLoad GltfLoad;
 
 typedef struct EgModelAsset
 {
     EgModelManager *manager;
 
     ModelType type;
+    EgAssetStatus status;
+    GltfLoad *load; // NULL once loading has finished
 
-    RgBuffer *vertex_buffer;
-    RgBuffer *index_buffer;
+    // In the engine geometry buffers, empty until the geometry is uploaded.
+    // Models made from a mesh share the mesh's.
+    EgGeometry geometry;
 
     EgArray(Node) nodes;
     EgArray(size_t) root_nodes;
@@ -115,6 +176,13 @@ typedef struct EgModelAsset
     EgArray(Material) materials;
     EgArray(EgImage) images;
     EgArray(EgSampler) samplers;
+
+    // Only skinned models have them, their vertices are skinned per instance
+    // by egModelManagerDispatchSkinning
+    ModelAnimation *animation;
+    EgBuffer skin_buffer; // EgSkinVertex for every vertex of the geometry
+    EgArray(EgSkinningMesh) skinning_meshes;
+    uint32_t skinned_vertex_count;
 } EgModelAsset;
 
 static float4x4 NodeLocalMatrix(Node *node)
@@ -133,20 +201,34 @@ static float4x4 NodeLocalMatrix(Node *node)
     return egFloat4x4Mul(&result, &node->matrix);
 }
 
-static float4x4 NodeResolveMatrix(Node *node, EgModelAsset *model)
+static float4x4 NodeResolveMatrix(Node *node, Node *nodes)
 {
     float4x4 m = NodeLocalMatrix(node);
     int32_t p = node->parent_index;
     while (p != -1)
     {
-        float4x4 parent_local_mat = NodeLocalMatrix(&model->nodes[p]);
+        float4x4 parent_local_mat = NodeLocalMatrix(&nodes[p]);
         m = egFloat4x4Mul(&m, &parent_local_mat);
-        p = model->nodes[p].parent_index;
+        p = nodes[p].parent_index;
     }
 
     return m;
 }
 
+// Copies one element of a structured buffer to frame_allocator and returns
+// its element index
+static uint32_t PushUniform(
+    EgFrameAllocator *frame_allocator,
+    const void *data,
+    size_t size,
+    uint32_t *buffer_index)
+{
+    EgFrameAllocation allocation = egFrameAllocatorAllocate(frame_allocator, size, size);
+    memcpy(allocation.data, data, size);
+    *buffer_index = allocation.buffer_index;
+    return allocation.offset / (uint32_t)size;
+}
+
 EgModelManager *egModelManagerCreate(
     EgAllocator *allocator, EgEngine *engine, size_t model_limit, size_t material_limit)
 {
@@ -155,34 +237,125 @@ EgModelManager *egModelManagerCreate(
 
     manager->allocator = allocator;
     manager->engine = engine;
-    manager->camera_buffer_pool =
-        egBufferPoolCreate(manager->allocator, engine, sizeof(EgCameraUniform), 16);
-    manager->model_buffer_pool =
-        egBufferPoolCreate(manager->allocator, engine, sizeof(ModelUniform), model_limit);
-    manager->material_buffer_pool = egBufferPoolCreate(
-        manager->allocator, engine, sizeof(MaterialUniform), material_limit);
+    // The limits only size the first chunk of each frame, more gets allocated
+    // when a frame needs it
+    manager->camera_uniforms = egFrameAllocatorCreate(
+        allocator,
+        engine,
+        &(EgFrameAllocatorInfo){
+            .frames_in_flight = FRAMES_IN_FLIGHT,
+            .frame_size = sizeof(EgCameraUniform) * 16,
+        });
+    manager->model_uniforms = egFrameAllocatorCreate(
+        allocator,
+        engine,
+        &(EgFrameAllocatorInfo){
+            .frames_in_flight = FRAMES_IN_FLIGHT,
+            .frame_size = sizeof(ModelUniform) * EG_MAX(model_limit, 1),
+        });
+    manager->material_uniforms = egFrameAllocatorCreate(
+        allocator,
+        engine,
+        &(EgFrameAllocatorInfo){
+            .frames_in_flight = FRAMES_IN_FLIGHT,
+            .frame_size = sizeof(MaterialUniform) * EG_MAX(material_limit, 1),
+        });
+
+    RgDevice *device = egEngineGetDevice(engine);
+
+    manager->thread_count = EG_CLAMP(
+        egJobSystemGetThreadCount(egEngineGetJobSystem(engine)),
+        1,
+        (uint32_t)MAX_RECORDING_THREADS);
+    for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+    {
+        for (uint32_t t = 0; t < manager->thread_count; ++t)
+        {
+            manager->cmd_pools[f][t] = rgCmdPoolCreate(device, RG_QUEUE_TYPE_GRAPHICS);
+            manager->secondary_cmd_buffers[f][t] =
+                rgCmdBufferCreateSecondary(device, manager->cmd_pools[f][t]);
+        }
+    }
+
+    manager->queued_draws = egArrayCreate(allocator, QueuedDraw);
+    manager->loading_models = egArrayCreate(allocator, EgModelAsset *);
+
+    manager->skinning = egSkinningManagerCreate(allocator, engine);
 
     return manager;
 }
 
 void egModelManagerDestroy(EgModelManager *manager)
 {
-    egBufferPoolDestroy(manager->camera_buffer_pool);
-    egBufferPoolDestroy(manager->model_buffer_pool);
-    egBufferPoolDestroy(manager->material_buffer_pool);
+    RgDevice *device = egEngineGetDevice(manager->engine);
+
+    for (uint32_t f = 0; f < FRAMES_IN_FLIGHT; ++f)
+    {
+        for (uint32_t t = 0; t < manager->thread_count; ++t)
+        {
+            rgCmdBufferDestroy(
+                device, manager->cmd_pools[f][t], manager->secondary_cmd_buffers[f][t]);
+            rgCmdPoolDestroy(device, manager->cmd_pools[f][t]);
+        }
+    }
+
+    egArrayFree(&manager->queued_draws);
+    egArrayFree(&manager->loading_models);
+
+    egSkinningManagerDestroy(manager->skinning);
+
+    egFrameAllocatorDestroy(manager->camera_uniforms);
+    egFrameAllocatorDestroy(manager->model_uniforms);
+    egFrameAllocatorDestroy(manager->material_uniforms);
 
     egFree(manager->allocator, manager);
 }
 
+void egModelManagerGetUploadStats(EgModelManager *manager, EgFrameAllocatorStats *stats)
+{
+    EgFrameAllocator *frame_allocators[] = {
+        manager->camera_uniforms,
+        manager->model_uniforms,
+        manager->material_uniforms,
+    };
+
+    *stats = (EgFrameAllocatorStats){};
+    for (uint32_t i = 0; i < sizeof(frame_allocators) / sizeof(frame_allocators[0]); ++i)
+    {
+        EgFrameAllocatorStats allocator_stats;
+        egFrameAllocatorGetStats(frame_allocators[i], &allocator_stats);
+        stats->capacity += allocator_stats.capacity;
+        stats->frame_used += allocator_stats.frame_used;
+        stats->peak_frame_used += allocator_stats.peak_frame_used;
+        stats->chunk_count += allocator_stats.chunk_count;
+        stats->overflow_count += allocator_stats.overflow_count;
+    }
+}
+
 void
 egModelManagerBeginFrame(EgModelManager *manager, EgCameraUniform *camera_uniform)
 {
-    egBufferPoolReset(manager->camera_buffer_pool);
-    egBufferPoolReset(manager->model_buffer_pool);
-    egBufferPoolReset(manager->material_buffer_pool);
+    egFrameAllocatorNextFrame(manager->camera_uniforms);
+    egFrameAllocatorNextFrame(manager->model_uniforms);
+    egFrameAllocatorNextFrame(manager->material_uniforms);
+
+    manager->frame_index = (manager->frame_index + 1) % FRAMES_IN_FLIGHT;
+    egArrayResize(&manager->queued_draws, 0);
+
+    egSkinningManagerBeginFrame(manager->skinning);
+
+    manager->current_camera_index = PushUniform(
+        manager->camera_uniforms,
+        camera_uniform,
+        sizeof(*camera_uniform),
+        &manager->current_camera_buffer_index);
 
-    manager->current_camera_index = egBufferPoolAllocateItem(
-        manager->camera_buffer_pool, sizeof(*camera_uniform), camera_uniform);
+    manager->view_proj = egFloat4x4Mul(&camera_uniform->view, &camera_uniform->proj);
+    manager->camera_pos = camera_uniform->pos;
+
+    uint32_t width, height;
+    egEngineGetWindowSize(manager->engine, &width, &height);
+    manager->lod_scale = fabsf(camera_uniform->proj.yy) * 0.5f * (float)height;
 }
 
 static Material MaterialDefault(EgEngine *engine)
@@ -203,202 +376,558 @@ static Material MaterialDefault(EgEngine *engine)
     return material;
 }
 
-EgModelAsset *
-egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
+typedef struct DecodedImage
 {
-    EgEngine *engine = manager->engine;
-    EgAllocator *allocator = manager->allocator;
-    RgDevice *device = egEngineGetDevice(engine);
-    RgCmdPool *transfer_cmd_pool = egEngineGetTransferCmdPool(engine);
+    const uint8_t *encoded;
+    size_t encoded_size;
 
-    EgModelAsset *model = (EgModelAsset *)egAllocate(allocator, sizeof(EgModelAsset));
-    *model = (EgModelAsset){};
+    EgAllocator *allocator;
+    EgJobSystem *job_system;
+    EgAssetCache *cache; // NULL to always decode
+    EgMipFilter mip_filter;
+    // Generate the mip chain on the CPU instead of blitting it on the GPU
+    bool cpu_mipmaps;
+    // Already compressed, the levels are uploaded as they are
+    bool is_ktx2;
+    // Format PNG and JPEG images are converted to, block compressed formats
+    // require cpu_mipmaps
+    RgFormat format;
+
+    uint8_t *pixels; // RGBA8
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_count;
+    // Levels after the first, tightly packed, only used with cpu_mipmaps
+    uint8_t *mips;
+    // Every level in the block compressed format, tightly packed
+    uint8_t *compressed;
+    // Holds the levels when they were found in the cache
+    EgAssetCacheEntry cache_entry;
+
+    // Levels ready to be uploaded, they point into pixels, mips, compressed,
+    // the cache entry or the KTX2 data. Empty if decoding failed. The rest of
+    // the mip chain is generated on the GPU.
+    EgKtx2Image levels;
+
+    // Set once the decode job has finished, successfully or not
+    volatile uint32_t decoded;
+    bool uploading;
+    uint64_t upload_batch; // 0 until the upload is submitted
+    bool published;
+} DecodedImage;
+
+// State of a glTF model that is still being loaded. Parsing, image decoding
+// and geometry processing run as jobs, GPU resources are created on the main
+// thread by GltfLoadPublish.
+struct GltfLoad
+{
+    EgModelAsset *model; // NULL when cooking
+    EgAllocator *allocator;
+    EgJobSystem *job_system;
+    EgAssetCache *cache; // NULL to skip the cache
+
+    const uint8_t *data;
+    size_t size;
+    bool owns_data;
+
+    cgltf_data *gltf_data;
+    bool parse_failed;
+
+    EgJobCounter parse_counter;
+    EgJobCounter image_counter;
+
+    DecodedImage *images;
+    size_t image_count;
+    size_t published_image_count;
+    uint32_t max_mip_count;
+    bool cpu_mipmaps;
+    // Encode images to BC1, BC5 or BC7 before uploading them
+    bool compress;
+
+    MaterialImageSources *material_sources;
+    bool materials_published;
+
+    // Built by the parse job, moved into the model when published
+    EgArray(EgCompactVertex) vertices;
+    // Mix of 16 and 32-bit indices, see AppendIndices
+    EgArray(uint8_t) indices;
+    EgArray(ModelMesh) meshes;
+    EgArray(Node) nodes;
+    EgArray(size_t) root_nodes;
+    // Only for skinned models, one for each vertex
+    EgArray(EgSkinVertex) skin_vertices;
+    ModelAnimation *animation;
+    EgBuffer skin_buffer;
+    // Totals over every primitive, zero when the geometry came from the cache
+    EgMeshOptimizeStats mesh_stats;
+    EgGeometry geometry;
+    uint64_t geometry_batch;
+    bool geometry_published;
+
+    // Most recent upload batch that includes data from this load
+    uint64_t last_batch;
+};
 
-    model->manager = manager;
-    model->type = MODEL_FROM_GLTF;
+static void DecodeKtx2Image(DecodedImage *image)
+{
+    if (!egKtx2Parse(image->encoded, image->encoded_size, &image->levels))
+    {
+        image->levels.level_count = 0;
+        return;
+    }
 
-    model->nodes = egArrayCreate(allocator, Node);
-    model->root_nodes = egArrayCreate(allocator, size_t);
-    model->meshes = egArrayCreate(allocator, ModelMesh);
-    model->materials = egArrayCreate(allocator, Material);
-    model->images = egArrayCreate(allocator, EgImage);
-    model->samplers = egArrayCreate(allocator, EgSampler);
+    image->width = image->levels.width;
+    image->height = image->levels.height;
+    image->mip_count = image->levels.level_count;
+}
 
-    cgltf_options gltf_options = {};
-    gltf_options.type = cgltf_file_type_glb;
-    cgltf_data *gltf_data = NULL;
-    cgltf_result result = cgltf_parse(&gltf_options, data, size, &gltf_data);
-    if (result != cgltf_result_success)
+static void DecodeStbImage(DecodedImage *image)
+{
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t n_channels = 0;
+
+    image->pixels = stbi_load_from_memory(
+        image->encoded, (int)image->encoded_size, &width, &height, &n_channels, 4);
+    if (!image->pixels) return;
+
+    EG_ASSERT(width > 0 && height > 0 && n_channels > 0);
+    image->width = (uint32_t)width;
+    image->height = (uint32_t)height;
+    image->mip_count = egMipCount(image->width, image->height);
+
+    EgKtx2Image *levels = &image->levels;
+    levels->format = RG_FORMAT_RGBA8_UNORM;
+    levels->width = image->width;
+    levels->height = image->height;
+    levels->level_count = image->cpu_mipmaps ? image->mip_count : 1;
+    levels->levels[0].data = image->pixels;
+    levels->levels[0].size = (size_t)image->width * (size_t)image->height * 4;
+
+    if (image->cpu_mipmaps && image->mip_count > 1)
     {
-        cgltf_free(gltf_data);
-        return NULL;
+        size_t mips_size = 0;
+        for (uint32_t level = 1; level < image->mip_count; ++level)
+        {
+            mips_size += (size_t)egMipExtent(image->width, level) *
+                         (size_t)egMipExtent(image->height, level) * 4;
+        }
+
+        image->mips = (uint8_t *)egAllocate(image->allocator, mips_size);
+
+        // Each level is filtered from the previous one
+        const uint8_t *src = image->pixels;
+        uint8_t *dst = image->mips;
+        for (uint32_t level = 1; level < image->mip_count; ++level)
+        {
+            uint32_t src_width = egMipExtent(image->width, level - 1);
+            uint32_t src_height = egMipExtent(image->height, level - 1);
+            egDownsampleRGBA8(
+                image->allocator, image->mip_filter, src, src_width, src_height, dst);
+
+            levels->levels[level].data = dst;
+            levels->levels[level].size = (size_t)egMipExtent(image->width, level) *
+                                         (size_t)egMipExtent(image->height, level) * 4;
+
+            src = dst;
+            dst += levels->levels[level].size;
+        }
     }
 
-    result = cgltf_load_buffers(&gltf_options, gltf_data, NULL);
-    if (result != cgltf_result_success)
+    if (!egFormatIsBlockCompressed(image->format)) return;
+    EG_ASSERT(image->cpu_mipmaps);
+
+    size_t compressed_size = 0;
+    for (uint32_t level = 0; level < levels->level_count; ++level)
     {
-        cgltf_free(gltf_data);
-        return NULL;
+        compressed_size += egFormatImageSize(
+            image->format,
+            egMipExtent(image->width, level),
+            egMipExtent(image->height, level));
     }
 
-    egArrayResize(&model->images, gltf_data->images_count);
-    for (uint32_t i = 0; i < gltf_data->images_count; ++i)
+    image->compressed = (uint8_t *)egAllocate(image->allocator, compressed_size);
+
+    // Encoding is the slowest step, so the blocks of each level are spread over
+    // the job system as well
+    uint8_t *dst = image->compressed;
+    for (uint32_t level = 0; level < levels->level_count; ++level)
     {
-        cgltf_image *gltf_image = &gltf_data->images[i];
-        const char *mime_type = gltf_image->mime_type;
+        uint32_t level_width = egMipExtent(image->width, level);
+        uint32_t level_height = egMipExtent(image->height, level);
+        egCompressImage(
+            image->job_system,
+            image->format,
+            levels->levels[level].data,
+            level_width,
+            level_height,
+            dst);
+
+        levels->levels[level].data = dst;
+        levels->levels[level].size =
+            egFormatImageSize(image->format, level_width, level_height);
+        dst += levels->levels[level].size;
+    }
+    levels->format = image->format;
 
-        if (strcmp(mime_type, "image/png") == 0 || strcmp(mime_type, "image/jpeg") == 0)
-        {
-            cgltf_buffer *buffer = gltf_image->buffer_view->buffer;
+    // The uncompressed levels aren't needed anymore
+    stbi_image_free(image->pixels);
+    image->pixels = NULL;
+    if (image->mips)
+    {
+        egFree(image->allocator, image->mips);
+        image->mips = NULL;
+    }
+}
 
-            size_t size = gltf_image->buffer_view->size;
-            uint8_t *buffer_data =
-                (uint8_t *)buffer->data + gltf_image->buffer_view->offset;
+// Bump whenever decoding, mipmap generation or compression change their output
+#define TEXTURE_CACHE_VERSION 1
 
-            int32_t width = 0;
-            int32_t height = 0;
-            int32_t n_channels = 0;
+typedef struct TextureCacheParams
+{
+    uint32_t version;
+    uint32_t format;
+    uint32_t mip_filter;
+    uint32_t cpu_mipmaps;
+} TextureCacheParams;
 
-            uint8_t *image_data = stbi_load_from_memory(
-                buffer_data, (int)size, &width, &height, &n_channels, 4);
-            if (!image_data)
-            {
-                return NULL;
-            }
+static EgAssetCacheKey TextureCacheKey(DecodedImage *image)
+{
+    TextureCacheParams params = {
+        .version = TEXTURE_CACHE_VERSION,
+        .format = (uint32_t)image->format,
+        .mip_filter = (uint32_t)image->mip_filter,
+        .cpu_mipmaps = image->cpu_mipmaps,
+    };
+    return egAssetCacheKeyCreate(
+        "texture", image->encoded, image->encoded_size, &params, sizeof(params));
+}
 
-            EG_ASSERT(width > 0 && height > 0 && n_channels > 0);
-
-            /* uint32_t mip_count = (uint32_t)floor(log2((float)(width > height ? width :
-             * height))) + 1; */
-
-            RgImageInfo image_info = {};
-            image_info.format = RG_FORMAT_RGBA8_UNORM;
-            image_info.extent = (RgExtent3D){(uint32_t)width, (uint32_t)height, 1};
-            image_info.aspect = RG_IMAGE_ASPECT_COLOR;
-            image_info.layer_count = 1;
-            image_info.sample_count = 1;
-            image_info.mip_count = 1;
-            image_info.usage = RG_IMAGE_USAGE_SAMPLED | RG_IMAGE_USAGE_TRANSFER_DST;
-
-            model->images[i] = egEngineAllocateImage(engine, &image_info);
-
-            RgImageCopy image_copy = {};
-            image_copy.array_layer = 0;
-            image_copy.image = model->images[i].image;
-            image_copy.mip_level = 0;
-            image_copy.offset = (RgOffset3D){0, 0, 0};
-            rgImageUpload(
-                device,
-                transfer_cmd_pool,
-                &image_copy,
-                &image_info.extent,
-                (size_t)(width * height * 4),
-                image_data);
+// Cached textures are KTX2 files with the levels DecodeStbImage would produce
+static bool LoadCachedImage(DecodedImage *image)
+{
+    EgAssetCacheEntry *entry = &image->cache_entry;
+    if (!egAssetCacheLoad(image->cache, TextureCacheKey(image), entry)) return false;
 
-            stbi_image_free(image_data);
-        }
-        else
-        {
-            printf(
-                "Unsupported image format for GLTF model: %s\n", gltf_image->mime_type);
-            EG_ASSERT(0);
-        }
+    if (!egKtx2Parse(entry->data, entry->size, &image->levels))
+    {
+        egAssetCacheEntryRelease(entry);
+        image->levels.level_count = 0;
+        return false;
     }
 
-    egArrayResize(&model->samplers, gltf_data->samplers_count);
-    for (uint32_t i = 0; i < gltf_data->samplers_count; ++i)
+    image->width = image->levels.width;
+    image->height = image->levels.height;
+    image->mip_count = egMipCount(image->width, image->height);
+
+    return true;
+}
+
+static void StoreCachedImage(DecodedImage *image)
+{
+    if (image->levels.level_count == 0) return;
+
+    size_t ktx2_size = 0;
+    uint8_t *ktx2 = egKtx2Write(image->allocator, &image->levels, &ktx2_size);
+    egAssetCacheStore(image->cache, TextureCacheKey(image), ktx2, ktx2_size);
+    egFree(image->allocator, ktx2);
+}
+
+static void DecodeImageProc(void *user_data)
+{
+    DecodedImage *image = (DecodedImage *)user_data;
+
+    if (image->is_ktx2)
+    {
+        DecodeKtx2Image(image);
+    }
+    else if (!image->cache)
+    {
+        DecodeStbImage(image);
+    }
+    else if (!LoadCachedImage(image))
     {
-        cgltf_sampler gltf_sampler = gltf_data->samplers[i];
+        DecodeStbImage(image);
+        StoreCachedImage(image);
+    }
 
-        RgSamplerInfo sampler_info = {};
-        sampler_info.anisotropy = true;
-        sampler_info.max_anisotropy = 16.0;
-        sampler_info.mag_filter = RG_FILTER_LINEAR;
-        sampler_info.min_filter = RG_FILTER_LINEAR;
-        sampler_info.min_lod = 0.0f;
-        sampler_info.max_lod = 1.0f;
-        sampler_info.address_mode = RG_SAMPLER_ADDRESS_MODE_REPEAT;
-        sampler_info.border_color = RG_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    egAtomicStoreU32(&image->decoded, 1);
+}
 
-        switch (gltf_sampler.mag_filter)
-        {
-        case 0x2600: sampler_info.mag_filter = RG_FILTER_NEAREST; break;
-        case 0x2601: sampler_info.mag_filter = RG_FILTER_LINEAR; break;
-        default: break;
-        }
+// Vertices and indices of a primitive while the geometry is being built,
+// indices are relative to first_vertex
+typedef struct PrimitiveGeometry
+{
+    size_t first_vertex;
+    size_t vertex_count;
+    size_t first_index;
+    size_t index_count;
+    EgMeshOptimizeStats stats;
+    EgMeshlet *meshlets;
+    size_t meshlet_count;
+    float3 center;
+    float radius;
+    // Relative to the primitive vertices, the LODs index into it
+    EgArray(uint32_t) lod_indices;
+    uint32_t lod_count;
+    PrimitiveLod lods[MAX_PRIMITIVE_LODS];
+    // Its skins follow the vertices through the optimizer
+    bool is_skinned;
+} PrimitiveGeometry;
+
+typedef struct OptimizeGeometryJob
+{
+    EgAllocator *allocator;
+    EgVertex *vertices;
+    EgSkinVertex *skins; // NULL if no primitive is skinned
+    uint32_t *indices;
+    PrimitiveGeometry *primitives;
+} OptimizeGeometryJob;
+
+static void BuildPrimitiveLods(
+    EgAllocator *allocator,
+    PrimitiveGeometry *primitive,
+    const EgVertex *vertices,
+    const uint32_t *indices)
+{
+    primitive->lod_indices = egArrayCreate(allocator, uint32_t);
+    primitive->lod_count = 0;
+    primitive->center = V3(0.0f, 0.0f, 0.0f);
+    primitive->radius = 0.0f;
+    if (primitive->vertex_count == 0) return;
+
+    float3 min = vertices[0].pos;
+    float3 max = min;
+    for (size_t i = 1; i < primitive->vertex_count; ++i)
+    {
+        float3 pos = vertices[i].pos;
+        min = V3(EG_MIN(min.x, pos.x), EG_MIN(min.y, pos.y), EG_MIN(min.z, pos.z));
+        max = V3(EG_MAX(max.x, pos.x), EG_MAX(max.y, pos.y), EG_MAX(max.z, pos.z));
+    }
+
+    primitive->center = egFloat3MulScalar(egFloat3Add(min, max), 0.5f);
+    for (size_t i = 0; i < primitive->vertex_count; ++i)
+    {
+        float distance = egFloat3Length(egFloat3Sub(vertices[i].pos, primitive->center));
+        primitive->radius = EG_MAX(primitive->radius, distance);
+    }
+
+    if (primitive->index_count / 3 < LOD_MIN_TRIANGLES) return;
 
-        switch (gltf_sampler.min_filter)
+    // Every level is simplified from the full primitive, so its error is
+    // measured against the original surface
+    uint32_t *scratch =
+        (uint32_t *)egAllocate(allocator, sizeof(uint32_t) * primitive->index_count);
+    size_t previous_count = primitive->index_count;
+
+    while (primitive->lod_count < MAX_PRIMITIVE_LODS)
+    {
+        float error = 0.0f;
+        size_t index_count = egMeshSimplify(
+            allocator,
+            scratch,
+            indices,
+            primitive->index_count,
+            vertices,
+            primitive->vertex_count,
+            previous_count / 6 * 3,
+            primitive->radius * LOD_MAX_RELATIVE_ERROR,
+            &error);
+        if (index_count == 0 ||
+            (float)index_count > (float)previous_count * LOD_MAX_TRIANGLE_RATIO)
         {
-        case 0x2600: sampler_info.min_filter = RG_FILTER_NEAREST; break;
-        case 0x2601: sampler_info.min_filter = RG_FILTER_LINEAR; break;
-        default: break;
+            break;
         }
 
-        model->samplers[i] = egEngineAllocateSampler(engine, &sampler_info);
+        egMeshOptimizeVertexCache(
+            allocator, scratch, index_count, primitive->vertex_count);
+
+        size_t first_index = egArrayLength(primitive->lod_indices);
+        egArrayResize(&primitive->lod_indices, first_index + index_count);
+        memcpy(
+            &primitive->lod_indices[first_index],
+            scratch,
+            sizeof(uint32_t) * index_count);
+
+        primitive->lods[primitive->lod_count++] = (PrimitiveLod){
+            .first_index = (uint32_t)first_index,
+            .index_count = (uint32_t)index_count,
+            .error = error,
+        };
+        previous_count = index_count;
     }
 
-    egArrayResize(&model->materials, gltf_data->materials_count);
+    egFree(allocator, scratch);
+}
 
-    for (size_t i = 0; i < gltf_data->materials_count; ++i)
+static void OptimizeGeometryProc(void *user_data, size_t begin, size_t end)
+{
+    OptimizeGeometryJob *job = (OptimizeGeometryJob *)user_data;
+    for (size_t i = begin; i < end; ++i)
     {
-        cgltf_material gltf_material = gltf_data->materials[i];
-        EG_ASSERT(gltf_material.has_pbr_metallic_roughness);
+        PrimitiveGeometry *primitive = &job->primitives[i];
+
+        // Skins move with their vertices, and keep apart vertices that only
+        // differ in their joints or weights
+        EgSkinVertex *skins = NULL;
+        if (primitive->is_skinned) skins = &job->skins[primitive->first_vertex];
+
+        primitive->vertex_count = egMeshOptimize(
+            job->allocator,
+            &job->vertices[primitive->first_vertex],
+            skins,
+            sizeof(EgSkinVertex),
+            primitive->vertex_count,
+            &job->indices[primitive->first_index],
+            primitive->index_count,
+            &primitive->stats);
+
+        primitive->meshlets = (EgMeshlet *)egAllocate(
+            job->allocator,
+            sizeof(EgMeshlet) * egMeshletBuildBound(primitive->index_count));
+        primitive->meshlet_count = egMeshletBuild(
+            job->allocator,
+            primitive->meshlets,
+            &job->vertices[primitive->first_vertex],
+            primitive->vertex_count,
+            &job->indices[primitive->first_index],
+            primitive->index_count);
+
+        BuildPrimitiveLods(
+            job->allocator,
+            primitive,
+            &job->vertices[primitive->first_vertex],
+            &job->indices[primitive->first_index]);
+    }
+}
 
-        Material *mat = &model->materials[i];
-        *mat = MaterialDefault(engine);
+// Appends indices as 16 or 32-bit, the latter aligned to 4 bytes, and
+// returns the first one in units of index_type
+static uint32_t AppendIndices(
+    EgArray(uint8_t) * index_data,
+    const uint32_t *indices,
+    size_t index_count,
+    RgIndexType index_type)
+{
+    bool is_16_bit = index_type == RG_INDEX_TYPE_UINT16;
+    size_t index_size = is_16_bit ? sizeof(uint16_t) : sizeof(uint32_t);
 
-        if (egArrayLength(model->samplers) > 0)
-        {
-            mat->sampler = model->samplers[0];
-        }
+    size_t size = egArrayLength(*index_data);
+    size_t offset = (size + index_size - 1) & ~(index_size - 1);
+    egArrayResize(index_data, offset + index_size * index_count);
+    memset(*index_data + size, 0, offset - size);
 
-        cgltf_texture *gltf_albedo_texture =
-            gltf_material.pbr_metallic_roughness.base_color_texture.texture;
-        if (gltf_albedo_texture != NULL)
+    uint8_t *dst = *index_data + offset;
+    if (is_16_bit)
+    {
+        for (size_t k = 0; k < index_count; ++k)
         {
-            size_t image_index = (size_t)(gltf_albedo_texture->image - gltf_data->images);
-            mat->albedo_image = model->images[image_index];
+            ((uint16_t *)dst)[k] = (uint16_t)indices[k];
         }
+    }
+    else
+    {
+        memcpy(dst, indices, index_size * index_count);
+    }
 
-        cgltf_texture *gltf_normal_texture = gltf_material.normal_texture.texture;
-        if (gltf_normal_texture != NULL)
-        {
-            size_t image_index = (size_t)(gltf_normal_texture->image - gltf_data->images);
-            mat->normal_image = model->images[image_index];
-        }
+    return (uint32_t)(offset / index_size);
+}
 
-        cgltf_texture *gltf_mr_texture =
-            gltf_material.pbr_metallic_roughness.metallic_roughness_texture.texture;
-        if (gltf_mr_texture != NULL)
-        {
-            size_t image_index = (size_t)(gltf_mr_texture->image - gltf_data->images);
-            mat->metallic_roughness_image = model->images[image_index];
-        }
+// Moves the joints to the palette of the whole model, which has the joints of
+// every skin one after the other, and scales the weights to add up to 65535
+static void GltfReadSkin(
+    cgltf_accessor *joints,
+    cgltf_accessor *weights,
+    uint32_t first_joint,
+    size_t vertex_count,
+    EgSkinVertex *skins)
+{
+    for (size_t k = 0; k < vertex_count; ++k)
+    {
+        cgltf_uint joint_values[4] = {0};
+        float weight_values[4] = {0};
+        cgltf_accessor_read_uint(joints, k, joint_values, 4);
+        cgltf_accessor_read_float(weights, k, weight_values, 4);
 
-        cgltf_texture *gltf_occlusion_texture = gltf_material.occlusion_texture.texture;
-        if (gltf_occlusion_texture != NULL)
+        float sum = 0.0f;
+        for (uint32_t c = 0; c < 4; ++c)
         {
-            size_t image_index =
-                (size_t)(gltf_occlusion_texture->image - gltf_data->images);
-            mat->occlusion_image = model->images[image_index];
+            weight_values[c] = EG_MAX(weight_values[c], 0.0f);
+            sum += weight_values[c];
         }
 
-        cgltf_texture *gltf_emissive_texture = gltf_material.emissive_texture.texture;
-        if (gltf_emissive_texture != NULL)
+        int32_t total = 0;
+        uint32_t largest = 0;
+        for (uint32_t c = 0; c < 4; ++c)
         {
-            size_t image_index =
-                (size_t)(gltf_emissive_texture->image - gltf_data->images);
-            mat->emissive_image = model->images[image_index];
+            uint32_t joint = first_joint + joint_values[c];
+            skins[k].joints[c] = (uint16_t)EG_MIN(joint, UINT16_MAX);
+
+            float weight = sum > 0.0f ? weight_values[c] / sum : (c == 0 ? 1.0f : 0.0f);
+            skins[k].weights[c] = (uint16_t)lrintf(weight * 65535.0f);
+            total += skins[k].weights[c];
+            if (skins[k].weights[c] > skins[k].weights[largest]) largest = c;
         }
+
+        // Rounding leaves the sum off by a few units
+        skins[k].weights[largest] =
+            (uint16_t)((int32_t)skins[k].weights[largest] + 65535 - total);
     }
+}
+
+static void GltfBuildGeometry(GltfLoad *load)
+{
+    EgAllocator *allocator = load->allocator;
+    cgltf_data *gltf_data = load->gltf_data;
+
+    load->vertices = egArrayCreate(allocator, EgCompactVertex);
+    load->indices = egArrayCreate(allocator, uint8_t);
+    load->meshes = egArrayCreate(allocator, ModelMesh);
+    load->nodes = egArrayCreate(allocator, Node);
+    load->root_nodes = egArrayCreate(allocator, size_t);
 
+    // Full precision vertices, optimized and then compressed a mesh at a time
     EgArray(EgVertex) vertices = egArrayCreate(allocator, EgVertex);
     EgArray(uint32_t) indices = egArrayCreate(allocator, uint32_t);
+    EgArray(PrimitiveGeometry) geometry = egArrayCreate(allocator, PrimitiveGeometry);
+
+    // A mesh takes the skin of the first node that uses it with one. Skinned
+    // models keep a skin for every vertex, zero for the static meshes.
+    bool has_skins = gltf_data->skins_count > 0;
+    EgArray(EgSkinVertex) skins = egArrayCreate(allocator, EgSkinVertex);
+    EgArray(int32_t) mesh_skins = egArrayCreate(allocator, int32_t);
+    EgArray(uint32_t) skin_first_joints = egArrayCreate(allocator, uint32_t);
+
+    egArrayResize(&mesh_skins, gltf_data->meshes_count);
+    for (size_t i = 0; i < gltf_data->meshes_count; ++i)
+    {
+        mesh_skins[i] = -1;
+    }
+    for (size_t i = 0; i < gltf_data->nodes_count; ++i)
+    {
+        cgltf_node *gltf_node = &gltf_data->nodes[i];
+        if (!gltf_node->mesh || !gltf_node->skin) continue;
+
+        size_t mesh_index = (size_t)(gltf_node->mesh - gltf_data->meshes);
+        if (mesh_skins[mesh_index] == -1)
+        {
+            mesh_skins[mesh_index] = (int32_t)(gltf_node->skin - gltf_data->skins);
+        }
+    }
+
+    uint32_t joint_count = 0;
+    egArrayResize(&skin_first_joints, gltf_data->skins_count);
+    for (size_t i = 0; i < gltf_data->skins_count; ++i)
+    {
+        skin_first_joints[i] = joint_count;
+        joint_count += (uint32_t)gltf_data->skins[i].joints_count;
+    }
 
-    egArrayResize(&model->meshes, gltf_data->meshes_count);
+    egArrayResize(&load->meshes, gltf_data->meshes_count);
     for (size_t i = 0; i < gltf_data->meshes_count; ++i)
     {
         EgArray(Primitive) primitives = egArrayCreate(allocator, Primitive);
+        size_t skinned_primitive_count = 0;
 
         cgltf_mesh *gltf_mesh = &gltf_data->meshes[i];
         for (size_t j = 0; j < gltf_mesh->primitives_count; ++j)
@@ -425,6 +954,9 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
             size_t uv0_byte_stride = 0;
             uint8_t *uv0_buffer = NULL;
 
+            cgltf_accessor *joints_accessor = NULL;
+            cgltf_accessor *weights_accessor = NULL;
+
             for (size_t k = 0; k < gltf_primitive->attributes_count; ++k)
             {
                 switch (gltf_primitive->attributes[k].type)
@@ -471,6 +1003,16 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
 
                     break;
                 }
+                case cgltf_attribute_type_joints: {
+                    if (gltf_primitive->attributes[k].index == 0)
+                        joints_accessor = gltf_primitive->attributes[k].data;
+                    break;
+                }
+                case cgltf_attribute_type_weights: {
+                    if (gltf_primitive->attributes[k].index == 0)
+                        weights_accessor = gltf_primitive->attributes[k].data;
+                    break;
+                }
                 default: break;
                 }
             }
@@ -478,6 +1020,7 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
             egArrayResize(&vertices, egArrayLength(vertices) + vertex_count);
 
             EgVertex *new_vertices = &vertices[egArrayLength(vertices) - vertex_count];
+            memset(new_vertices, 0, sizeof(EgVertex) * vertex_count);
 
             for (size_t k = 0; k < vertex_count; ++k)
             {
@@ -520,6 +1063,25 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
                 }
             }
 
+            bool is_skinned = mesh_skins[i] != -1 && joints_accessor && weights_accessor;
+            if (has_skins)
+            {
+                egArrayResize(&skins, egArrayLength(vertices));
+                EgSkinVertex *new_skins = &skins[vertex_start];
+                memset(new_skins, 0, sizeof(EgSkinVertex) * vertex_count);
+
+                if (is_skinned)
+                {
+                    GltfReadSkin(
+                        joints_accessor,
+                        weights_accessor,
+                        skin_first_joints[mesh_skins[i]],
+                        vertex_count,
+                        new_skins);
+                    skinned_primitive_count++;
+                }
+            }
+
             if (has_indices)
             {
                 cgltf_accessor *accessor = gltf_primitive->indices;
@@ -540,7 +1102,7 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
                     uint32_t *buf = (uint32_t *)data_ptr;
                     for (size_t k = 0; k < index_count; ++k)
                     {
-                        new_indices[k] = buf[k] + vertex_start;
+                        new_indices[k] = buf[k];
                     }
                     break;
                 }
@@ -548,7 +1110,7 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
                     uint16_t *buf = (uint16_t *)data_ptr;
                     for (size_t k = 0; k < index_count; ++k)
                     {
-                        new_indices[k] = (uint32_t)buf[k] + vertex_start;
+                        new_indices[k] = (uint32_t)buf[k];
                     }
                     break;
                 }
@@ -556,20 +1118,41 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
                     uint8_t *buf = (uint8_t *)data_ptr;
                     for (size_t k = 0; k < index_count; ++k)
                     {
-                        new_indices[k] = (uint32_t)buf[k] + vertex_start;
+                        new_indices[k] = (uint32_t)buf[k];
                     }
                     break;
                 }
                 default: EG_ASSERT(0); break;
                 }
             }
+            else
+            {
+                // Welding needs indices, which also lets the primitive start
+                // anywhere in the vertex buffer
+                index_count = vertex_count;
+
+                egArrayResize(&indices, egArrayLength(indices) + index_count);
+                uint32_t *new_indices = &indices[egArrayLength(indices) - index_count];
+                for (size_t k = 0; k < index_count; ++k)
+                {
+                    new_indices[k] = (uint32_t)k;
+                }
+            }
+
+            PrimitiveGeometry primitive_geometry = {
+                .first_vertex = vertex_start,
+                .vertex_count = vertex_count,
+                .first_index = index_start,
+                .index_count = index_count,
+                .is_skinned = is_skinned,
+            };
+            egArrayPush(&geometry, primitive_geometry);
 
             Primitive new_primitive = {
-                .first_index = (uint32_t)index_start,
                 .index_count = (uint32_t)index_count,
                 .vertex_count = (uint32_t)vertex_count,
                 .material_index = -1,
-                .has_indices = has_indices,
+                .has_indices = true,
                 .is_normal_mapped = ((normal_buffer != NULL) && (tangent_buffer != NULL)),
             };
 
@@ -582,37 +1165,153 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
             egArrayPush(&primitives, new_primitive);
         }
 
-        model->meshes[i] = (ModelMesh){
+        // Every primitive needs joints and weights, the mesh is drawn in one
+        // piece
+        load->meshes[i] = (ModelMesh){
             .primitives = primitives,
+            .meshlets = egArrayCreate(allocator, EgMeshlet),
+            .is_skinned = skinned_primitive_count > 0 &&
+                          skinned_primitive_count == gltf_mesh->primitives_count,
         };
     }
 
-    size_t vertex_buffer_size = sizeof(EgVertex) * egArrayLength(vertices);
-    size_t index_buffer_size = sizeof(uint32_t) * egArrayLength(indices);
-    EG_ASSERT(vertex_buffer_size > 0);
+    OptimizeGeometryJob optimize_job = {
+        .allocator = allocator,
+        .vertices = vertices,
+        .skins = has_skins ? skins : NULL,
+        .indices = indices,
+        .primitives = geometry,
+    };
+    if (load->job_system)
+    {
+        egJobSystemParallelFor(
+            load->job_system,
+            egArrayLength(geometry),
+            1,
+            OptimizeGeometryProc,
+            &optimize_job);
+    }
+    else
+    {
+        OptimizeGeometryProc(&optimize_job, 0, egArrayLength(geometry));
+    }
+
+    // Welding leaves gaps after each primitive's vertices, close them while
+    // compressing the vertices of each mesh. Indices stay relative to the
+    // primitive's first vertex so most of them fit in 16 bits.
+    size_t geometry_index = 0;
+    size_t vertex_cursor = 0;
+    size_t skinned_vertex_cursor = 0;
+    for (size_t i = 0; i < egArrayLength(load->meshes); ++i)
+    {
+        ModelMesh *mesh = &load->meshes[i];
+        size_t mesh_vertex_start = vertex_cursor;
+
+        for (size_t j = 0; j < egArrayLength(mesh->primitives); ++j)
+        {
+            PrimitiveGeometry *primitive_geometry = &geometry[geometry_index++];
+            memmove(
+                &vertices[vertex_cursor],
+                &vertices[primitive_geometry->first_vertex],
+                sizeof(EgVertex) * primitive_geometry->vertex_count);
+            if (has_skins)
+            {
+                memmove(
+                    &skins[vertex_cursor],
+                    &skins[primitive_geometry->first_vertex],
+                    sizeof(EgSkinVertex) * primitive_geometry->vertex_count);
+            }
+
+            Primitive *primitive = &mesh->primitives[j];
+            primitive->first_vertex = (uint32_t)vertex_cursor;
+            primitive->vertex_count = (uint32_t)primitive_geometry->vertex_count;
+            primitive->index_type = primitive->vertex_count <= UINT16_MAX
+                                        ? RG_INDEX_TYPE_UINT16
+                                        : RG_INDEX_TYPE_UINT32;
+            primitive->first_index = AppendIndices(
+                &load->indices,
+                &indices[primitive_geometry->first_index],
+                primitive_geometry->index_count,
+                primitive->index_type);
+            vertex_cursor += primitive_geometry->vertex_count;
+
+            primitive->center = primitive_geometry->center;
+            primitive->radius = primitive_geometry->radius;
+            primitive->lod_count = primitive_geometry->lod_count;
+            for (uint32_t k = 0; k < primitive_geometry->lod_count; ++k)
+            {
+                PrimitiveLod *lod = &primitive_geometry->lods[k];
+                primitive->lods[k] = (PrimitiveLod){
+                    .first_index = AppendIndices(
+                        &load->indices,
+                        &primitive_geometry->lod_indices[lod->first_index],
+                        lod->index_count,
+                        primitive->index_type),
+                    .index_count = lod->index_count,
+                    .error = lod->error,
+                };
+            }
+            egArrayFree(&primitive_geometry->lod_indices);
+
+            primitive->first_meshlet = (uint32_t)egArrayLength(mesh->meshlets);
+            primitive->meshlet_count = (uint32_t)primitive_geometry->meshlet_count;
+            for (size_t k = 0; k < primitive_geometry->meshlet_count; ++k)
+            {
+                egArrayPush(&mesh->meshlets, primitive_geometry->meshlets[k]);
+            }
+            egFree(allocator, primitive_geometry->meshlets);
+
+            EgMeshOptimizeStats *stats = &primitive_geometry->stats;
+            load->mesh_stats.vertex_count_before += stats->vertex_count_before;
+            load->mesh_stats.vertex_count_after += stats->vertex_count_after;
+            load->mesh_stats.triangle_count += stats->triangle_count;
+            load->mesh_stats.cache_misses_before += stats->cache_misses_before;
+            load->mesh_stats.cache_misses_after += stats->cache_misses_after;
+        }
+
+        size_t mesh_vertex_count = vertex_cursor - mesh_vertex_start;
+        EgVertex *mesh_vertices = &vertices[mesh_vertex_start];
 
-    RgBufferInfo vertex_buffer_info = {};
-    vertex_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
-    vertex_buffer_info.usage = RG_BUFFER_USAGE_VERTEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    vertex_buffer_info.size = vertex_buffer_size;
-    model->vertex_buffer = rgBufferCreate(device, &vertex_buffer_info);
+        mesh->first_vertex = (uint32_t)mesh_vertex_start;
+        mesh->vertex_count = (uint32_t)mesh_vertex_count;
+        if (mesh->is_skinned)
+        {
+            mesh->first_skinned_vertex = (uint32_t)skinned_vertex_cursor;
+            skinned_vertex_cursor += mesh_vertex_count;
+        }
+
+        egVertexQuantizationCompute(
+            mesh_vertices, mesh_vertex_count, &mesh->quantization);
+
+        egArrayResize(&load->vertices, vertex_cursor);
+        egVertexCompress(
+            mesh_vertices,
+            mesh_vertex_count,
+            &mesh->quantization,
+            &load->vertices[mesh_vertex_start]);
+    }
 
-    RgBufferInfo index_buffer_info = {};
-    index_buffer_info.memory = RG_BUFFER_MEMORY_DEVICE;
-    index_buffer_info.usage = RG_BUFFER_USAGE_INDEX | RG_BUFFER_USAGE_TRANSFER_DST;
-    index_buffer_info.size = index_buffer_size;
-    model->index_buffer = rgBufferCreate(device, &index_buffer_info);
+    egArrayFree(&geometry);
+    egArrayFree(&indices);
+    egArrayFree(&vertices);
+    egArrayFree(&mesh_skins);
+    egArrayFree(&skin_first_joints);
 
-    rgBufferUpload(
-        device, transfer_cmd_pool, model->vertex_buffer, 0, vertex_buffer_size, vertices);
-    rgBufferUpload(
-        device, transfer_cmd_pool, model->index_buffer, 0, index_buffer_size, indices);
+    if (skinned_vertex_cursor > 0)
+    {
+        egArrayResize(&skins, vertex_cursor);
+        load->skin_vertices = skins;
+    }
+    else
+    {
+        egArrayFree(&skins);
+    }
 
-    egArrayResize(&model->nodes, gltf_data->nodes_count);
+    egArrayResize(&load->nodes, gltf_data->nodes_count);
     for (size_t i = 0; i < gltf_data->nodes_count; ++i)
     {
         cgltf_node *gltf_node = &gltf_data->nodes[i];
-        Node *node = &model->nodes[i];
+        Node *node = &load->nodes[i];
 
         *node = (Node){
             .parent_index = -1,
@@ -651,7 +1350,7 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
 
         if (gltf_node->has_matrix)
         {
-            memcpy(&node->matrix, gltf_node->rotation, sizeof(float) * 16);
+            memcpy(&node->matrix, gltf_node->matrix, sizeof(float) * 16);
         }
 
         if (gltf_node->mesh)
@@ -668,43 +1367,1433 @@ egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
     }
 
     // Add children / root nodes
-    for (size_t i = 0; i < egArrayLength(model->nodes); ++i)
+    for (size_t i = 0; i < egArrayLength(load->nodes); ++i)
     {
-        if (model->nodes[i].parent_index == -1)
+        if (load->nodes[i].parent_index == -1)
         {
-            egArrayPush(&model->root_nodes, i);
+            egArrayPush(&load->root_nodes, i);
         }
         else
         {
-            size_t parent_index = model->nodes[i].parent_index;
-            Node *parent = &model->nodes[parent_index];
+            size_t parent_index = load->nodes[i].parent_index;
+            Node *parent = &load->nodes[parent_index];
             egArrayPush(&parent->children_indices, i);
         }
     }
 
-    for (size_t i = 0; i < egArrayLength(model->nodes); ++i)
+    for (size_t i = 0; i < egArrayLength(load->nodes); ++i)
     {
-        model->nodes[i].resolved_matrix = NodeResolveMatrix(&model->nodes[i], model);
+        load->nodes[i].resolved_matrix = NodeResolveMatrix(&load->nodes[i], load->nodes);
     }
-
-    egArrayFree(&indices);
-    egArrayFree(&vertices);
-
-    cgltf_free(gltf_data);
-
-    return model;
 }
 
-EgModelAsset *egModelAssetFromMesh(EgModelManager *manager, EgMesh *mesh)
+static void ModelAnimationDestroy(EgAllocator *allocator, ModelAnimation *animation)
 {
-    EgAllocator *allocator = manager->allocator;
-    EgEngine *engine = manager->engine;
+    egArrayFree(&animation->parents);
+    egArrayFree(&animation->rest_pose);
+    egArrayFree(&animation->node_matrices);
+    egArrayFree(&animation->joint_nodes);
+    egArrayFree(&animation->inverse_bind_matrices);
+    for (size_t i = 0; i < egArrayLength(animation->clips); ++i)
+    {
+        egCompressedAnimationClipDestroy(animation->clips[i]);
+    }
+    egArrayFree(&animation->clips);
+    egFree(allocator, animation);
+}
+
+static bool GltfChannelSupported(cgltf_animation_channel *gltf_channel)
+{
+    switch (gltf_channel->target_path)
+    {
+    case cgltf_animation_path_type_translation:
+    case cgltf_animation_path_type_rotation:
+    case cgltf_animation_path_type_scale: break;
+    default: return false;
+    }
+
+    cgltf_animation_sampler *sampler = gltf_channel->sampler;
+    return gltf_channel->target_node && sampler && sampler->input && sampler->output &&
+           sampler->input->count > 0;
+}
+
+// The skeleton has every node of the model and a clip for every animation.
+// Morph target weights aren't animated, and cubic spline keys are sampled
+// linearly between their values. Clips are read whole and then compressed.
+static void GltfBuildAnimation(GltfLoad *load)
+{
+    EgAllocator *allocator = load->allocator;
+    cgltf_data *gltf_data = load->gltf_data;
+    size_t node_count = gltf_data->nodes_count;
+
+    ModelAnimation *animation =
+        (ModelAnimation *)egAllocate(allocator, sizeof(ModelAnimation));
+    *animation = (ModelAnimation){
+        .parents = egArrayCreate(allocator, int32_t),
+        .rest_pose = egArrayCreate(allocator, EgJointPose),
+        .node_matrices = egArrayCreate(allocator, float4x4),
+        .joint_nodes = egArrayCreate(allocator, uint32_t),
+        .inverse_bind_matrices = egArrayCreate(allocator, float4x4),
+        .clips = egArrayCreate(allocator, EgCompressedAnimationClip *),
+    };
+
+    // Depth first from the roots, every node is reached after its parent
+    EgArray(uint32_t) order = egArrayCreate(allocator, uint32_t);
+    EgArray(uint32_t) skeleton_indices = egArrayCreate(allocator, uint32_t);
+    EgArray(uint32_t) stack = egArrayCreate(allocator, uint32_t);
+    egArrayResize(&skeleton_indices, node_count);
+
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        if (!gltf_data->nodes[i].parent) egArrayPush(&stack, (uint32_t)i);
+    }
+    while (egArrayLength(stack) > 0)
+    {
+        uint32_t node_index = stack[egArrayLength(stack) - 1];
+        egArrayPop(&stack);
+
+        skeleton_indices[node_index] = (uint32_t)egArrayLength(order);
+        egArrayPush(&order, node_index);
+
+        cgltf_node *gltf_node = &gltf_data->nodes[node_index];
+        for (size_t j = 0; j < gltf_node->children_count; ++j)
+        {
+            egArrayPush(&stack, (uint32_t)(gltf_node->children[j] - gltf_data->nodes));
+        }
+    }
+    EG_ASSERT(egArrayLength(order) == node_count);
+
+    bool has_matrices = false;
+    egArrayResize(&animation->parents, node_count);
+    egArrayResize(&animation->rest_pose, node_count);
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        cgltf_node *gltf_node = &gltf_data->nodes[order[i]];
+        animation->parents[i] =
+            gltf_node->parent
+                ? (int32_t)skeleton_indices[gltf_node->parent - gltf_data->nodes]
+                : -1;
+
+        EgJointPose *pose = &animation->rest_pose[i];
+        *pose = (EgJointPose){
+            .translation = V4(0.0f, 0.0f, 0.0f, 0.0f),
+            .rotation = {0.0f, 0.0f, 0.0f, 1.0f},
+            .scale = V4(1.0f, 1.0f, 1.0f, 0.0f),
+        };
+        if (gltf_node->has_translation)
+        {
+            memcpy(&pose->translation, gltf_node->translation, sizeof(float) * 3);
+        }
+        if (gltf_node->has_rotation)
+        {
+            memcpy(&pose->rotation, gltf_node->rotation, sizeof(float) * 4);
+        }
+        if (gltf_node->has_scale)
+        {
+            memcpy(&pose->scale, gltf_node->scale, sizeof(float) * 3);
+        }
+        if (gltf_node->has_matrix) has_matrices = true;
+    }
+
+    if (has_matrices)
+    {
+        egArrayResize(&animation->node_matrices, node_count);
+        for (size_t i = 0; i < node_count; ++i)
+        {
+            cgltf_node *gltf_node = &gltf_data->nodes[order[i]];
+            animation->node_matrices[i] = egFloat4x4Diagonal(1.0f);
+            if (gltf_node->has_matrix)
+            {
+                memcpy(&animation->node_matrices[i], gltf_node->matrix, sizeof(float4x4));
+            }
+        }
+    }
+
+    for (size_t i = 0; i < gltf_data->skins_count; ++i)
+    {
+        cgltf_skin *skin = &gltf_data->skins[i];
+        for (size_t j = 0; j < skin->joints_count; ++j)
+        {
+            egArrayPush(
+                &animation->joint_nodes,
+                skeleton_indices[skin->joints[j] - gltf_data->nodes]);
+
+            float4x4 inverse_bind_matrix = egFloat4x4Diagonal(1.0f);
+            if (skin->inverse_bind_matrices)
+            {
+                cgltf_accessor_read_float(
+                    skin->inverse_bind_matrices, j, &inverse_bind_matrix.xx, 16);
+            }
+            egArrayPush(&animation->inverse_bind_matrices, inverse_bind_matrix);
+        }
+    }
+
+    // Sized up front, the channels point into the arrays
+    EgArray(EgAnimationChannel) channels = egArrayCreate(allocator, EgAnimationChannel);
+    EgArray(float) times = egArrayCreate(allocator, float);
+    EgArray(float4) values = egArrayCreate(allocator, float4);
+    size_t channel_count = 0;
+    size_t key_count = 0;
+    for (size_t i = 0; i < gltf_data->animations_count; ++i)
+    {
+        cgltf_animation *gltf_animation = &gltf_data->animations[i];
+        for (size_t j = 0; j < gltf_animation->channels_count; ++j)
+        {
+            cgltf_animation_channel *gltf_channel = &gltf_animation->channels[j];
+            if (!GltfChannelSupported(gltf_channel)) continue;
+            channel_count++;
+            key_count += gltf_channel->sampler->input->count;
+        }
+    }
+    egArrayResize(&channels, channel_count);
+    egArrayResize(&times, key_count);
+    egArrayResize(&values, key_count);
+
+    size_t channel_index = 0;
+    size_t key_index = 0;
+    for (size_t i = 0; i < gltf_data->animations_count; ++i)
+    {
+        cgltf_animation *gltf_animation = &gltf_data->animations[i];
+        EgAnimationClip clip = {
+            .channels = &channels[channel_index],
+        };
+
+        for (size_t j = 0; j < gltf_animation->channels_count; ++j)
+        {
+            cgltf_animation_channel *gltf_channel = &gltf_animation->channels[j];
+            if (!GltfChannelSupported(gltf_channel)) continue;
+
+            cgltf_animation_sampler *sampler = gltf_channel->sampler;
+            size_t channel_key_count = sampler->input->count;
+            float *channel_times = &times[key_index];
+            float4 *channel_values = &values[key_index];
+            key_index += channel_key_count;
+
+            EgAnimationPath path;
+            switch (gltf_channel->target_path)
+            {
+            case cgltf_animation_path_type_translation:
+                path = EG_ANIMATION_PATH_TRANSLATION;
+                break;
+            case cgltf_animation_path_type_rotation:
+                path = EG_ANIMATION_PATH_ROTATION;
+                break;
+            default: path = EG_ANIMATION_PATH_SCALE; break;
+            }
+
+            // Cubic spline outputs have an in-tangent, the value and an
+            // out-tangent for every key
+            bool is_cubic =
+                sampler->interpolation == cgltf_interpolation_type_cubic_spline;
+            size_t component_count = path == EG_ANIMATION_PATH_ROTATION ? 4 : 3;
+            for (size_t k = 0; k < channel_key_count; ++k)
+            {
+                channel_times[k] = 0.0f;
+                cgltf_accessor_read_float(sampler->input, k, &channel_times[k], 1);
+
+                channel_values[k] = V4(0.0f, 0.0f, 0.0f, 0.0f);
+                cgltf_accessor_read_float(
+                    sampler->output,
+                    is_cubic ? k * 3 + 1 : k,
+                    &channel_values[k].x,
+                    component_count);
+            }
+
+            channels[channel_index++] = (EgAnimationChannel){
+                .node = skeleton_indices[gltf_channel->target_node - gltf_data->nodes],
+                .path = path,
+                .interpolation = sampler->interpolation == cgltf_interpolation_type_step
+                                     ? EG_ANIMATION_INTERPOLATION_STEP
+                                     : EG_ANIMATION_INTERPOLATION_LINEAR,
+                .key_count = (uint32_t)channel_key_count,
+                .times = channel_times,
+                .values = channel_values,
+            };
+            clip.channel_count++;
+            clip.duration = EG_MAX(clip.duration, channel_times[channel_key_count - 1]);
+        }
+
+        egArrayPush(&animation->clips, egAnimationClipCompress(allocator, &clip, NULL));
+    }
+
+    egArrayFree(&channels);
+    egArrayFree(&times);
+    egArrayFree(&values);
+
+    egArrayFree(&order);
+    egArrayFree(&skeleton_indices);
+    egArrayFree(&stack);
+
+    animation->skeleton = (EgSkeleton){
+        .node_count = (uint32_t)node_count,
+        .parents = animation->parents,
+        .rest_pose = animation->rest_pose,
+        .node_matrices = has_matrices ? animation->node_matrices : NULL,
+        .joint_count = (uint32_t)egArrayLength(animation->joint_nodes),
+        .joint_nodes = animation->joint_nodes,
+        .inverse_bind_matrices = animation->inverse_bind_matrices,
+    };
+
+    load->animation = animation;
+}
+
+static int32_t GltfImageIndex(cgltf_data *gltf_data, cgltf_texture *texture)
+{
+    if (texture == NULL || texture->image == NULL) return -1;
+    return (int32_t)(texture->image - gltf_data->images);
+}
+
+static uint8_t *CookModel(GltfLoad *load, bool include_images, size_t *cooked_size);
+
+// Bump whenever GltfBuildGeometry changes its output
+#define GEOMETRY_CACHE_VERSION 7
+
+typedef struct GeometryCacheParams
+{
+    uint32_t version;
+    uint32_t vertex_size;
+} GeometryCacheParams;
+
+static EgAssetCacheKey GeometryCacheKey(GltfLoad *load)
+{
+    GeometryCacheParams params = {
+        .version = GEOMETRY_CACHE_VERSION,
+        .vertex_size = sizeof(EgCompactVertex),
+    };
+    return egAssetCacheKeyCreate(
+        "geometry", load->data, load->size, &params, sizeof(params));
+}
+
+// Cached geometry is a cooked model file without images
+static bool GltfLoadCachedGeometry(GltfLoad *load)
+{
+    if (!load->cache) return false;
+
+    EgAssetCacheEntry entry;
+    if (!egAssetCacheLoad(load->cache, GeometryCacheKey(load), &entry)) return false;
+
+    if (!egModelFileValidate(entry.data, entry.size))
+    {
+        egAssetCacheEntryRelease(&entry);
+        return false;
+    }
+
+    const EgModelFileHeader *header = (const EgModelFileHeader *)entry.data;
+
+    load->vertices = egArrayCreate(load->allocator, EgCompactVertex);
+    egArrayResize(&load->vertices, header->vertices.size / sizeof(EgCompactVertex));
+    memcpy(load->vertices, entry.data + header->vertices.offset, header->vertices.size);
+
+    load->indices = egArrayCreate(load->allocator, uint8_t);
+    egArrayResize(&load->indices, header->indices.size);
+    memcpy(load->indices, entry.data + header->indices.offset, header->indices.size);
+
+    egModelFileReadScene(
+        entry.data, load->allocator, &load->nodes, &load->root_nodes, &load->meshes);
+
+    egAssetCacheEntryRelease(&entry);
+    return true;
+}
+
+static void GltfStoreCachedGeometry(GltfLoad *load)
+{
+    if (!load->cache) return;
+
+    size_t size = 0;
+    uint8_t *data = CookModel(load, false, &size);
+    egAssetCacheStore(load->cache, GeometryCacheKey(load), data, size);
+    egFree(load->allocator, data);
+}
+
+static void GltfParseProc(void *user_data)
+{
+    GltfLoad *load = (GltfLoad *)user_data;
+    EgAllocator *allocator = load->allocator;
+
+    cgltf_options gltf_options = {};
+    gltf_options.type = cgltf_file_type_glb;
+    cgltf_result result =
+        cgltf_parse(&gltf_options, load->data, load->size, &load->gltf_data);
+    if (result == cgltf_result_success)
+    {
+        result = cgltf_load_buffers(&gltf_options, load->gltf_data, NULL);
+    }
+
+    if (result != cgltf_result_success)
+    {
+        load->parse_failed = true;
+        return;
+    }
+
+    cgltf_data *gltf_data = load->gltf_data;
+
+    load->material_sources = (MaterialImageSources *)egAllocate(
+        allocator, sizeof(MaterialImageSources) * gltf_data->materials_count);
+    for (size_t i = 0; i < gltf_data->materials_count; ++i)
+    {
+        cgltf_material *gltf_material = &gltf_data->materials[i];
+        EG_ASSERT(gltf_material->has_pbr_metallic_roughness);
+
+        cgltf_pbr_metallic_roughness *pbr = &gltf_material->pbr_metallic_roughness;
+        load->material_sources[i] = (MaterialImageSources){
+            .albedo = GltfImageIndex(gltf_data, pbr->base_color_texture.texture),
+            .normal = GltfImageIndex(gltf_data, gltf_material->normal_texture.texture),
+            .metallic_roughness =
+                GltfImageIndex(gltf_data, pbr->metallic_roughness_texture.texture),
+            .occlusion =
+                GltfImageIndex(gltf_data, gltf_material->occlusion_texture.texture),
+            .emissive =
+                GltfImageIndex(gltf_data, gltf_material->emissive_texture.texture),
+        };
+    }
+
+    load->image_count = gltf_data->images_count;
+    load->images =
+        (DecodedImage *)egAllocate(allocator, sizeof(DecodedImage) * load->image_count);
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        cgltf_image *gltf_image = &gltf_data->images[i];
+        const char *mime_type = gltf_image->mime_type;
+
+        bool is_ktx2 = strcmp(mime_type, "image/ktx2") == 0;
+        if (strcmp(mime_type, "image/png") != 0 && strcmp(mime_type, "image/jpeg") != 0 &&
+            !is_ktx2)
+        {
+            printf(
+                "Unsupported image format for GLTF model: %s\n", gltf_image->mime_type);
+            EG_ASSERT(0);
+        }
+
+        load->images[i] = (DecodedImage){
+            .encoded = (uint8_t *)gltf_image->buffer_view->buffer->data +
+                       gltf_image->buffer_view->offset,
+            .encoded_size = gltf_image->buffer_view->size,
+            .allocator = allocator,
+            .job_system = load->job_system,
+            .cache = load->cache,
+            .mip_filter = EG_MIP_FILTER_BOX,
+            .cpu_mipmaps = load->cpu_mipmaps,
+            .is_ktx2 = is_ktx2,
+            .format = RG_FORMAT_RGBA8_UNORM,
+        };
+
+        // Only the header is parsed here, samplers need the LOD range before the
+        // images are decoded
+        uint32_t mip_count = 0;
+        if (is_ktx2)
+        {
+            EgKtx2Image ktx2;
+            if (egKtx2Parse(
+                    load->images[i].encoded, load->images[i].encoded_size, &ktx2))
+            {
+                mip_count = ktx2.level_count;
+            }
+        }
+        else
+        {
+            int32_t width = 0;
+            int32_t height = 0;
+            int32_t n_channels = 0;
+            if (stbi_info_from_memory(
+                    load->images[i].encoded,
+                    (int)load->images[i].encoded_size,
+                    &width,
+                    &height,
+                    &n_channels))
+            {
+                mip_count = egMipCount((uint32_t)width, (uint32_t)height);
+            }
+        }
+        if (mip_count > load->max_mip_count) load->max_mip_count = mip_count;
+    }
+
+    // Color textures keep more detail with the sharper filter, it would ring on
+    // normal and data maps.
+    // Albedo needs alpha and the most precision so it gets BC7, normal maps only
+    // keep X and Y in BC5, and the occlusion/metallic/roughness and emissive maps
+    // are fine with BC1. Images shared between uses take the best format.
+    for (size_t i = 0; i < gltf_data->materials_count; ++i)
+    {
+        MaterialImageSources *sources = &load->material_sources[i];
+        if (sources->albedo != -1)
+        {
+            load->images[sources->albedo].mip_filter = EG_MIP_FILTER_KAISER;
+        }
+        if (sources->emissive != -1)
+        {
+            load->images[sources->emissive].mip_filter = EG_MIP_FILTER_KAISER;
+        }
+
+        if (!load->compress) continue;
+
+        int32_t data_images[] = {
+            sources->metallic_roughness, sources->occlusion, sources->emissive};
+        for (uint32_t j = 0; j < EG_CARRAY_LENGTH(data_images); ++j)
+        {
+            if (data_images[j] == -1) continue;
+            DecodedImage *image = &load->images[data_images[j]];
+            if (image->format == RG_FORMAT_RGBA8_UNORM)
+                image->format = RG_FORMAT_BC1_RGB_UNORM;
+            else if (image->format == RG_FORMAT_BC5_UNORM)
+                image->format = RG_FORMAT_BC7_UNORM;
+        }
+        if (sources->normal != -1)
+        {
+            DecodedImage *image = &load->images[sources->normal];
+            if (image->format == RG_FORMAT_RGBA8_UNORM)
+                image->format = RG_FORMAT_BC5_UNORM;
+            else if (image->format == RG_FORMAT_BC1_RGB_UNORM)
+                image->format = RG_FORMAT_BC7_UNORM;
+        }
+        if (sources->albedo != -1)
+        {
+            load->images[sources->albedo].format = RG_FORMAT_BC7_UNORM;
+        }
+    }
+
+    // Decoding dominates load time, so every image gets a job of its own and
+    // is published as soon as it's done
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        egJobSystemRun(
+            load->job_system, DecodeImageProc, &load->images[i], &load->image_counter);
+    }
+
+    // Cached geometry is a cooked model, which has no skins
+    bool is_skinned = gltf_data->skins_count > 0;
+    if (is_skinned || !GltfLoadCachedGeometry(load))
+    {
+        GltfBuildGeometry(load);
+        if (!is_skinned) GltfStoreCachedGeometry(load);
+    }
+
+    if (is_skinned) GltfBuildAnimation(load);
+}
+
+static RgFilter GltfFilter(cgltf_int filter)
+{
+    switch (filter)
+    {
+    case 0x2600: return RG_FILTER_NEAREST;
+    case 0x2601: return RG_FILTER_LINEAR;
+    default: return RG_FILTER_LINEAR;
+    }
+}
+
+static RgSamplerInfo
+ModelSamplerInfo(RgFilter mag_filter, RgFilter min_filter, uint32_t max_mip_count)
+{
+    RgSamplerInfo sampler_info = {};
+    sampler_info.anisotropy = true;
+    sampler_info.max_anisotropy = 16.0;
+    sampler_info.mag_filter = mag_filter;
+    sampler_info.min_filter = min_filter;
+    sampler_info.min_lod = 0.0f;
+    sampler_info.max_lod = (float)max_mip_count;
+    sampler_info.address_mode = RG_SAMPLER_ADDRESS_MODE_REPEAT;
+    sampler_info.border_color = RG_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    return sampler_info;
+}
+
+static void GltfPublishMaterials(GltfLoad *load)
+{
+    EgModelAsset *model = load->model;
+    EgEngine *engine = model->manager->engine;
+    cgltf_data *gltf_data = load->gltf_data;
+
+    // Images are filled in as they finish decoding
+    egArrayResize(&model->images, load->image_count);
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        model->images[i] = (EgImage){0};
+    }
+
+    egArrayResize(&model->samplers, gltf_data->samplers_count);
+    for (uint32_t i = 0; i < gltf_data->samplers_count; ++i)
+    {
+        RgSamplerInfo sampler_info = ModelSamplerInfo(
+            GltfFilter(gltf_data->samplers[i].mag_filter),
+            GltfFilter(gltf_data->samplers[i].min_filter),
+            load->max_mip_count);
+        model->samplers[i] = egEngineAllocateSampler(engine, &sampler_info);
+    }
+
+    // Materials start out with the default placeholder images
+    egArrayResize(&model->materials, gltf_data->materials_count);
+    for (size_t i = 0; i < gltf_data->materials_count; ++i)
+    {
+        Material *mat = &model->materials[i];
+        *mat = MaterialDefault(engine);
+
+        if (egArrayLength(model->samplers) > 0)
+        {
+            mat->sampler = model->samplers[0];
+        }
+    }
+
+    load->materials_published = true;
+}
+
+static void GltfPublishImage(GltfLoad *load, size_t image_index)
+{
+    EgModelAsset *model = load->model;
+    EgImage image = model->images[image_index];
+    bool is_two_channel = load->images[image_index].levels.format == RG_FORMAT_BC5_UNORM;
+
+    for (size_t i = 0; i < egArrayLength(model->materials); ++i)
+    {
+        Material *mat = &model->materials[i];
+        MaterialImageSources *sources = &load->material_sources[i];
+
+        if (sources->albedo == (int32_t)image_index) mat->albedo_image = image;
+        if (sources->normal == (int32_t)image_index)
+        {
+            mat->normal_image = image;
+            mat->is_normal_two_channel = is_two_channel;
+        }
+        if (sources->metallic_roughness == (int32_t)image_index)
+            mat->metallic_roughness_image = image;
+        if (sources->occlusion == (int32_t)image_index) mat->occlusion_image = image;
+        if (sources->emissive == (int32_t)image_index) mat->emissive_image = image;
+    }
+}
+
+// Records the uploads of every image decoded since the last update. The pixels
+// are copied to staging memory right away, the materials only switch to the
+// image once its batch has finished.
+static void GltfUploadImages(GltfLoad *load)
+{
+    EgModelAsset *model = load->model;
+    EgEngine *engine = model->manager->engine;
+    RgDevice *device = egEngineGetDevice(engine);
+    RgUploadContext *upload_context = egEngineGetUploadContext(engine);
+
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        DecodedImage *decoded = &load->images[i];
+        if (decoded->uploading || decoded->published) continue;
+        if (!egAtomicLoadU32(&decoded->decoded)) continue;
+
+        EgKtx2Image *levels = &decoded->levels;
+        if (levels->level_count == 0)
+        {
+            // Keep the placeholder if the image can't be decoded
+            fprintf(stderr, "Failed to decode GLTF image %zu\n", i);
+            decoded->published = true;
+            load->published_image_count++;
+            continue;
+        }
+
+        if (!rgDeviceSupportsSampledFormat(device, levels->format))
+        {
+            fprintf(stderr, "Unsupported format for GLTF image %zu\n", i);
+            decoded->published = true;
+            load->published_image_count++;
+            continue;
+        }
+
+        // Levels missing from the image are blitted from the ones before them
+        bool generate_mipmaps = levels->level_count < decoded->mip_count;
+
+        RgImageInfo image_info = {};
+        image_info.format = levels->format;
+        image_info.extent = (RgExtent3D){decoded->width, decoded->height, 1};
+        image_info.aspect = RG_IMAGE_ASPECT_COLOR;
+        image_info.layer_count = 1;
+        image_info.sample_count = 1;
+        image_info.mip_count = decoded->mip_count;
+        image_info.usage = RG_IMAGE_USAGE_SAMPLED | RG_IMAGE_USAGE_TRANSFER_DST;
+        if (generate_mipmaps)
+        {
+            image_info.usage |= RG_IMAGE_USAGE_TRANSFER_SRC;
+        }
+
+        model->images[i] = egEngineAllocateImage(engine, &image_info);
+
+        RgImageCopy image_copy = {};
+        image_copy.image = model->images[i].image;
+
+        for (uint32_t level = 0; level < levels->level_count; ++level)
+        {
+            RgExtent3D level_extent = {
+                egMipExtent(decoded->width, level),
+                egMipExtent(decoded->height, level),
+                1,
+            };
+
+            image_copy.mip_level = level;
+            rgUploadImage(
+                upload_context,
+                &image_copy,
+                &level_extent,
+                levels->levels[level].size,
+                levels->levels[level].data);
+        }
+
+        if (generate_mipmaps)
+        {
+            rgUploadGenerateMipmaps(upload_context, image_copy.image);
+        }
+
+        if (decoded->pixels)
+        {
+            stbi_image_free(decoded->pixels);
+            decoded->pixels = NULL;
+        }
+        if (decoded->mips)
+        {
+            egFree(decoded->allocator, decoded->mips);
+            decoded->mips = NULL;
+        }
+        if (decoded->compressed)
+        {
+            egFree(decoded->allocator, decoded->compressed);
+            decoded->compressed = NULL;
+        }
+        egAssetCacheEntryRelease(&decoded->cache_entry);
+        decoded->uploading = true;
+    }
+}
+
+// Returns false when the engine geometry buffers are full
+static bool GltfUploadGeometry(GltfLoad *load)
+{
+    EgModelAsset *model = load->model;
+    EgEngine *engine = model->manager->engine;
+    RgUploadContext *upload_context = egEngineGetUploadContext(engine);
+
+    size_t vertex_count = egArrayLength(load->vertices);
+    size_t index_size = egArrayLength(load->indices);
+    EG_ASSERT(vertex_count > 0);
+
+    if (!egEngineAllocateGeometry(engine, vertex_count, index_size, &load->geometry))
+    {
+        fprintf(stderr, "Out of geometry memory for model\n");
+        return false;
+    }
+
+    rgUploadBuffer(
+        upload_context,
+        egEngineGetVertexBuffer(engine).buffer,
+        sizeof(EgCompactVertex) * load->geometry.first_vertex,
+        sizeof(EgCompactVertex) * vertex_count,
+        load->vertices);
+    rgUploadBuffer(
+        upload_context,
+        egEngineGetIndexBuffer(engine),
+        load->geometry.index_offset,
+        index_size,
+        load->indices);
+
+    // Skins are only read by the skinning pass, so they get a buffer of their
+    // own instead of growing every vertex
+    size_t skin_count = egArrayLength(load->skin_vertices);
+    if (skin_count > 0)
+    {
+        EG_ASSERT(skin_count == vertex_count);
+        RgBufferInfo buffer_info = {
+            .size = sizeof(EgSkinVertex) * skin_count,
+            .usage = RG_BUFFER_USAGE_STORAGE | RG_BUFFER_USAGE_TRANSFER_DST,
+            .memory = RG_BUFFER_MEMORY_DEVICE,
+        };
+        load->skin_buffer = egEngineAllocateStorageBuffer(engine, &buffer_info);
+        rgUploadBuffer(
+            upload_context,
+            load->skin_buffer.buffer,
+            0,
+            buffer_info.size,
+            load->skin_vertices);
+    }
+
+    egArrayFree(&load->vertices);
+    egArrayFree(&load->indices);
+    egArrayFree(&load->skin_vertices);
+    return true;
+}
+
+static void GltfPublishGeometry(GltfLoad *load)
+{
+    EgModelAsset *model = load->model;
+
+    // The model only becomes renderable once its buffers are uploaded
+    egArrayFree(&model->meshes);
+    egArrayFree(&model->nodes);
+    egArrayFree(&model->root_nodes);
+    model->meshes = load->meshes;
+    model->nodes = load->nodes;
+    model->root_nodes = load->root_nodes;
+    load->meshes = NULL;
+    load->nodes = NULL;
+    load->root_nodes = NULL;
+
+    model->geometry = load->geometry;
+    load->geometry = (EgGeometry){};
+
+    model->animation = load->animation;
+    model->skin_buffer = load->skin_buffer;
+    load->animation = NULL;
+    load->skin_buffer = (EgBuffer){};
+
+    // What the skinning manager needs of each skinned mesh, for every instance
+    egArrayResize(&model->skinning_meshes, 0);
+    model->skinned_vertex_count = 0;
+    if (model->skin_buffer.buffer)
+    {
+        for (size_t i = 0; i < egArrayLength(model->meshes); ++i)
+        {
+            ModelMesh *mesh = &model->meshes[i];
+            if (!mesh->is_skinned) continue;
+
+            EgSkinningMesh skinning_mesh = {
+                .position_offset = mesh->quantization.position_offset,
+                .position_scale = mesh->quantization.position_scale,
+                .first_vertex = model->geometry.first_vertex + mesh->first_vertex,
+                .vertex_count = mesh->vertex_count,
+                .first_skin_vertex = mesh->first_vertex,
+                .output_offset = mesh->first_skinned_vertex,
+            };
+            egArrayPush(&model->skinning_meshes, skinning_mesh);
+            model->skinned_vertex_count += mesh->vertex_count;
+        }
+    }
+
+    load->geometry_published = true;
+}
+
+static void GltfLoadFree(GltfLoad *load)
+{
+    EgAllocator *allocator = load->allocator;
+
+    // Outstanding jobs still reference the load
+    egJobSystemWait(load->job_system, &load->parse_counter);
+    egJobSystemWait(load->job_system, &load->image_counter);
+
+    // Pending uploads may still write to the geometry and the skin buffer,
+    // which only exist if the load belongs to a model
+    if (load->geometry.vertex_count > 0 || load->skin_buffer.buffer)
+    {
+        rgDeviceWaitIdle(egEngineGetDevice(load->model->manager->engine));
+    }
+    if (load->geometry.vertex_count > 0)
+    {
+        egEngineFreeGeometry(load->model->manager->engine, &load->geometry);
+    }
+    if (load->skin_buffer.buffer)
+    {
+        egEngineFreeStorageBuffer(load->model->manager->engine, &load->skin_buffer);
+    }
+    if (load->animation) ModelAnimationDestroy(allocator, load->animation);
+
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        if (load->images[i].pixels) stbi_image_free(load->images[i].pixels);
+        if (load->images[i].mips) egFree(allocator, load->images[i].mips);
+        if (load->images[i].compressed) egFree(allocator, load->images[i].compressed);
+        egAssetCacheEntryRelease(&load->images[i].cache_entry);
+    }
+    if (load->images) egFree(allocator, load->images);
+    if (load->material_sources) egFree(allocator, load->material_sources);
+
+    for (size_t i = 0; i < egArrayLength(load->nodes); ++i)
+    {
+        egArrayFree(&load->nodes[i].children_indices);
+    }
+    for (size_t i = 0; i < egArrayLength(load->meshes); ++i)
+    {
+        egArrayFree(&load->meshes[i].primitives);
+        egArrayFree(&load->meshes[i].meshlets);
+    }
+    egArrayFree(&load->vertices);
+    egArrayFree(&load->indices);
+    egArrayFree(&load->skin_vertices);
+    egArrayFree(&load->meshes);
+    egArrayFree(&load->nodes);
+    egArrayFree(&load->root_nodes);
+
+    if (load->gltf_data) cgltf_free(load->gltf_data);
+    if (load->owns_data) egFree(allocator, (void *)load->data);
+
+    egFree(allocator, load);
+}
+
+// Creates the GPU resources for everything the jobs have finished so far and
+// publishes the ones whose uploads completed. Never blocks.
+// Returns true once the load is complete, successfully or not.
+static bool GltfLoadPublish(GltfLoad *load)
+{
+    EgModelAsset *model = load->model;
+    RgUploadContext *upload_context = egEngineGetUploadContext(model->manager->engine);
+
+    if (!egJobCounterIsDone(&load->parse_counter)) return false;
+
+    if (load->parse_failed)
+    {
+        model->status = EG_ASSET_STATUS_FAILED;
+        return true;
+    }
+
+    if (!load->materials_published)
+    {
+        GltfPublishMaterials(load);
+    }
+
+    // Everything recorded during this update goes out in a single batch
+    bool upload_geometry = load->geometry.vertex_count == 0 && !load->geometry_published;
+    if (upload_geometry && !GltfUploadGeometry(load))
+    {
+        model->status = EG_ASSET_STATUS_FAILED;
+        return true;
+    }
+
+    if (load->published_image_count < load->image_count)
+    {
+        GltfUploadImages(load);
+    }
+
+    uint64_t batch = rgUploadContextSubmit(upload_context);
+    load->last_batch = batch;
+
+    if (upload_geometry)
+    {
+        load->geometry_batch = batch;
+    }
+
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        DecodedImage *decoded = &load->images[i];
+        if (decoded->uploading && decoded->upload_batch == 0)
+        {
+            decoded->upload_batch = batch;
+        }
+    }
+
+    if (!load->geometry_published &&
+        rgUploadContextIsComplete(upload_context, load->geometry_batch))
+    {
+        GltfPublishGeometry(load);
+    }
+
+    for (size_t i = 0; i < load->image_count; ++i)
+    {
+        DecodedImage *decoded = &load->images[i];
+        if (decoded->uploading &&
+            rgUploadContextIsComplete(upload_context, decoded->upload_batch))
+        {
+            GltfPublishImage(load, i);
+            decoded->uploading = false;
+            decoded->published = true;
+            load->published_image_count++;
+        }
+    }
+
+    if (!load->geometry_published) return false;
+    if (load->published_image_count < load->image_count) return false;
+
+    model->status = EG_ASSET_STATUS_READY;
+    return true;
+}
+
+static EgModelAsset *GltfLoadStart(
+    EgModelManager *manager, const uint8_t *data, size_t size, bool owns_data)
+{
+    EgAllocator *allocator = manager->allocator;
+
+    EgModelAsset *model = (EgModelAsset *)egAllocate(allocator, sizeof(EgModelAsset));
+    *model = (EgModelAsset){};
+
+    model->manager = manager;
+    model->type = MODEL_FROM_GLTF;
+    model->status = EG_ASSET_STATUS_LOADING;
+
+    model->nodes = egArrayCreate(allocator, Node);
+    model->root_nodes = egArrayCreate(allocator, size_t);
+    model->meshes = egArrayCreate(allocator, ModelMesh);
+    model->materials = egArrayCreate(allocator, Material);
+    model->images = egArrayCreate(allocator, EgImage);
+    model->samplers = egArrayCreate(allocator, EgSampler);
+    model->skinning_meshes = egArrayCreate(allocator, EgSkinningMesh);
+
+    GltfLoad *load = (GltfLoad *)egAllocate(allocator, sizeof(GltfLoad));
+    *load = (GltfLoad){};
+    load->model = model;
+    load->allocator = allocator;
+    load->job_system = egEngineGetJobSystem(manager->engine);
+    load->cache = egEngineGetAssetCache(manager->engine);
+    load->data = data;
+    load->size = size;
+    load->owns_data = owns_data;
+    load->max_mip_count = 1;
+    // BC7 support implies BC1 and BC5, they're part of the same device feature.
+    // Compressed images can't be blitted, so their mips are made on the CPU.
+    RgDevice *device = egEngineGetDevice(manager->engine);
+    load->compress = rgDeviceSupportsSampledFormat(device, RG_FORMAT_BC7_UNORM);
+    load->cpu_mipmaps = load->compress ||
+                        !rgDeviceSupportsLinearBlit(device, RG_FORMAT_RGBA8_UNORM);
+
+    model->load = load;
+
+    egJobSystemRun(
+        egEngineGetJobSystem(manager->engine), GltfParseProc, load, &load->parse_counter);
+
+    return model;
+}
+
+EgModelAsset *
+egModelAssetFromGltf(EgModelManager *manager, const uint8_t *data, size_t size)
+{
+    EgJobSystem *job_system = egEngineGetJobSystem(manager->engine);
+
+    EgModelAsset *model = GltfLoadStart(manager, data, size, false);
+    GltfLoad *load = model->load;
+
+    RgUploadContext *upload_context = egEngineGetUploadContext(manager->engine);
+
+    egJobSystemWait(job_system, &load->parse_counter);
+    egJobSystemWait(job_system, &load->image_counter);
+
+    // Once every job is done the first publish records all uploads
+    while (!GltfLoadPublish(load))
+    {
+        rgUploadContextWait(upload_context, load->last_batch);
+    }
+
+    GltfLoadFree(load);
+    model->load = NULL;
+
+    if (model->status == EG_ASSET_STATUS_FAILED)
+    {
+        egModelAssetDestroy(model);
+        return NULL;
+    }
+
+    return model;
+}
+
+EgModelAsset *
+egModelAssetLoadAsync(EgModelManager *manager, const uint8_t *data, size_t size)
+{
+    // The caller's data only has to live until this returns
+    uint8_t *data_copy = (uint8_t *)egAllocate(manager->allocator, size);
+    memcpy(data_copy, data, size);
+
+    EgModelAsset *model = GltfLoadStart(manager, data_copy, size, true);
+    egArrayPush(&manager->loading_models, model);
+
+    return model;
+}
+
+// Serializes a parsed load. Without images every image range is left empty,
+// which is enough to cache the geometry before the images are decoded.
+static uint8_t *CookModel(GltfLoad *load, bool include_images, size_t *cooked_size)
+{
+    EgAllocator *allocator = load->allocator;
+    cgltf_data *gltf_data = load->gltf_data;
+
+    EgModelFileSampler *samplers = (EgModelFileSampler *)egAllocate(
+        allocator, sizeof(EgModelFileSampler) * (gltf_data->samplers_count + 1));
+    for (size_t i = 0; i < gltf_data->samplers_count; ++i)
+    {
+        samplers[i] = (EgModelFileSampler){
+            .mag_filter = GltfFilter(gltf_data->samplers[i].mag_filter),
+            .min_filter = GltfFilter(gltf_data->samplers[i].min_filter),
+        };
+    }
+
+    EgKtx2Image *images = NULL;
+    if (include_images)
+    {
+        images = (EgKtx2Image *)egAllocate(
+            allocator, sizeof(EgKtx2Image) * (load->image_count + 1));
+        for (size_t i = 0; i < load->image_count; ++i)
+        {
+            images[i] = load->images[i].levels;
+        }
+    }
+
+    ModelFileContents contents = {
+        .vertices = load->vertices,
+        .indices = load->indices,
+        .nodes = load->nodes,
+        .root_nodes = load->root_nodes,
+        .meshes = load->meshes,
+        .materials = load->material_sources,
+        .material_count = gltf_data->materials_count,
+        .samplers = samplers,
+        .sampler_count = gltf_data->samplers_count,
+        .images = images,
+        .image_count = load->image_count,
+        .max_mip_count = load->max_mip_count,
+    };
+    uint8_t *cooked = egModelFileWrite(allocator, &contents, cooked_size);
+
+    egFree(allocator, samplers);
+    if (images) egFree(allocator, images);
+    return cooked;
+}
+
+uint8_t *egModelCookGltf(
+    EgAllocator *allocator,
+    EgJobSystem *job_system,
+    const uint8_t *data,
+    size_t size,
+    bool compress_images,
+    size_t *cooked_size,
+    EgMeshOptimizeStats *mesh_stats)
+{
+    GltfLoad *load = (GltfLoad *)egAllocate(allocator, sizeof(GltfLoad));
+    *load = (GltfLoad){};
+    load->allocator = allocator;
+    load->job_system = job_system;
+    load->data = data;
+    load->size = size;
+    load->max_mip_count = 1;
+    load->compress = compress_images;
+    // The whole mip chain is stored in the file
+    load->cpu_mipmaps = true;
+
+    // Parses on the calling thread, the images are still decoded by the jobs
+    GltfParseProc(load);
+    egJobSystemWait(job_system, &load->image_counter);
+
+    if (load->parse_failed)
+    {
+        GltfLoadFree(load);
+        return NULL;
+    }
+
+    // The cooked format has no skins or animations, such models would load
+    // as static meshes in their bind pose
+    cgltf_data *gltf_data = load->gltf_data;
+    if (gltf_data->skins_count > 0 || gltf_data->animations_count > 0)
+    {
+        fprintf(
+            stderr,
+            "Skinned and animated models can't be cooked (%zu skins, %zu animations)\n",
+            gltf_data->skins_count,
+            gltf_data->animations_count);
+        GltfLoadFree(load);
+        return NULL;
+    }
+
+    uint8_t *cooked = CookModel(load, true, cooked_size);
+    if (mesh_stats) *mesh_stats = load->mesh_stats;
+
+    GltfLoadFree(load);
+
+    return cooked;
+}
+
+EgModelAsset *egModelAssetFromCookedFile(EgModelManager *manager, const char *path)
+{
+    EgAllocator *allocator = manager->allocator;
+    EgEngine *engine = manager->engine;
+    RgDevice *device = egEngineGetDevice(engine);
+    RgUploadContext *upload_context = egEngineGetUploadContext(engine);
+
+    EgFileMap *file_map = egFileMapOpen(allocator, path);
+    if (!file_map) return NULL;
+
+    const uint8_t *data = egFileMapGetData(file_map);
+    size_t size = egFileMapGetSize(file_map);
+    if (!egModelFileValidate(data, size))
+    {
+        fprintf(stderr, "Invalid cooked model file: %s\n", path);
+        egFileMapClose(file_map);
+        return NULL;
+    }
+
+    const EgModelFileHeader *header = (const EgModelFileHeader *)data;
+
+    EgGeometry geometry;
+    size_t vertex_count = header->vertices.size / sizeof(EgCompactVertex);
+    if (!egEngineAllocateGeometry(engine, vertex_count, header->indices.size, &geometry))
+    {
+        fprintf(stderr, "Out of geometry memory for model: %s\n", path);
+        egFileMapClose(file_map);
+        return NULL;
+    }
+
+    EgModelAsset *model = (EgModelAsset *)egAllocate(allocator, sizeof(EgModelAsset));
+    *model = (EgModelAsset){};
+
+    model->manager = manager;
+    model->type = MODEL_FROM_GLTF;
+    model->status = EG_ASSET_STATUS_READY;
+    model->geometry = geometry;
+
+    model->materials = egArrayCreate(allocator, Material);
+    model->images = egArrayCreate(allocator, EgImage);
+    model->samplers = egArrayCreate(allocator, EgSampler);
+    model->skinning_meshes = egArrayCreate(allocator, EgSkinningMesh);
+
+    // The geometry is copied from the mapping straight into staging memory
+    rgUploadBuffer(
+        upload_context,
+        egEngineGetVertexBuffer(engine).buffer,
+        sizeof(EgCompactVertex) * geometry.first_vertex,
+        header->vertices.size,
+        data + header->vertices.offset);
+    rgUploadBuffer(
+        upload_context,
+        egEngineGetIndexBuffer(engine),
+        geometry.index_offset,
+        header->indices.size,
+        data + header->indices.offset);
+
+    size_t image_count = EG_MODEL_FILE_COUNT(header, EgModelFileRange, images);
+    const EgModelFileRange *images =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileRange, images);
+    RgFormat *image_formats =
+        (RgFormat *)egAllocate(allocator, sizeof(RgFormat) * (image_count + 1));
+
+    egArrayResize(&model->images, image_count);
+    for (size_t i = 0; i < image_count; ++i)
+    {
+        model->images[i] = (EgImage){0};
+        image_formats[i] = RG_FORMAT_UNDEFINED;
+
+        // Only the headers are parsed, the levels point into the mapping
+        EgKtx2Image ktx2;
+        if (images[i].size == 0 ||
+            !egKtx2Parse(data + images[i].offset, images[i].size, &ktx2))
+        {
+            fprintf(stderr, "Missing image %zu in cooked model: %s\n", i, path);
+            continue;
+        }
+
+        if (!rgDeviceSupportsSampledFormat(device, ktx2.format))
+        {
+            fprintf(stderr, "Unsupported format for image %zu in: %s\n", i, path);
+            continue;
+        }
+
+        RgImageInfo image_info = {};
+        image_info.format = ktx2.format;
+        image_info.extent = (RgExtent3D){ktx2.width, ktx2.height, 1};
+        image_info.aspect = RG_IMAGE_ASPECT_COLOR;
+        image_info.layer_count = 1;
+        image_info.sample_count = 1;
+        image_info.mip_count = ktx2.level_count;
+        image_info.usage = RG_IMAGE_USAGE_SAMPLED | RG_IMAGE_USAGE_TRANSFER_DST;
+
+        model->images[i] = egEngineAllocateImage(engine, &image_info);
+        image_formats[i] = ktx2.format;
+
+        RgImageCopy image_copy = {};
+        image_copy.image = model->images[i].image;
+        for (uint32_t level = 0; level < ktx2.level_count; ++level)
+        {
+            RgExtent3D level_extent = {
+                egMipExtent(ktx2.width, level),
+                egMipExtent(ktx2.height, level),
+                1,
+            };
+
+            image_copy.mip_level = level;
+            rgUploadImage(
+                upload_context,
+                &image_copy,
+                &level_extent,
+                ktx2.levels[level].size,
+                ktx2.levels[level].data);
+        }
+    }
+
+    size_t sampler_count = EG_MODEL_FILE_COUNT(header, EgModelFileSampler, samplers);
+    const EgModelFileSampler *samplers =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileSampler, samplers);
+    egArrayResize(&model->samplers, sampler_count);
+    for (size_t i = 0; i < sampler_count; ++i)
+    {
+        RgSamplerInfo sampler_info = ModelSamplerInfo(
+            (RgFilter)samplers[i].mag_filter,
+            (RgFilter)samplers[i].min_filter,
+            header->max_mip_count);
+        model->samplers[i] = egEngineAllocateSampler(engine, &sampler_info);
+    }
+
+    size_t material_count = EG_MODEL_FILE_COUNT(header, EgModelFileMaterial, materials);
+    const EgModelFileMaterial *materials =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMaterial, materials);
+    egArrayResize(&model->materials, material_count);
+    for (size_t i = 0; i < material_count; ++i)
+    {
+        const EgModelFileMaterial *file_material = &materials[i];
+        Material *mat = &model->materials[i];
+        *mat = MaterialDefault(engine);
+
+        if (sampler_count > 0)
+        {
+            mat->sampler = model->samplers[0];
+        }
+
+        // Images that couldn't be created keep the placeholders
+        int32_t index = file_material->albedo_image;
+        if (index != -1 && model->images[index].image)
+            mat->albedo_image = model->images[index];
+
+        index = file_material->normal_image;
+        if (index != -1 && model->images[index].image)
+        {
+            mat->normal_image = model->images[index];
+            mat->is_normal_two_channel = image_formats[index] == RG_FORMAT_BC5_UNORM;
+        }
+
+        index = file_material->metallic_roughness_image;
+        if (index != -1 && model->images[index].image)
+            mat->metallic_roughness_image = model->images[index];
+
+        index = file_material->occlusion_image;
+        if (index != -1 && model->images[index].image)
+            mat->occlusion_image = model->images[index];
+
+        index = file_material->emissive_image;
+        if (index != -1 && model->images[index].image)
+            mat->emissive_image = model->images[index];
+    }
+
+    egFree(allocator, image_formats);
+
+    egModelFileReadScene(
+        data, allocator, &model->nodes, &model->root_nodes, &model->meshes);
+
+    // Everything is in staging memory already, the mapping can go before the
+    // uploads finish
+    egFileMapClose(file_map);
+
+    rgUploadContextWait(upload_context, rgUploadContextSubmit(upload_context));
+
+    return model;
+}
+
+EgAssetStatus egModelAssetGetStatus(EgModelAsset *model)
+{
+    return model->status;
+}
+
+const EgSkeleton *egModelAssetGetSkeleton(EgModelAsset *model)
+{
+    return model->animation ? &model->animation->skeleton : NULL;
+}
+
+uint32_t egModelAssetGetAnimationCount(EgModelAsset *model)
+{
+    return model->animation ? (uint32_t)egArrayLength(model->animation->clips) : 0;
+}
+
+const EgCompressedAnimationClip *egModelAssetGetAnimation(
+    EgModelAsset *model, uint32_t index)
+{
+    EG_ASSERT(index < egModelAssetGetAnimationCount(model));
+    return model->animation->clips[index];
+}
+
+// Largest factor the transform scales lengths by
+static float MaxScale(const float4x4 *transform)
+{
+    const float4x4 *m = transform;
+    float x = m->xx * m->xx + m->xy * m->xy + m->xz * m->xz;
+    float y = m->yx * m->yx + m->yy * m->yy + m->yz * m->yz;
+    float z = m->zx * m->zx + m->zy * m->zy + m->zz * m->zz;
+    return sqrtf(EG_MAX(x, EG_MAX(y, z)));
+}
+
+bool egModelAssetGetBounds(EgModelAsset *model, float3 *center, float *radius)
+{
+    if (model->load && !model->load->geometry_published) return false;
+
+    // The primitive spheres are merged around the center of their box
+    float3 min = V3(INFINITY, INFINITY, INFINITY);
+    float3 max = V3(-INFINITY, -INFINITY, -INFINITY);
+    bool has_bounds = true;
+    for (size_t i = 0; i < egArrayLength(model->nodes); ++i)
+    {
+        Node *node = &model->nodes[i];
+        if (node->mesh_index == -1) continue;
+
+        ModelMesh *mesh = &model->meshes[node->mesh_index];
+        float scale = MaxScale(&node->resolved_matrix);
+        for (size_t j = 0; j < egArrayLength(mesh->primitives); ++j)
+        {
+            Primitive *primitive = &mesh->primitives[j];
+            has_bounds = has_bounds && primitive->radius > 0.0f;
+
+            float4 local =
+                V4(primitive->center.x, primitive->center.y, primitive->center.z, 1.0f);
+            float4 world = egFloat4x4MulVector(&node->resolved_matrix, &local);
+            float world_radius = primitive->radius * scale;
+            min = V3(
+                EG_MIN(min.x, world.x - world_radius),
+                EG_MIN(min.y, world.y - world_radius),
+                EG_MIN(min.z, world.z - world_radius));
+            max = V3(
+                EG_MAX(max.x, world.x + world_radius),
+                EG_MAX(max.y, world.y + world_radius),
+                EG_MAX(max.z, world.z + world_radius));
+        }
+    }
+
+    if (min.x > max.x)
+    {
+        *center = V3(0.0f, 0.0f, 0.0f);
+        *radius = 0.0f;
+        return true;
+    }
+
+    *center = egFloat3MulScalar(egFloat3Add(min, max), 0.5f);
+    *radius = has_bounds ? 0.0f : INFINITY;
+    for (size_t i = 0; i < egArrayLength(model->nodes) && has_bounds; ++i)
+    {
+        Node *node = &model->nodes[i];
+        if (node->mesh_index == -1) continue;
+
+        ModelMesh *mesh = &model->meshes[node->mesh_index];
+        float scale = MaxScale(&node->resolved_matrix);
+        for (size_t j = 0; j < egArrayLength(mesh->primitives); ++j)
+        {
+            Primitive *primitive = &mesh->primitives[j];
+            float4 local =
+                V4(primitive->center.x, primitive->center.y, primitive->center.z, 1.0f);
+            float4 world = egFloat4x4MulVector(&node->resolved_matrix, &local);
+            float distance = egFloat3Distance(V3(world.x, world.y, world.z), *center);
+            *radius = EG_MAX(*radius, distance + primitive->radius * scale);
+        }
+    }
+    return true;
+}
+
+void egModelManagerUpdate(EgModelManager *manager)
+{
+    for (size_t i = 0; i < egArrayLength(manager->loading_models);)
+    {
+        EgModelAsset *model = manager->loading_models[i];
+        if (GltfLoadPublish(model->load))
+        {
+            GltfLoadFree(model->load);
+            model->load = NULL;
+
+            manager->loading_models[i] =
+                manager->loading_models[egArrayLength(manager->loading_models) - 1];
+            egArrayPop(&manager->loading_models);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+EgModelAsset *egModelAssetFromMesh(EgModelManager *manager, EgMesh *mesh)
+{
+    EgAllocator *allocator = manager->allocator;
+    EgEngine *engine = manager->engine;
 
     EgModelAsset *model = (EgModelAsset *)egAllocate(allocator, sizeof(EgModelAsset));
     *model = (EgModelAsset){};
 
     model->manager = manager;
     model->type = MODEL_FROM_MESH;
+    model->status = EG_ASSET_STATUS_READY;
 
     model->nodes = egArrayCreate(allocator, Node);
     model->root_nodes = egArrayCreate(allocator, size_t);
@@ -712,21 +2801,24 @@ EgModelAsset *egModelAssetFromMesh(EgModelManager *manager, EgMesh *mesh)
     model->materials = egArrayCreate(allocator, Material);
     model->images = egArrayCreate(allocator, EgImage);
     model->samplers = egArrayCreate(allocator, EgSampler);
+    model->skinning_meshes = egArrayCreate(allocator, EgSkinningMesh);
 
-    model->vertex_buffer = egMeshGetVertexBuffer(mesh);
-    model->index_buffer = egMeshGetIndexBuffer(mesh);
+    model->geometry = *egMeshGetGeometry(mesh);
 
     egArrayPush(&model->materials, MaterialDefault(engine));
 
     Primitive primitive = {};
     primitive.first_index = 0;
     primitive.index_count = egMeshGetIndexCount(mesh);
+    primitive.index_type = egMeshGetIndexType(mesh);
     primitive.material_index = 0;
     primitive.has_indices = true;
     primitive.is_normal_mapped = false;
 
     ModelMesh model_mesh = {};
     model_mesh.primitives = egArrayCreate(allocator, Primitive);
+    model_mesh.meshlets = egArrayCreate(allocator, EgMeshlet);
+    model_mesh.quantization = *egMeshGetQuantization(mesh);
     egArrayPush(&model_mesh.primitives, primitive);
 
     egArrayPush(&model->meshes, model_mesh);
@@ -753,7 +2845,24 @@ EgModelAsset *egModelAssetFromMesh(EgModelManager *manager, EgMesh *mesh)
 void egModelAssetDestroy(EgModelAsset *model)
 {
     EgEngine *engine = model->manager->engine;
-    RgDevice *device = egEngineGetDevice(engine);
+
+    if (model->load)
+    {
+        EgModelManager *manager = model->manager;
+        for (size_t i = 0; i < egArrayLength(manager->loading_models); ++i)
+        {
+            if (manager->loading_models[i] == model)
+            {
+                manager->loading_models[i] =
+                    manager->loading_models[egArrayLength(manager->loading_models) - 1];
+                egArrayPop(&manager->loading_models);
+                break;
+            }
+        }
+
+        GltfLoadFree(model->load);
+        model->load = NULL;
+    }
 
     switch (model->type)
     {
@@ -772,11 +2881,22 @@ void egModelAssetDestroy(EgModelAsset *model)
              image != model->images + egArrayLength(model->images);
              ++image)
         {
-            egEngineFreeImage(engine, image);
+            // Images that never finished loading are still placeholders
+            if (image->image) egEngineFreeImage(engine, image);
         }
 
-        rgBufferDestroy(device, model->vertex_buffer);
-        rgBufferDestroy(device, model->index_buffer);
+        if (model->geometry.vertex_count > 0)
+        {
+            egEngineFreeGeometry(engine, &model->geometry);
+        }
+        if (model->skin_buffer.buffer)
+        {
+            egEngineFreeStorageBuffer(engine, &model->skin_buffer);
+        }
+        if (model->animation)
+        {
+            ModelAnimationDestroy(model->manager->allocator, model->animation);
+        }
         break;
     }
     }
@@ -792,6 +2912,7 @@ void egModelAssetDestroy(EgModelAsset *model)
          ++mesh)
     {
         egArrayFree(&mesh->primitives);
+        egArrayFree(&mesh->meshlets);
     }
 
     egArrayFree(&model->nodes);
@@ -800,17 +2921,242 @@ void egModelAssetDestroy(EgModelAsset *model)
     egArrayFree(&model->materials);
     egArrayFree(&model->images);
     egArrayFree(&model->samplers);
+    egArrayFree(&model->skinning_meshes);
 
     egFree(model->manager->allocator, model);
 }
 
-static void
-NodeRender(EgModelAsset *model, Node *node, RgCmdBuffer *cmd_buffer, float4x4 *transform)
+// Every model shares the engine geometry buffers, so they are bound once per
+// command buffer. Primitives choose their own index type, the index buffer is
+// only rebound when it changes.
+typedef struct DrawState
 {
-    (void)node;
-    (void)cmd_buffer;
+    bool vertex_buffer_bound;
+    bool index_buffer_bound;
+    RgIndexType index_type;
+} DrawState;
+
+// Meshlets are culled in batches of this size, the visibility flags live on
+// the stack
+#define MESHLET_CULL_BATCH 256
+
+// Where the draws of a mesh pull their vertices from
+typedef struct DrawVertices
+{
+    uint32_t buffer_index;
+    EgVertexFormat format;
+    // Added to the first vertex of each primitive
+    int64_t vertex_offset;
+} DrawVertices;
+
+static void PushPrimitiveConstants(
+    EgModelAsset *model,
+    Primitive *primitive,
+    ModelUniform *model_uniform,
+    const DrawVertices *vertices,
+    RgCmdBuffer *cmd_buffer)
+{
+    EgModelManager *manager = model->manager;
+    EgEngine *engine = manager->engine;
+    Material *material = &model->materials[primitive->material_index];
+
+    uint32_t model_buffer_index;
+    uint32_t model_index = PushUniform(
+        manager->model_uniforms,
+        model_uniform,
+        sizeof(*model_uniform),
+        &model_buffer_index);
+
+    MaterialUniform material_uniform = {};
+    material_uniform.base_color = material->base_color;
+    material_uniform.emissive = material->emissive;
+    material_uniform.metallic = material->metallic;
+    material_uniform.roughness = material->roughness;
+    material_uniform.is_normal_mapped = material->is_normal_mapped;
+    material_uniform.is_normal_two_channel = material->is_normal_two_channel;
+
+    material_uniform.sampler_index = material->sampler.index;
+    material_uniform.albedo_image_index = material->albedo_image.index;
+    material_uniform.normal_image_index = material->normal_image.index;
+    material_uniform.metallic_roughness_image_index =
+        material->metallic_roughness_image.index;
+    material_uniform.occlusion_image_index = material->occlusion_image.index;
+    material_uniform.emissive_image_index = material->emissive_image.index;
+    material_uniform.brdf_image_index = egEngineGetBRDFImage(engine).index;
+
+    uint32_t material_buffer_index;
+    uint32_t material_index = PushUniform(
+        manager->material_uniforms,
+        &material_uniform,
+        sizeof(material_uniform),
+        &material_buffer_index);
+
+    struct
+    {
+        uint32_t camera_buffer_index;
+        uint32_t camera_index;
+
+        uint32_t model_buffer_index;
+        uint32_t model_index;
+
+        uint32_t material_buffer_index;
+        uint32_t material_index;
 
+        // For shaders that pull their vertices, the base vertex is already
+        // part of SV_VertexID
+        uint32_t vertex_buffer_index;
+        uint32_t vertex_format;
+    } pc;
+
+    pc.camera_buffer_index = manager->current_camera_buffer_index;
+    pc.camera_index = manager->current_camera_index;
+
+    pc.model_buffer_index = model_buffer_index;
+    pc.model_index = model_index;
+
+    pc.material_buffer_index = material_buffer_index;
+    pc.material_index = material_index;
+
+    pc.vertex_buffer_index = vertices->buffer_index;
+    pc.vertex_format = vertices->format;
+
+    rgCmdPushConstants(cmd_buffer, 0, sizeof(pc), &pc);
+}
+
+// first_index is in units of the primitive index_type, from the start of the
+// model's indices
+static void DrawPrimitiveIndices(
+    EgModelAsset *model,
+    Primitive *primitive,
+    const DrawVertices *vertices,
+    RgCmdBuffer *cmd_buffer,
+    DrawState *state,
+    uint32_t first_index,
+    uint32_t index_count)
+{
     EgEngine *engine = model->manager->engine;
+    if (!state->index_buffer_bound || state->index_type != primitive->index_type)
+    {
+        rgCmdBindIndexBuffer(
+            cmd_buffer, egEngineGetIndexBuffer(engine), 0, primitive->index_type);
+        state->index_buffer_bound = true;
+        state->index_type = primitive->index_type;
+    }
+
+    uint32_t index_size = primitive->index_type == RG_INDEX_TYPE_UINT16
+                              ? sizeof(uint16_t)
+                              : sizeof(uint32_t);
+    rgCmdDrawIndexed(
+        cmd_buffer,
+        index_count,
+        1,
+        (uint32_t)(model->geometry.index_offset / index_size) + first_index,
+        (int32_t)(vertices->vertex_offset + primitive->first_vertex),
+        0);
+}
+
+// Draws the visible meshlets, merging neighbours into a single draw. Nothing
+// is pushed when every meshlet is culled.
+static void DrawPrimitiveMeshlets(
+    EgModelAsset *model,
+    ModelMesh *mesh,
+    Primitive *primitive,
+    ModelUniform *model_uniform,
+    const DrawVertices *vertices,
+    const EgMeshletCuller *culler,
+    RgCmdBuffer *cmd_buffer,
+    DrawState *state)
+{
+    const EgMeshlet *meshlets = &mesh->meshlets[primitive->first_meshlet];
+    uint8_t visible[MESHLET_CULL_BATCH];
+
+    bool constants_pushed = false;
+    uint32_t run_first_index = 0;
+    uint32_t run_index_count = 0;
+
+    for (size_t batch = 0; batch < primitive->meshlet_count; batch += MESHLET_CULL_BATCH)
+    {
+        size_t batch_count = EG_MIN(MESHLET_CULL_BATCH, primitive->meshlet_count - batch);
+        if (egMeshletCull(culler, &meshlets[batch], batch_count, visible) == 0) continue;
+
+        for (size_t i = 0; i < batch_count; ++i)
+        {
+            if (!visible[i]) continue;
+
+            const EgMeshlet *meshlet = &meshlets[batch + i];
+            if (run_index_count > 0 && run_first_index + run_index_count ==
+                                           primitive->first_index + meshlet->first_index)
+            {
+                run_index_count += meshlet->index_count;
+                continue;
+            }
+
+            if (run_index_count > 0)
+            {
+                DrawPrimitiveIndices(
+                    model,
+                    primitive,
+                    vertices,
+                    cmd_buffer,
+                    state,
+                    run_first_index,
+                    run_index_count);
+            }
+            else if (!constants_pushed)
+            {
+                PushPrimitiveConstants(
+                    model, primitive, model_uniform, vertices, cmd_buffer);
+                constants_pushed = true;
+            }
+
+            run_first_index = primitive->first_index + meshlet->first_index;
+            run_index_count = meshlet->index_count;
+        }
+    }
+
+    if (run_index_count > 0)
+    {
+        DrawPrimitiveIndices(
+            model,
+            primitive,
+            vertices,
+            cmd_buffer,
+            state,
+            run_first_index,
+            run_index_count);
+    }
+}
+
+// Picks the coarsest LOD whose error projects to at most LOD_MAX_PIXEL_ERROR
+// pixels at the point of the bounding sphere closest to the camera, 0 being
+// the full primitive. Both the error and the camera are in model space, so
+// uniform scale cancels out.
+static uint32_t SelectPrimitiveLod(
+    EgModelManager *manager, const Primitive *primitive, float3 camera_pos)
+{
+    float distance =
+        egFloat3Length(egFloat3Sub(primitive->center, camera_pos)) - primitive->radius;
+    if (distance <= 0.0f) return 0;
+
+    uint32_t lod = 0;
+    for (uint32_t i = 0; i < primitive->lod_count; ++i)
+    {
+        float pixel_error = primitive->lods[i].error * manager->lod_scale / distance;
+        if (pixel_error > LOD_MAX_PIXEL_ERROR) break;
+        lod = i + 1;
+    }
+    return lod;
+}
+
+static void NodeRender(
+    EgModelAsset *model,
+    Node *node,
+    RgCmdBuffer *cmd_buffer,
+    float4x4 *transform,
+    uint32_t skinned_first_vertex,
+    DrawState *state)
+{
+    EgModelManager *manager = model->manager;
 
     ModelUniform model_uniform = {};
     model_uniform.transform = egFloat4x4Mul(&node->resolved_matrix, transform);
@@ -819,70 +3165,117 @@ NodeRender(EgModelAsset *model, Node *node, RgCmdBuffer *cmd_buffer, float4x4 *t
     {
         ModelMesh *mesh = &model->meshes[node->mesh_index];
 
+        DrawVertices vertices = {
+            .buffer_index = egEngineGetVertexBuffer(manager->engine).index,
+            .format = EG_VERTEX_FORMAT_COMPACT,
+            .vertex_offset = model->geometry.first_vertex,
+        };
+
+        // Skinned vertices are posed in model space already, the joints take
+        // the place of the node transform. Their bounds move with the pose, so
+        // they skip meshlet culling and LODs.
+        bool is_skinned = mesh->is_skinned && skinned_first_vertex != NO_SKINNED_VERTICES;
+        if (is_skinned)
+        {
+            model_uniform.transform = *transform;
+            vertices = (DrawVertices){
+                .buffer_index = egSkinningManagerGetOutputBufferIndex(manager->skinning),
+                .format = EG_VERTEX_FORMAT_SKINNED,
+                .vertex_offset = (int64_t)skinned_first_vertex +
+                                 mesh->first_skinned_vertex - mesh->first_vertex,
+            };
+        }
+
+        EgVertexQuantization *quantization = &mesh->quantization;
+        model_uniform.position_offset = V4(
+            quantization->position_offset.x,
+            quantization->position_offset.y,
+            quantization->position_offset.z,
+            0.0f);
+        model_uniform.position_scale = V4(
+            quantization->position_scale.x,
+            quantization->position_scale.y,
+            quantization->position_scale.z,
+            0.0f);
+        model_uniform.uv_offset_scale = V4(
+            quantization->uv_offset.x,
+            quantization->uv_offset.y,
+            quantization->uv_scale.x,
+            quantization->uv_scale.y);
+
+        // Meshlet and LOD bounds are in model space, so the frustum and the
+        // camera are brought there instead
+        float4x4 inverse_transform = egFloat4x4Inverse(&model_uniform.transform);
+        float4 camera_pos = egFloat4x4MulVector(&inverse_transform, &manager->camera_pos);
+        float3 model_camera_pos = V3(camera_pos.x, camera_pos.y, camera_pos.z);
+
+        EgMeshletCuller culler;
+        if (egArrayLength(mesh->meshlets) > 0 && !is_skinned)
+        {
+            float4x4 model_view_proj =
+                egFloat4x4Mul(&model_uniform.transform, &manager->view_proj);
+            egMeshletCullerInit(&culler, &model_view_proj, model_camera_pos);
+        }
+
         for (Primitive *primitive = mesh->primitives;
              primitive != mesh->primitives + egArrayLength(mesh->primitives);
              ++primitive)
         {
-            Material *material = &model->materials[primitive->material_index];
-
-            uint32_t model_index = egBufferPoolAllocateItem(
-                model->manager->model_buffer_pool, sizeof(ModelUniform), &model_uniform);
-
-            MaterialUniform material_uniform = {};
-            material_uniform.base_color = material->base_color;
-            material_uniform.emissive = material->emissive;
-            material_uniform.metallic = material->metallic;
-            material_uniform.roughness = material->roughness;
-            material_uniform.is_normal_mapped = material->is_normal_mapped;
-
-            material_uniform.sampler_index = material->sampler.index;
-            material_uniform.albedo_image_index = material->albedo_image.index;
-            material_uniform.normal_image_index = material->normal_image.index;
-            material_uniform.metallic_roughness_image_index =
-                material->metallic_roughness_image.index;
-            material_uniform.occlusion_image_index = material->occlusion_image.index;
-            material_uniform.emissive_image_index = material->emissive_image.index;
-            material_uniform.brdf_image_index = egEngineGetBRDFImage(engine).index;
-
-            uint32_t material_index = egBufferPoolAllocateItem(
-                model->manager->material_buffer_pool,
-                sizeof(MaterialUniform),
-                &material_uniform);
-
-            struct
+            // Meshlets only cover the full indices, coarser LODs are small
+            // enough to be drawn whole
+            uint32_t lod =
+                is_skinned ? 0 : SelectPrimitiveLod(manager, primitive, model_camera_pos);
+            if (lod > 0)
             {
-                uint32_t camera_buffer_index;
-                uint32_t camera_index;
-
-                uint32_t model_buffer_index;
-                uint32_t model_index;
-
-                uint32_t material_buffer_index;
-                uint32_t material_index;
-            } pc;
-
-            pc.camera_buffer_index =
-                egBufferPoolGetBufferIndex(model->manager->camera_buffer_pool);
-            pc.camera_index = model->manager->current_camera_index;
-
-            pc.model_buffer_index =
-                egBufferPoolGetBufferIndex(model->manager->model_buffer_pool);
-            pc.model_index = model_index;
+                PushPrimitiveConstants(
+                    model, primitive, &model_uniform, &vertices, cmd_buffer);
+                DrawPrimitiveIndices(
+                    model,
+                    primitive,
+                    &vertices,
+                    cmd_buffer,
+                    state,
+                    primitive->lods[lod - 1].first_index,
+                    primitive->lods[lod - 1].index_count);
+                continue;
+            }
 
-            pc.material_buffer_index =
-                egBufferPoolGetBufferIndex(model->manager->material_buffer_pool);
-            pc.material_index = material_index;
+            if (primitive->meshlet_count > 0 && !is_skinned)
+            {
+                DrawPrimitiveMeshlets(
+                    model,
+                    mesh,
+                    primitive,
+                    &model_uniform,
+                    &vertices,
+                    &culler,
+                    cmd_buffer,
+                    state);
+                continue;
+            }
 
-            rgCmdPushConstants(cmd_buffer, 0, sizeof(pc), &pc);
+            PushPrimitiveConstants(
+                model, primitive, &model_uniform, &vertices, cmd_buffer);
 
             if (primitive->has_indices)
             {
-                rgCmdDrawIndexed(
-                    cmd_buffer, primitive->index_count, 1, primitive->first_index, 0, 0);
+                DrawPrimitiveIndices(
+                    model,
+                    primitive,
+                    &vertices,
+                    cmd_buffer,
+                    state,
+                    primitive->first_index,
+                    primitive->index_count);
             }
             else
             {
-                rgCmdDraw(cmd_buffer, primitive->vertex_count, 1, 0, 0);
+                rgCmdDraw(
+                    cmd_buffer,
+                    primitive->vertex_count,
+                    1,
+                    (uint32_t)(vertices.vertex_offset + primitive->first_vertex),
+                    0);
             }
         }
     }
@@ -892,19 +3285,175 @@ NodeRender(EgModelAsset *model, Node *node, RgCmdBuffer *cmd_buffer, float4x4 *t
          ++index)
     {
         Node *child = &model->nodes[*index];
-        NodeRender(model, child, cmd_buffer, transform);
+        NodeRender(model, child, cmd_buffer, transform, skinned_first_vertex, state);
     }
 }
 
-void
-egModelAssetRender(EgModelAsset *model, RgCmdBuffer *cmd_buffer, float4x4 *transform)
+static void ModelRender(
+    EgModelAsset *model,
+    RgCmdBuffer *cmd_buffer,
+    float4x4 *transform,
+    uint32_t skinned_first_vertex,
+    DrawState *state)
 {
     EG_ASSERT(transform);
-    rgCmdBindVertexBuffer(cmd_buffer, model->vertex_buffer, 0);
-    rgCmdBindIndexBuffer(cmd_buffer, model->index_buffer, 0, RG_INDEX_TYPE_UINT32);
+
+    // Geometry of models that are still loading isn't published yet
+    if (model->geometry.vertex_count == 0) return;
+
+    if (!state->vertex_buffer_bound)
+    {
+        rgCmdBindVertexBuffer(
+            cmd_buffer, egEngineGetVertexBuffer(model->manager->engine).buffer, 0);
+        state->vertex_buffer_bound = true;
+    }
+
     for (Node *node = model->nodes; node != model->nodes + egArrayLength(model->nodes);
          ++node)
     {
-        NodeRender(model, node, cmd_buffer, transform);
+        NodeRender(model, node, cmd_buffer, transform, skinned_first_vertex, state);
+    }
+}
+
+void
+egModelAssetRender(EgModelAsset *model, RgCmdBuffer *cmd_buffer, float4x4 *transform)
+{
+    DrawState state = {};
+    ModelRender(model, cmd_buffer, transform, NO_SKINNED_VERTICES, &state);
+}
+
+void egModelAssetQueueRender(EgModelAsset *model, float4x4 *transform)
+{
+    EG_ASSERT(transform);
+    QueuedDraw draw = {
+        .model = model,
+        .transform = *transform,
+        .skinned_first_vertex = NO_SKINNED_VERTICES,
+    };
+    egArrayPush(&model->manager->queued_draws, draw);
+}
+
+void egModelAssetQueueRenderSkinned(
+    EgModelAsset *model, float4x4 *transform, const float4x4 *palette)
+{
+    EG_ASSERT(transform);
+    EG_ASSERT(palette);
+
+    EgSkinningInstance instance = {
+        .meshes = model->skinning_meshes,
+        .mesh_count = (uint32_t)egArrayLength(model->skinning_meshes),
+        .vertex_count = model->skinned_vertex_count,
+        .skin_buffer_index = model->skin_buffer.index,
+        .palette = palette,
+        .joint_count = model->animation ? model->animation->skeleton.joint_count : 0,
+    };
+
+    uint32_t first_output_vertex;
+    EgSkinningManager *skinning = model->manager->skinning;
+    if (model->skinned_vertex_count == 0 ||
+        !egSkinningManagerQueue(skinning, &instance, &first_output_vertex))
+    {
+        egModelAssetQueueRender(model, transform);
+        return;
     }
+
+    QueuedDraw draw = {
+        .model = model,
+        .transform = *transform,
+        .skinned_first_vertex = first_output_vertex,
+    };
+    egArrayPush(&model->manager->queued_draws, draw);
+}
+
+void egModelManagerDispatchSkinning(
+    EgModelManager *manager, RgCmdBuffer *cmd_buffer, RgPipeline *pipeline)
+{
+    egSkinningManagerDispatch(manager->skinning, cmd_buffer, pipeline);
+}
+
+typedef struct RecordSlice
+{
+    EgModelManager *manager;
+    RgCmdBuffer *cmd_buffer;
+    RgRenderPass *render_pass;
+    RgPipeline *pipeline;
+    QueuedDraw *draws;
+    size_t draw_count;
+} RecordSlice;
+
+static void RecordDrawSlice(RecordSlice *slice)
+{
+    RgCmdBuffer *cmd_buffer = slice->cmd_buffer;
+
+    rgCmdBufferBeginSecondary(cmd_buffer, slice->render_pass);
+
+    rgCmdBindPipeline(cmd_buffer, slice->pipeline);
+    rgCmdBindDescriptorSet(
+        cmd_buffer, 0, egEngineGetGlobalDescriptorSet(slice->manager->engine), 0, NULL);
+
+    DrawState state = {};
+    for (size_t i = 0; i < slice->draw_count; ++i)
+    {
+        QueuedDraw *draw = &slice->draws[i];
+        ModelRender(
+            draw->model,
+            cmd_buffer,
+            &draw->transform,
+            draw->skinned_first_vertex,
+            &state);
+    }
+
+    rgCmdBufferEnd(cmd_buffer);
+}
+
+static void RecordSlicesProc(void *user_data, size_t begin, size_t end)
+{
+    RecordSlice *slices = (RecordSlice *)user_data;
+    for (size_t i = begin; i < end; ++i)
+    {
+        RecordDrawSlice(&slices[i]);
+    }
+}
+
+void egModelManagerRecordDraws(
+    EgModelManager *manager,
+    RgCmdBuffer *cmd_buffer,
+    RgRenderPass *render_pass,
+    RgPipeline *pipeline)
+{
+    RgDevice *device = egEngineGetDevice(manager->engine);
+
+    size_t draw_count = egArrayLength(manager->queued_draws);
+    if (draw_count == 0) return;
+
+    uint32_t slice_count = manager->thread_count;
+    if (draw_count < slice_count) slice_count = (uint32_t)draw_count;
+
+    RecordSlice slices[MAX_RECORDING_THREADS];
+    RgCmdBuffer *secondaries[MAX_RECORDING_THREADS];
+
+    for (uint32_t t = 0; t < slice_count; ++t)
+    {
+        rgCmdPoolReset(device, manager->cmd_pools[manager->frame_index][t]);
+
+        // Even split, so no slice is empty or starts past the end: the sizes
+        // differ by one at most
+        size_t first = t * draw_count / slice_count;
+        size_t last = (t + 1) * draw_count / slice_count;
+
+        secondaries[t] = manager->secondary_cmd_buffers[manager->frame_index][t];
+        slices[t] = (RecordSlice){
+            .manager = manager,
+            .cmd_buffer = secondaries[t],
+            .render_pass = render_pass,
+            .pipeline = pipeline,
+            .draws = &manager->queued_draws[first],
+            .draw_count = last - first,
+        };
+    }
+
+    egJobSystemParallelFor(
+        egEngineGetJobSystem(manager->engine), slice_count, 1, RecordSlicesProc, slices);
+
+    rgCmdExecuteCommands(cmd_buffer, slice_count, secondaries);
 }
@@ -12,28 +12,110 @@ typedef struct EgAllocator EgAllocator;
 typedef struct EgEngine EgEngine;
 typedef struct EgMesh EgMesh;
 typedef struct RgCmdBuffer RgCmdBuffer;
-typedef struct EgBufferPool EgBufferPool;
+typedef struct RgRenderPass RgRenderPass;
+typedef struct RgPipeline RgPipeline;
 typedef struct EgCameraUniform EgCameraUniform;
+typedef struct EgFrameAllocatorStats EgFrameAllocatorStats;
+typedef struct EgJobSystem EgJobSystem;
+typedef struct EgMeshOptimizeStats EgMeshOptimizeStats;
+typedef struct EgSkeleton EgSkeleton;
+typedef struct EgCompressedAnimationClip EgCompressedAnimationClip;
 
 typedef struct EgModelManager EgModelManager;
 typedef struct EgModelAsset EgModelAsset;
 
+typedef enum EgAssetStatus
+{
+    EG_ASSET_STATUS_LOADING,
+    EG_ASSET_STATUS_READY,
+    EG_ASSET_STATUS_FAILED,
+} EgAssetStatus;
+
 EgModelManager *egModelManagerCreate(
 		EgAllocator *allocator, EgEngine *engine, size_t model_limit, size_t material_limit);
 void egModelManagerDestroy(EgModelManager *manager);
 
 void egModelManagerBeginFrame(EgModelManager *manager, EgCameraUniform *camera_uniform);
+// Camera, model and material uniforms, summed over their frame allocators.
+// The peak is the sum of each allocator's own peak.
+void egModelManagerGetUploadStats(EgModelManager *manager, EgFrameAllocatorStats *stats);
+// Publishes the parts of async loads that became ready, call it once per frame
+// from the main thread
+void egModelManagerUpdate(EgModelManager *manager);
 
 EgModelAsset *egModelAssetFromGltf(
         EgModelManager *manager,
         const uint8_t *data,
         size_t size);
+// Returns immediately and loads the model on the job system. The model renders
+// with placeholder images until its own are decoded, and renders nothing until
+// its geometry is uploaded. data is copied. The manager's allocator has to be
+// thread safe.
+EgModelAsset *egModelAssetLoadAsync(
+        EgModelManager *manager,
+        const uint8_t *data,
+        size_t size);
+EgAssetStatus egModelAssetGetStatus(EgModelAsset *model);
+// Skeleton and animations of glTF models with skins, see animation.h. NULL and
+// zero for other models and until the geometry is loaded. Skins aren't part of
+// cooked files, so cooked models are static. Animations are kept compressed.
+const EgSkeleton *egModelAssetGetSkeleton(EgModelAsset *model);
+uint32_t egModelAssetGetAnimationCount(EgModelAsset *model);
+const EgCompressedAnimationClip *egModelAssetGetAnimation(
+    EgModelAsset *model, uint32_t index);
+// Bounding sphere of the model in model space, false until its geometry is
+// loaded. Models made from an EgMesh have an infinite radius, skinned models
+// the bounds of their bind pose.
+bool egModelAssetGetBounds(EgModelAsset *model, float3 *center, float *radius);
+// Loads a model written by egModelCookGltf. The file is mapped and copied
+// straight into staging memory, returns NULL if it's missing or invalid.
+EgModelAsset *egModelAssetFromCookedFile(EgModelManager *manager, const char *path);
+// Converts a GLB file to the cooked format described in model_file.h, with
+// the geometry ready for the GPU and the images mipmapped (and compressed to
+// BC1/BC5/BC7 if compress_images is set). The format has no skins or
+// animations, so models with either are rejected. Doesn't need a device.
+// Returns NULL if the file can't be parsed or is rejected, the result is
+// allocated with allocator.
+// mesh_stats (if not NULL) receives what the mesh optimizer did.
+uint8_t *egModelCookGltf(
+        EgAllocator *allocator,
+        EgJobSystem *job_system,
+        const uint8_t *data,
+        size_t size,
+        bool compress_images,
+        size_t *cooked_size,
+        EgMeshOptimizeStats *mesh_stats);
 EgModelAsset *egModelAssetFromMesh(
         EgModelManager *manager,
         EgMesh *mesh);
 void egModelAssetDestroy(EgModelAsset *model);
 void egModelAssetRender(EgModelAsset *model, RgCmdBuffer *cmd_buffer, float4x4 *transform);
 
+// Queues the model to be recorded by the next egModelManagerRecordDraws call
+void egModelAssetQueueRender(EgModelAsset *model, float4x4 *transform);
+// Same for a skinned instance of the model. palette has the joint_count
+// matrices of the model skeleton, see egSkeletonBuildPalettes, and is copied.
+// The skinned meshes are drawn from vertices skinned by
+// egModelManagerDispatchSkinning. Models without skins, and instances past the
+// skinning limits of a frame, are drawn like egModelAssetQueueRender does.
+void egModelAssetQueueRenderSkinned(
+    EgModelAsset *model, float4x4 *transform, const float4x4 *palette);
+
+// Skins the instances queued since egModelManagerBeginFrame with one dispatch
+// of pipeline (made from shaders/skinning.hlsl), and makes the result visible
+// to vertex shaders. Record it after queueing and outside of render passes.
+void egModelManagerDispatchSkinning(
+    EgModelManager *manager, RgCmdBuffer *cmd_buffer, RgPipeline *pipeline);
+
+// Records the draws queued since egModelManagerBeginFrame into secondary command
+// buffers, split across worker threads, and executes them from cmd_buffer.
+// render_pass must have been set with rgCmdSetRenderPassSecondary.
+void egModelManagerRecordDraws(
+    EgModelManager *manager,
+    RgCmdBuffer *cmd_buffer,
+    RgRenderPass *render_pass,
+    RgPipeline *pipeline);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <rg.h>
+#include "base.h"
+#include "math_types.h"
+#include "array.h"
+#include "vertex_format.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Scene of a model as model_asset.c builds and draws it, shared with
+// model_file.c which cooks and reads it. Not part of the renderer API.
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgMeshlet EgMeshlet;
+typedef struct EgKtx2Image EgKtx2Image;
+typedef struct EgModelFileSampler EgModelFileSampler;
+
+enum {
+    // Levels of detail after the full primitive, each with about half the
+    // triangles of the previous one
+    MAX_PRIMITIVE_LODS = 4,
+};
+
+typedef struct PrimitiveLod
+{
+    uint32_t first_index; // In units of the primitive index_type
+    uint32_t index_count;
+    float error; // Model space distance
+} PrimitiveLod;
+
+typedef struct Primitive
+{
+    // In units of index_type
+    uint32_t first_index;
+    uint32_t index_count;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    int32_t material_index;
+    RgIndexType index_type;
+    // Into the mesh meshlets, primitives without any are drawn whole
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // Bounding sphere in model space
+    float3 center;
+    float radius;
+    uint32_t lod_count;
+    PrimitiveLod lods[MAX_PRIMITIVE_LODS];
+    bool has_indices;
+    bool is_normal_mapped;
+} Primitive;
+
+typedef struct ModelMesh
+{
+    EgArray(Primitive) primitives;
+    EgArray(EgMeshlet) meshlets;
+    // Shared by the vertices of every primitive
+    EgVertexQuantization quantization;
+    // The vertices of every primitive, relative to the model geometry
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    // Skinned meshes are drawn from the skinned vertices of each instance,
+    // starting at first_skinned_vertex
+    bool is_skinned;
+    uint32_t first_skinned_vertex;
+} ModelMesh;
+
+typedef struct Node
+{
+    int64_t parent_index;
+    EgArray(size_t) children_indices;
+
+    float4x4 matrix;
+    float4x4 resolved_matrix;
+    int64_t mesh_index;
+
+    float3 translation;
+    float3 scale;
+    quat128 rotation;
+} Node;
+
+// Indices into the glTF images referenced by a material, -1 for none
+typedef struct MaterialImageSources
+{
+    int32_t albedo;
+    int32_t normal;
+    int32_t metallic_roughness;
+    int32_t occlusion;
+    int32_t emissive;
+} MaterialImageSources;
+
+// Everything egModelFileWrite needs, the arrays are those of a parsed glTF
+typedef struct ModelFileContents
+{
+    EgArray(EgCompactVertex) vertices;
+    // Mix of 16 and 32-bit indices, see EgModelFilePrimitive
+    EgArray(uint8_t) indices;
+    EgArray(Node) nodes;
+    EgArray(size_t) root_nodes;
+    EgArray(ModelMesh) meshes;
+    const MaterialImageSources *materials;
+    size_t material_count;
+    const EgModelFileSampler *samplers;
+    size_t sampler_count;
+    // NULL leaves every image range empty, images without levels failed to
+    // decode
+    const EgKtx2Image *images;
+    size_t image_count;
+    uint32_t max_mip_count;
+} ModelFileContents;
+
+// Returns the cooked file, allocated with allocator
+uint8_t *egModelFileWrite(
+    EgAllocator *allocator, const ModelFileContents *contents, size_t *cooked_size);
+// Creates the node and mesh arrays from the tables of a file that passed
+// egModelFileValidate
+void egModelFileReadScene(
+    const uint8_t *data,
+    EgAllocator *allocator,
+    EgArray(Node) * nodes,
+    EgArray(size_t) * root_nodes,
+    EgArray(ModelMesh) * meshes);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,576 @@
+#include "model_file.h"
+
+#include <stdio.h>
+#include "math.h"
+#include "array.h"
+#include "allocator.h"
+#include "engine.h"
+#include "ktx2.h"
+#include "meshlet.h"
+#include "vertex_format.h"
+#include "model_asset_internal.h"
+
+EG_STATIC_ASSERT(
+    MAX_PRIMITIVE_LODS == EG_MODEL_FILE_MAX_LODS, "LOD counts must match the file");
+
+// Writer {{{
+typedef struct CookWriter
+{
+    EgAllocator *allocator;
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} CookWriter;
+
+// Appends data at the next aligned offset and returns where it ended up
+static EgModelFileRange CookWrite(CookWriter *writer, const void *data, size_t size)
+{
+    size_t offset = (writer->size + EG_MODEL_FILE_ALIGNMENT - 1) &
+                    ~(size_t)(EG_MODEL_FILE_ALIGNMENT - 1);
+    if (offset + size > writer->capacity)
+    {
+        size_t capacity = writer->capacity * 2;
+        if (capacity < offset + size) capacity = offset + size;
+        writer->data = (uint8_t *)egReallocate(writer->allocator, writer->data, capacity);
+        writer->capacity = capacity;
+    }
+
+    memset(writer->data + writer->size, 0, offset - writer->size);
+    if (size > 0) memcpy(writer->data + offset, data, size);
+    writer->size = offset + size;
+
+    return (EgModelFileRange){offset, size};
+}
+
+uint8_t *egModelFileWrite(
+    EgAllocator *allocator, const ModelFileContents *contents, size_t *cooked_size)
+{
+    CookWriter writer = {.allocator = allocator};
+
+    // Written again at the end, once the ranges are known
+    EgModelFileHeader header = {};
+    CookWrite(&writer, &header, sizeof(header));
+
+    header.magic = EG_MODEL_FILE_MAGIC;
+    header.version = EG_MODEL_FILE_VERSION;
+    header.vertex_size = sizeof(EgCompactVertex);
+    header.max_mip_count = contents->max_mip_count;
+
+    header.vertices = CookWrite(
+        &writer,
+        contents->vertices,
+        sizeof(EgCompactVertex) * egArrayLength(contents->vertices));
+    header.indices =
+        CookWrite(&writer, contents->indices, egArrayLength(contents->indices));
+
+    EgArray(EgModelFileNode) nodes = egArrayCreate(allocator, EgModelFileNode);
+    EgArray(uint32_t) children = egArrayCreate(allocator, uint32_t);
+    EgArray(uint32_t) root_nodes = egArrayCreate(allocator, uint32_t);
+    egArrayResize(&nodes, egArrayLength(contents->nodes));
+    for (size_t i = 0; i < egArrayLength(contents->nodes); ++i)
+    {
+        const Node *node = &contents->nodes[i];
+        EgModelFileNode *file_node = &nodes[i];
+        *file_node = (EgModelFileNode){
+            .translation =
+                {node->translation.x, node->translation.y, node->translation.z},
+            .scale = {node->scale.x, node->scale.y, node->scale.z},
+            .rotation =
+                {node->rotation.x, node->rotation.y, node->rotation.z, node->rotation.w},
+            .parent_index = (int32_t)node->parent_index,
+            .mesh_index = (int32_t)node->mesh_index,
+            .first_child = (uint32_t)egArrayLength(children),
+            .child_count = (uint32_t)egArrayLength(node->children_indices),
+        };
+        memcpy(file_node->matrix, &node->matrix, sizeof(file_node->matrix));
+        memcpy(
+            file_node->resolved_matrix,
+            &node->resolved_matrix,
+            sizeof(file_node->resolved_matrix));
+
+        for (size_t j = 0; j < egArrayLength(node->children_indices); ++j)
+        {
+            egArrayPush(&children, (uint32_t)node->children_indices[j]);
+        }
+    }
+    for (size_t i = 0; i < egArrayLength(contents->root_nodes); ++i)
+    {
+        egArrayPush(&root_nodes, (uint32_t)contents->root_nodes[i]);
+    }
+
+    header.nodes =
+        CookWrite(&writer, nodes, sizeof(EgModelFileNode) * egArrayLength(nodes));
+    header.children =
+        CookWrite(&writer, children, sizeof(uint32_t) * egArrayLength(children));
+    header.root_nodes =
+        CookWrite(&writer, root_nodes, sizeof(uint32_t) * egArrayLength(root_nodes));
+
+    egArrayFree(&nodes);
+    egArrayFree(&children);
+    egArrayFree(&root_nodes);
+
+    EgArray(EgModelFileMesh) meshes = egArrayCreate(allocator, EgModelFileMesh);
+    EgArray(EgModelFilePrimitive) primitives =
+        egArrayCreate(allocator, EgModelFilePrimitive);
+    EgArray(EgModelFileMeshlet) meshlets = egArrayCreate(allocator, EgModelFileMeshlet);
+    for (size_t i = 0; i < egArrayLength(contents->meshes); ++i)
+    {
+        const ModelMesh *mesh = &contents->meshes[i];
+        const EgVertexQuantization *quantization = &mesh->quantization;
+        EgModelFileMesh file_mesh = {
+            .first_primitive = (uint32_t)egArrayLength(primitives),
+            .primitive_count = (uint32_t)egArrayLength(mesh->primitives),
+            .first_meshlet = (uint32_t)egArrayLength(meshlets),
+            .meshlet_count = (uint32_t)egArrayLength(mesh->meshlets),
+        };
+        memcpy(
+            file_mesh.position_offset,
+            &quantization->position_offset,
+            sizeof(file_mesh.position_offset));
+        memcpy(
+            file_mesh.position_scale,
+            &quantization->position_scale,
+            sizeof(file_mesh.position_scale));
+        memcpy(
+            file_mesh.uv_offset, &quantization->uv_offset, sizeof(file_mesh.uv_offset));
+        memcpy(
+            file_mesh.uv_scale, &quantization->uv_scale, sizeof(file_mesh.uv_scale));
+        egArrayPush(&meshes, file_mesh);
+
+        for (size_t j = 0; j < egArrayLength(mesh->primitives); ++j)
+        {
+            Primitive *primitive = &mesh->primitives[j];
+            EgModelFilePrimitive file_primitive = {
+                .first_index = primitive->first_index,
+                .index_count = primitive->index_count,
+                .first_vertex = primitive->first_vertex,
+                .vertex_count = primitive->vertex_count,
+                .index_type = (uint32_t)primitive->index_type,
+                .first_meshlet = primitive->first_meshlet,
+                .meshlet_count = primitive->meshlet_count,
+                .material_index = primitive->material_index,
+                .has_indices = primitive->has_indices,
+                .is_normal_mapped = primitive->is_normal_mapped,
+                .center = {primitive->center.x, primitive->center.y, primitive->center.z},
+                .radius = primitive->radius,
+                .lod_count = primitive->lod_count,
+            };
+            for (uint32_t k = 0; k < primitive->lod_count; ++k)
+            {
+                file_primitive.lods[k] = (EgModelFileLod){
+                    .first_index = primitive->lods[k].first_index,
+                    .index_count = primitive->lods[k].index_count,
+                    .error = primitive->lods[k].error,
+                };
+            }
+            egArrayPush(&primitives, file_primitive);
+        }
+
+        for (size_t j = 0; j < egArrayLength(mesh->meshlets); ++j)
+        {
+            EgMeshlet *meshlet = &mesh->meshlets[j];
+            EgModelFileMeshlet file_meshlet = {
+                .center = {meshlet->center.x, meshlet->center.y, meshlet->center.z},
+                .radius = meshlet->radius,
+                .cone_axis =
+                    {
+                        meshlet->cone_axis.x,
+                        meshlet->cone_axis.y,
+                        meshlet->cone_axis.z,
+                    },
+                .cone_cutoff = meshlet->cone_cutoff,
+                .first_index = meshlet->first_index,
+                .index_count = meshlet->index_count,
+            };
+            egArrayPush(&meshlets, file_meshlet);
+        }
+    }
+
+    header.meshes =
+        CookWrite(&writer, meshes, sizeof(EgModelFileMesh) * egArrayLength(meshes));
+    header.primitives = CookWrite(
+        &writer, primitives, sizeof(EgModelFilePrimitive) * egArrayLength(primitives));
+    header.meshlets = CookWrite(
+        &writer, meshlets, sizeof(EgModelFileMeshlet) * egArrayLength(meshlets));
+
+    egArrayFree(&meshes);
+    egArrayFree(&primitives);
+    egArrayFree(&meshlets);
+
+    EgArray(EgModelFileMaterial) materials =
+        egArrayCreate(allocator, EgModelFileMaterial);
+    for (size_t i = 0; i < contents->material_count; ++i)
+    {
+        const MaterialImageSources *sources = &contents->materials[i];
+        EgModelFileMaterial file_material = {
+            .albedo_image = sources->albedo,
+            .normal_image = sources->normal,
+            .metallic_roughness_image = sources->metallic_roughness,
+            .occlusion_image = sources->occlusion,
+            .emissive_image = sources->emissive,
+        };
+        egArrayPush(&materials, file_material);
+    }
+
+    header.materials = CookWrite(
+        &writer, materials, sizeof(EgModelFileMaterial) * egArrayLength(materials));
+    header.samplers = CookWrite(
+        &writer,
+        contents->samplers,
+        sizeof(EgModelFileSampler) * contents->sampler_count);
+
+    egArrayFree(&materials);
+
+    // Every image becomes a KTX2 file, so the levels keep their own offsets
+    EgArray(EgModelFileRange) images = egArrayCreate(allocator, EgModelFileRange);
+    egArrayResize(&images, contents->image_count);
+    for (size_t i = 0; i < contents->image_count; ++i)
+    {
+        if (!contents->images || contents->images[i].level_count == 0)
+        {
+            if (contents->images) fprintf(stderr, "Failed to decode GLTF image %zu\n", i);
+            images[i] = (EgModelFileRange){0, 0};
+            continue;
+        }
+
+        size_t ktx2_size = 0;
+        uint8_t *ktx2 = egKtx2Write(allocator, &contents->images[i], &ktx2_size);
+        images[i] = CookWrite(&writer, ktx2, ktx2_size);
+        egFree(allocator, ktx2);
+    }
+
+    header.images =
+        CookWrite(&writer, images, sizeof(EgModelFileRange) * egArrayLength(images));
+
+    egArrayFree(&images);
+
+    memcpy(writer.data, &header, sizeof(header));
+
+    *cooked_size = writer.size;
+    return writer.data;
+}
+// }}}
+
+// Reader {{{
+static bool CookedRangeValid(EgModelFileRange range, size_t file_size, size_t item_size)
+{
+    if (range.offset % EG_MODEL_FILE_ALIGNMENT != 0) return false;
+    if (range.offset > file_size || range.size > file_size - range.offset) return false;
+    return range.size % item_size == 0;
+}
+
+bool egModelFileValidate(const uint8_t *data, size_t size)
+{
+    if (size < sizeof(EgModelFileHeader)) return false;
+
+    const EgModelFileHeader *header = (const EgModelFileHeader *)data;
+    if (header->magic != EG_MODEL_FILE_MAGIC) return false;
+    if (header->version != EG_MODEL_FILE_VERSION) return false;
+    if (header->vertex_size != sizeof(EgCompactVertex)) return false;
+
+    if (!CookedRangeValid(header->vertices, size, sizeof(EgCompactVertex)) ||
+        !CookedRangeValid(header->indices, size, sizeof(uint16_t)) ||
+        !CookedRangeValid(header->nodes, size, sizeof(EgModelFileNode)) ||
+        !CookedRangeValid(header->children, size, sizeof(uint32_t)) ||
+        !CookedRangeValid(header->root_nodes, size, sizeof(uint32_t)) ||
+        !CookedRangeValid(header->meshes, size, sizeof(EgModelFileMesh)) ||
+        !CookedRangeValid(header->primitives, size, sizeof(EgModelFilePrimitive)) ||
+        !CookedRangeValid(header->meshlets, size, sizeof(EgModelFileMeshlet)) ||
+        !CookedRangeValid(header->materials, size, sizeof(EgModelFileMaterial)) ||
+        !CookedRangeValid(header->samplers, size, sizeof(EgModelFileSampler)) ||
+        !CookedRangeValid(header->images, size, sizeof(EgModelFileRange)))
+    {
+        return false;
+    }
+
+    if (header->vertices.size == 0) return false;
+
+    size_t vertex_count = EG_MODEL_FILE_COUNT(header, EgCompactVertex, vertices);
+    size_t node_count = EG_MODEL_FILE_COUNT(header, EgModelFileNode, nodes);
+    size_t child_count = EG_MODEL_FILE_COUNT(header, uint32_t, children);
+    size_t mesh_count = EG_MODEL_FILE_COUNT(header, EgModelFileMesh, meshes);
+    size_t primitive_count =
+        EG_MODEL_FILE_COUNT(header, EgModelFilePrimitive, primitives);
+    size_t meshlet_count = EG_MODEL_FILE_COUNT(header, EgModelFileMeshlet, meshlets);
+    size_t material_count = EG_MODEL_FILE_COUNT(header, EgModelFileMaterial, materials);
+    size_t image_count = EG_MODEL_FILE_COUNT(header, EgModelFileRange, images);
+
+    const EgModelFileNode *nodes =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileNode, nodes);
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        if (nodes[i].parent_index >= (int64_t)node_count) return false;
+        if (nodes[i].mesh_index >= (int64_t)mesh_count) return false;
+        if (nodes[i].first_child > child_count) return false;
+        if (nodes[i].child_count > child_count - nodes[i].first_child) return false;
+    }
+
+    const uint32_t *children = EG_MODEL_FILE_TABLE(data, header, uint32_t, children);
+    for (size_t i = 0; i < child_count; ++i)
+    {
+        if (children[i] >= node_count) return false;
+    }
+
+    const uint32_t *root_nodes = EG_MODEL_FILE_TABLE(data, header, uint32_t, root_nodes);
+    for (size_t i = 0; i < EG_MODEL_FILE_COUNT(header, uint32_t, root_nodes); ++i)
+    {
+        if (root_nodes[i] >= node_count) return false;
+    }
+
+    const EgModelFileMesh *meshes =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMesh, meshes);
+    for (size_t i = 0; i < mesh_count; ++i)
+    {
+        if (meshes[i].first_primitive > primitive_count) return false;
+        if (meshes[i].primitive_count > primitive_count - meshes[i].first_primitive)
+            return false;
+    }
+
+    const EgModelFilePrimitive *primitives =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFilePrimitive, primitives);
+    for (size_t i = 0; i < primitive_count; ++i)
+    {
+        const EgModelFilePrimitive *primitive = &primitives[i];
+        if (primitive->material_index < 0 ||
+            primitive->material_index >= (int64_t)material_count)
+            return false;
+
+        if (primitive->first_vertex > vertex_count ||
+            primitive->vertex_count > vertex_count - primitive->first_vertex)
+            return false;
+
+        if (primitive->has_indices)
+        {
+            size_t index_size;
+            switch (primitive->index_type)
+            {
+            case RG_INDEX_TYPE_UINT16: index_size = sizeof(uint16_t); break;
+            case RG_INDEX_TYPE_UINT32: index_size = sizeof(uint32_t); break;
+            default: return false;
+            }
+
+            size_t index_count = header->indices.size / index_size;
+            if (primitive->first_index > index_count ||
+                primitive->index_count > index_count - primitive->first_index)
+                return false;
+
+            if (primitive->lod_count > EG_MODEL_FILE_MAX_LODS) return false;
+            for (uint32_t j = 0; j < primitive->lod_count; ++j)
+            {
+                const EgModelFileLod *lod = &primitive->lods[j];
+                if (lod->first_index > index_count ||
+                    lod->index_count > index_count - lod->first_index)
+                    return false;
+            }
+        }
+        else if (primitive->lod_count > 0)
+        {
+            return false;
+        }
+    }
+
+    const EgModelFileMeshlet *meshlets =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMeshlet, meshlets);
+    for (size_t i = 0; i < mesh_count; ++i)
+    {
+        const EgModelFileMesh *mesh = &meshes[i];
+        if (mesh->first_meshlet > meshlet_count ||
+            mesh->meshlet_count > meshlet_count - mesh->first_meshlet)
+            return false;
+
+        for (size_t j = 0; j < mesh->primitive_count; ++j)
+        {
+            const EgModelFilePrimitive *primitive =
+                &primitives[mesh->first_primitive + j];
+            if (primitive->meshlet_count > 0 && !primitive->has_indices) return false;
+            if (primitive->first_meshlet > mesh->meshlet_count ||
+                primitive->meshlet_count > mesh->meshlet_count - primitive->first_meshlet)
+                return false;
+
+            const EgModelFileMeshlet *primitive_meshlets =
+                &meshlets[mesh->first_meshlet + primitive->first_meshlet];
+            for (size_t k = 0; k < primitive->meshlet_count; ++k)
+            {
+                const EgModelFileMeshlet *meshlet = &primitive_meshlets[k];
+                if (meshlet->first_index > primitive->index_count ||
+                    meshlet->index_count > primitive->index_count - meshlet->first_index)
+                    return false;
+            }
+        }
+    }
+
+    const EgModelFileMaterial *materials =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMaterial, materials);
+    for (size_t i = 0; i < material_count; ++i)
+    {
+        int32_t material_images[] = {
+            materials[i].albedo_image,
+            materials[i].normal_image,
+            materials[i].metallic_roughness_image,
+            materials[i].occlusion_image,
+            materials[i].emissive_image,
+        };
+        for (uint32_t j = 0; j < EG_CARRAY_LENGTH(material_images); ++j)
+        {
+            if (material_images[j] >= (int64_t)image_count) return false;
+        }
+    }
+
+    const EgModelFileRange *images =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileRange, images);
+    for (size_t i = 0; i < image_count; ++i)
+    {
+        if (images[i].offset > size || images[i].size > size - images[i].offset)
+            return false;
+    }
+
+    return true;
+}
+
+void egModelFileReadScene(
+    const uint8_t *data,
+    EgAllocator *allocator,
+    EgArray(Node) * nodes,
+    EgArray(size_t) * root_nodes,
+    EgArray(ModelMesh) * meshes)
+{
+    const EgModelFileHeader *header = (const EgModelFileHeader *)data;
+
+    *nodes = egArrayCreate(allocator, Node);
+    *root_nodes = egArrayCreate(allocator, size_t);
+    *meshes = egArrayCreate(allocator, ModelMesh);
+
+    size_t mesh_count = EG_MODEL_FILE_COUNT(header, EgModelFileMesh, meshes);
+    const EgModelFileMesh *file_meshes =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMesh, meshes);
+    const EgModelFilePrimitive *primitives =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFilePrimitive, primitives);
+    const EgModelFileMeshlet *file_meshlets =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileMeshlet, meshlets);
+    egArrayResize(meshes, mesh_count);
+    for (size_t i = 0; i < mesh_count; ++i)
+    {
+        EgArray(Primitive) mesh_primitives = egArrayCreate(allocator, Primitive);
+        egArrayResize(&mesh_primitives, file_meshes[i].primitive_count);
+        for (uint32_t j = 0; j < file_meshes[i].primitive_count; ++j)
+        {
+            const EgModelFilePrimitive *primitive =
+                &primitives[file_meshes[i].first_primitive + j];
+            mesh_primitives[j] = (Primitive){
+                .first_index = primitive->first_index,
+                .index_count = primitive->index_count,
+                .first_vertex = primitive->first_vertex,
+                .vertex_count = primitive->vertex_count,
+                .material_index = primitive->material_index,
+                .index_type = (RgIndexType)primitive->index_type,
+                .first_meshlet = primitive->first_meshlet,
+                .meshlet_count = primitive->meshlet_count,
+                .has_indices = primitive->has_indices != 0,
+                .is_normal_mapped = primitive->is_normal_mapped != 0,
+                .center =
+                    V3(primitive->center[0], primitive->center[1], primitive->center[2]),
+                .radius = primitive->radius,
+                .lod_count = primitive->lod_count,
+            };
+            for (uint32_t k = 0; k < primitive->lod_count; ++k)
+            {
+                mesh_primitives[j].lods[k] = (PrimitiveLod){
+                    .first_index = primitive->lods[k].first_index,
+                    .index_count = primitive->lods[k].index_count,
+                    .error = primitive->lods[k].error,
+                };
+            }
+        }
+
+        const EgModelFileMesh *file_mesh = &file_meshes[i];
+
+        EgArray(EgMeshlet) mesh_meshlets = egArrayCreate(allocator, EgMeshlet);
+        egArrayResize(&mesh_meshlets, file_mesh->meshlet_count);
+        for (uint32_t j = 0; j < file_mesh->meshlet_count; ++j)
+        {
+            const EgModelFileMeshlet *meshlet =
+                &file_meshlets[file_mesh->first_meshlet + j];
+            mesh_meshlets[j] = (EgMeshlet){
+                .center = V3(meshlet->center[0], meshlet->center[1], meshlet->center[2]),
+                .radius = meshlet->radius,
+                .cone_axis = V3(
+                    meshlet->cone_axis[0], meshlet->cone_axis[1], meshlet->cone_axis[2]),
+                .cone_cutoff = meshlet->cone_cutoff,
+                .first_index = meshlet->first_index,
+                .index_count = meshlet->index_count,
+            };
+        }
+
+        ModelMesh *mesh = &(*meshes)[i];
+        *mesh = (ModelMesh){
+            .primitives = mesh_primitives,
+            .meshlets = mesh_meshlets,
+        };
+        memcpy(
+            &mesh->quantization.position_offset,
+            file_mesh->position_offset,
+            sizeof(file_mesh->position_offset));
+        memcpy(
+            &mesh->quantization.position_scale,
+            file_mesh->position_scale,
+            sizeof(file_mesh->position_scale));
+        memcpy(
+            &mesh->quantization.uv_offset,
+            file_mesh->uv_offset,
+            sizeof(file_mesh->uv_offset));
+        memcpy(
+            &mesh->quantization.uv_scale,
+            file_mesh->uv_scale,
+            sizeof(file_mesh->uv_scale));
+    }
+
+    size_t node_count = EG_MODEL_FILE_COUNT(header, EgModelFileNode, nodes);
+    const EgModelFileNode *file_nodes =
+        EG_MODEL_FILE_TABLE(data, header, EgModelFileNode, nodes);
+    const uint32_t *children = EG_MODEL_FILE_TABLE(data, header, uint32_t, children);
+    egArrayResize(nodes, node_count);
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        const EgModelFileNode *file_node = &file_nodes[i];
+        Node *node = &(*nodes)[i];
+        *node = (Node){
+            .parent_index = file_node->parent_index,
+            .children_indices = egArrayCreate(allocator, size_t),
+            .mesh_index = file_node->mesh_index,
+
+            .translation = V3(
+                file_node->translation[0],
+                file_node->translation[1],
+                file_node->translation[2]),
+            .scale =
+                V3(file_node->scale[0], file_node->scale[1], file_node->scale[2]),
+            .rotation =
+                {
+                    file_node->rotation[0],
+                    file_node->rotation[1],
+                    file_node->rotation[2],
+                    file_node->rotation[3],
+                },
+        };
+        memcpy(&node->matrix, file_node->matrix, sizeof(file_node->matrix));
+        memcpy(
+            &node->resolved_matrix,
+            file_node->resolved_matrix,
+            sizeof(file_node->resolved_matrix));
+
+        for (uint32_t j = 0; j < file_node->child_count; ++j)
+        {
+            egArrayPush(
+                &node->children_indices, (size_t)children[file_node->first_child + j]);
+        }
+    }
+
+    size_t root_node_count = EG_MODEL_FILE_COUNT(header, uint32_t, root_nodes);
+    const uint32_t *file_root_nodes =
+        EG_MODEL_FILE_TABLE(data, header, uint32_t, root_nodes);
+    for (size_t i = 0; i < root_node_count; ++i)
+    {
+        egArrayPush(root_nodes, (size_t)file_root_nodes[i]);
+    }
+}
+// }}}
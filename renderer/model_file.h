@@ -0,0 +1,156 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cooked model file (.egm), written by egModelCookGltf and read by
+// egModelAssetFromCookedFile. Everything is little endian and every range
+// starts at a multiple of EG_MODEL_FILE_ALIGNMENT, so tables can be used in
+// place and blobs copied straight to staging memory.
+//
+// The file starts with EgModelFileHeader, the ranges it points to hold:
+//  - vertices: EgCompactVertex array, ready for the vertex buffer
+//  - indices: 16 and 32-bit indices, ready for the index buffer. Each
+//    primitive's indices are relative to its first vertex and use the
+//    smallest type its vertex count allows. The levels of detail of a
+//    primitive follow its full indices and use the same type.
+//  - nodes: EgModelFileNode array
+//  - children: uint32_t node indices, referenced by the nodes
+//  - root_nodes: uint32_t node indices
+//  - meshes: EgModelFileMesh array
+//  - primitives: EgModelFilePrimitive array, referenced by the meshes
+//  - meshlets: EgModelFileMeshlet array, referenced by the meshes
+//  - materials: EgModelFileMaterial array
+//  - samplers: EgModelFileSampler array
+//  - images: EgModelFileRange array, each one a KTX2 file with the full mip
+//    chain, or an empty range for images that failed to cook
+
+#define EG_MODEL_FILE_MAGIC 0x314D4745 // "EGM1"
+#define EG_MODEL_FILE_VERSION 5
+#define EG_MODEL_FILE_ALIGNMENT 16
+#define EG_MODEL_FILE_MAX_LODS 4
+
+typedef struct EgModelFileRange
+{
+    uint64_t offset;
+    uint64_t size;
+} EgModelFileRange;
+
+typedef struct EgModelFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vertex_size; // sizeof(EgCompactVertex) when the file was cooked
+    uint32_t max_mip_count;
+
+    EgModelFileRange vertices;
+    EgModelFileRange indices;
+    EgModelFileRange nodes;
+    EgModelFileRange children;
+    EgModelFileRange root_nodes;
+    EgModelFileRange meshes;
+    EgModelFileRange primitives;
+    EgModelFileRange meshlets;
+    EgModelFileRange materials;
+    EgModelFileRange samplers;
+    EgModelFileRange images;
+} EgModelFileHeader;
+
+typedef struct EgModelFileNode
+{
+    float matrix[16];
+    float resolved_matrix[16];
+    float translation[3];
+    float scale[3];
+    float rotation[4];
+    int32_t parent_index; // -1 for root nodes
+    int32_t mesh_index;   // -1 for nodes without a mesh
+    uint32_t first_child;
+    uint32_t child_count;
+} EgModelFileNode;
+
+typedef struct EgModelFileMesh
+{
+    uint32_t first_primitive;
+    uint32_t primitive_count;
+    uint32_t first_meshlet;
+    uint32_t meshlet_count;
+    // EgVertexQuantization of the mesh vertices
+    float position_offset[3];
+    float position_scale[3];
+    float uv_offset[2];
+    float uv_scale[2];
+} EgModelFileMesh;
+
+// Simplified indices of a primitive, with the largest distance (in model
+// space) they move the surface by
+typedef struct EgModelFileLod
+{
+    uint32_t first_index; // In units of the primitive index_type
+    uint32_t index_count;
+    float error;
+} EgModelFileLod;
+
+typedef struct EgModelFilePrimitive
+{
+    uint32_t first_index; // In units of index_type
+    uint32_t index_count;
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    uint32_t index_type; // RgIndexType
+    uint32_t first_meshlet; // Relative to the mesh
+    uint32_t meshlet_count;
+    int32_t material_index;
+    uint32_t has_indices;
+    uint32_t is_normal_mapped;
+    // Bounding sphere in model space
+    float center[3];
+    float radius;
+    // From finest to coarsest, all coarser than the full indices
+    uint32_t lod_count;
+    EgModelFileLod lods[EG_MODEL_FILE_MAX_LODS];
+} EgModelFilePrimitive;
+
+// EgMeshlet
+typedef struct EgModelFileMeshlet
+{
+    float center[3];
+    float radius;
+    float cone_axis[3];
+    float cone_cutoff;
+    uint32_t first_index;
+    uint32_t index_count;
+} EgModelFileMeshlet;
+
+// Indices into the images, -1 for none
+typedef struct EgModelFileMaterial
+{
+    int32_t albedo_image;
+    int32_t normal_image;
+    int32_t metallic_roughness_image;
+    int32_t occlusion_image;
+    int32_t emissive_image;
+} EgModelFileMaterial;
+
+typedef struct EgModelFileSampler
+{
+    uint32_t mag_filter; // RgFilter
+    uint32_t min_filter; // RgFilter
+} EgModelFileSampler;
+
+// Checks the ranges and every index stored in the tables, so a loader can
+// trust them
+bool egModelFileValidate(const uint8_t *data, size_t size);
+
+// Table of a valid file, and its number of items
+#define EG_MODEL_FILE_TABLE(data, header, type, range)                                  \
+    ((const type *)((data) + (header)->range.offset))
+#define EG_MODEL_FILE_COUNT(header, type, range)                                        \
+    ((size_t)((header)->range.size / sizeof(type)))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,165 @@
+#include "offset_allocator.h"
+
+#include <string.h>
+#include "allocator.h"
+#include "array.h"
+
+typedef struct FreeRange
+{
+    uint64_t offset;
+    uint64_t size;
+} FreeRange;
+
+struct EgOffsetAllocator
+{
+    EgAllocator *allocator;
+    uint64_t size;
+    uint64_t free_size;
+    // Sorted by offset, neighbours are always merged
+    EgArray(FreeRange) free_ranges;
+};
+
+static void
+InsertRange(EgOffsetAllocator *offset_allocator, size_t index, FreeRange range)
+{
+    size_t count = egArrayLength(offset_allocator->free_ranges);
+    egArrayResize(&offset_allocator->free_ranges, count + 1);
+
+    FreeRange *ranges = offset_allocator->free_ranges;
+    memmove(&ranges[index + 1], &ranges[index], sizeof(FreeRange) * (count - index));
+    ranges[index] = range;
+}
+
+static void RemoveRange(EgOffsetAllocator *offset_allocator, size_t index)
+{
+    size_t count = egArrayLength(offset_allocator->free_ranges);
+
+    FreeRange *ranges = offset_allocator->free_ranges;
+    memmove(&ranges[index], &ranges[index + 1], sizeof(FreeRange) * (count - index - 1));
+    egArrayPop(&offset_allocator->free_ranges);
+}
+
+EgOffsetAllocator *egOffsetAllocatorCreate(EgAllocator *allocator, uint64_t size)
+{
+    EgOffsetAllocator *offset_allocator =
+        (EgOffsetAllocator *)egAllocate(allocator, sizeof(*offset_allocator));
+    *offset_allocator = (EgOffsetAllocator){
+        .allocator = allocator,
+        .size = size,
+        .free_size = size,
+        .free_ranges = egArrayCreate(allocator, FreeRange),
+    };
+
+    if (size > 0)
+    {
+        FreeRange range = {0, size};
+        egArrayPush(&offset_allocator->free_ranges, range);
+    }
+
+    return offset_allocator;
+}
+
+void egOffsetAllocatorDestroy(EgOffsetAllocator *offset_allocator)
+{
+    egArrayFree(&offset_allocator->free_ranges);
+    egFree(offset_allocator->allocator, offset_allocator);
+}
+
+uint64_t egOffsetAllocatorAllocate(
+    EgOffsetAllocator *offset_allocator, uint64_t size, uint64_t alignment)
+{
+    EG_ASSERT(size > 0);
+    EG_ASSERT(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+    FreeRange *ranges = offset_allocator->free_ranges;
+    size_t best_index = SIZE_MAX;
+    uint64_t best_waste = UINT64_MAX;
+
+    for (size_t i = 0; i < egArrayLength(ranges); ++i)
+    {
+        uint64_t aligned = (ranges[i].offset + alignment - 1) & ~(alignment - 1);
+        uint64_t padding = aligned - ranges[i].offset;
+        if (padding > ranges[i].size || ranges[i].size - padding < size) continue;
+
+        uint64_t waste = ranges[i].size - size;
+        if (waste < best_waste)
+        {
+            best_index = i;
+            best_waste = waste;
+            if (waste == 0) break;
+        }
+    }
+
+    if (best_index == SIZE_MAX) return EG_OFFSET_ALLOCATOR_INVALID;
+
+    // The padding before the allocation and whatever is left after it stay
+    // free
+    FreeRange range = ranges[best_index];
+    uint64_t offset = (range.offset + alignment - 1) & ~(alignment - 1);
+    FreeRange before = {range.offset, offset - range.offset};
+    FreeRange after = {offset + size, range.offset + range.size - (offset + size)};
+
+    RemoveRange(offset_allocator, best_index);
+    if (after.size > 0) InsertRange(offset_allocator, best_index, after);
+    if (before.size > 0) InsertRange(offset_allocator, best_index, before);
+
+    offset_allocator->free_size -= size;
+    return offset;
+}
+
+void egOffsetAllocatorFree(
+    EgOffsetAllocator *offset_allocator, uint64_t offset, uint64_t size)
+{
+    EG_ASSERT(size > 0);
+    EG_ASSERT(offset + size <= offset_allocator->size);
+
+    // First range after the freed one
+    FreeRange *ranges = offset_allocator->free_ranges;
+    size_t low = 0;
+    size_t high = egArrayLength(ranges);
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if (ranges[middle].offset < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    size_t index = low;
+    bool has_previous = index > 0;
+    bool has_next = index < egArrayLength(ranges);
+    uint64_t previous_end =
+        has_previous ? ranges[index - 1].offset + ranges[index - 1].size : 0;
+    EG_ASSERT(previous_end <= offset);
+    EG_ASSERT(!has_next || offset + size <= ranges[index].offset);
+
+    bool merge_before = has_previous && previous_end == offset;
+    bool merge_after = has_next && offset + size == ranges[index].offset;
+
+    if (merge_before && merge_after)
+    {
+        ranges[index - 1].size += size + ranges[index].size;
+        RemoveRange(offset_allocator, index);
+    }
+    else if (merge_before)
+    {
+        ranges[index - 1].size += size;
+    }
+    else if (merge_after)
+    {
+        ranges[index].offset = offset;
+        ranges[index].size += size;
+    }
+    else
+    {
+        InsertRange(offset_allocator, index, (FreeRange){offset, size});
+    }
+
+    offset_allocator->free_size += size;
+}
+
+uint64_t egOffsetAllocatorGetFreeSize(EgOffsetAllocator *offset_allocator)
+{
+    return offset_allocator->free_size;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgOffsetAllocator EgOffsetAllocator;
+
+#define EG_OFFSET_ALLOCATOR_INVALID UINT64_MAX
+
+// Hands out ranges of [0, size) for sub-allocating a buffer. It only tracks
+// offsets, the memory lives somewhere else. Not thread safe.
+EgOffsetAllocator *egOffsetAllocatorCreate(EgAllocator *allocator, uint64_t size);
+void egOffsetAllocatorDestroy(EgOffsetAllocator *offset_allocator);
+
+// Returns the offset of the best fitting free range, or
+// EG_OFFSET_ALLOCATOR_INVALID if none is large enough. alignment must be a
+// power of two.
+uint64_t egOffsetAllocatorAllocate(
+    EgOffsetAllocator *offset_allocator, uint64_t size, uint64_t alignment);
+// size must be the one the range was allocated with
+void egOffsetAllocatorFree(
+    EgOffsetAllocator *offset_allocator, uint64_t offset, uint64_t size);
+
+uint64_t egOffsetAllocatorGetFreeSize(EgOffsetAllocator *offset_allocator);
+
+#ifdef __cplusplus
+}
+#endif
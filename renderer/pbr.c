@@ -41,7 +41,7 @@ EgImage egGenerateBRDFLUT(EgEngine *engine, RgCmdPool *cmd_pool, uint32_t dim)
 
     rgCmdBufferEnd(cmd_buffer);
 
-    rgCmdBufferSubmit(cmd_buffer);
+    rgCmdBufferSubmitFenceOnly(cmd_buffer);
     rgCmdBufferWait(device, cmd_buffer);
 
     rgCmdBufferDestroy(device, cmd_pool, cmd_buffer);
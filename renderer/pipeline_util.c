@@ -10,11 +10,32 @@
 #include "engine.h"
 #include "math.h"
 #include "array.h"
+#include "asset_cache.h"
 
 enum {
     MAX_ATTRIBUTES = 16,
 };
 
+typedef enum VertexFormat
+{
+    // Tightly packed 32-bit inputs, laid out like the shader declares them
+    VERTEX_FORMAT_FLOAT,
+    // EgCompactVertex, the shader inputs get their packed formats from
+    // compact_attributes
+    VERTEX_FORMAT_COMPACT,
+    // No vertex inputs, the shader reads the engine vertex buffer through the
+    // bindless storage buffers with SV_VertexID, see EgVertexFormat
+    VERTEX_FORMAT_PULLED,
+} VertexFormat;
+
+// By location: position, normal, tangent, uv
+static const RgVertexAttribute compact_attributes[] = {
+    {RG_FORMAT_RGBA16_UNORM, offsetof(EgCompactVertex, pos)},
+    {RG_FORMAT_RG16_SNORM, offsetof(EgCompactVertex, normal)},
+    {RG_FORMAT_RG16_SNORM, offsetof(EgCompactVertex, tangent)},
+    {RG_FORMAT_RG16_UNORM, offsetof(EgCompactVertex, uv)},
+};
+
 typedef struct Id
 {
     uint32_t opcode;
@@ -49,8 +70,38 @@ struct PipelineAsset
     RgPipeline *pipeline;
 };
 
+RgPipeline *egPipelineUtilCreateComputePipeline(
+    EgEngine *engine,
+    EgAllocator *allocator,
+    RgPipelineLayout *pipeline_layout,
+    const char *hlsl,
+    size_t hlsl_size)
+{
+    RgDevice *device = egEngineGetDevice(engine);
+
+    size_t code_size = 0;
+    uint8_t *code = compileShader(
+        engine, allocator, hlsl, hlsl_size, TS_SHADER_STAGE_COMPUTE, "main", &code_size);
+
+    RgComputePipelineInfo pipeline_info = {0};
+    pipeline_info.pipeline_layout = pipeline_layout;
+    pipeline_info.code = code;
+    pipeline_info.code_size = code_size;
+    pipeline_info.entry = "main";
+
+    RgPipeline *pipeline = rgComputePipelineCreate(device, &pipeline_info);
+
+    egFree(allocator, code);
+
+    return pipeline;
+}
+
 static void analyzeSpirv(
-    RgShaderStage stage, const uint32_t *code, size_t code_size, ModuleInfo *module);
+    RgShaderStage stage,
+    VertexFormat vertex_format,
+    const uint32_t *code,
+    size_t code_size,
+    ModuleInfo *module);
 
 static bool isWhitespace(char c)
 {
@@ -123,6 +174,19 @@ static bool stringToPolygonMode(const char *str, size_t len, RgPolygonMode *valu
     return true;
 }
 
+static bool stringToVertexFormat(const char *str, size_t len, VertexFormat *value)
+{
+    if (strncmp(str, "float", len) == 0)
+        *value = VERTEX_FORMAT_FLOAT;
+    else if (strncmp(str, "compact", len) == 0)
+        *value = VERTEX_FORMAT_COMPACT;
+    else if (strncmp(str, "pulled", len) == 0)
+        *value = VERTEX_FORMAT_PULLED;
+    else
+        return false;
+    return true;
+}
+
 static bool stringToCompareOp(const char *str, size_t len, RgCompareOp *value)
 {
     if (strncmp(str, "never", len) == 0) *value = RG_COMPARE_OP_NEVER;
@@ -140,78 +204,104 @@ static bool stringToCompareOp(const char *str, size_t len, RgCompareOp *value)
     return true;
 }
 
-RgPipeline *egPipelineUtilCreateGraphicsPipeline(
+// Bump whenever the compiler changes its output
+#define SHADER_CACHE_VERSION 1
+
+typedef struct ShaderCacheParams
+{
+    uint32_t version;
+    uint32_t stage;
+    char entry_point[32];
+} ShaderCacheParams;
+
+// Returns SPIR-V allocated with allocator. Sources can't include other files,
+// so they're all the cache key needs besides the stage and entry point.
+static uint8_t *compileShader(
     EgEngine *engine,
     EgAllocator *allocator,
-    RgPipelineLayout *pipeline_layout,
     const char *hlsl,
-    size_t hlsl_size)
+    size_t hlsl_size,
+    TsShaderStage stage,
+    const char *entry_point,
+    size_t *spirv_size)
 {
-    RgDevice *device = egEngineGetDevice(engine);
+    EgAssetCache *cache = egEngineGetAssetCache(engine);
 
-    uint8_t *vertex_code = NULL;
-    size_t vertex_code_size = 0;
+    ShaderCacheParams params = {0};
+    params.version = SHADER_CACHE_VERSION;
+    params.stage = (uint32_t)stage;
+    strncpy(params.entry_point, entry_point, sizeof(params.entry_point) - 1);
+    EgAssetCacheKey key =
+        egAssetCacheKeyCreate("shader", hlsl, hlsl_size, &params, sizeof(params));
 
-    // Compile vertex
+    EgAssetCacheEntry entry;
+    if (cache && egAssetCacheLoad(cache, key, &entry))
     {
-        TsCompilerOptions *options = tsCompilerOptionsCreate();
-        tsCompilerOptionsSetStage(options, TS_SHADER_STAGE_VERTEX);
-        tsCompilerOptionsSetEntryPoint(options, "vertex", strlen("vertex"));
-        tsCompilerOptionsSetSource(options, hlsl, hlsl_size, NULL, 0);
-
-        TsCompilerOutput *output = tsCompile(options);
-        const char *errors = tsCompilerOutputGetErrors(output);
-        if (errors)
-        {
-            fprintf(stderr, "Shader compilation error:\n%s\n", errors);
+        uint8_t *code = (uint8_t *)egAllocate(allocator, entry.size);
+        memcpy(code, entry.data, entry.size);
+        *spirv_size = entry.size;
 
-            tsCompilerOutputDestroy(output);
-            tsCompilerOptionsDestroy(options);
-            exit(1);
-        }
+        egAssetCacheEntryRelease(&entry);
+        return code;
+    }
 
-        size_t spirv_size = 0;
-        const uint8_t *spirv = tsCompilerOutputGetSpirv(output, &spirv_size);
+    TsCompilerOptions *options = tsCompilerOptionsCreate();
+    tsCompilerOptionsSetStage(options, stage);
+    tsCompilerOptionsSetEntryPoint(options, entry_point, strlen(entry_point));
+    tsCompilerOptionsSetSource(options, hlsl, hlsl_size, NULL, 0);
 
-        vertex_code = (uint8_t *)egAllocate(allocator, spirv_size);
-        memcpy(vertex_code, spirv, spirv_size);
-        vertex_code_size = spirv_size;
+    TsCompilerOutput *output = tsCompile(options);
+    const char *errors = tsCompilerOutputGetErrors(output);
+    if (errors)
+    {
+        fprintf(stderr, "Shader compilation error:\n%s\n", errors);
 
         tsCompilerOutputDestroy(output);
         tsCompilerOptionsDestroy(options);
+        exit(1);
     }
 
-    uint8_t *fragment_code = NULL;
-    size_t fragment_code_size = 0;
+    const uint8_t *spirv = tsCompilerOutputGetSpirv(output, spirv_size);
 
-    // Compile fragment
-    {
-        TsCompilerOptions *options = tsCompilerOptionsCreate();
-        tsCompilerOptionsSetStage(options, TS_SHADER_STAGE_FRAGMENT);
-        tsCompilerOptionsSetEntryPoint(options, "pixel", strlen("pixel"));
-        tsCompilerOptionsSetSource(options, hlsl, hlsl_size, NULL, 0);
-
-        TsCompilerOutput *output = tsCompile(options);
-        const char *errors = tsCompilerOutputGetErrors(output);
-        if (errors)
-        {
-            fprintf(stderr, "Shader compilation error:\n%s\n", errors);
+    if (cache) egAssetCacheStore(cache, key, spirv, *spirv_size);
 
-            tsCompilerOutputDestroy(output);
-            tsCompilerOptionsDestroy(options);
-            exit(1);
-        }
+    uint8_t *code = (uint8_t *)egAllocate(allocator, *spirv_size);
+    memcpy(code, spirv, *spirv_size);
 
-        size_t spirv_size = 0;
-        const uint8_t *spirv = tsCompilerOutputGetSpirv(output, &spirv_size);
+    tsCompilerOutputDestroy(output);
+    tsCompilerOptionsDestroy(options);
 
-        fragment_code = (uint8_t *)egAllocate(allocator, spirv_size);
-        memcpy(fragment_code, spirv, spirv_size);
-        fragment_code_size = spirv_size;
+    return code;
+}
 
-        tsCompilerOutputDestroy(output);
-        tsCompilerOptionsDestroy(options);
-    }
+RgPipeline *egPipelineUtilCreateGraphicsPipeline(
+    EgEngine *engine,
+    EgAllocator *allocator,
+    RgPipelineLayout *pipeline_layout,
+    const char *hlsl,
+    size_t hlsl_size)
+{
+    RgDevice *device = egEngineGetDevice(engine);
+
+    size_t vertex_code_size = 0;
+    uint8_t *vertex_code = compileShader(
+        engine,
+        allocator,
+        hlsl,
+        hlsl_size,
+        TS_SHADER_STAGE_VERTEX,
+        "vertex",
+        &vertex_code_size);
+
+    size_t fragment_code_size = 0;
+    uint8_t *fragment_code = compileShader(
+        engine,
+        allocator,
+        hlsl,
+        hlsl_size,
+        TS_SHADER_STAGE_FRAGMENT,
+        "pixel",
+        &fragment_code_size);
 
     RgGraphicsPipelineInfo pipeline_info = {0};
     pipeline_info.polygon_mode = RG_POLYGON_MODE_FILL;
@@ -232,6 +322,8 @@ RgPipeline *egPipelineUtilCreateGraphicsPipeline(
     pipeline_info.fragment_size = fragment_code_size;
     pipeline_info.fragment_entry = "pixel";
 
+    VertexFormat vertex_format = VERTEX_FORMAT_FLOAT;
+
     const char *pragma = "#pragma";
     size_t pragma_len = strlen(pragma);
 
@@ -306,6 +398,10 @@ RgPipeline *egPipelineUtilCreateGraphicsPipeline(
             {
                 success = stringToFrontFace(value, value_len, &pipeline_info.front_face);
             }
+            else if (strncmp(key, "vertex_format", key_len) == 0)
+            {
+                success = stringToVertexFormat(value, value_len, &vertex_format);
+            }
             else
             {
                 success = false;
@@ -327,6 +423,7 @@ RgPipeline *egPipelineUtilCreateGraphicsPipeline(
     ModuleInfo vertex_module = {0};
     analyzeSpirv(
         RG_SHADER_STAGE_VERTEX,
+        vertex_format,
         (uint32_t *)vertex_code,
         vertex_code_size / 4,
         &vertex_module);
@@ -346,7 +443,11 @@ RgPipeline *egPipelineUtilCreateGraphicsPipeline(
 }
 
 static void analyzeSpirv(
-    RgShaderStage stage, const uint32_t *code, size_t code_size, ModuleInfo *module)
+    RgShaderStage stage,
+    VertexFormat vertex_format,
+    const uint32_t *code,
+    size_t code_size,
+    ModuleInfo *module)
 {
     memset(module, 0, sizeof(*module));
 
@@ -473,11 +574,26 @@ static void analyzeSpirv(
             case SpvStorageClassInput: {
                 if (!id->is_builtin && stage == RG_SHADER_STAGE_VERTEX)
                 {
+                    // Pulled vertices only use built-in inputs
+                    EG_ASSERT(vertex_format != VERTEX_FORMAT_PULLED);
+
                     module->attributes_count =
                         EG_MAX(module->attributes_count, id->location + 1);
                     RgVertexAttribute *attrib = &module->attributes[id->location];
 
-                    if (pointed_type->opcode == SpvOpTypeVector)
+                    if (vertex_format == VERTEX_FORMAT_COMPACT)
+                    {
+                        // Normalized formats are read as floats
+                        Id *elem_type = pointed_type;
+                        if (pointed_type->opcode == SpvOpTypeVector)
+                            elem_type = &ids[pointed_type->subtype_id];
+                        EG_ASSERT(elem_type->opcode == SpvOpTypeFloat);
+
+                        EG_ASSERT(
+                            id->location < EG_CARRAY_LENGTH(compact_attributes));
+                        *attrib = compact_attributes[id->location];
+                    }
+                    else if (pointed_type->opcode == SpvOpTypeVector)
                     {
                         uint32_t vector_width = pointed_type->vector_width;
                         Id *elem_type = &ids[pointed_type->subtype_id];
@@ -531,6 +647,19 @@ static void analyzeSpirv(
         }
     }
 
+    if (vertex_format == VERTEX_FORMAT_COMPACT)
+    {
+        module->vertex_stride = sizeof(EgCompactVertex);
+        free(ids);
+        return;
+    }
+
+    if (vertex_format == VERTEX_FORMAT_PULLED)
+    {
+        free(ids);
+        return;
+    }
+
     size_t offset = 0;
     for (uint32_t i = 0; i < module->attributes_count; ++i)
     {
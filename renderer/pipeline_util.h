@@ -17,6 +17,12 @@ RgPipeline *egPipelineUtilCreateGraphicsPipeline(
         EgAllocator *allocator,
         RgPipelineLayout *pipeline_layout,
         const char *hlsl, size_t hlsl_size);
+// The entry point is "main"
+RgPipeline *egPipelineUtilCreateComputePipeline(
+        EgEngine *engine,
+        EgAllocator *allocator,
+        RgPipelineLayout *pipeline_layout,
+        const char *hlsl, size_t hlsl_size);
 
 #ifdef __cplusplus
 }
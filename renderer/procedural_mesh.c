@@ -0,0 +1,447 @@
+#include "procedural_mesh.h"
+
+#include "math.h"
+#include "engine.h"
+#include "job_system.h"
+
+// Rows are handed to jobs in chunks of about this many vertices
+#define GENERATE_VERTICES_PER_JOB 4096
+
+#define MAX_PATCHES 6
+
+// Every shape is made of grids of (columns + 1) * (rows + 1) vertices, each
+// evaluated on its own, which is what makes the counts exact and the rows
+// independent
+typedef struct Patch
+{
+    // Cube face, or side and caps of the cylinder
+    uint32_t part;
+    uint32_t columns;
+    uint32_t rows;
+    // The first or last row of vertices is a single point (a pole or the
+    // center of a cap), the triangles that would be degenerate are dropped
+    bool collapse_first;
+    bool collapse_last;
+    // The UV directions are clockwise around the normal
+    bool flip;
+    size_t first_vertex;
+    size_t first_index;
+    // Into the vertex rows of all the patches
+    size_t first_row;
+} Patch;
+
+typedef struct Generator
+{
+    const EgProceduralMeshInfo *info;
+    Patch patches[MAX_PATCHES];
+    uint32_t patch_count;
+    size_t row_count;
+    size_t vertex_count;
+    size_t index_count;
+    EgVertex *vertices;
+    uint32_t *indices;
+} Generator;
+
+// Point of a patch, the tangent and bitangent point towards increasing U and
+// V and don't need to be normalized
+typedef struct Surface
+{
+    float3 pos;
+    float3 normal;
+    float3 tangent;
+    float3 bitangent;
+    float2 uv;
+} Surface;
+
+// Unit cube faces, as origin + U * right + V * up
+static const float CUBE_ORIGINS[6][3] = {
+    {-1.0f, -1.0f, -1.0f},
+    {1.0f, -1.0f, -1.0f},
+    {1.0f, -1.0f, 1.0f},
+    {-1.0f, -1.0f, 1.0f},
+    {-1.0f, 1.0f, -1.0f},
+    {-1.0f, -1.0f, 1.0f},
+};
+static const float CUBE_RIGHTS[6][3] = {
+    {2.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, 2.0f},
+    {-2.0f, 0.0f, 0.0f},
+    {0.0f, 0.0f, -2.0f},
+    {2.0f, 0.0f, 0.0f},
+    {2.0f, 0.0f, 0.0f},
+};
+static const float CUBE_UPS[6][3] = {
+    {0.0f, 2.0f, 0.0f},
+    {0.0f, 2.0f, 0.0f},
+    {0.0f, 2.0f, 0.0f},
+    {0.0f, 2.0f, 0.0f},
+    {0.0f, 0.0f, 2.0f},
+    {0.0f, 0.0f, -2.0f},
+};
+
+enum {
+    CYLINDER_SIDE = 0,
+    CYLINDER_TOP = 1,
+    CYLINDER_BOTTOM = 2,
+};
+
+static float3 LoadFloat3(const float v[3])
+{
+    return V3(v[0], v[1], v[2]);
+}
+
+// Point of a sphere or capsule at polar angle theta (zero at the top) and
+// azimuth phi
+static void EvaluateSphere(Surface *surface, float radius, float theta, float phi)
+{
+    float sin_theta = sinf(theta), cos_theta = cosf(theta);
+    float sin_phi = sinf(phi), cos_phi = cosf(phi);
+
+    surface->normal = V3(sin_theta * cos_phi, cos_theta, sin_theta * sin_phi);
+    surface->pos = egFloat3MulScalar(surface->normal, radius);
+    surface->tangent = V3(-sin_phi, 0.0f, cos_phi);
+    surface->bitangent = V3(cos_theta * cos_phi, -sin_theta, cos_theta * sin_phi);
+}
+
+static Surface EvaluatePatch(
+    const EgProceduralMeshInfo *info, const Patch *patch, uint32_t column, uint32_t row)
+{
+    float u = (float)column / (float)patch->columns;
+    float v = (float)row / (float)patch->rows;
+    float phi = u * 2.0f * EG_PI;
+
+    Surface surface = {0};
+    surface.uv = V2(u, v);
+
+    switch (info->shape)
+    {
+    case EG_PROCEDURAL_SHAPE_CUBE:
+    case EG_PROCEDURAL_SHAPE_CUBE_SPHERE: {
+        float3 right = LoadFloat3(CUBE_RIGHTS[patch->part]);
+        float3 up = LoadFloat3(CUBE_UPS[patch->part]);
+        float3 p = egFloat3Add(
+            LoadFloat3(CUBE_ORIGINS[patch->part]),
+            egFloat3Add(egFloat3MulScalar(right, u), egFloat3MulScalar(up, v)));
+
+        if (info->shape == EG_PROCEDURAL_SHAPE_CUBE)
+        {
+            surface.pos = egFloat3MulScalar(p, info->radius);
+            surface.normal = egFloat3Cross(right, up);
+            if (egFloat3Dot(surface.normal, p) < 0.0f)
+            {
+                surface.normal = egFloat3MulScalar(surface.normal, -1.0f);
+            }
+            surface.tangent = right;
+            surface.bitangent = up;
+        }
+        else
+        {
+            // The face directions projected on the tangent plane
+            float3 n = egFloat3Normalize(p);
+            surface.pos = egFloat3MulScalar(n, info->radius);
+            surface.normal = n;
+            surface.tangent =
+                egFloat3Sub(right, egFloat3MulScalar(n, egFloat3Dot(right, n)));
+            surface.bitangent = egFloat3Sub(up, egFloat3MulScalar(n, egFloat3Dot(up, n)));
+        }
+        break;
+    }
+    case EG_PROCEDURAL_SHAPE_UV_SPHERE: {
+        EvaluateSphere(&surface, info->radius, v * EG_PI, phi);
+        break;
+    }
+    case EG_PROCEDURAL_SHAPE_PLANE: {
+        surface.pos = V3(
+            (2.0f * u - 1.0f) * info->radius, 0.0f, (2.0f * v - 1.0f) * info->radius);
+        surface.normal = V3(0.0f, 1.0f, 0.0f);
+        surface.tangent = V3(1.0f, 0.0f, 0.0f);
+        surface.bitangent = V3(0.0f, 0.0f, 1.0f);
+        break;
+    }
+    case EG_PROCEDURAL_SHAPE_CYLINDER: {
+        float cos_phi = cosf(phi), sin_phi = sinf(phi);
+        float half_height = 0.5f * info->height;
+
+        if (patch->part == CYLINDER_SIDE)
+        {
+            surface.pos = V3(
+                info->radius * cos_phi,
+                (1.0f - 2.0f * v) * half_height,
+                info->radius * sin_phi);
+            surface.normal = V3(cos_phi, 0.0f, sin_phi);
+            surface.tangent = V3(-sin_phi, 0.0f, cos_phi);
+            surface.bitangent = V3(0.0f, -1.0f, 0.0f);
+        }
+        else
+        {
+            // Caps go from the center (v = 0) to the rim, with planar UVs so
+            // the tangents don't swirl around the center
+            float sign = patch->part == CYLINDER_TOP ? 1.0f : -1.0f;
+            float x = v * cos_phi, z = v * sin_phi;
+            surface.pos = V3(info->radius * x, sign * half_height, info->radius * z);
+            surface.normal = V3(0.0f, sign, 0.0f);
+            surface.tangent = V3(1.0f, 0.0f, 0.0f);
+            surface.bitangent = V3(0.0f, 0.0f, 1.0f);
+            surface.uv = V2(0.5f + 0.5f * x, 0.5f + 0.5f * z);
+        }
+        break;
+    }
+    case EG_PROCEDURAL_SHAPE_TORUS: {
+        float theta = v * 2.0f * EG_PI;
+        float cos_phi = cosf(phi), sin_phi = sinf(phi);
+        float cos_theta = cosf(theta), sin_theta = sinf(theta);
+
+        surface.normal = V3(cos_theta * cos_phi, sin_theta, cos_theta * sin_phi);
+        surface.pos = egFloat3Add(
+            V3(info->radius * cos_phi, 0.0f, info->radius * sin_phi),
+            egFloat3MulScalar(surface.normal, info->minor_radius));
+        surface.tangent = V3(-sin_phi, 0.0f, cos_phi);
+        surface.bitangent = V3(-sin_theta * cos_phi, cos_theta, -sin_theta * sin_phi);
+        break;
+    }
+    case EG_PROCEDURAL_SHAPE_CAPSULE: {
+        // Rows 0 to rings are the top hemisphere and the next rings + 1 the
+        // bottom one, the band between the two equators is the straight part
+        uint32_t rings = info->rings;
+        bool top = row <= rings;
+        float t = top ? (float)row / (float)rings
+                      : 1.0f + (float)(row - rings - 1) / (float)rings;
+        float theta = t * 0.5f * EG_PI;
+        float offset = (top ? 0.5f : -0.5f) * info->height;
+
+        EvaluateSphere(&surface, info->radius, theta, phi);
+        surface.pos.y += offset;
+
+        // V follows the distance along the surface from the top
+        float length = EG_PI * info->radius + info->height;
+        float distance = theta * info->radius + (top ? 0.0f : info->height);
+        surface.uv.y = length > 0.0f ? distance / length : v;
+        break;
+    }
+    }
+
+    return surface;
+}
+
+static EgVertex SurfaceToVertex(const Surface *surface)
+{
+    float3 normal = egFloat3Normalize(surface->normal);
+    float3 tangent = egFloat3Normalize(surface->tangent);
+
+    // glTF convention: bitangent = cross(normal, tangent.xyz) * tangent.w
+    float3 bitangent = egFloat3Cross(normal, tangent);
+    float handedness = egFloat3Dot(bitangent, surface->bitangent) < 0.0f ? -1.0f : 1.0f;
+
+    EgVertex vertex = {0};
+    vertex.pos = surface->pos;
+    vertex.normal = normal;
+    vertex.tangent[0] = tangent.x;
+    vertex.tangent[1] = tangent.y;
+    vertex.tangent[2] = tangent.z;
+    vertex.tangent[3] = handedness;
+    vertex.uv = surface->uv;
+    return vertex;
+}
+
+static size_t PatchTriangleRowCount(const Patch *patch, uint32_t row)
+{
+    bool collapsed = (patch->collapse_first && row == 0) ||
+                     (patch->collapse_last && row == patch->rows - 1);
+    return collapsed ? patch->columns : (size_t)patch->columns * 2;
+}
+
+static size_t PatchIndexCount(const Patch *patch)
+{
+    size_t triangle_count = (size_t)patch->columns * patch->rows * 2;
+    if (patch->collapse_first) triangle_count -= patch->columns;
+    if (patch->collapse_last) triangle_count -= patch->columns;
+    return triangle_count * 3;
+}
+
+// Index of the first triangle of a row of cells, only the first row can be
+// shorter than the ones before the one asked for
+static size_t PatchFirstIndex(const Patch *patch, uint32_t row)
+{
+    size_t triangle_count = (size_t)row * patch->columns * 2;
+    if (patch->collapse_first && row > 0) triangle_count -= patch->columns;
+    return patch->first_index + triangle_count * 3;
+}
+
+static void AddPatch(
+    Generator *generator,
+    uint32_t part,
+    uint32_t columns,
+    uint32_t rows,
+    bool collapse_first,
+    bool collapse_last)
+{
+    EG_ASSERT(generator->patch_count < MAX_PATCHES);
+    EG_ASSERT(columns > 0 && rows > 0);
+    EG_ASSERT(!(collapse_first && collapse_last && rows < 2));
+
+    Patch *patch = &generator->patches[generator->patch_count++];
+    *patch = (Patch){
+        .part = part,
+        .columns = columns,
+        .rows = rows,
+        .collapse_first = collapse_first,
+        .collapse_last = collapse_last,
+        .first_vertex = generator->vertex_count,
+        .first_index = generator->index_count,
+        .first_row = generator->row_count,
+    };
+
+    // The diagonals of a middle cell tell the orientation even when one of
+    // its edges is collapsed
+    uint32_t c = columns / 2, r = rows / 2;
+    if (c == columns) c--;
+    if (r == rows) r--;
+    Surface a = EvaluatePatch(generator->info, patch, c, r);
+    Surface b = EvaluatePatch(generator->info, patch, c + 1, r);
+    Surface d = EvaluatePatch(generator->info, patch, c, r + 1);
+    Surface e = EvaluatePatch(generator->info, patch, c + 1, r + 1);
+    float3 orientation =
+        egFloat3Cross(egFloat3Sub(e.pos, a.pos), egFloat3Sub(d.pos, b.pos));
+    float3 normal = egFloat3Add(
+        egFloat3Add(a.normal, b.normal), egFloat3Add(d.normal, e.normal));
+    patch->flip = egFloat3Dot(orientation, normal) < 0.0f;
+
+    generator->vertex_count += (size_t)(columns + 1) * (rows + 1);
+    generator->index_count += PatchIndexCount(patch);
+    generator->row_count += rows + 1;
+}
+
+static void GeneratorInit(Generator *generator, const EgProceduralMeshInfo *info)
+{
+    *generator = (Generator){0};
+    generator->info = info;
+
+    uint32_t segments = info->segments;
+    uint32_t rings = info->rings;
+
+    switch (info->shape)
+    {
+    case EG_PROCEDURAL_SHAPE_CUBE:
+    case EG_PROCEDURAL_SHAPE_CUBE_SPHERE:
+        for (uint32_t face = 0; face < 6; ++face)
+        {
+            AddPatch(generator, face, segments, segments, false, false);
+        }
+        break;
+    case EG_PROCEDURAL_SHAPE_UV_SPHERE:
+        EG_ASSERT(segments >= 3 && rings >= 2);
+        AddPatch(generator, 0, segments, rings, true, true);
+        break;
+    case EG_PROCEDURAL_SHAPE_PLANE:
+        AddPatch(generator, 0, segments, rings, false, false);
+        break;
+    case EG_PROCEDURAL_SHAPE_CYLINDER:
+        EG_ASSERT(segments >= 3);
+        AddPatch(generator, CYLINDER_SIDE, segments, rings, false, false);
+        AddPatch(generator, CYLINDER_TOP, segments, 1, true, false);
+        AddPatch(generator, CYLINDER_BOTTOM, segments, 1, true, false);
+        break;
+    case EG_PROCEDURAL_SHAPE_TORUS:
+        EG_ASSERT(segments >= 3 && rings >= 3);
+        AddPatch(generator, 0, segments, rings, false, false);
+        break;
+    case EG_PROCEDURAL_SHAPE_CAPSULE:
+        EG_ASSERT(segments >= 3 && rings >= 1);
+        AddPatch(generator, 0, segments, rings * 2 + 1, true, true);
+        break;
+    }
+}
+
+static void GenerateRowsProc(void *user_data, size_t begin, size_t end)
+{
+    Generator *generator = (Generator *)user_data;
+
+    uint32_t patch_index = 0;
+    for (size_t i = begin; i < end; ++i)
+    {
+        while (i >= generator->patches[patch_index].first_row +
+                         generator->patches[patch_index].rows + 1)
+        {
+            patch_index++;
+        }
+
+        const Patch *patch = &generator->patches[patch_index];
+        uint32_t row = (uint32_t)(i - patch->first_row);
+        uint32_t stride = patch->columns + 1;
+
+        EgVertex *vertices = &generator->vertices[patch->first_vertex + row * stride];
+        for (uint32_t column = 0; column <= patch->columns; ++column)
+        {
+            Surface surface = EvaluatePatch(generator->info, patch, column, row);
+            vertices[column] = SurfaceToVertex(&surface);
+        }
+
+        // The last row of vertices has no cells after it
+        if (row == patch->rows) continue;
+
+        bool drop_first = patch->collapse_first && row == 0;
+        bool drop_last = patch->collapse_last && row == patch->rows - 1;
+
+        uint32_t *indices = &generator->indices[PatchFirstIndex(patch, row)];
+        size_t index_count = 0;
+        for (uint32_t column = 0; column < patch->columns; ++column)
+        {
+            uint32_t a = (uint32_t)patch->first_vertex + row * stride + column;
+            uint32_t b = a + 1;
+            uint32_t c = a + stride;
+            uint32_t d = c + 1;
+
+            // a b d lies on the first row of the cell and a d c on the last
+            if (!drop_first)
+            {
+                indices[index_count++] = a;
+                indices[index_count++] = patch->flip ? d : b;
+                indices[index_count++] = patch->flip ? b : d;
+            }
+            if (!drop_last)
+            {
+                indices[index_count++] = a;
+                indices[index_count++] = patch->flip ? c : d;
+                indices[index_count++] = patch->flip ? d : c;
+            }
+        }
+        EG_ASSERT(index_count == PatchTriangleRowCount(patch, row) * 3);
+    }
+}
+
+void egProceduralMeshCount(
+    const EgProceduralMeshInfo *info, size_t *vertex_count, size_t *index_count)
+{
+    Generator generator;
+    GeneratorInit(&generator, info);
+    *vertex_count = generator.vertex_count;
+    *index_count = generator.index_count;
+}
+
+void egProceduralMeshGenerate(
+    const EgProceduralMeshInfo *info,
+    EgJobSystem *job_system,
+    EgVertex *vertices,
+    uint32_t *indices)
+{
+    Generator generator;
+    GeneratorInit(&generator, info);
+    generator.vertices = vertices;
+    generator.indices = indices;
+
+    if (!job_system)
+    {
+        GenerateRowsProc(&generator, 0, generator.row_count);
+        return;
+    }
+
+    uint32_t max_columns = 0;
+    for (uint32_t i = 0; i < generator.patch_count; ++i)
+    {
+        max_columns = EG_MAX(max_columns, generator.patches[i].columns);
+    }
+    size_t grain_size = EG_MAX(1, GENERATE_VERTICES_PER_JOB / (max_columns + 1));
+
+    egJobSystemParallelFor(
+        job_system, generator.row_count, grain_size, GenerateRowsProc, &generator);
+}
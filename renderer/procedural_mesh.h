@@ -0,0 +1,59 @@
+#pragma once
+
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgVertex EgVertex;
+typedef struct EgJobSystem EgJobSystem;
+
+typedef enum EgProceduralShape
+{
+    EG_PROCEDURAL_SHAPE_CUBE,
+    EG_PROCEDURAL_SHAPE_CUBE_SPHERE,
+    EG_PROCEDURAL_SHAPE_UV_SPHERE,
+    EG_PROCEDURAL_SHAPE_PLANE,
+    EG_PROCEDURAL_SHAPE_CYLINDER,
+    EG_PROCEDURAL_SHAPE_TORUS,
+    EG_PROCEDURAL_SHAPE_CAPSULE,
+} EgProceduralShape;
+
+// Everything is centered on the origin, with Y as the axis of the round
+// shapes and the normal of the plane. Fields a shape doesn't use are ignored.
+typedef struct EgProceduralMeshInfo
+{
+    EgProceduralShape shape;
+    // Half size of the cube and the plane, major radius of the torus
+    float radius;
+    // Length of the straight part of the cylinder and the capsule
+    float height;
+    // Radius of the torus tube
+    float minor_radius;
+    // Cells along each edge of a cube face, around the Y axis of the round
+    // shapes, or along X of the plane
+    uint32_t segments;
+    // Cells from pole to pole of the UV sphere, along the height of the
+    // cylinder, around the torus tube, per capsule hemisphere, or along Z of
+    // the plane
+    uint32_t rings;
+} EgProceduralMeshInfo;
+
+// Exact number of vertices and indices egProceduralMeshGenerate writes, so
+// the destination can be allocated once
+void egProceduralMeshCount(
+    const EgProceduralMeshInfo *info, size_t *vertex_count, size_t *index_count);
+
+// Fills counter-clockwise triangles with normals, tangents and UVs. Every
+// row of cells is independent, so they are spread over job_system (if not
+// NULL). Vertices along UV seams and poles are duplicated, nothing is welded.
+void egProceduralMeshGenerate(
+    const EgProceduralMeshInfo *info,
+    EgJobSystem *job_system,
+    EgVertex *vertices,
+    uint32_t *indices);
+
+#ifdef __cplusplus
+}
+#endif
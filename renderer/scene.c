@@ -0,0 +1,461 @@
+#include "scene.h"
+
+#include "math.h"
+#include "allocator.h"
+#include "array.h"
+#include "bvh.h"
+#include "job_system.h"
+#include "meshlet.h"
+#include "model_asset.h"
+#include "thread.h"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define EG_SCENE_SSE
+#include <xmmintrin.h>
+#endif
+
+// Instances culled by each job
+#define CULL_GRAIN_SIZE 4096
+
+typedef struct SceneSlot
+{
+    uint32_t dense_index;
+    uint32_t generation; // Odd while the slot holds an instance
+} SceneSlot;
+
+struct EgScene
+{
+    EgAllocator *allocator;
+
+    // Indexed by handle
+    EgArray(SceneSlot) slots;
+    EgArray(uint32_t) free_slots;
+
+    // Indexed by instance, see EgSceneArrays
+    EgArray(float4x4) transforms;
+    EgArray(float) center_x;
+    EgArray(float) center_y;
+    EgArray(float) center_z;
+    EgArray(float) radius;
+    EgArray(EgModelAsset *) models;
+    EgArray(uint32_t) flags;
+    EgArray(EgSceneHandle) handles;
+    // Model space bounding spheres, w is the radius
+    EgArray(float4) local_bounds;
+
+    // Instances whose model bounds aren't known yet
+    size_t pending_bounds_count;
+
+    // Over the world bounds of the instances that have them, by handle index
+    EgBvh *bvh;
+    EgArray(uint32_t) query_ids;
+};
+
+EgScene *egSceneCreate(EgAllocator *allocator, size_t initial_capacity)
+{
+    EgScene *scene = (EgScene *)egAllocate(allocator, sizeof(*scene));
+    *scene = (EgScene){
+        .allocator = allocator,
+        .slots = egArrayCreate(allocator, SceneSlot),
+        .free_slots = egArrayCreate(allocator, uint32_t),
+        .transforms = egArrayCreate(allocator, float4x4),
+        .center_x = egArrayCreate(allocator, float),
+        .center_y = egArrayCreate(allocator, float),
+        .center_z = egArrayCreate(allocator, float),
+        .radius = egArrayCreate(allocator, float),
+        .models = egArrayCreate(allocator, EgModelAsset *),
+        .flags = egArrayCreate(allocator, uint32_t),
+        .handles = egArrayCreate(allocator, EgSceneHandle),
+        .local_bounds = egArrayCreate(allocator, float4),
+        .bvh = egBvhCreate(allocator),
+        .query_ids = egArrayCreate(allocator, uint32_t),
+    };
+
+    egArrayEnsure(&scene->slots, initial_capacity);
+    egArrayEnsure(&scene->transforms, initial_capacity);
+    egArrayEnsure(&scene->center_x, initial_capacity);
+    egArrayEnsure(&scene->center_y, initial_capacity);
+    egArrayEnsure(&scene->center_z, initial_capacity);
+    egArrayEnsure(&scene->radius, initial_capacity);
+    egArrayEnsure(&scene->models, initial_capacity);
+    egArrayEnsure(&scene->flags, initial_capacity);
+    egArrayEnsure(&scene->handles, initial_capacity);
+    egArrayEnsure(&scene->local_bounds, initial_capacity);
+
+    return scene;
+}
+
+void egSceneDestroy(EgScene *scene)
+{
+    egArrayFree(&scene->slots);
+    egArrayFree(&scene->free_slots);
+    egArrayFree(&scene->transforms);
+    egArrayFree(&scene->center_x);
+    egArrayFree(&scene->center_y);
+    egArrayFree(&scene->center_z);
+    egArrayFree(&scene->radius);
+    egArrayFree(&scene->models);
+    egArrayFree(&scene->flags);
+    egArrayFree(&scene->handles);
+    egArrayFree(&scene->local_bounds);
+    egBvhDestroy(scene->bvh);
+    egArrayFree(&scene->query_ids);
+    egFree(scene->allocator, scene);
+}
+
+static uint32_t DenseIndex(EgScene *scene, EgSceneHandle handle)
+{
+    EG_ASSERT(egSceneIsValid(scene, handle));
+    return scene->slots[handle.index].dense_index;
+}
+
+// Largest factor the transform scales lengths by
+static float MaxScale(const float4x4 *transform)
+{
+    const float4x4 *m = transform;
+    float x = m->xx * m->xx + m->xy * m->xy + m->xz * m->xz;
+    float y = m->yx * m->yx + m->yy * m->yy + m->yz * m->yz;
+    float z = m->zx * m->zx + m->zy * m->zy + m->zz * m->zz;
+    return sqrtf(EG_MAX(x, EG_MAX(y, z)));
+}
+
+static void UpdateWorldBounds(EgScene *scene, uint32_t i)
+{
+    float4 local = scene->local_bounds[i];
+    if (local.w < 0.0f)
+    {
+        scene->center_x[i] = 0.0f;
+        scene->center_y[i] = 0.0f;
+        scene->center_z[i] = 0.0f;
+        scene->radius[i] = -1.0f;
+        return;
+    }
+
+    float4 center = V4(local.x, local.y, local.z, 1.0f);
+    float4 world = egFloat4x4MulVector(&scene->transforms[i], &center);
+    scene->center_x[i] = world.x;
+    scene->center_y[i] = world.y;
+    scene->center_z[i] = world.z;
+    scene->radius[i] = local.w * MaxScale(&scene->transforms[i]);
+
+    float radius = scene->radius[i];
+    EgBvhBounds bounds = {
+        .min = V3(world.x - radius, world.y - radius, world.z - radius),
+        .max = V3(world.x + radius, world.y + radius, world.z + radius),
+    };
+    uint32_t id = scene->handles[i].index;
+    if (egBvhContains(scene->bvh, id))
+        egBvhUpdate(scene->bvh, id, &bounds);
+    else
+        egBvhInsert(scene->bvh, id, &bounds);
+}
+
+// Fetches the model bounds, false while they aren't known
+static bool ResolveLocalBounds(EgScene *scene, uint32_t i)
+{
+    float3 center;
+    float radius;
+    if (!egModelAssetGetBounds(scene->models[i], &center, &radius)) return false;
+
+    scene->local_bounds[i] = V4(center.x, center.y, center.z, radius);
+    UpdateWorldBounds(scene, i);
+    return true;
+}
+
+EgSceneHandle egSceneAdd(
+    EgScene *scene, EgModelAsset *model, const float4x4 *transform, uint32_t flags)
+{
+    EG_ASSERT(model && transform);
+
+    uint32_t slot_index;
+    if (egArrayLength(scene->free_slots) > 0)
+    {
+        slot_index = scene->free_slots[egArrayLength(scene->free_slots) - 1];
+        egArrayPop(&scene->free_slots);
+    }
+    else
+    {
+        slot_index = (uint32_t)egArrayLength(scene->slots);
+        egArrayPush(&scene->slots, (SceneSlot){});
+    }
+
+    uint32_t dense_index = (uint32_t)egArrayLength(scene->transforms);
+    SceneSlot *slot = &scene->slots[slot_index];
+    slot->dense_index = dense_index;
+    slot->generation++;
+
+    EgSceneHandle handle = {
+        .index = slot_index,
+        .generation = slot->generation,
+    };
+
+    egArrayPush(&scene->transforms, *transform);
+    egArrayPush(&scene->center_x, 0.0f);
+    egArrayPush(&scene->center_y, 0.0f);
+    egArrayPush(&scene->center_z, 0.0f);
+    egArrayPush(&scene->radius, -1.0f);
+    egArrayPush(&scene->models, model);
+    egArrayPush(&scene->flags, flags);
+    egArrayPush(&scene->handles, handle);
+    egArrayPush(&scene->local_bounds, V4(0.0f, 0.0f, 0.0f, -1.0f));
+
+    if (!ResolveLocalBounds(scene, dense_index)) scene->pending_bounds_count++;
+
+    return handle;
+}
+
+void egSceneRemove(EgScene *scene, EgSceneHandle handle)
+{
+    uint32_t dense_index = DenseIndex(scene, handle);
+    uint32_t last = (uint32_t)egArrayLength(scene->transforms) - 1;
+
+    if (scene->local_bounds[dense_index].w < 0.0f) scene->pending_bounds_count--;
+    if (egBvhContains(scene->bvh, handle.index)) egBvhRemove(scene->bvh, handle.index);
+
+    // The last instance takes the place of the removed one
+    if (dense_index != last)
+    {
+        scene->transforms[dense_index] = scene->transforms[last];
+        scene->center_x[dense_index] = scene->center_x[last];
+        scene->center_y[dense_index] = scene->center_y[last];
+        scene->center_z[dense_index] = scene->center_z[last];
+        scene->radius[dense_index] = scene->radius[last];
+        scene->models[dense_index] = scene->models[last];
+        scene->flags[dense_index] = scene->flags[last];
+        scene->handles[dense_index] = scene->handles[last];
+        scene->local_bounds[dense_index] = scene->local_bounds[last];
+        scene->slots[scene->handles[dense_index].index].dense_index = dense_index;
+    }
+
+    egArrayPop(&scene->transforms);
+    egArrayPop(&scene->center_x);
+    egArrayPop(&scene->center_y);
+    egArrayPop(&scene->center_z);
+    egArrayPop(&scene->radius);
+    egArrayPop(&scene->models);
+    egArrayPop(&scene->flags);
+    egArrayPop(&scene->handles);
+    egArrayPop(&scene->local_bounds);
+
+    scene->slots[handle.index].generation++;
+    egArrayPush(&scene->free_slots, handle.index);
+}
+
+bool egSceneIsValid(EgScene *scene, EgSceneHandle handle)
+{
+    return handle.index < egArrayLength(scene->slots) &&
+           (handle.generation & 1) != 0 &&
+           scene->slots[handle.index].generation == handle.generation;
+}
+
+void egSceneSetTransform(EgScene *scene, EgSceneHandle handle, const float4x4 *transform)
+{
+    uint32_t i = DenseIndex(scene, handle);
+    scene->transforms[i] = *transform;
+    UpdateWorldBounds(scene, i);
+}
+
+const float4x4 *egSceneGetTransform(EgScene *scene, EgSceneHandle handle)
+{
+    return &scene->transforms[DenseIndex(scene, handle)];
+}
+
+void egSceneSetFlags(EgScene *scene, EgSceneHandle handle, uint32_t flags)
+{
+    scene->flags[DenseIndex(scene, handle)] = flags;
+}
+
+uint32_t egSceneGetFlags(EgScene *scene, EgSceneHandle handle)
+{
+    return scene->flags[DenseIndex(scene, handle)];
+}
+
+size_t egSceneGetInstanceCount(EgScene *scene)
+{
+    return egArrayLength(scene->transforms);
+}
+
+EgSceneArrays egSceneGetArrays(EgScene *scene)
+{
+    return (EgSceneArrays){
+        .count = egArrayLength(scene->transforms),
+        .transforms = scene->transforms,
+        .center_x = scene->center_x,
+        .center_y = scene->center_y,
+        .center_z = scene->center_z,
+        .radius = scene->radius,
+        .models = scene->models,
+        .flags = scene->flags,
+        .handles = scene->handles,
+    };
+}
+
+typedef struct CullJob
+{
+    EgScene *scene;
+    EgMeshletCuller culler;
+    uint8_t *visible;
+    volatile uint32_t visible_count;
+} CullJob;
+
+static void CullProc(void *user_data, size_t begin, size_t end)
+{
+    CullJob *job = (CullJob *)user_data;
+    EgScene *scene = job->scene;
+    const EgMeshletCuller *culler = &job->culler;
+    uint8_t *visible = job->visible;
+
+    uint32_t visible_count = 0;
+    size_t i = begin;
+
+#if defined(EG_SCENE_SSE)
+    // Four instances at a time against one plane at a time, the last two
+    // planes of the culler always pass
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&scene->center_x[i]);
+        __m128 y = _mm_loadu_ps(&scene->center_y[i]);
+        __m128 z = _mm_loadu_ps(&scene->center_z[i]);
+        __m128 radius = _mm_loadu_ps(&scene->radius[i]);
+        __m128 neg_radius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+        __m128 outside = _mm_setzero_ps();
+        for (uint32_t p = 0; p < 6; ++p)
+        {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(culler->plane_x[p]), x),
+                    _mm_mul_ps(_mm_set1_ps(culler->plane_y[p]), y)),
+                _mm_add_ps(
+                    _mm_mul_ps(_mm_set1_ps(culler->plane_z[p]), z),
+                    _mm_set1_ps(culler->plane_w[p])));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, neg_radius));
+        }
+        // Unknown bounds are never outside
+        outside = _mm_and_ps(outside, _mm_cmpge_ps(radius, _mm_setzero_ps()));
+
+        int outside_mask = _mm_movemask_ps(outside);
+        for (uint32_t lane = 0; lane < 4; ++lane)
+        {
+            bool is_visible = (outside_mask & (1 << lane)) == 0 &&
+                              (scene->flags[i + lane] & EG_SCENE_FLAG_HIDDEN) == 0;
+            visible[i + lane] = is_visible;
+            visible_count += is_visible;
+        }
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        bool is_visible = (scene->flags[i] & EG_SCENE_FLAG_HIDDEN) == 0;
+        for (uint32_t p = 0; p < 6 && is_visible && scene->radius[i] >= 0.0f; ++p)
+        {
+            float distance = culler->plane_x[p] * scene->center_x[i] +
+                             culler->plane_y[p] * scene->center_y[i] +
+                             culler->plane_z[p] * scene->center_z[i] + culler->plane_w[p];
+            if (distance < -scene->radius[i]) is_visible = false;
+        }
+        visible[i] = is_visible;
+        visible_count += is_visible;
+    }
+
+    egAtomicFetchAddU32(&job->visible_count, visible_count);
+}
+
+size_t egSceneCull(
+    EgScene *scene, EgJobSystem *job_system, const float4x4 *view_proj, uint8_t *visible)
+{
+    size_t count = egArrayLength(scene->transforms);
+
+    // Models that were loading may have finished since the last cull
+    for (size_t i = 0; i < count && scene->pending_bounds_count > 0; ++i)
+    {
+        if (scene->local_bounds[i].w >= 0.0f) continue;
+        if (ResolveLocalBounds(scene, (uint32_t)i)) scene->pending_bounds_count--;
+    }
+
+    CullJob job = {
+        .scene = scene,
+        .visible = visible,
+    };
+    egMeshletCullerInit(&job.culler, view_proj, V3(0.0f, 0.0f, 0.0f));
+
+    if (!job_system)
+    {
+        CullProc(&job, 0, count);
+    }
+    else
+    {
+        egJobSystemParallelFor(job_system, count, CULL_GRAIN_SIZE, CullProc, &job);
+    }
+
+    return job.visible_count;
+}
+
+void egSceneQueueRender(EgScene *scene, const uint8_t *visible)
+{
+    for (size_t i = 0; i < egArrayLength(scene->transforms); ++i)
+    {
+        bool is_visible = visible ? visible[i] != 0
+                                  : (scene->flags[i] & EG_SCENE_FLAG_HIDDEN) == 0;
+        if (!is_visible) continue;
+        egModelAssetQueueRender(scene->models[i], &scene->transforms[i]);
+    }
+}
+
+void egSceneUpdateBvh(EgScene *scene, EgJobSystem *job_system)
+{
+    egBvhMaintain(scene->bvh, job_system);
+}
+
+// Turns the ids of a BVH query into handles, in place of the ids
+static size_t QueryHandles(
+    EgScene *scene, size_t count, EgSceneHandle *handles, size_t max_count)
+{
+    for (size_t i = 0; i < EG_MIN(count, max_count); ++i)
+    {
+        uint32_t index = scene->query_ids[i];
+        handles[i] = (EgSceneHandle){
+            .index = index,
+            .generation = scene->slots[index].generation,
+        };
+    }
+    return count;
+}
+
+size_t egSceneQueryFrustum(
+    EgScene *scene, const float4x4 *view_proj, EgSceneHandle *handles, size_t max_count)
+{
+    egArrayResize(&scene->query_ids, max_count);
+    size_t count = egBvhQueryFrustum(scene->bvh, view_proj, scene->query_ids, max_count);
+    return QueryHandles(scene, count, handles, max_count);
+}
+
+size_t egSceneQuerySphere(
+    EgScene *scene, float3 center, float radius, EgSceneHandle *handles, size_t max_count)
+{
+    egArrayResize(&scene->query_ids, max_count);
+    size_t count =
+        egBvhQuerySphere(scene->bvh, center, radius, scene->query_ids, max_count);
+    return QueryHandles(scene, count, handles, max_count);
+}
+
+bool egSceneRaycast(
+    EgScene *scene,
+    float3 origin,
+    float3 direction,
+    float max_distance,
+    EgSceneHandle *handle,
+    float *distance)
+{
+    uint32_t index;
+    if (!egBvhRaycast(scene->bvh, origin, direction, max_distance, &index, distance))
+    {
+        return false;
+    }
+    *handle = (EgSceneHandle){
+        .index = index,
+        .generation = scene->slots[index].generation,
+    };
+    return true;
+}
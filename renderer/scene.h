@@ -0,0 +1,105 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgJobSystem EgJobSystem;
+typedef struct EgModelAsset EgModelAsset;
+typedef struct EgScene EgScene;
+
+// Stays valid until its instance is removed, stale handles are detected by
+// the generation. The zero handle is never valid.
+typedef struct EgSceneHandle
+{
+    uint32_t index;
+    uint32_t generation;
+} EgSceneHandle;
+
+typedef enum EgSceneFlags
+{
+    // Never visible, the instance keeps its place
+    EG_SCENE_FLAG_HIDDEN = 1 << 0,
+    // Bits from here on are left to the application
+    EG_SCENE_FLAG_USER = 1 << 16,
+} EgSceneFlags;
+
+// The instances packed in parallel arrays, element i of each belongs to the
+// same instance. Adding and removing instances invalidates the pointers, and
+// removing one moves the last instance into its place.
+typedef struct EgSceneArrays
+{
+    size_t count;
+    const float4x4 *transforms;
+    // World space bounding spheres, kept up to date with the transforms. The
+    // radius is negative until the bounds of the model are known.
+    const float *center_x;
+    const float *center_y;
+    const float *center_z;
+    const float *radius;
+    EgModelAsset *const *models;
+    const uint32_t *flags;
+    const EgSceneHandle *handles;
+} EgSceneArrays;
+
+EgScene *egSceneCreate(EgAllocator *allocator, size_t initial_capacity);
+void egSceneDestroy(EgScene *scene);
+
+// Adding, removing and updating an instance are constant time
+EgSceneHandle egSceneAdd(
+    EgScene *scene, EgModelAsset *model, const float4x4 *transform, uint32_t flags);
+void egSceneRemove(EgScene *scene, EgSceneHandle handle);
+bool egSceneIsValid(EgScene *scene, EgSceneHandle handle);
+
+void egSceneSetTransform(EgScene *scene, EgSceneHandle handle, const float4x4 *transform);
+const float4x4 *egSceneGetTransform(EgScene *scene, EgSceneHandle handle);
+void egSceneSetFlags(EgScene *scene, EgSceneHandle handle, uint32_t flags);
+uint32_t egSceneGetFlags(EgScene *scene, EgSceneHandle handle);
+
+size_t egSceneGetInstanceCount(EgScene *scene);
+EgSceneArrays egSceneGetArrays(EgScene *scene);
+
+// Sets visible[i] to 1 for the instances of egSceneGetArrays whose bounds are
+// at least partly inside the frustum of view_proj (with a [0, 1] depth range)
+// and that aren't hidden, 0 otherwise. Instances whose model is still loading
+// are visible. Batches of instances are spread over job_system (if not NULL).
+// Returns the number of visible instances.
+size_t egSceneCull(
+    EgScene *scene, EgJobSystem *job_system, const float4x4 *view_proj, uint8_t *visible);
+
+// Queues the instances egSceneCull found visible with egModelAssetQueueRender,
+// or every instance that isn't hidden if visible is NULL
+void egSceneQueueRender(EgScene *scene, const uint8_t *visible);
+
+// The instances are also kept in a BVH over their world bounds (see bvh.h),
+// refitted as they move. Call once a frame to rebuild it on job_system when
+// it has degraded.
+void egSceneUpdateBvh(EgScene *scene, EgJobSystem *job_system);
+
+// BVH queries, hidden instances included and instances whose model is still
+// loading left out. They write at most max_count handles and return how many
+// instances matched, which can be more.
+size_t egSceneQueryFrustum(
+    EgScene *scene, const float4x4 *view_proj, EgSceneHandle *handles, size_t max_count);
+size_t egSceneQuerySphere(
+    EgScene *scene,
+    float3 center,
+    float radius,
+    EgSceneHandle *handles,
+    size_t max_count);
+// Closest instance whose bounds the ray enters, see egBvhRaycast
+bool egSceneRaycast(
+    EgScene *scene,
+    float3 origin,
+    float3 direction,
+    float max_distance,
+    EgSceneHandle *handle,
+    float *distance);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,230 @@
+#include "skinning.h"
+
+#include <rg.h>
+#include "math.h"
+#include "allocator.h"
+#include "engine.h"
+
+enum {
+    FRAMES_IN_FLIGHT = 2,
+    // Per frame in flight, instances past any of them aren't skinned
+    MAX_SKINNING_JOBS = 4096,
+    MAX_PALETTE_MATRICES = 64 * 1024,
+    MAX_SKINNED_VERTICES = 1024 * 1024,
+    // Threads per group of skinning.hlsl
+    SKINNING_GROUP_SIZE = 64,
+};
+
+// Skins the vertices of one mesh of one instance, read by skinning.hlsl
+typedef struct SkinningJob
+{
+    // Dequantization of the mesh positions
+    float4 position_offset;
+    float4 position_scale;
+    // In the engine vertex buffer
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    // EgSkinVertex of the instance
+    uint32_t skin_buffer_index;
+    uint32_t first_skin_vertex;
+    // In the palette and skinned vertex buffers
+    uint32_t first_palette_matrix;
+    uint32_t first_output_vertex;
+    uint32_t padding[2];
+} SkinningJob;
+
+EG_STATIC_ASSERT(sizeof(SkinningJob) == 64, "SkinningJob must match skinning.hlsl");
+
+struct EgSkinningManager
+{
+    EgAllocator *allocator;
+    EgEngine *engine;
+
+    uint32_t frame_index;
+
+    // Each buffer holds a range per frame in flight, the counts are for the
+    // current one
+    bool buffers_created;
+    EgBuffer job_buffer;
+    EgBuffer palette_buffer;
+    EgBuffer output_buffer; // EgSkinnedVertex
+    SkinningJob *jobs;
+    float4x4 *palettes;
+    uint32_t job_count;
+    uint32_t palette_matrix_count;
+    uint32_t output_vertex_count;
+    // Of the largest job, sets the width of the dispatch
+    uint32_t max_job_vertex_count;
+};
+
+EgSkinningManager *egSkinningManagerCreate(EgAllocator *allocator, EgEngine *engine)
+{
+    EgSkinningManager *skinning =
+        (EgSkinningManager *)egAllocate(allocator, sizeof(*skinning));
+    *skinning = (EgSkinningManager){};
+
+    skinning->allocator = allocator;
+    skinning->engine = engine;
+
+    return skinning;
+}
+
+void egSkinningManagerDestroy(EgSkinningManager *skinning)
+{
+    if (skinning->buffers_created)
+    {
+        RgDevice *device = egEngineGetDevice(skinning->engine);
+        rgBufferUnmap(device, skinning->job_buffer.buffer);
+        rgBufferUnmap(device, skinning->palette_buffer.buffer);
+        egEngineFreeStorageBuffer(skinning->engine, &skinning->job_buffer);
+        egEngineFreeStorageBuffer(skinning->engine, &skinning->palette_buffer);
+        egEngineFreeStorageBuffer(skinning->engine, &skinning->output_buffer);
+    }
+
+    egFree(skinning->allocator, skinning);
+}
+
+static void CreateBuffers(EgSkinningManager *skinning)
+{
+    EgEngine *engine = skinning->engine;
+    RgDevice *device = egEngineGetDevice(engine);
+
+    RgBufferInfo job_buffer_info = {
+        .size = sizeof(SkinningJob) * MAX_SKINNING_JOBS * FRAMES_IN_FLIGHT,
+        .usage = RG_BUFFER_USAGE_STORAGE,
+        .memory = RG_BUFFER_MEMORY_HOST,
+    };
+    skinning->job_buffer = egEngineAllocateStorageBuffer(engine, &job_buffer_info);
+    skinning->jobs = (SkinningJob *)rgBufferMap(device, skinning->job_buffer.buffer);
+
+    RgBufferInfo palette_buffer_info = {
+        .size = sizeof(float4x4) * MAX_PALETTE_MATRICES * FRAMES_IN_FLIGHT,
+        .usage = RG_BUFFER_USAGE_STORAGE,
+        .memory = RG_BUFFER_MEMORY_HOST,
+    };
+    skinning->palette_buffer =
+        egEngineAllocateStorageBuffer(engine, &palette_buffer_info);
+    skinning->palettes =
+        (float4x4 *)rgBufferMap(device, skinning->palette_buffer.buffer);
+
+    RgBufferInfo output_buffer_info = {
+        .size = sizeof(EgSkinnedVertex) * MAX_SKINNED_VERTICES * FRAMES_IN_FLIGHT,
+        .usage = RG_BUFFER_USAGE_STORAGE,
+        .memory = RG_BUFFER_MEMORY_DEVICE,
+    };
+    skinning->output_buffer = egEngineAllocateStorageBuffer(engine, &output_buffer_info);
+
+    skinning->buffers_created = true;
+}
+
+void egSkinningManagerBeginFrame(EgSkinningManager *skinning)
+{
+    skinning->frame_index = (skinning->frame_index + 1) % FRAMES_IN_FLIGHT;
+
+    skinning->job_count = 0;
+    skinning->palette_matrix_count = 0;
+    skinning->output_vertex_count = 0;
+    skinning->max_job_vertex_count = 0;
+}
+
+bool egSkinningManagerQueue(
+    EgSkinningManager *skinning,
+    const EgSkinningInstance *instance,
+    uint32_t *first_output_vertex)
+{
+    EG_ASSERT(instance->palette);
+
+    if (skinning->job_count + instance->mesh_count > MAX_SKINNING_JOBS ||
+        skinning->palette_matrix_count + instance->joint_count > MAX_PALETTE_MATRICES ||
+        skinning->output_vertex_count + instance->vertex_count > MAX_SKINNED_VERTICES)
+    {
+        return false;
+    }
+
+    if (!skinning->buffers_created) CreateBuffers(skinning);
+
+    uint32_t first_palette_matrix =
+        skinning->frame_index * MAX_PALETTE_MATRICES + skinning->palette_matrix_count;
+    *first_output_vertex =
+        skinning->frame_index * MAX_SKINNED_VERTICES + skinning->output_vertex_count;
+    memcpy(
+        &skinning->palettes[first_palette_matrix],
+        instance->palette,
+        sizeof(float4x4) * instance->joint_count);
+
+    for (uint32_t i = 0; i < instance->mesh_count; ++i)
+    {
+        const EgSkinningMesh *mesh = &instance->meshes[i];
+
+        uint32_t job_index =
+            skinning->frame_index * MAX_SKINNING_JOBS + skinning->job_count++;
+        skinning->jobs[job_index] = (SkinningJob){
+            .position_offset = V4(
+                mesh->position_offset.x,
+                mesh->position_offset.y,
+                mesh->position_offset.z,
+                0.0f),
+            .position_scale = V4(
+                mesh->position_scale.x,
+                mesh->position_scale.y,
+                mesh->position_scale.z,
+                0.0f),
+            .first_vertex = mesh->first_vertex,
+            .vertex_count = mesh->vertex_count,
+            .skin_buffer_index = instance->skin_buffer_index,
+            .first_skin_vertex = mesh->first_skin_vertex,
+            .first_palette_matrix = first_palette_matrix,
+            .first_output_vertex = *first_output_vertex + mesh->output_offset,
+        };
+
+        skinning->max_job_vertex_count =
+            EG_MAX(skinning->max_job_vertex_count, mesh->vertex_count);
+    }
+
+    skinning->palette_matrix_count += instance->joint_count;
+    skinning->output_vertex_count += instance->vertex_count;
+
+    return true;
+}
+
+void egSkinningManagerDispatch(
+    EgSkinningManager *skinning, RgCmdBuffer *cmd_buffer, RgPipeline *pipeline)
+{
+    if (skinning->job_count == 0) return;
+
+    rgCmdBindPipeline(cmd_buffer, pipeline);
+    rgCmdBindDescriptorSet(
+        cmd_buffer, 0, egEngineGetGlobalDescriptorSet(skinning->engine), 0, NULL);
+
+    struct
+    {
+        uint32_t job_buffer_index;
+        uint32_t first_job;
+        uint32_t palette_buffer_index;
+        uint32_t vertex_buffer_index;
+        uint32_t output_buffer_index;
+    } pc;
+
+    pc.job_buffer_index = skinning->job_buffer.index;
+    pc.first_job = skinning->frame_index * MAX_SKINNING_JOBS;
+    pc.palette_buffer_index = skinning->palette_buffer.index;
+    pc.vertex_buffer_index = egEngineGetVertexBuffer(skinning->engine).index;
+    pc.output_buffer_index = skinning->output_buffer.index;
+
+    rgCmdPushConstants(cmd_buffer, 0, sizeof(pc), &pc);
+
+    // One row of groups per job, the shorter jobs leave threads idle at the end
+    // of their row
+    rgCmdDispatch(
+        cmd_buffer,
+        (skinning->max_job_vertex_count + SKINNING_GROUP_SIZE - 1) / SKINNING_GROUP_SIZE,
+        skinning->job_count,
+        1);
+
+    rgCmdMemoryBarrier(cmd_buffer, RG_PIPELINE_STAGE_COMPUTE, RG_PIPELINE_STAGE_VERTEX);
+}
+
+uint32_t egSkinningManagerGetOutputBufferIndex(EgSkinningManager *skinning)
+{
+    return skinning->output_buffer.index;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgEngine EgEngine;
+typedef struct RgCmdBuffer RgCmdBuffer;
+typedef struct RgPipeline RgPipeline;
+typedef struct EgSkinningManager EgSkinningManager;
+
+// A mesh whose vertices are skinned for each instance
+typedef struct EgSkinningMesh
+{
+    // Dequantization of the mesh positions, see EgVertexQuantization
+    float3 position_offset;
+    float3 position_scale;
+    // In the engine vertex buffer
+    uint32_t first_vertex;
+    uint32_t vertex_count;
+    // In the skin buffer of the instance
+    uint32_t first_skin_vertex;
+    // From the first output vertex of the instance
+    uint32_t output_offset;
+} EgSkinningMesh;
+
+typedef struct EgSkinningInstance
+{
+    const EgSkinningMesh *meshes;
+    uint32_t mesh_count;
+    // Output vertices of all the meshes
+    uint32_t vertex_count;
+    // Bindless index of a storage buffer of EgSkinVertex
+    uint32_t skin_buffer_index;
+    // Copied by egSkinningManagerQueue
+    const float4x4 *palette;
+    uint32_t joint_count;
+} EgSkinningInstance;
+
+// Skins vertices with a compute pass into a device buffer of EgSkinnedVertex,
+// which vertex shaders read in place of the engine vertex buffer. The buffers
+// hold a fixed number of jobs, palette matrices and vertices for each frame
+// in flight, and are created by the first egSkinningManagerQueue call.
+EgSkinningManager *egSkinningManagerCreate(EgAllocator *allocator, EgEngine *engine);
+void egSkinningManagerDestroy(EgSkinningManager *skinning);
+
+// Moves to the buffer ranges of the next frame in flight and drops the
+// instances queued so far. The GPU must be done with the frame that last used
+// them.
+void egSkinningManagerBeginFrame(EgSkinningManager *skinning);
+
+// Adds a job for each mesh of the instance. Returns false, queueing nothing,
+// when the instance would go past the limits of the frame. Otherwise
+// first_output_vertex gets the first vertex of the instance in the output
+// buffer, valid until the next egSkinningManagerBeginFrame.
+bool egSkinningManagerQueue(
+    EgSkinningManager *skinning,
+    const EgSkinningInstance *instance,
+    uint32_t *first_output_vertex);
+
+// Skins the queued instances with one dispatch of pipeline (made from
+// shaders/skinning.hlsl), and makes the result visible to vertex shaders.
+// Record it outside of render passes.
+void egSkinningManagerDispatch(
+    EgSkinningManager *skinning, RgCmdBuffer *cmd_buffer, RgPipeline *pipeline);
+
+// Bindless index of the EgSkinnedVertex buffer
+uint32_t egSkinningManagerGetOutputBufferIndex(EgSkinningManager *skinning);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,633 @@
+#include "texture_compression.h"
+
+#include <string.h>
+#include "math.h"
+#include "job_system.h"
+
+// Interpolation weights of the 4 bit indices of BC7, out of 64
+static const uint32_t bc7_weights4[16] = {
+    0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+bool egFormatIsBlockCompressed(RgFormat format)
+{
+    switch (format)
+    {
+    case RG_FORMAT_BC1_RGB_UNORM:
+    case RG_FORMAT_BC1_RGB_SRGB:
+    case RG_FORMAT_BC5_UNORM:
+    case RG_FORMAT_BC7_UNORM:
+    case RG_FORMAT_BC7_SRGB: return true;
+    default: return false;
+    }
+}
+
+size_t egFormatImageSize(RgFormat format, uint32_t width, uint32_t height)
+{
+    size_t blocks = (size_t)((width + 3) / 4) * (size_t)((height + 3) / 4);
+    switch (format)
+    {
+    case RG_FORMAT_BC1_RGB_UNORM:
+    case RG_FORMAT_BC1_RGB_SRGB: return blocks * 8;
+    case RG_FORMAT_BC5_UNORM:
+    case RG_FORMAT_BC7_UNORM:
+    case RG_FORMAT_BC7_SRGB: return blocks * 16;
+    default: return (size_t)width * (size_t)height * 4;
+    }
+}
+
+// Finds the direction of largest variance of the texels with power iteration
+static void PrincipalAxis(
+    const uint8_t texels[64], uint32_t channels, float mean[4], float axis[4])
+{
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        mean[c] = 0.0f;
+        axis[c] = 0.0f;
+    }
+
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            mean[c] += (float)texels[i * 4 + c] / 16.0f;
+        }
+    }
+
+    float covariance[4][4] = {{0.0f}};
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        float d[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            d[c] = (float)texels[i * 4 + c] - mean[c];
+        }
+
+        for (uint32_t a = 0; a < channels; ++a)
+        {
+            for (uint32_t b = 0; b < channels; ++b)
+            {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+
+    // Start from the channel that varies the most, a fixed start vector finds
+    // nothing when it's orthogonal to the axis, such as (1, 1, 1) for a ramp
+    // whose channels always sum to the same value
+    uint32_t widest = 0;
+    for (uint32_t c = 1; c < channels; ++c)
+    {
+        if (covariance[c][c] > covariance[widest][widest]) widest = c;
+    }
+    float v[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    v[widest] = 1.0f;
+
+    for (uint32_t iteration = 0; iteration < 8; ++iteration)
+    {
+        float r[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        float length = 0.0f;
+        for (uint32_t a = 0; a < channels; ++a)
+        {
+            for (uint32_t b = 0; b < channels; ++b)
+            {
+                r[a] += covariance[a][b] * v[b];
+            }
+            length += r[a] * r[a];
+        }
+
+        // Flat blocks have no preferred direction
+        if (length < 1e-8f) break;
+
+        length = sqrtf(length);
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            v[c] = r[c] / length;
+        }
+    }
+
+    for (uint32_t c = 0; c < channels; ++c)
+    {
+        axis[c] = v[c];
+    }
+}
+
+// Endpoints along the principal axis that bound every texel of the block
+static void BoundingEndpoints(
+    const uint8_t texels[64], uint32_t channels, float e0[4], float e1[4])
+{
+    float mean[4];
+    float axis[4];
+    PrincipalAxis(texels, channels, mean, axis);
+
+    float min_t = 0.0f;
+    float max_t = 0.0f;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        float t = 0.0f;
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            t += ((float)texels[i * 4 + c] - mean[c]) * axis[c];
+        }
+        if (t < min_t) min_t = t;
+        if (t > max_t) max_t = t;
+    }
+
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        e0[c] = mean[c] + axis[c] * min_t;
+        e1[c] = mean[c] + axis[c] * max_t;
+    }
+}
+
+// Least squares endpoints for the given interpolation factor of each texel,
+// returns false if the factors don't determine them
+static bool RefineEndpoints(
+    const uint8_t texels[64],
+    uint32_t channels,
+    const float factors[16],
+    float e0[4],
+    float e1[4])
+{
+    float aa = 0.0f;
+    float ab = 0.0f;
+    float bb = 0.0f;
+    float ax[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    float bx[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        float b = factors[i];
+        float a = 1.0f - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            ax[c] += a * (float)texels[i * 4 + c];
+            bx[c] += b * (float)texels[i * 4 + c];
+        }
+    }
+
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) return false;
+
+    for (uint32_t c = 0; c < channels; ++c)
+    {
+        e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+        e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+    }
+
+    return true;
+}
+
+static float Clamp255(float value)
+{
+    return value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+}
+
+// BC1 {{{
+static uint16_t PackRGB565(const float color[4])
+{
+    uint32_t r = (uint32_t)(Clamp255(color[0]) * 31.0f / 255.0f + 0.5f);
+    uint32_t g = (uint32_t)(Clamp255(color[1]) * 63.0f / 255.0f + 0.5f);
+    uint32_t b = (uint32_t)(Clamp255(color[2]) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t packed, int32_t color[3])
+{
+    int32_t r = (packed >> 11) & 31;
+    int32_t g = (packed >> 5) & 63;
+    int32_t b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// Picks the closest palette entry for every texel, returns the squared error
+static uint32_t FitBC1(
+    const uint8_t texels[64], uint16_t c0, uint16_t c1, uint32_t *indices)
+{
+    int32_t palette[4][3];
+    UnpackRGB565(c0, palette[0]);
+    UnpackRGB565(c1, palette[1]);
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+
+    uint32_t error = 0;
+    *indices = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t best_index = 0;
+        uint32_t best_error = UINT32_MAX;
+        for (uint32_t p = 0; p < 4; ++p)
+        {
+            uint32_t e = 0;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                int32_t d = (int32_t)texels[i * 4 + c] - palette[p][c];
+                e += (uint32_t)(d * d);
+            }
+            if (e < best_error)
+            {
+                best_error = e;
+                best_index = p;
+            }
+        }
+
+        error += best_error;
+        *indices |= best_index << (i * 2);
+    }
+
+    return error;
+}
+
+static uint32_t EncodeBC1Endpoints(
+    const uint8_t texels[64], const float e0[4], const float e1[4], uint8_t dst[8])
+{
+    uint16_t c0 = PackRGB565(e0);
+    uint16_t c1 = PackRGB565(e1);
+
+    // c0 > c1 selects the four color mode
+    if (c0 < c1)
+    {
+        uint16_t tmp = c0;
+        c0 = c1;
+        c1 = tmp;
+    }
+
+    uint32_t indices = 0;
+    uint32_t error = 0;
+    if (c0 == c1)
+    {
+        // Every index refers to c0
+        int32_t color[3];
+        UnpackRGB565(c0, color);
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+                int32_t d = (int32_t)texels[i * 4 + c] - color[c];
+                error += (uint32_t)(d * d);
+            }
+        }
+    }
+    else
+    {
+        error = FitBC1(texels, c0, c1, &indices);
+    }
+
+    dst[0] = (uint8_t)(c0 & 0xff);
+    dst[1] = (uint8_t)(c0 >> 8);
+    dst[2] = (uint8_t)(c1 & 0xff);
+    dst[3] = (uint8_t)(c1 >> 8);
+    dst[4] = (uint8_t)(indices & 0xff);
+    dst[5] = (uint8_t)((indices >> 8) & 0xff);
+    dst[6] = (uint8_t)((indices >> 16) & 0xff);
+    dst[7] = (uint8_t)(indices >> 24);
+
+    return error;
+}
+
+void egEncodeBlockBC1(const uint8_t texels[64], uint8_t dst[8])
+{
+    float e0[4];
+    float e1[4];
+    BoundingEndpoints(texels, 3, e0, e1);
+
+    uint32_t error = EncodeBC1Endpoints(texels, e0, e1, dst);
+
+    // One least squares pass over the chosen indices usually lowers the error
+    static const float bc1_factors[4] = {0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f};
+    uint16_t c0 = (uint16_t)(dst[0] | (dst[1] << 8));
+    uint16_t c1 = (uint16_t)(dst[2] | (dst[3] << 8));
+    if (c0 == c1) return;
+
+    uint32_t indices =
+        (uint32_t)dst[4] | ((uint32_t)dst[5] << 8) | ((uint32_t)dst[6] << 16) |
+        ((uint32_t)dst[7] << 24);
+
+    float factors[16];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        factors[i] = bc1_factors[(indices >> (i * 2)) & 3];
+    }
+
+    int32_t color0[3];
+    int32_t color1[3];
+    UnpackRGB565(c0, color0);
+    UnpackRGB565(c1, color1);
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        e0[c] = (float)color0[c];
+        e1[c] = (float)color1[c];
+    }
+
+    if (RefineEndpoints(texels, 3, factors, e0, e1))
+    {
+        uint8_t refined[8];
+        if (EncodeBC1Endpoints(texels, e0, e1, refined) < error)
+        {
+            memcpy(dst, refined, sizeof(refined));
+        }
+    }
+}
+// }}}
+
+// BC4 / BC5 {{{
+static void EncodeBlockBC4(const uint8_t texels[64], uint32_t channel, uint8_t dst[8])
+{
+    uint8_t min = 255;
+    uint8_t max = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint8_t value = texels[i * 4 + channel];
+        if (value < min) min = value;
+        if (value > max) max = value;
+    }
+
+    // max > min selects the eight value mode, index 1 is max and the rest
+    // interpolate between them
+    uint64_t indices = 0;
+    if (max > min)
+    {
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            float t = (float)(texels[i * 4 + channel] - max) / (float)(min - max);
+            uint32_t step = (uint32_t)(t * 7.0f + 0.5f);
+
+            uint64_t index;
+            if (step == 0)
+                index = 0;
+            else if (step == 7)
+                index = 1;
+            else
+                index = step + 1;
+
+            indices |= index << (i * 3);
+        }
+    }
+
+    dst[0] = max;
+    dst[1] = min;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        dst[2 + i] = (uint8_t)((indices >> (i * 8)) & 0xff);
+    }
+}
+
+void egEncodeBlockBC5(const uint8_t texels[64], uint8_t dst[16])
+{
+    EncodeBlockBC4(texels, 0, &dst[0]);
+    EncodeBlockBC4(texels, 1, &dst[8]);
+}
+// }}}
+
+// BC7 {{{
+// Only mode 6 is used: one subset, 7 bit RGBA endpoints with a p-bit each and
+// 4 bit indices. It's the best single mode for smooth color with alpha.
+typedef struct Bc7Mode6
+{
+    uint8_t endpoints[2][4]; // 7 bits
+    uint8_t p_bits[2];
+    uint8_t indices[16];
+} Bc7Mode6;
+
+static void
+QuantizeBC7Endpoint(const float endpoint[4], uint8_t quantized[4], uint8_t *p_bit)
+{
+    uint32_t best_error = UINT32_MAX;
+    for (uint8_t p = 0; p < 2; ++p)
+    {
+        uint8_t q[4];
+        uint32_t error = 0;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            float value = (Clamp255(endpoint[c]) - (float)p) * 0.5f + 0.5f;
+            int32_t qi = (int32_t)value;
+            qi = qi < 0 ? 0 : (qi > 127 ? 127 : qi);
+            q[c] = (uint8_t)qi;
+
+            int32_t d = (int32_t)((qi << 1) | p) - (int32_t)(endpoint[c] + 0.5f);
+            error += (uint32_t)(d * d);
+        }
+
+        if (error < best_error)
+        {
+            best_error = error;
+            memcpy(quantized, q, sizeof(q));
+            *p_bit = p;
+        }
+    }
+}
+
+static uint32_t FitBC7(const uint8_t texels[64], Bc7Mode6 *block)
+{
+    int32_t e[2][4];
+    for (uint32_t j = 0; j < 2; ++j)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            e[j][c] = (block->endpoints[j][c] << 1) | block->p_bits[j];
+        }
+    }
+
+    int32_t palette[16][4];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        int32_t w = (int32_t)bc7_weights4[i];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            palette[i][c] = ((64 - w) * e[0][c] + w * e[1][c] + 32) >> 6;
+        }
+    }
+
+    uint32_t error = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t best_index = 0;
+        uint32_t best_error = UINT32_MAX;
+        for (uint32_t p = 0; p < 16; ++p)
+        {
+            uint32_t err = 0;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                int32_t d = (int32_t)texels[i * 4 + c] - palette[p][c];
+                err += (uint32_t)(d * d);
+            }
+            if (err < best_error)
+            {
+                best_error = err;
+                best_index = p;
+            }
+        }
+
+        block->indices[i] = (uint8_t)best_index;
+        error += best_error;
+    }
+
+    return error;
+}
+
+static uint32_t QuantizeBC7(
+    const uint8_t texels[64], const float e0[4], const float e1[4], Bc7Mode6 *block)
+{
+    QuantizeBC7Endpoint(e0, block->endpoints[0], &block->p_bits[0]);
+    QuantizeBC7Endpoint(e1, block->endpoints[1], &block->p_bits[1]);
+    return FitBC7(texels, block);
+}
+
+static void WriteBits(uint8_t *dst, uint32_t *bit, uint32_t value, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if ((value >> i) & 1)
+        {
+            dst[*bit >> 3] |= (uint8_t)(1 << (*bit & 7));
+        }
+        (*bit)++;
+    }
+}
+
+void egEncodeBlockBC7(const uint8_t texels[64], uint8_t dst[16])
+{
+    float e0[4];
+    float e1[4];
+    BoundingEndpoints(texels, 4, e0, e1);
+
+    Bc7Mode6 block;
+    uint32_t error = QuantizeBC7(texels, e0, e1, &block);
+
+    float factors[16];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        factors[i] = (float)bc7_weights4[block.indices[i]] / 64.0f;
+    }
+
+    if (RefineEndpoints(texels, 4, factors, e0, e1))
+    {
+        Bc7Mode6 refined;
+        if (QuantizeBC7(texels, e0, e1, &refined) < error)
+        {
+            block = refined;
+        }
+    }
+
+    // The most significant bit of the first index is implicitly zero, the
+    // weights are symmetric so swapping the endpoints keeps the same colors
+    if (block.indices[0] & 8)
+    {
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            uint8_t tmp = block.endpoints[0][c];
+            block.endpoints[0][c] = block.endpoints[1][c];
+            block.endpoints[1][c] = tmp;
+        }
+
+        uint8_t tmp = block.p_bits[0];
+        block.p_bits[0] = block.p_bits[1];
+        block.p_bits[1] = tmp;
+
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            block.indices[i] = (uint8_t)(15 - block.indices[i]);
+        }
+    }
+
+    memset(dst, 0, 16);
+    uint32_t bit = 0;
+    WriteBits(dst, &bit, 1 << 6, 7); // Mode 6
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        WriteBits(dst, &bit, block.endpoints[0][c], 7);
+        WriteBits(dst, &bit, block.endpoints[1][c], 7);
+    }
+    WriteBits(dst, &bit, block.p_bits[0], 1);
+    WriteBits(dst, &bit, block.p_bits[1], 1);
+    WriteBits(dst, &bit, block.indices[0], 3);
+    for (uint32_t i = 1; i < 16; ++i)
+    {
+        WriteBits(dst, &bit, block.indices[i], 4);
+    }
+}
+// }}}
+
+typedef struct CompressJob
+{
+    RgFormat format;
+    const uint8_t *pixels;
+    uint32_t width;
+    uint32_t height;
+    uint8_t *dst;
+} CompressJob;
+
+static void CompressRows(void *user_data, size_t begin, size_t end)
+{
+    CompressJob *job = (CompressJob *)user_data;
+
+    uint32_t blocks_x = (job->width + 3) / 4;
+    size_t block_size = egFormatImageSize(job->format, 4, 4);
+
+    for (size_t by = begin; by < end; ++by)
+    {
+        for (uint32_t bx = 0; bx < blocks_x; ++bx)
+        {
+            uint8_t texels[64];
+            for (uint32_t y = 0; y < 4; ++y)
+            {
+                uint32_t py = EG_MIN((uint32_t)by * 4 + y, job->height - 1);
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    uint32_t px = EG_MIN(bx * 4 + x, job->width - 1);
+                    memcpy(
+                        &texels[(y * 4 + x) * 4],
+                        &job->pixels[((size_t)py * job->width + px) * 4],
+                        4);
+                }
+            }
+
+            uint8_t *dst = &job->dst[(by * blocks_x + bx) * block_size];
+            switch (job->format)
+            {
+            case RG_FORMAT_BC1_RGB_UNORM:
+            case RG_FORMAT_BC1_RGB_SRGB: egEncodeBlockBC1(texels, dst); break;
+            case RG_FORMAT_BC5_UNORM: egEncodeBlockBC5(texels, dst); break;
+            case RG_FORMAT_BC7_UNORM:
+            case RG_FORMAT_BC7_SRGB: egEncodeBlockBC7(texels, dst); break;
+            default: EG_ASSERT(0); break;
+            }
+        }
+    }
+}
+
+void egCompressImage(
+    EgJobSystem *job_system,
+    RgFormat format,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst)
+{
+    EG_ASSERT(egFormatIsBlockCompressed(format));
+
+    CompressJob job = {
+        .format = format,
+        .pixels = pixels,
+        .width = width,
+        .height = height,
+        .dst = dst,
+    };
+
+    size_t block_rows = (height + 3) / 4;
+    if (job_system)
+    {
+        egJobSystemParallelFor(job_system, block_rows, 4, CompressRows, &job);
+    }
+    else
+    {
+        CompressRows(&job, 0, block_rows);
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <rg.h>
+#include "base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgJobSystem EgJobSystem;
+
+// BC1 for opaque color and data maps, BC5 for two channel normal maps and BC7
+// for color with alpha. Everything else is treated as RGBA8.
+bool egFormatIsBlockCompressed(RgFormat format);
+// Bytes taken by a single level of the given size
+size_t egFormatImageSize(RgFormat format, uint32_t width, uint32_t height);
+
+// Encodes a 4x4 block of RGBA8 texels, stored row by row
+void egEncodeBlockBC1(const uint8_t texels[64], uint8_t dst[8]);
+void egEncodeBlockBC5(const uint8_t texels[64], uint8_t dst[16]);
+void egEncodeBlockBC7(const uint8_t texels[64], uint8_t dst[16]);
+
+// Encodes a level of an RGBA8 image, edge texels are repeated to fill partial
+// blocks. Rows of blocks are spread over the job system unless it's NULL.
+void egCompressImage(
+    EgJobSystem *job_system,
+    RgFormat format,
+    const uint8_t *pixels,
+    uint32_t width,
+    uint32_t height,
+    uint8_t *dst);
+
+#ifdef __cplusplus
+}
+#endif
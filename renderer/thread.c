@@ -0,0 +1,242 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+
+#include "thread.h"
+
+#include <limits.h>
+#include "allocator.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+struct EgThread
+{
+    EgAllocator *allocator;
+    EgThreadProc proc;
+    void *user_data;
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+};
+
+struct EgSemaphore
+{
+    EgAllocator *allocator;
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t count;
+#endif
+};
+
+struct EgMutex
+{
+    EgAllocator *allocator;
+#if defined(_WIN32)
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI ThreadEntry(LPVOID param)
+{
+    EgThread *thread = (EgThread *)param;
+    thread->proc(thread->user_data);
+    return 0;
+}
+#else
+static void *ThreadEntry(void *param)
+{
+    EgThread *thread = (EgThread *)param;
+    thread->proc(thread->user_data);
+    return NULL;
+}
+#endif
+
+EgThread *egThreadCreate(EgAllocator *allocator, EgThreadProc proc, void *user_data)
+{
+    EgThread *thread = (EgThread *)egAllocate(allocator, sizeof(*thread));
+    *thread = (EgThread){0};
+
+    thread->allocator = allocator;
+    thread->proc = proc;
+    thread->user_data = user_data;
+
+#if defined(_WIN32)
+    thread->handle = CreateThread(NULL, 0, ThreadEntry, thread, 0, NULL);
+    EG_ASSERT(thread->handle != NULL);
+#else
+    int result = pthread_create(&thread->handle, NULL, ThreadEntry, thread);
+    EG_ASSERT(result == 0);
+#endif
+
+    return thread;
+}
+
+void egThreadJoin(EgThread *thread)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+
+    egFree(thread->allocator, thread);
+}
+
+void egThreadYield(void)
+{
+#if defined(_WIN32)
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void egThreadPinCurrent(uint32_t cpu_index)
+{
+#if defined(_WIN32)
+    SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (cpu_index % 64));
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu_index % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu_index;
+#endif
+}
+
+EgMutex *egMutexCreate(EgAllocator *allocator)
+{
+    EgMutex *mutex = (EgMutex *)egAllocate(allocator, sizeof(*mutex));
+    *mutex = (EgMutex){0};
+
+    mutex->allocator = allocator;
+
+#if defined(_WIN32)
+    InitializeSRWLock(&mutex->lock);
+#else
+    pthread_mutex_init(&mutex->lock, NULL);
+#endif
+
+    return mutex;
+}
+
+void egMutexDestroy(EgMutex *mutex)
+{
+#if !defined(_WIN32)
+    pthread_mutex_destroy(&mutex->lock);
+#endif
+
+    egFree(mutex->allocator, mutex);
+}
+
+void egMutexLock(EgMutex *mutex)
+{
+#if defined(_WIN32)
+    AcquireSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void egMutexUnlock(EgMutex *mutex)
+{
+#if defined(_WIN32)
+    ReleaseSRWLockExclusive(&mutex->lock);
+#else
+    pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+EgSemaphore *egSemaphoreCreate(EgAllocator *allocator, uint32_t initial_count)
+{
+    EgSemaphore *semaphore = (EgSemaphore *)egAllocate(allocator, sizeof(*semaphore));
+    *semaphore = (EgSemaphore){0};
+
+    semaphore->allocator = allocator;
+
+#if defined(_WIN32)
+    semaphore->handle = CreateSemaphoreA(NULL, (LONG)initial_count, LONG_MAX, NULL);
+    EG_ASSERT(semaphore->handle != NULL);
+#else
+    pthread_mutex_init(&semaphore->mutex, NULL);
+    pthread_cond_init(&semaphore->cond, NULL);
+    semaphore->count = initial_count;
+#endif
+
+    return semaphore;
+}
+
+void egSemaphoreDestroy(EgSemaphore *semaphore)
+{
+#if defined(_WIN32)
+    CloseHandle(semaphore->handle);
+#else
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+#endif
+
+    egFree(semaphore->allocator, semaphore);
+}
+
+void egSemaphoreWait(EgSemaphore *semaphore)
+{
+#if defined(_WIN32)
+    WaitForSingleObject(semaphore->handle, INFINITE);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0)
+    {
+        pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+    }
+    semaphore->count--;
+    pthread_mutex_unlock(&semaphore->mutex);
+#endif
+}
+
+void egSemaphoreSignal(EgSemaphore *semaphore, uint32_t count)
+{
+#if defined(_WIN32)
+    ReleaseSemaphore(semaphore->handle, (LONG)count, NULL);
+#else
+    pthread_mutex_lock(&semaphore->mutex);
+    semaphore->count += count;
+    pthread_mutex_unlock(&semaphore->mutex);
+    if (count == 1)
+    {
+        pthread_cond_signal(&semaphore->cond);
+    }
+    else
+    {
+        pthread_cond_broadcast(&semaphore->cond);
+    }
+#endif
+}
+
+uint32_t egGetCpuCount(void)
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (uint32_t)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
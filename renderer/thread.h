@@ -0,0 +1,114 @@
+#pragma once
+
+#include "base.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgAllocator EgAllocator;
+typedef struct EgThread EgThread;
+typedef struct EgMutex EgMutex;
+typedef struct EgSemaphore EgSemaphore;
+
+#if defined(_MSC_VER)
+#define EG_THREAD_LOCAL __declspec(thread)
+#else
+#define EG_THREAD_LOCAL __thread
+#endif
+
+typedef void (*EgThreadProc)(void *user_data);
+
+EgThread *egThreadCreate(EgAllocator *allocator, EgThreadProc proc, void *user_data);
+// Waits for the thread to finish and frees it
+void egThreadJoin(EgThread *thread);
+void egThreadYield(void);
+// Restricts the calling thread to run on the given logical processor
+void egThreadPinCurrent(uint32_t cpu_index);
+
+EgMutex *egMutexCreate(EgAllocator *allocator);
+void egMutexDestroy(EgMutex *mutex);
+void egMutexLock(EgMutex *mutex);
+void egMutexUnlock(EgMutex *mutex);
+
+EgSemaphore *egSemaphoreCreate(EgAllocator *allocator, uint32_t initial_count);
+void egSemaphoreDestroy(EgSemaphore *semaphore);
+void egSemaphoreWait(EgSemaphore *semaphore);
+void egSemaphoreSignal(EgSemaphore *semaphore, uint32_t count);
+
+// Number of logical processors available to the process
+uint32_t egGetCpuCount(void);
+
+// Atomics {{{
+#if defined(_MSC_VER)
+EG_INLINE uint32_t egAtomicLoadU32(volatile uint32_t *ptr)
+{
+    return (uint32_t)_InterlockedOr((volatile long *)ptr, 0);
+}
+
+EG_INLINE void egAtomicStoreU32(volatile uint32_t *ptr, uint32_t value)
+{
+    _InterlockedExchange((volatile long *)ptr, (long)value);
+}
+
+// Returns the value before the addition
+EG_INLINE uint32_t egAtomicFetchAddU32(volatile uint32_t *ptr, uint32_t value)
+{
+    return (uint32_t)_InterlockedExchangeAdd((volatile long *)ptr, (long)value);
+}
+
+// Returns true if *ptr was equal to expected and got replaced by desired
+EG_INLINE bool
+egAtomicCompareExchangeU32(volatile uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+    return (uint32_t)_InterlockedCompareExchange(
+               (volatile long *)ptr, (long)desired, (long)expected) == expected;
+}
+
+EG_INLINE void egCpuPause(void)
+{
+    _mm_pause();
+}
+#else
+EG_INLINE uint32_t egAtomicLoadU32(volatile uint32_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+EG_INLINE void egAtomicStoreU32(volatile uint32_t *ptr, uint32_t value)
+{
+    __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+// Returns the value before the addition
+EG_INLINE uint32_t egAtomicFetchAddU32(volatile uint32_t *ptr, uint32_t value)
+{
+    return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+// Returns true if *ptr was equal to expected and got replaced by desired
+EG_INLINE bool
+egAtomicCompareExchangeU32(volatile uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+    return __atomic_compare_exchange_n(
+        ptr, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+EG_INLINE void egCpuPause(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+#endif
+// }}}
+
+#ifdef __cplusplus
+}
+#endif
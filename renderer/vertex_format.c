@@ -0,0 +1,171 @@
+#include "vertex_format.h"
+
+#include <math.h>
+#include <string.h>
+#include "engine.h"
+
+EG_STATIC_ASSERT(sizeof(EgCompactVertex) == 20, "wrong EgCompactVertex size");
+EG_STATIC_ASSERT(sizeof(EgSkinVertex) == 16, "wrong EgSkinVertex size");
+EG_STATIC_ASSERT(sizeof(EgSkinnedVertex) == 32, "wrong EgSkinnedVertex size");
+
+static float SignNotZero(float value)
+{
+    return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static int16_t FloatToSnorm16(float value)
+{
+    if (value < -1.0f) value = -1.0f;
+    if (value > 1.0f) value = 1.0f;
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+static float Snorm16ToFloat(int16_t value)
+{
+    float result = (float)value / 32767.0f;
+    return result < -1.0f ? -1.0f : result;
+}
+
+// Maps value from [offset, offset + scale * 65535] to unorm16
+static uint16_t Quantize(float value, float offset, float scale)
+{
+    if (scale <= 0.0f) return 0;
+
+    float q = (value - offset) / scale;
+    if (q < 0.0f) q = 0.0f;
+    if (q > 65535.0f) q = 65535.0f;
+    return (uint16_t)lrintf(q);
+}
+
+static void FitRange(float min, float max, float *offset, float *scale)
+{
+    *offset = min;
+    *scale = (max - min) / 65535.0f;
+}
+
+void egVertexQuantizationCompute(
+    const EgVertex *vertices, size_t count, EgVertexQuantization *quantization)
+{
+    *quantization = (EgVertexQuantization){0};
+    if (count == 0) return;
+
+    float pos_min[3], pos_max[3];
+    float uv_min[2], uv_max[2];
+
+    memcpy(pos_min, &vertices[0].pos, sizeof(pos_min));
+    memcpy(pos_max, &vertices[0].pos, sizeof(pos_max));
+    memcpy(uv_min, &vertices[0].uv, sizeof(uv_min));
+    memcpy(uv_max, &vertices[0].uv, sizeof(uv_max));
+
+    for (size_t i = 1; i < count; ++i)
+    {
+        const float *pos = &vertices[i].pos.x;
+        const float *uv = &vertices[i].uv.x;
+
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            if (pos[c] < pos_min[c]) pos_min[c] = pos[c];
+            if (pos[c] > pos_max[c]) pos_max[c] = pos[c];
+        }
+
+        for (uint32_t c = 0; c < 2; ++c)
+        {
+            if (uv[c] < uv_min[c]) uv_min[c] = uv[c];
+            if (uv[c] > uv_max[c]) uv_max[c] = uv[c];
+        }
+    }
+
+    float *pos_offset = &quantization->position_offset.x;
+    float *pos_scale = &quantization->position_scale.x;
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        FitRange(pos_min[c], pos_max[c], &pos_offset[c], &pos_scale[c]);
+    }
+
+    float *uv_offset = &quantization->uv_offset.x;
+    float *uv_scale = &quantization->uv_scale.x;
+    for (uint32_t c = 0; c < 2; ++c)
+    {
+        FitRange(uv_min[c], uv_max[c], &uv_offset[c], &uv_scale[c]);
+    }
+}
+
+void egOctEncode(float3 v, int16_t *out)
+{
+    float l1 = fabsf(v.x) + fabsf(v.y) + fabsf(v.z);
+    if (!(l1 > 0.0f))
+    {
+        out[0] = 0;
+        out[1] = 0;
+        return;
+    }
+
+    float x = v.x / l1;
+    float y = v.y / l1;
+
+    // Fold the lower hemisphere over the diagonals
+    if (v.z < 0.0f)
+    {
+        float folded_x = (1.0f - fabsf(y)) * SignNotZero(x);
+        float folded_y = (1.0f - fabsf(x)) * SignNotZero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+
+    out[0] = FloatToSnorm16(x);
+    out[1] = FloatToSnorm16(y);
+}
+
+float3 egOctDecode(const int16_t *in)
+{
+    float3 v;
+    v.x = Snorm16ToFloat(in[0]);
+    v.y = Snorm16ToFloat(in[1]);
+    v.z = 1.0f - fabsf(v.x) - fabsf(v.y);
+
+    float t = v.z < 0.0f ? -v.z : 0.0f;
+    v.x -= t * SignNotZero(v.x);
+    v.y -= t * SignNotZero(v.y);
+
+    float length = sqrtf(v.x * v.x + v.y * v.y + v.z * v.z);
+    v.x /= length;
+    v.y /= length;
+    v.z /= length;
+    return v;
+}
+
+void egVertexCompress(
+    const EgVertex *vertices,
+    size_t count,
+    const EgVertexQuantization *quantization,
+    EgCompactVertex *compact_vertices)
+{
+    const float *pos_offset = &quantization->position_offset.x;
+    const float *pos_scale = &quantization->position_scale.x;
+    const float *uv_offset = &quantization->uv_offset.x;
+    const float *uv_scale = &quantization->uv_scale.x;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const EgVertex *vertex = &vertices[i];
+        EgCompactVertex *compact = &compact_vertices[i];
+
+        const float *pos = &vertex->pos.x;
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            compact->pos[c] = Quantize(pos[c], pos_offset[c], pos_scale[c]);
+        }
+        compact->pos[3] = vertex->tangent[3] < 0.0f ? 0 : UINT16_MAX;
+
+        egOctEncode(vertex->normal, compact->normal);
+        egOctEncode(
+            (float3){vertex->tangent[0], vertex->tangent[1], vertex->tangent[2]},
+            compact->tangent);
+
+        const float *uv = &vertex->uv.x;
+        for (uint32_t c = 0; c < 2; ++c)
+        {
+            compact->uv[c] = Quantize(uv[c], uv_offset[c], uv_scale[c]);
+        }
+    }
+}
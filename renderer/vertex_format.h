@@ -0,0 +1,42 @@
+#pragma once
+
+#include "base.h"
+#include "math_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct EgVertex EgVertex;
+typedef struct EgCompactVertex EgCompactVertex;
+
+// Maps the 16-bit positions and UVs of an EgCompactVertex back to their
+// original range: value = offset + scale * q, where q is the integer in
+// [0, 65535] and scale the size of one step
+typedef struct EgVertexQuantization
+{
+    float3 position_offset;
+    float3 position_scale;
+    float2 uv_offset;
+    float2 uv_scale;
+} EgVertexQuantization;
+
+// Fits the quantization to the bounds of the positions and UVs. Vertices
+// that share it must be compressed together so the same mapping applies.
+void egVertexQuantizationCompute(
+    const EgVertex *vertices, size_t count, EgVertexQuantization *quantization);
+
+void egVertexCompress(
+    const EgVertex *vertices,
+    size_t count,
+    const EgVertexQuantization *quantization,
+    EgCompactVertex *compact_vertices);
+
+// Octahedral encoding of a unit vector to two snorm16 values. Zero vectors
+// encode to +Z.
+void egOctEncode(float3 v, int16_t *out);
+float3 egOctDecode(const int16_t *in);
+
+#ifdef __cplusplus
+}
+#endif
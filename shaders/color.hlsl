@@ -1,4 +1,5 @@
 #pragma cull_mode front
+#pragma vertex_format pulled
 
 #define PI 3.14159265359
 
@@ -17,6 +18,9 @@ struct Camera
 struct Model
 {
 	float4x4 transform;
+	float4 position_offset;
+	float4 position_scale;
+	float4 uv_offset_scale;
 };
 
 struct Material
@@ -36,6 +40,8 @@ struct Material
 	uint emissive_image_index;
 
 	uint brdf_image_index;
+
+	uint is_normal_two_channel;
 };
 
 struct PushConstant
@@ -48,14 +54,34 @@ struct PushConstant
 
 	uint material_buffer_index;
 	uint material_index;
+
+	uint vertex_buffer_index;
+	uint vertex_format;
+};
+
+#define VERTEX_FORMAT_COMPACT 0
+#define VERTEX_FORMAT_SKINNED 1
+
+// EgSkinnedVertex
+struct SkinnedVertex
+{
+	float pos_x;
+	float pos_y;
+	float pos_z;
+	uint normal;
+	uint tangent;
+	uint uv;
+	float tangent_sign;
+	uint padding;
 };
 
 struct VsInput
 {
-	float3 pos     : POSITION;
-	float3 normal  : NORMAL;
-	float4 tangent : TANGENT;
-	float2 uv      : TEXCOORD0;
+	float3 pos;         // Model space
+	float tangent_sign;
+	float2 normal;      // octahedral encoded
+	float2 tangent;     // octahedral encoded
+	float2 uv;          // 16-bit steps from the mesh UV offset
 };
 
 struct VsOutput
@@ -70,6 +96,9 @@ struct VsOutput
 [[vk::binding(0)]] StructuredBuffer<Camera> camera_buffers[];
 [[vk::binding(0)]] StructuredBuffer<Model> model_buffers[];
 [[vk::binding(0)]] StructuredBuffer<Material> material_buffers[];
+// Read as 32-bit words, see pull_vertex
+[[vk::binding(0)]] StructuredBuffer<uint> vertex_buffers[];
+[[vk::binding(0)]] StructuredBuffer<SkinnedVertex> skinned_vertex_buffers[];
 [[vk::binding(1)]] Texture2D<float4> textures[];
 [[vk::binding(2)]] SamplerState samplers[];
 
@@ -115,24 +144,84 @@ float3 fresnel_schlick(float cosTheta, float3 F0)
     return F0 + (1.0 - F0) * pow(max(1.0 - cosTheta, 0.0), 5.0);
 }
 
-VsOutput vertex(in VsInput vs_in)
+float3 oct_decode(float2 e)
+{
+	float3 v = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-v.z);
+	v.x -= sign(v.x) * t;
+	v.y -= sign(v.y) * t;
+	return normalize(v);
+}
+
+float unpack_snorm16(uint bits)
+{
+	float value = float(bits & 0xFFFF);
+	if (value >= 32768.0) value -= 65536.0;
+	return max(value / 32767.0, -1.0);
+}
+
+// vertex_id already includes the base vertex of the draw. Quantized values
+// are scaled by the size of one 16-bit step, see EgVertexQuantization.
+VsInput pull_vertex(uint vertex_id, Model model)
+{
+	VsInput vs_in;
+	uint normal;
+	uint tangent;
+	uint uv;
+	if (pc.vertex_format == VERTEX_FORMAT_SKINNED)
+	{
+		SkinnedVertex vertex = skinned_vertex_buffers[pc.vertex_buffer_index][vertex_id];
+		vs_in.pos = float3(vertex.pos_x, vertex.pos_y, vertex.pos_z);
+		vs_in.tangent_sign = vertex.tangent_sign;
+		normal = vertex.normal;
+		tangent = vertex.tangent;
+		uv = vertex.uv;
+	}
+	else
+	{
+		// EgCompactVertex, five words: pos.xy, pos.zw, normal, tangent, uv
+		uint base = vertex_id * 5;
+		uint pos_xy = vertex_buffers[pc.vertex_buffer_index][base + 0];
+		uint pos_zw = vertex_buffers[pc.vertex_buffer_index][base + 1];
+		normal = vertex_buffers[pc.vertex_buffer_index][base + 2];
+		tangent = vertex_buffers[pc.vertex_buffer_index][base + 3];
+		uv = vertex_buffers[pc.vertex_buffer_index][base + 4];
+
+		float3 steps = float3(pos_xy & 0xFFFF, pos_xy >> 16, pos_zw & 0xFFFF);
+		vs_in.pos = model.position_offset.xyz + model.position_scale.xyz * steps;
+		vs_in.tangent_sign = (pos_zw >> 16) > 32767 ? 1.0 : -1.0;
+	}
+	vs_in.normal = float2(unpack_snorm16(normal), unpack_snorm16(normal >> 16));
+	vs_in.tangent = float2(unpack_snorm16(tangent), unpack_snorm16(tangent >> 16));
+	vs_in.uv = float2(uv & 0xFFFF, uv >> 16);
+	return vs_in;
+}
+
+VsOutput vertex(uint vertex_id : SV_VertexID)
 {
 	Model model = model_buffers[pc.model_buffer_index][pc.model_index];
 	Camera camera = camera_buffers[pc.camera_buffer_index][pc.camera_index];
 
+	VsInput vs_in = pull_vertex(vertex_id, model);
+
+	float3 pos = vs_in.pos;
+	float3 normal = oct_decode(vs_in.normal);
+	float3 tangent = oct_decode(vs_in.tangent);
+	float tangent_sign = vs_in.tangent_sign;
+
 	VsOutput vs_out;
-	vs_out.world_pos = mul(model.transform, float4(vs_in.pos, 1.0)).xyz;
+	vs_out.world_pos = mul(model.transform, float4(pos, 1.0)).xyz;
 	vs_out.sv_pos = mul(camera.proj, mul(camera.view, float4(vs_out.world_pos, 1.0)));
-	vs_out.uv = vs_in.uv;
+	vs_out.uv = model.uv_offset_scale.xy + model.uv_offset_scale.zw * vs_in.uv;
 
 	Material mat = material_buffers[pc.material_buffer_index][pc.material_index];
 
 	if (mat.is_normal_mapped != 0)
 	{
-		float3 T = normalize(mul(model.transform, float4(vs_in.tangent.xyz, 0.0f)).xyz);
-		float3 N = normalize(mul(model.transform, float4(vs_in.normal, 0.0f)).xyz);
+		float3 T = normalize(mul(model.transform, float4(tangent, 0.0f)).xyz);
+		float3 N = normalize(mul(model.transform, float4(normal, 0.0f)).xyz);
 		T = normalize(T - dot(T, N) * N); // re-orthogonalize
-		float3 B = vs_in.tangent.w * cross(N, T);
+		float3 B = tangent_sign * cross(N, T);
 		vs_out.tbn[0] = T;
 		vs_out.tbn[1] = B;
 		vs_out.tbn[2] = N;
@@ -144,7 +233,7 @@ VsOutput vertex(in VsInput vs_in)
 		model3[0] = model.transform[0].xyz;
 		model3[1] = model.transform[1].xyz;
 		model3[2] = model.transform[2].xyz;
-		vs_out.normal = normalize(mul(model3, vs_in.normal));
+		vs_out.normal = normalize(mul(model3, normal));
 	}
 
 	return vs_out;
@@ -174,7 +263,13 @@ void pixel(
 	if (mat.is_normal_mapped != 0)
 	{
 		N = normal_image.Sample(model_sampler, vs_out.uv).rgb;
-		N = normalize(N * 2.0 - 1.0); // Remap from [0, 1] to [-1, 1]
+		N = N * 2.0 - 1.0; // Remap from [0, 1] to [-1, 1]
+		if (mat.is_normal_two_channel != 0)
+		{
+			// BC5 only stores X and Y
+			N.z = sqrt(saturate(1.0 - dot(N.xy, N.xy)));
+		}
+		N = normalize(N);
 		N = normalize(mul(vs_out.tbn, N));
 	}
 	else
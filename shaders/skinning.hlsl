@@ -0,0 +1,139 @@
+// Skins EgCompactVertex into EgSkinnedVertex for egModelManagerDispatchSkinning.
+// Each row of groups runs one job, each thread one vertex of it.
+
+struct SkinningJob
+{
+	float4 position_offset;
+	float4 position_scale;
+	uint first_vertex;
+	uint vertex_count;
+	uint skin_buffer_index;
+	uint first_skin_vertex;
+	uint first_palette_matrix;
+	uint first_output_vertex;
+	uint padding0;
+	uint padding1;
+};
+
+// EgSkinnedVertex
+struct SkinnedVertex
+{
+	float pos_x;
+	float pos_y;
+	float pos_z;
+	uint normal;  // octahedral encoded, two snorm16
+	uint tangent; // octahedral encoded, two snorm16
+	uint uv;      // two unorm16, copied
+	float tangent_sign;
+	uint padding;
+};
+
+struct PushConstant
+{
+	uint job_buffer_index;
+	uint first_job;
+	uint palette_buffer_index;
+	uint vertex_buffer_index;
+	uint output_buffer_index;
+};
+
+[[vk::binding(0)]] StructuredBuffer<SkinningJob> job_buffers[];
+[[vk::binding(0)]] StructuredBuffer<float4x4> palette_buffers[];
+// EgCompactVertex and EgSkinVertex, read as 32-bit words
+[[vk::binding(0)]] StructuredBuffer<uint> word_buffers[];
+[[vk::binding(0)]] RWStructuredBuffer<SkinnedVertex> output_buffers[];
+
+[[vk::push_constant]] PushConstant pc;
+
+float unpack_snorm16(uint bits)
+{
+	float value = float(bits & 0xFFFF);
+	if (value >= 32768.0) value -= 65536.0;
+	return max(value / 32767.0, -1.0);
+}
+
+uint pack_snorm16(float2 v)
+{
+	int2 q = int2(round(clamp(v, -1.0, 1.0) * 32767.0));
+	return (uint(q.x) & 0xFFFF) | (uint(q.y) << 16);
+}
+
+float3 oct_decode(float2 e)
+{
+	float3 v = float3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+	float t = saturate(-v.z);
+	v.x -= sign(v.x) * t;
+	v.y -= sign(v.y) * t;
+	return normalize(v);
+}
+
+// Same as egOctEncode
+float2 oct_encode(float3 v)
+{
+	float2 e = v.xy / max(abs(v.x) + abs(v.y) + abs(v.z), 0.000001);
+	if (v.z < 0.0)
+	{
+		float2 s = float2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+		e = (1.0 - abs(e.yx)) * s;
+	}
+	return e;
+}
+
+[numthreads(64, 1, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+	SkinningJob job = job_buffers[pc.job_buffer_index][pc.first_job + id.y];
+	uint index = id.x;
+	if (index >= job.vertex_count) return;
+
+	// EgCompactVertex, five words: pos.xy, pos.zw, normal, tangent, uv
+	uint base = (job.first_vertex + index) * 5;
+	uint pos_xy = word_buffers[pc.vertex_buffer_index][base + 0];
+	uint pos_zw = word_buffers[pc.vertex_buffer_index][base + 1];
+	uint normal_bits = word_buffers[pc.vertex_buffer_index][base + 2];
+	uint tangent_bits = word_buffers[pc.vertex_buffer_index][base + 3];
+	uint uv_bits = word_buffers[pc.vertex_buffer_index][base + 4];
+
+	float3 pos = job.position_offset.xyz +
+		job.position_scale.xyz * float3(pos_xy & 0xFFFF, pos_xy >> 16, pos_zw & 0xFFFF);
+	float3 normal = oct_decode(
+		float2(unpack_snorm16(normal_bits), unpack_snorm16(normal_bits >> 16)));
+	float3 tangent = oct_decode(
+		float2(unpack_snorm16(tangent_bits), unpack_snorm16(tangent_bits >> 16)));
+
+	// EgSkinVertex, four words: joints 0 and 1, joints 2 and 3, then the
+	// weights the same way
+	uint skin_base = (job.first_skin_vertex + index) * 4;
+	uint joints01 = word_buffers[job.skin_buffer_index][skin_base + 0];
+	uint joints23 = word_buffers[job.skin_buffer_index][skin_base + 1];
+	uint weights01 = word_buffers[job.skin_buffer_index][skin_base + 2];
+	uint weights23 = word_buffers[job.skin_buffer_index][skin_base + 3];
+
+	uint4 joints = uint4(joints01 & 0xFFFF, joints01 >> 16, joints23 & 0xFFFF, joints23 >> 16);
+	float4 weights = float4(
+		weights01 & 0xFFFF, weights01 >> 16, weights23 & 0xFFFF, weights23 >> 16) / 65535.0;
+
+	uint palette = pc.palette_buffer_index;
+	uint first_matrix = job.first_palette_matrix;
+	float4x4 skin =
+		palette_buffers[palette][first_matrix + joints.x] * weights.x +
+		palette_buffers[palette][first_matrix + joints.y] * weights.y +
+		palette_buffers[palette][first_matrix + joints.z] * weights.z +
+		palette_buffers[palette][first_matrix + joints.w] * weights.w;
+
+	float3 skinned_pos = mul(skin, float4(pos, 1.0)).xyz;
+	float3 skinned_normal = normalize(mul(skin, float4(normal, 0.0)).xyz);
+	float3 skinned_tangent = normalize(mul(skin, float4(tangent, 0.0)).xyz);
+
+	SkinnedVertex vertex;
+	vertex.pos_x = skinned_pos.x;
+	vertex.pos_y = skinned_pos.y;
+	vertex.pos_z = skinned_pos.z;
+	vertex.normal = pack_snorm16(oct_encode(skinned_normal));
+	vertex.tangent = pack_snorm16(oct_encode(skinned_tangent));
+	vertex.uv = uv_bits;
+	vertex.tangent_sign = (pos_zw >> 16) > 32767 ? 1.0 : -1.0;
+	vertex.padding = 0;
+
+	output_buffers[pc.output_buffer_index][job.first_output_vertex + index] = vertex;
+}
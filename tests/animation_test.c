@@ -0,0 +1,297 @@
+#include <math.h>
+#include <string.h>
+#include "renderer/allocator.h"
+#include "renderer/animation.h"
+#include "renderer/math.h"
+
+#include "tests/test.h"
+
+enum {
+    NODE_COUNT = 32,
+    KEY_COUNT = 301, // 10 seconds at 30 keys per second
+    SAMPLE_COUNT = 2000,
+};
+
+#define CLIP_DURATION 10.0f
+#define TOLERANCE 0.0001f
+
+// Builds a clip with three channels per node: a translation moving along a
+// line, a rotation turning about a tilted axis, which goes through every
+// sign of w, and a constant scale
+typedef struct SyntheticClip
+{
+    float times[KEY_COUNT];
+    float4 values[NODE_COUNT][3][KEY_COUNT];
+    EgAnimationChannel channels[NODE_COUNT * 3];
+    EgAnimationClip clip;
+} SyntheticClip;
+
+static float4 AxisAngle(float3 axis, float angle)
+{
+    float s = sinf(angle * 0.5f);
+    return V4(axis.x * s, axis.y * s, axis.z * s, cosf(angle * 0.5f));
+}
+
+static void BuildClip(SyntheticClip *synthetic)
+{
+    for (uint32_t k = 0; k < KEY_COUNT; ++k)
+    {
+        synthetic->times[k] = CLIP_DURATION * (float)k / (float)(KEY_COUNT - 1);
+    }
+
+    for (uint32_t n = 0; n < NODE_COUNT; ++n)
+    {
+        float3 axis = egFloat3Normalize(V3(1.0f, (float)n, 2.0f));
+        // Up to two full turns, so w is negative over parts of the clip
+        float turns = 0.5f + 1.5f * (float)n / (float)(NODE_COUNT - 1);
+
+        for (uint32_t k = 0; k < KEY_COUNT; ++k)
+        {
+            float t = synthetic->times[k] / CLIP_DURATION;
+            synthetic->values[n][0][k] = V4(t * (float)n, 1.0f - 2.0f * t, 0.5f, 0.0f);
+
+            float4 rotation = AxisAngle(axis, t * turns * 2.0f * 3.14159265f);
+            // q and -q are the same rotation, glTF exporters write either
+            if (k % 7 == 3)
+            {
+                rotation = V4(-rotation.x, -rotation.y, -rotation.z, -rotation.w);
+            }
+            synthetic->values[n][1][k] = rotation;
+
+            synthetic->values[n][2][k] = V4(1.0f, 2.0f, 1.0f, 0.0f);
+        }
+
+        EgAnimationPath paths[3] = {
+            EG_ANIMATION_PATH_TRANSLATION,
+            EG_ANIMATION_PATH_ROTATION,
+            EG_ANIMATION_PATH_SCALE,
+        };
+        for (uint32_t p = 0; p < 3; ++p)
+        {
+            synthetic->channels[n * 3 + p] = (EgAnimationChannel){
+                .node = n,
+                .path = paths[p],
+                .interpolation = EG_ANIMATION_INTERPOLATION_LINEAR,
+                .key_count = KEY_COUNT,
+                .times = synthetic->times,
+                .values = synthetic->values[n][p],
+            };
+        }
+    }
+
+    synthetic->clip = (EgAnimationClip){
+        .duration = CLIP_DURATION,
+        .channel_count = NODE_COUNT * 3,
+        .channels = synthetic->channels,
+    };
+}
+
+static size_t RawSize(const EgAnimationClip *clip)
+{
+    size_t size = 0;
+    for (uint32_t i = 0; i < clip->channel_count; ++i)
+    {
+        size += (sizeof(float) + sizeof(float4)) * clip->channels[i].key_count;
+    }
+    return size;
+}
+
+static float ComponentError(const float *a, const float *b)
+{
+    return EG_MAX(
+        EG_MAX(fabsf(a[0] - b[0]), fabsf(a[1] - b[1])),
+        EG_MAX(fabsf(a[2] - b[2]), fabsf(a[3] - b[3])));
+}
+
+// Largest component error, rotations compare against the closer of q and -q
+static float PoseError(const EgJointPose *a, const EgJointPose *b, EgAnimationPath path)
+{
+    switch (path)
+    {
+    case EG_ANIMATION_PATH_TRANSLATION: {
+        float4 ta = a->translation, tb = b->translation;
+        ta.w = tb.w = 0.0f;
+        return ComponentError(&ta.x, &tb.x);
+    }
+    case EG_ANIMATION_PATH_ROTATION: {
+        float flipped[4] = {
+            -b->rotation.x, -b->rotation.y, -b->rotation.z, -b->rotation.w};
+        return EG_MIN(
+            ComponentError(&a->rotation.x, &b->rotation.x),
+            ComponentError(&a->rotation.x, flipped));
+    }
+    case EG_ANIMATION_PATH_SCALE: {
+        float4 sa = a->scale, sb = b->scale;
+        sa.w = sb.w = 0.0f;
+        return ComponentError(&sa.x, &sb.x);
+    }
+    }
+    return INFINITY;
+}
+
+// Worst error of each path over SAMPLE_COUNT times, between keys included
+static void MeasureError(
+    const EgAnimationClip *clip,
+    const EgCompressedAnimationClip *compressed,
+    uint32_t node_count,
+    float errors[3])
+{
+    EgJointPose raw[NODE_COUNT];
+    EgJointPose decoded[NODE_COUNT];
+    memset(errors, 0, sizeof(float) * 3);
+
+    for (uint32_t s = 0; s < SAMPLE_COUNT; ++s)
+    {
+        float time = clip->duration * (float)s / (float)SAMPLE_COUNT;
+        memset(raw, 0, sizeof(raw));
+        memset(decoded, 0, sizeof(decoded));
+        egAnimationClipSample(clip, time, raw);
+        egCompressedAnimationClipSample(compressed, time, decoded);
+
+        for (uint32_t n = 0; n < node_count; ++n)
+        {
+            for (uint32_t p = 0; p < 3; ++p)
+            {
+                float error = PoseError(&raw[n], &decoded[n], (EgAnimationPath)p);
+                errors[p] = EG_MAX(errors[p], error);
+            }
+        }
+    }
+}
+
+// Constant, linear and rotating channels take an order of magnitude less
+// memory, and sample within tolerance of the raw clip
+static void TestCompressedClip(void)
+{
+    SyntheticClip *synthetic = (SyntheticClip *)egAllocate(NULL, sizeof(SyntheticClip));
+    BuildClip(synthetic);
+
+    EgAnimationCompressionInfo info = {
+        .translation_tolerance = TOLERANCE,
+        .rotation_tolerance = TOLERANCE,
+        .scale_tolerance = TOLERANCE,
+    };
+    EgCompressedAnimationClip *compressed =
+        egAnimationClipCompress(NULL, &synthetic->clip, &info);
+
+    size_t raw_size = RawSize(&synthetic->clip);
+    size_t compressed_size = egCompressedAnimationClipGetSize(compressed);
+    printf("  %zu bytes -> %zu bytes\n", raw_size, compressed_size);
+    TEST_CHECK(compressed_size * 10 <= raw_size);
+    TEST_CHECK(egCompressedAnimationClipGetDuration(compressed) == CLIP_DURATION);
+
+    float errors[3];
+    MeasureError(&synthetic->clip, compressed, NODE_COUNT, errors);
+    printf(
+        "  translation %.2g, rotation %.2g, scale %.2g\n",
+        errors[0],
+        errors[1],
+        errors[2]);
+
+    // The tolerance, plus half a 16-bit step of the largest channel range (the
+    // translation along x spans NODE_COUNT - 1, rotations 2) and the movement
+    // over half a step of time
+    float time_step = CLIP_DURATION / 65535.0f;
+    float translation_bound = TOLERANCE + 0.5f * (float)(NODE_COUNT - 1) / 65535.0f +
+                              0.5f * time_step * (float)(NODE_COUNT - 1) / CLIP_DURATION;
+    float rotation_bound = TOLERANCE + 0.5f * 2.0f / 65535.0f +
+                           0.5f * time_step * 2.0f * 3.14159265f * 2.0f / CLIP_DURATION;
+    TEST_CHECK(errors[0] <= translation_bound);
+    TEST_CHECK(errors[1] <= rotation_bound);
+    TEST_CHECK(errors[2] <= TOLERANCE);
+
+    egCompressedAnimationClipDestroy(compressed);
+    egFree(NULL, synthetic);
+}
+
+// A rotation that only holds negative w keys comes back as the same rotation
+static void TestNegativeW(void)
+{
+    float times[3] = {0.0f, 0.5f, 1.0f};
+    float4 constant[3];
+    float4 turning[3];
+    for (uint32_t k = 0; k < 3; ++k)
+    {
+        float4 q = AxisAngle(V3(0.0f, 1.0f, 0.0f), 3.0f);
+        constant[k] = V4(-q.x, -q.y, -q.z, -q.w);
+        turning[k] = AxisAngle(V3(0.0f, 0.0f, 1.0f), 4.0f + (float)k);
+        TEST_CHECK(constant[k].w < 0.0f && turning[k].w < 0.0f);
+    }
+
+    EgAnimationChannel channels[2] = {
+        {
+            .node = 0,
+            .path = EG_ANIMATION_PATH_ROTATION,
+            .key_count = 3,
+            .times = times,
+            .values = constant,
+        },
+        {
+            .node = 1,
+            .path = EG_ANIMATION_PATH_ROTATION,
+            .key_count = 3,
+            .times = times,
+            .values = turning,
+        },
+    };
+    EgAnimationClip clip = {.duration = 1.0f, .channel_count = 2, .channels = channels};
+    EgCompressedAnimationClip *compressed = egAnimationClipCompress(NULL, &clip, NULL);
+
+    float errors[3];
+    MeasureError(&clip, compressed, 2, errors);
+    TEST_CHECK(errors[EG_ANIMATION_PATH_ROTATION] <= 0.001f);
+
+    egCompressedAnimationClipDestroy(compressed);
+}
+
+// Every key sits at time zero, sampling anywhere gives the first key
+static void TestZeroDuration(void)
+{
+    float times[2] = {0.0f, 0.0f};
+    float4 translations[2] = {V4(1.0f, 2.0f, 3.0f, 0.0f), V4(4.0f, 5.0f, 6.0f, 0.0f)};
+    float4 rotations[2] = {
+        AxisAngle(V3(1.0f, 0.0f, 0.0f), 1.0f), AxisAngle(V3(1.0f, 0.0f, 0.0f), 2.0f)};
+
+    EgAnimationChannel channels[2] = {
+        {
+            .node = 0,
+            .path = EG_ANIMATION_PATH_TRANSLATION,
+            .key_count = 2,
+            .times = times,
+            .values = translations,
+        },
+        {
+            .node = 0,
+            .path = EG_ANIMATION_PATH_ROTATION,
+            .key_count = 2,
+            .times = times,
+            .values = rotations,
+        },
+    };
+    EgAnimationClip clip = {.duration = 0.0f, .channel_count = 2, .channels = channels};
+    EgCompressedAnimationClip *compressed = egAnimationClipCompress(NULL, &clip, NULL);
+    TEST_CHECK(egCompressedAnimationClipGetDuration(compressed) == 0.0f);
+
+    float sample_times[3] = {0.0f, 0.5f, 3.0f};
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        EgJointPose raw = {};
+        EgJointPose decoded = {};
+        egAnimationClipSample(&clip, sample_times[i], &raw);
+        egCompressedAnimationClipSample(compressed, sample_times[i], &decoded);
+
+        TEST_CHECK(isfinite(decoded.translation.x) && isfinite(decoded.rotation.w));
+        TEST_CHECK(PoseError(&raw, &decoded, EG_ANIMATION_PATH_TRANSLATION) <= 0.001f);
+        TEST_CHECK(PoseError(&raw, &decoded, EG_ANIMATION_PATH_ROTATION) <= 0.001f);
+    }
+
+    egCompressedAnimationClipDestroy(compressed);
+}
+
+int main(void)
+{
+    TEST_RUN(TestCompressedClip);
+    TEST_RUN(TestNegativeW);
+    TEST_RUN(TestZeroDuration);
+    return TestResult();
+}
@@ -0,0 +1,446 @@
+// The deque is internal to the job system, so the test builds it directly
+#include "renderer/job_system.c"
+
+#include "tests/test.h"
+
+// Deque {{{
+enum {
+    DEQUE_JOB_COUNT = 1 << 20,
+    THIEF_COUNT = 3,
+};
+
+typedef struct DequeTest
+{
+    WorkDeque *deque;
+    volatile uint32_t *taken; // Times each job was taken, one per job
+    volatile uint32_t owner_done;
+    volatile uint32_t stolen_count;
+} DequeTest;
+
+static void Take(DequeTest *test, const Job *job)
+{
+    size_t index = (size_t)job->user_data;
+    egAtomicFetchAddU32(&test->taken[index], 1);
+}
+
+static void ThiefProc(void *user_data)
+{
+    DequeTest *test = (DequeTest *)user_data;
+    uint32_t stolen_count = 0;
+
+    while (true)
+    {
+        Job job;
+        if (DequeSteal(test->deque, &job))
+        {
+            Take(test, &job);
+            stolen_count++;
+        }
+        else if (egAtomicLoadU32(&test->owner_done))
+        {
+            break;
+        }
+    }
+
+    egAtomicFetchAddU32(&test->stolen_count, stolen_count);
+}
+
+// The owner pushes every job and pops some of them back while thieves steal
+// from the top, which races the owner for the last job over and over
+static void TestDequeRaces(void)
+{
+    DequeTest test = {};
+    test.deque = (WorkDeque *)egAllocate(NULL, sizeof(WorkDeque));
+    memset(test.deque, 0, sizeof(WorkDeque));
+    size_t taken_size = sizeof(uint32_t) * DEQUE_JOB_COUNT;
+    test.taken = (volatile uint32_t *)egAllocate(NULL, taken_size);
+    memset((void *)test.taken, 0, taken_size);
+
+    EgThread *thieves[THIEF_COUNT];
+    for (uint32_t i = 0; i < THIEF_COUNT; ++i)
+    {
+        thieves[i] = egThreadCreate(NULL, ThiefProc, &test);
+    }
+
+    uint32_t popped_count = 0;
+    for (size_t i = 0; i < DEQUE_JOB_COUNT; ++i)
+    {
+        Job job = {.user_data = (void *)i};
+        while (!DequePush(test.deque, &job))
+        {
+            // Full, make room like a worker running its own jobs would
+            Job popped;
+            if (DequePop(test.deque, &popped))
+            {
+                Take(&test, &popped);
+                popped_count++;
+            }
+        }
+
+        // Keep the deque short now and then so pops meet steals on the last job
+        if (i % 3 == 0)
+        {
+            Job popped;
+            while (DequePop(test.deque, &popped))
+            {
+                Take(&test, &popped);
+                popped_count++;
+            }
+        }
+    }
+
+    Job popped;
+    while (DequePop(test.deque, &popped))
+    {
+        Take(&test, &popped);
+        popped_count++;
+    }
+    egAtomicStoreU32(&test.owner_done, 1);
+
+    for (uint32_t i = 0; i < THIEF_COUNT; ++i)
+    {
+        egThreadJoin(thieves[i]);
+    }
+
+    uint32_t lost_count = 0;
+    uint32_t duplicate_count = 0;
+    for (size_t i = 0; i < DEQUE_JOB_COUNT; ++i)
+    {
+        if (test.taken[i] == 0) lost_count++;
+        if (test.taken[i] > 1) duplicate_count++;
+    }
+
+    TEST_CHECK(lost_count == 0);
+    TEST_CHECK(duplicate_count == 0);
+    TEST_CHECK(popped_count + test.stolen_count == DEQUE_JOB_COUNT);
+    TEST_CHECK(DequeSteal(test.deque, &popped) == false);
+
+    egFree(NULL, (void *)test.taken);
+    egFree(NULL, test.deque);
+}
+
+static void TestDequeOrder(void)
+{
+    WorkDeque *deque = (WorkDeque *)egAllocate(NULL, sizeof(WorkDeque));
+    memset(deque, 0, sizeof(WorkDeque));
+
+    for (size_t i = 0; i < DEQUE_CAPACITY; ++i)
+    {
+        Job job = {.user_data = (void *)i};
+        TEST_CHECK(DequePush(deque, &job));
+    }
+    Job job = {};
+    TEST_CHECK(!DequePush(deque, &job));
+
+    // The owner takes the newest job, thieves the oldest
+    TEST_CHECK(DequePop(deque, &job) && (size_t)job.user_data == DEQUE_CAPACITY - 1);
+    TEST_CHECK(DequeSteal(deque, &job) && (size_t)job.user_data == 0);
+
+    size_t count = 0;
+    while (DequePop(deque, &job))
+    {
+        count++;
+    }
+    TEST_CHECK(count == DEQUE_CAPACITY - 2);
+    TEST_CHECK(!DequeSteal(deque, &job));
+
+    egFree(NULL, deque);
+}
+// }}}
+
+// Job system {{{
+typedef struct CountJob
+{
+    EgJobSystem *job_system;
+    volatile uint32_t *total;
+    EgJobCounter *counter;
+    uint32_t children;
+} CountJob;
+
+static void CountProc(void *user_data)
+{
+    CountJob *job = (CountJob *)user_data;
+    egAtomicFetchAddU32(job->total, 1);
+
+    // Jobs pushed from a worker go to its own deque
+    for (uint32_t i = 0; i < job->children; ++i)
+    {
+        CountJob *child = (CountJob *)egAllocate(NULL, sizeof(CountJob));
+        *child = (CountJob){
+            .job_system = job->job_system,
+            .total = job->total,
+            .counter = job->counter,
+        };
+        egJobSystemRun(job->job_system, CountProc, child, job->counter);
+    }
+
+    egFree(NULL, job);
+}
+
+static void IncrementProc(void *user_data)
+{
+    egAtomicFetchAddU32((volatile uint32_t *)user_data, 1);
+}
+
+static void TestCounters(EgJobSystem *job_system)
+{
+    enum { PARENT_COUNT = 2000, CHILD_COUNT = 8 };
+
+    volatile uint32_t total = 0;
+    EgJobCounter counter = {};
+    for (uint32_t i = 0; i < PARENT_COUNT; ++i)
+    {
+        CountJob *job = (CountJob *)egAllocate(NULL, sizeof(CountJob));
+        *job = (CountJob){
+            .job_system = job_system,
+            .total = &total,
+            .counter = &counter,
+            .children = CHILD_COUNT,
+        };
+        egJobSystemRun(job_system, CountProc, job, &counter);
+    }
+
+    egJobSystemWait(job_system, &counter);
+    TEST_CHECK(egJobCounterIsDone(&counter));
+    TEST_CHECK(total == PARENT_COUNT * (1 + CHILD_COUNT));
+
+    // A counter can be reused once it's done
+    for (uint32_t i = 0; i < PARENT_COUNT; ++i)
+    {
+        egJobSystemRun(job_system, IncrementProc, (void *)&total, &counter);
+    }
+    egJobSystemWait(job_system, &counter);
+    TEST_CHECK(total == PARENT_COUNT * (2 + CHILD_COUNT));
+}
+
+typedef struct ExternalTest
+{
+    EgJobSystem *job_system;
+    volatile uint32_t total;
+} ExternalTest;
+
+static void ExternalThreadProc(void *user_data)
+{
+    ExternalTest *test = (ExternalTest *)user_data;
+    EgJobCounter counter = {};
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        egJobSystemRun(test->job_system, IncrementProc, (void *)&test->total, &counter);
+    }
+    egJobSystemWait(test->job_system, &counter);
+}
+
+// Threads outside the job system inject their jobs and can wait on them
+static void TestExternalThreads(EgJobSystem *job_system)
+{
+    ExternalTest test = {.job_system = job_system};
+    EgThread *threads[2];
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(threads); ++i)
+    {
+        threads[i] = egThreadCreate(NULL, ExternalThreadProc, &test);
+    }
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(threads); ++i)
+    {
+        egThreadJoin(threads[i]);
+    }
+    TEST_CHECK(test.total == 2000);
+}
+
+typedef struct Stage
+{
+    volatile uint32_t *sequence;
+    // Value of sequence when the stage ran, and the jobs that ran before it
+    uint32_t order;
+    uint32_t work_seen;
+    volatile uint32_t *work;
+} Stage;
+
+static void StageProc(void *user_data)
+{
+    Stage *stage = (Stage *)user_data;
+    stage->work_seen = egAtomicLoadU32(stage->work);
+    stage->order = egAtomicFetchAddU32(stage->sequence, 1);
+}
+
+static void SlowIncrementProc(void *user_data)
+{
+    for (uint32_t i = 0; i < 1000; ++i)
+    {
+        egCpuPause();
+    }
+    egAtomicFetchAddU32((volatile uint32_t *)user_data, 1);
+}
+
+// Each stage waits on the counter of the previous one, and the first one on a
+// batch of jobs, so the stages must run in order after the whole batch
+static void TestRunAfter(EgJobSystem *job_system)
+{
+    enum { BATCH_COUNT = 256, STAGE_COUNT = 64 };
+
+    volatile uint32_t work = 0;
+    volatile uint32_t sequence = 0;
+
+    EgJobCounter batch = {};
+    EgJobCounter counters[STAGE_COUNT] = {};
+    Stage stages[STAGE_COUNT] = {};
+
+    for (uint32_t i = 0; i < BATCH_COUNT; ++i)
+    {
+        egJobSystemRun(job_system, SlowIncrementProc, (void *)&work, &batch);
+    }
+
+    for (uint32_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        stages[i] = (Stage){.sequence = &sequence, .work = &work};
+        EgJobCounter *dependency = (i == 0) ? &batch : &counters[i - 1];
+        egJobSystemRunAfter(job_system, dependency, StageProc, &stages[i], &counters[i]);
+    }
+
+    egJobSystemWait(job_system, &counters[STAGE_COUNT - 1]);
+
+    for (uint32_t i = 0; i < STAGE_COUNT; ++i)
+    {
+        TEST_CHECK(stages[i].order == i);
+        TEST_CHECK(stages[i].work_seen == BATCH_COUNT);
+    }
+
+    // A dependency that is already done runs the job right away
+    EgJobCounter done = {};
+    EgJobCounter counter = {};
+    uint32_t ran = 0;
+    egJobSystemRunAfter(job_system, &done, IncrementProc, (void *)&ran, &counter);
+    egJobSystemWait(job_system, &counter);
+    TEST_CHECK(ran == 1);
+}
+
+typedef struct CoverageTest
+{
+    volatile uint32_t *hits;
+    volatile uint32_t max_range;
+} CoverageTest;
+
+static void CoverageProc(void *user_data, size_t begin, size_t end)
+{
+    CoverageTest *test = (CoverageTest *)user_data;
+    for (size_t i = begin; i < end; ++i)
+    {
+        egAtomicFetchAddU32(&test->hits[i], 1);
+    }
+
+    uint32_t range = (uint32_t)(end - begin);
+    uint32_t max_range = egAtomicLoadU32(&test->max_range);
+    while (range > max_range &&
+           !egAtomicCompareExchangeU32(&test->max_range, max_range, range))
+    {
+        max_range = egAtomicLoadU32(&test->max_range);
+    }
+}
+
+static bool CheckCoverage(EgJobSystem *job_system, size_t count, size_t grain_size)
+{
+    CoverageTest test = {};
+    test.hits = (volatile uint32_t *)egAllocate(NULL, sizeof(uint32_t) * (count + 1));
+    memset((void *)test.hits, 0, sizeof(uint32_t) * (count + 1));
+
+    egJobSystemParallelFor(job_system, count, grain_size, CoverageProc, &test);
+
+    bool covered = true;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (test.hits[i] != 1) covered = false;
+    }
+    if (test.hits[count] != 0) covered = false;
+    if (test.max_range > (grain_size ? grain_size : 1)) covered = false;
+
+    egFree(NULL, (void *)test.hits);
+    return covered;
+}
+
+// Every index is visited exactly once, in ranges of at most grain_size
+static void TestParallelFor(EgJobSystem *job_system)
+{
+    TEST_CHECK(CheckCoverage(job_system, 0, 16));
+    TEST_CHECK(CheckCoverage(job_system, 1, 16));
+    TEST_CHECK(CheckCoverage(job_system, 15, 16));
+    TEST_CHECK(CheckCoverage(job_system, 16, 16));
+    TEST_CHECK(CheckCoverage(job_system, 17, 16));
+    TEST_CHECK(CheckCoverage(job_system, 1000, 0));
+    TEST_CHECK(CheckCoverage(job_system, 100003, 97));
+    TEST_CHECK(CheckCoverage(job_system, 1 << 20, 4096));
+}
+
+typedef struct NestedTest
+{
+    EgJobSystem *job_system;
+    volatile uint32_t *hits;
+} NestedTest;
+
+static void NestedProc(void *user_data, size_t begin, size_t end)
+{
+    NestedTest *test = (NestedTest *)user_data;
+    for (size_t i = begin; i < end; ++i)
+    {
+        CoverageTest inner = {.hits = test->hits + i * 64};
+        egJobSystemParallelFor(test->job_system, 64, 4, CoverageProc, &inner);
+    }
+}
+
+// A parallel for inside a job waits by running other jobs instead of blocking
+static void TestNestedParallelFor(EgJobSystem *job_system)
+{
+    enum { OUTER_COUNT = 256 };
+
+    volatile uint32_t *hits =
+        (volatile uint32_t *)egAllocate(NULL, sizeof(uint32_t) * OUTER_COUNT * 64);
+    memset((void *)hits, 0, sizeof(uint32_t) * OUTER_COUNT * 64);
+
+    NestedTest test = {.job_system = job_system, .hits = hits};
+    egJobSystemParallelFor(job_system, OUTER_COUNT, 1, NestedProc, &test);
+
+    uint32_t wrong_count = 0;
+    for (size_t i = 0; i < OUTER_COUNT * 64; ++i)
+    {
+        if (hits[i] != 1) wrong_count++;
+    }
+    TEST_CHECK(wrong_count == 0);
+
+    egFree(NULL, (void *)hits);
+}
+// }}}
+
+static void TestJobSystem(uint32_t worker_count)
+{
+    EgJobSystemInfo info = {.worker_count = worker_count};
+    EgJobSystem *job_system = egJobSystemCreate(NULL, &info);
+
+    TEST_CHECK(egJobSystemGetThreadCount(job_system) == worker_count + 1);
+    TEST_CHECK(egJobSystemGetThreadIndex(job_system) == 0);
+
+    TestCounters(job_system);
+    TestExternalThreads(job_system);
+    TestRunAfter(job_system);
+    TestParallelFor(job_system);
+    TestNestedParallelFor(job_system);
+
+    egJobSystemDestroy(job_system);
+}
+
+static void TestOneWorker(void)
+{
+    TestJobSystem(1);
+}
+
+static void TestManyThreads(void)
+{
+    // More threads than processors, so workers get preempted mid steal
+    TestJobSystem(egGetCpuCount() + 2);
+}
+
+int main(void)
+{
+    TEST_RUN(TestDequeOrder);
+    TEST_RUN(TestDequeRaces);
+    TEST_RUN(TestOneWorker);
+    TEST_RUN(TestManyThreads);
+    return TestResult();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Minimal checks for the CPU-only tests, a failed check is reported and the
+// test keeps going so one run shows every failure
+
+static int test_failure_count = 0;
+
+#define TEST_CHECK(value)                                                                \
+    do                                                                                   \
+    {                                                                                    \
+        if (!(value))                                                                    \
+        {                                                                                \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #value);    \
+            test_failure_count++;                                                        \
+        }                                                                                \
+    } while (0)
+
+#define TEST_RUN(test)                                                                   \
+    do                                                                                   \
+    {                                                                                    \
+        int failures_before = test_failure_count;                                        \
+        test();                                                                          \
+        bool passed = (test_failure_count == failures_before);                           \
+        printf("%s %s\n", passed ? "PASS" : "FAIL", #test);                              \
+    } while (0)
+
+static inline int TestResult(void)
+{
+    return test_failure_count == 0 ? 0 : 1;
+}
@@ -0,0 +1,734 @@
+#include <math.h>
+#include <string.h>
+#include "renderer/allocator.h"
+#include "renderer/job_system.h"
+#include "renderer/ktx2.h"
+#include "renderer/math.h"
+#include "renderer/texture_compression.h"
+
+#include "tests/test.h"
+
+// Reference decoders {{{
+// Written from the BC format descriptions rather than from the encoder, so
+// the encoder is checked against the layout the GPU reads
+
+static void DecodeRGB565(uint16_t packed, int32_t color[3])
+{
+    int32_t r = (packed >> 11) & 31;
+    int32_t g = (packed >> 5) & 63;
+    int32_t b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+static void DecodeBC1(const uint8_t block[8], uint8_t texels[64])
+{
+    uint16_t c0 = (uint16_t)(block[0] | (block[1] << 8));
+    uint16_t c1 = (uint16_t)(block[2] | (block[3] << 8));
+
+    int32_t palette[4][4];
+    DecodeRGB565(c0, palette[0]);
+    DecodeRGB565(c1, palette[1]);
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        if (c0 > c1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = (c0 > c1) ? 255 : 0;
+
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t index = (block[4 + i / 4] >> ((i % 4) * 2)) & 3;
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            texels[i * 4 + c] = (uint8_t)palette[index][c];
+        }
+    }
+}
+
+static void DecodeBC4(const uint8_t block[8], uint8_t texels[64], uint32_t channel)
+{
+    int32_t palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+    if (palette[0] > palette[1])
+    {
+        for (int32_t i = 1; i < 7; ++i)
+        {
+            palette[1 + i] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+        }
+    }
+    else
+    {
+        for (int32_t i = 1; i < 5; ++i)
+        {
+            palette[1 + i] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+
+    uint64_t indices = 0;
+    for (uint32_t i = 0; i < 6; ++i)
+    {
+        indices |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        texels[i * 4 + channel] = (uint8_t)palette[(indices >> (i * 3)) & 7];
+    }
+}
+
+static void DecodeBC5(const uint8_t block[16], uint8_t texels[64])
+{
+    memset(texels, 0, 64);
+    DecodeBC4(&block[0], texels, 0);
+    DecodeBC4(&block[8], texels, 1);
+}
+
+static uint32_t ReadBits(const uint8_t *block, uint32_t *bit, uint32_t count)
+{
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        value |= (uint32_t)((block[*bit >> 3] >> (*bit & 7)) & 1) << i;
+        (*bit)++;
+    }
+    return value;
+}
+
+// Only mode 6, returns false for blocks of any other mode
+static bool DecodeBC7Mode6(const uint8_t block[16], uint8_t texels[64])
+{
+    static const int32_t weights[16] = {
+        0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+    uint32_t bit = 0;
+    uint32_t mode = 0;
+    while (mode < 8 && ReadBits(block, &bit, 1) == 0)
+    {
+        mode++;
+    }
+    if (mode != 6) return false;
+
+    int32_t endpoints[2][4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        endpoints[0][c] = (int32_t)ReadBits(block, &bit, 7);
+        endpoints[1][c] = (int32_t)ReadBits(block, &bit, 7);
+    }
+    for (uint32_t e = 0; e < 2; ++e)
+    {
+        int32_t p_bit = (int32_t)ReadBits(block, &bit, 1);
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            endpoints[e][c] = (endpoints[e][c] << 1) | p_bit;
+        }
+    }
+
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        uint32_t index = ReadBits(block, &bit, i == 0 ? 3 : 4);
+        int32_t w = weights[index];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+            texels[i * 4 + c] =
+                (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >> 6);
+        }
+    }
+
+    return bit == 128;
+}
+// }}}
+
+// Blocks {{{
+static uint32_t NextRandom(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static void SolidBlock(uint8_t texels[64], uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        texels[i * 4 + 0] = r;
+        texels[i * 4 + 1] = g;
+        texels[i * 4 + 2] = b;
+        texels[i * 4 + 3] = a;
+    }
+}
+
+// Linear ramp between two random colors along a random direction of the block
+static void GradientBlock(uint8_t texels[64], uint32_t *rng)
+{
+    uint8_t from[4];
+    uint8_t to[4];
+    for (uint32_t c = 0; c < 4; ++c)
+    {
+        from[c] = (uint8_t)NextRandom(rng);
+        to[c] = (uint8_t)NextRandom(rng);
+    }
+    bool vertical = NextRandom(rng) & 1;
+
+    for (uint32_t y = 0; y < 4; ++y)
+    {
+        for (uint32_t x = 0; x < 4; ++x)
+        {
+            float t = (float)(vertical ? y : x) / 3.0f;
+            for (uint32_t c = 0; c < 4; ++c)
+            {
+                float value = (float)from[c] + ((float)to[c] - (float)from[c]) * t;
+                texels[(y * 4 + x) * 4 + c] = (uint8_t)(value + 0.5f);
+            }
+        }
+    }
+}
+
+static void NoiseBlock(uint8_t texels[64], uint32_t *rng)
+{
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        texels[i] = (uint8_t)NextRandom(rng);
+    }
+}
+
+// Root mean square error over the first channel_count channels
+static float BlockError(const uint8_t a[64], const uint8_t b[64], uint32_t channel_count)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < channel_count; ++c)
+        {
+            int32_t d = (int32_t)a[i * 4 + c] - (int32_t)b[i * 4 + c];
+            sum += (uint32_t)(d * d);
+        }
+    }
+    return sqrtf((float)sum / (float)(16 * channel_count));
+}
+
+static uint32_t
+MaxChannelError(const uint8_t a[64], const uint8_t b[64], uint32_t channels)
+{
+    uint32_t max = 0;
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        for (uint32_t c = 0; c < channels; ++c)
+        {
+            int32_t d = (int32_t)a[i * 4 + c] - (int32_t)b[i * 4 + c];
+            uint32_t ad = (uint32_t)(d < 0 ? -d : d);
+            if (ad > max) max = ad;
+        }
+    }
+    return max;
+}
+// }}}
+
+// Encoders {{{
+typedef void (*EncodeProc)(const uint8_t texels[64], uint8_t *dst);
+typedef bool (*DecodeProc)(const uint8_t *block, uint8_t texels[64]);
+
+static bool DecodeBC1Proc(const uint8_t *block, uint8_t texels[64])
+{
+    DecodeBC1(block, texels);
+    return true;
+}
+
+static bool DecodeBC5Proc(const uint8_t *block, uint8_t texels[64])
+{
+    DecodeBC5(block, texels);
+    return true;
+}
+
+typedef struct Codec
+{
+    const char *name;
+    EncodeProc encode;
+    DecodeProc decode;
+    uint32_t channel_count; // Channels the format keeps
+    // Bounds of the worst channel of a solid block and of the RMSE of a
+    // gradient block
+    uint32_t solid_max_error;
+    float gradient_error;
+} Codec;
+
+static const Codec codecs[] = {
+    // 565 endpoints are off by up to 4 per channel, gradients sit on the 1/3
+    // and 2/3 interpolants
+    {"BC1", egEncodeBlockBC1, DecodeBC1Proc, 3, 4, 4.0f},
+    // Gradients of four values fall between the eight steps of BC4
+    {"BC5", egEncodeBlockBC5, DecodeBC5Proc, 2, 0, 8.0f},
+    // 7 bit endpoints with a shared p-bit are off by at most 1
+    {"BC7", egEncodeBlockBC7, DecodeBC7Mode6, 4, 1, 1.5f},
+};
+
+// RMSE of replacing the block with its mean color, which any encoder should
+// at least match
+static float FlatError(const uint8_t texels[64], uint32_t channel_count)
+{
+    uint8_t flat[64] = {};
+    for (uint32_t c = 0; c < channel_count; ++c)
+    {
+        uint32_t sum = 0;
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            sum += texels[i * 4 + c];
+        }
+        for (uint32_t i = 0; i < 16; ++i)
+        {
+            flat[i * 4 + c] = (uint8_t)((sum + 8) / 16);
+        }
+    }
+    return BlockError(texels, flat, channel_count);
+}
+
+static void CheckRoundTrip(
+    const Codec *codec, const uint8_t texels[64], uint32_t max_error, float rmse)
+{
+    uint8_t block[16] = {};
+    uint8_t decoded[64] = {};
+    codec->encode(texels, block);
+
+    bool decodable = codec->decode(block, decoded);
+    TEST_CHECK(decodable);
+    if (!decodable) return;
+
+    if (max_error != UINT32_MAX)
+    {
+        uint32_t error = MaxChannelError(texels, decoded, codec->channel_count);
+        if (error > max_error)
+        {
+            fprintf(stderr, "%s: solid block off by %u\n", codec->name, error);
+        }
+        TEST_CHECK(error <= max_error);
+    }
+    else
+    {
+        float error = BlockError(texels, decoded, codec->channel_count);
+        if (error > rmse)
+        {
+            fprintf(stderr, "%s: block RMSE %.2f over %.2f\n", codec->name, error, rmse);
+        }
+        TEST_CHECK(error <= rmse);
+    }
+}
+
+static void TestSolidBlocks(void)
+{
+    static const uint8_t colors[][4] = {
+        {0, 0, 0, 255},
+        {255, 255, 255, 255},
+        {255, 0, 0, 0},
+        {0, 255, 0, 128},
+        {0, 0, 255, 255},
+        {17, 130, 201, 77},
+        {128, 128, 128, 128},
+        {1, 254, 3, 252},
+    };
+
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(codecs); ++i)
+    {
+        for (uint32_t j = 0; j < EG_CARRAY_LENGTH(colors); ++j)
+        {
+            uint8_t texels[64];
+            SolidBlock(texels, colors[j][0], colors[j][1], colors[j][2], colors[j][3]);
+            CheckRoundTrip(&codecs[i], texels, codecs[i].solid_max_error, 0.0f);
+        }
+    }
+}
+
+static void TestGradientBlocks(void)
+{
+    uint32_t rng = 0x12345678u;
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(codecs); ++i)
+    {
+        for (uint32_t j = 0; j < 1000; ++j)
+        {
+            uint8_t texels[64];
+            GradientBlock(texels, &rng);
+            CheckRoundTrip(&codecs[i], texels, UINT32_MAX, codecs[i].gradient_error);
+        }
+    }
+}
+
+static void TestNoiseBlocks(void)
+{
+    uint32_t rng = 0x9E3779B9u;
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(codecs); ++i)
+    {
+        for (uint32_t j = 0; j < 1000; ++j)
+        {
+            uint8_t texels[64];
+            NoiseBlock(texels, &rng);
+            float bound = FlatError(texels, codecs[i].channel_count) + 1.0f;
+            CheckRoundTrip(&codecs[i], texels, UINT32_MAX, bound);
+        }
+    }
+}
+
+// With max > min, BC4 spans the range of the channel in 7 steps, so no texel
+// is further than half a step from its value
+static void TestBC5StepBound(void)
+{
+    uint32_t rng = 7;
+    for (uint32_t j = 0; j < 2000; ++j)
+    {
+        uint8_t texels[64];
+        if (j & 1)
+        {
+            GradientBlock(texels, &rng);
+        }
+        else
+        {
+            NoiseBlock(texels, &rng);
+        }
+
+        uint8_t block[16];
+        uint8_t decoded[64];
+        egEncodeBlockBC5(texels, block);
+        DecodeBC5(block, decoded);
+
+        for (uint32_t c = 0; c < 2; ++c)
+        {
+            int32_t min = 255;
+            int32_t max = 0;
+            int32_t worst = 0;
+            for (uint32_t i = 0; i < 16; ++i)
+            {
+                int32_t value = texels[i * 4 + c];
+                int32_t error = value - (int32_t)decoded[i * 4 + c];
+                error = error < 0 ? -error : error;
+                min = EG_MIN(min, value);
+                max = EG_MAX(max, value);
+                worst = EG_MAX(worst, error);
+            }
+            TEST_CHECK(worst * 14 <= (max - min) + 14);
+        }
+    }
+}
+
+// Colors that are exact in 565 and sit on the endpoints come back unchanged
+static void TestExactBC1(void)
+{
+    uint8_t texels[64];
+    for (uint32_t i = 0; i < 16; ++i)
+    {
+        // 565 values (30, 3, 16) and (1, 63, 4) expanded to 8 bits
+        bool first = (i % 3) == 0;
+        texels[i * 4 + 0] = first ? 247 : 8;
+        texels[i * 4 + 1] = first ? 12 : 255;
+        texels[i * 4 + 2] = first ? 132 : 33;
+        texels[i * 4 + 3] = 255;
+    }
+
+    uint8_t block[8];
+    uint8_t decoded[64];
+    egEncodeBlockBC1(texels, block);
+    DecodeBC1(block, decoded);
+    TEST_CHECK(MaxChannelError(texels, decoded, 3) == 0);
+}
+
+// Every block of an image with a partial last row and column of blocks
+// matches the block encoder on the clamped texels, with or without the job
+// system
+static void TestCompressImage(void)
+{
+    enum { WIDTH = 37, HEIGHT = 23 };
+
+    uint32_t rng = 42;
+    uint8_t *pixels = (uint8_t *)egAllocate(NULL, WIDTH * HEIGHT * 4);
+    for (uint32_t i = 0; i < WIDTH * HEIGHT * 4; ++i)
+    {
+        pixels[i] = (uint8_t)NextRandom(&rng);
+    }
+
+    EgJobSystemInfo info = {.worker_count = 2};
+    EgJobSystem *job_system = egJobSystemCreate(NULL, &info);
+
+    static const RgFormat formats[] = {
+        RG_FORMAT_BC1_RGB_UNORM,
+        RG_FORMAT_BC5_UNORM,
+        RG_FORMAT_BC7_UNORM,
+    };
+    for (uint32_t f = 0; f < EG_CARRAY_LENGTH(formats); ++f)
+    {
+        RgFormat format = formats[f];
+        size_t size = egFormatImageSize(format, WIDTH, HEIGHT);
+        size_t block_size = egFormatImageSize(format, 4, 4);
+        TEST_CHECK(size == block_size * ((WIDTH + 3) / 4) * ((HEIGHT + 3) / 4));
+
+        uint8_t *serial = (uint8_t *)egAllocate(NULL, size);
+        uint8_t *parallel = (uint8_t *)egAllocate(NULL, size);
+        egCompressImage(NULL, format, pixels, WIDTH, HEIGHT, serial);
+        egCompressImage(job_system, format, pixels, WIDTH, HEIGHT, parallel);
+        TEST_CHECK(memcmp(serial, parallel, size) == 0);
+
+        // Last block, which only has one valid column and three valid rows
+        uint32_t bx = (WIDTH - 1) / 4;
+        uint32_t by = (HEIGHT - 1) / 4;
+        uint8_t texels[64];
+        for (uint32_t y = 0; y < 4; ++y)
+        {
+            for (uint32_t x = 0; x < 4; ++x)
+            {
+                uint32_t px = EG_MIN(bx * 4 + x, WIDTH - 1);
+                uint32_t py = EG_MIN(by * 4 + y, HEIGHT - 1);
+                memcpy(&texels[(y * 4 + x) * 4], &pixels[(py * WIDTH + px) * 4], 4);
+            }
+        }
+
+        uint8_t expected[16];
+        switch (format)
+        {
+        case RG_FORMAT_BC1_RGB_UNORM: egEncodeBlockBC1(texels, expected); break;
+        case RG_FORMAT_BC5_UNORM: egEncodeBlockBC5(texels, expected); break;
+        default: egEncodeBlockBC7(texels, expected); break;
+        }
+        size_t last = (by * ((WIDTH + 3) / 4) + bx) * block_size;
+        TEST_CHECK(memcmp(&serial[last], expected, block_size) == 0);
+
+        egFree(NULL, parallel);
+        egFree(NULL, serial);
+    }
+
+    egJobSystemDestroy(job_system);
+    egFree(NULL, pixels);
+}
+// }}}
+
+// KTX2 {{{
+typedef struct TestImage
+{
+    EgKtx2Image image;
+    uint8_t *storage;
+} TestImage;
+
+// A full mip chain of random data in the given format
+static TestImage CreateTestImage(RgFormat format, uint32_t width, uint32_t height)
+{
+    TestImage test = {};
+    test.image.format = format;
+    test.image.width = width;
+    test.image.height = height;
+
+    size_t total = 0;
+    uint32_t level_count = 0;
+    for (uint32_t w = width, h = height;; w = EG_MAX(w / 2, 1), h = EG_MAX(h / 2, 1))
+    {
+        total += egFormatImageSize(format, w, h);
+        level_count++;
+        if (w == 1 && h == 1) break;
+    }
+
+    test.storage = (uint8_t *)egAllocate(NULL, total);
+    uint32_t rng = width * 31 + height;
+    for (size_t i = 0; i < total; ++i)
+    {
+        test.storage[i] = (uint8_t)NextRandom(&rng);
+    }
+
+    test.image.level_count = level_count;
+    size_t offset = 0;
+    for (uint32_t level = 0; level < level_count; ++level)
+    {
+        size_t size = egFormatImageSize(
+            format, EG_MAX(width >> level, 1), EG_MAX(height >> level, 1));
+        test.image.levels[level].data = test.storage + offset;
+        test.image.levels[level].size = size;
+        offset += size;
+    }
+
+    return test;
+}
+
+static void TestKtx2RoundTrip(void)
+{
+    static const RgFormat formats[] = {
+        RG_FORMAT_RGBA8_UNORM,
+        RG_FORMAT_BC1_RGB_UNORM,
+        RG_FORMAT_BC1_RGB_SRGB,
+        RG_FORMAT_BC5_UNORM,
+        RG_FORMAT_BC7_UNORM,
+        RG_FORMAT_BC7_SRGB,
+    };
+
+    for (uint32_t f = 0; f < EG_CARRAY_LENGTH(formats); ++f)
+    {
+        TestImage test = CreateTestImage(formats[f], 64, 20);
+
+        size_t size = 0;
+        uint8_t *file = egKtx2Write(NULL, &test.image, &size);
+
+        EgKtx2Image parsed;
+        TEST_CHECK(egKtx2Parse(file, size, &parsed));
+        TEST_CHECK(parsed.format == test.image.format);
+        TEST_CHECK(parsed.width == 64 && parsed.height == 20);
+        TEST_CHECK(parsed.level_count == test.image.level_count);
+        TEST_CHECK(parsed.level_count == 7);
+
+        for (uint32_t level = 0; level < parsed.level_count; ++level)
+        {
+            const EgKtx2Level *a = &parsed.levels[level];
+            const EgKtx2Level *b = &test.image.levels[level];
+            TEST_CHECK(a->size == b->size);
+            TEST_CHECK(a->size == b->size && memcmp(a->data, b->data, a->size) == 0);
+
+            // Levels are aligned to their block size, or to 4 bytes for RGBA8
+            size_t alignment = egFormatIsBlockCompressed(formats[f])
+                                   ? egFormatImageSize(formats[f], 4, 4)
+                                   : 4;
+            TEST_CHECK((size_t)(a->data - file) % alignment == 0);
+        }
+
+        egFree(NULL, file);
+        egFree(NULL, test.storage);
+    }
+}
+
+// Every prefix of a file is rejected, the largest level is stored last
+static void TestKtx2Truncated(void)
+{
+    TestImage test = CreateTestImage(RG_FORMAT_BC7_UNORM, 16, 16);
+    size_t size = 0;
+    uint8_t *file = egKtx2Write(NULL, &test.image, &size);
+
+    uint32_t accepted_count = 0;
+    for (size_t prefix = 0; prefix < size; ++prefix)
+    {
+        // A copy of exactly prefix bytes, so reads past it are caught by ASan
+        uint8_t *copy = (uint8_t *)egAllocate(NULL, prefix ? prefix : 1);
+        memcpy(copy, file, prefix);
+
+        EgKtx2Image parsed;
+        if (egKtx2Parse(copy, prefix, &parsed)) accepted_count++;
+        egFree(NULL, copy);
+    }
+    TEST_CHECK(accepted_count == 0);
+
+    egFree(NULL, file);
+    egFree(NULL, test.storage);
+}
+
+static void WriteU32(uint8_t *p, uint32_t value)
+{
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        p[i] = (uint8_t)(value >> (i * 8));
+    }
+}
+
+static void WriteU64(uint8_t *p, uint64_t value)
+{
+    WriteU32(p, (uint32_t)value);
+    WriteU32(p + 4, (uint32_t)(value >> 32));
+}
+
+typedef struct Corruption
+{
+    const char *name;
+    size_t offset;
+    uint32_t size; // 1, 4 or 8 bytes
+    uint64_t value;
+} Corruption;
+
+// Byte offsets in the header, after the 12 byte identifier
+enum {
+    HEADER_FORMAT = 12,
+    HEADER_WIDTH = 20,
+    HEADER_HEIGHT = 24,
+    HEADER_DEPTH = 28,
+    HEADER_LAYERS = 32,
+    HEADER_FACES = 36,
+    HEADER_LEVELS = 40,
+    HEADER_SUPERCOMPRESSION = 44,
+    LEVEL_INDEX = 80, // Offset, then length of each level
+};
+
+static void TestKtx2Corrupt(void)
+{
+    static const Corruption corruptions[] = {
+        {"identifier", 1, 1, 'X'},
+        {"unknown format", HEADER_FORMAT, 4, 43},
+        {"zero width", HEADER_WIDTH, 4, 0},
+        {"zero height", HEADER_HEIGHT, 4, 0},
+        {"3D", HEADER_DEPTH, 4, 4},
+        {"array", HEADER_LAYERS, 4, 2},
+        {"cube map", HEADER_FACES, 4, 6},
+        {"too many levels", HEADER_LEVELS, 4, EG_KTX2_MAX_LEVELS + 1},
+        {"more levels than stored", HEADER_LEVELS, 4, 12},
+        {"supercompressed", HEADER_SUPERCOMPRESSION, 4, 2},
+        {"level past the end", LEVEL_INDEX, 8, 1u << 20},
+        {"level offset overflow", LEVEL_INDEX, 8, UINT64_MAX - 8},
+        {"level length mismatch", LEVEL_INDEX + 8, 8, 64},
+        {"level length overflow", LEVEL_INDEX + 8, 8, UINT64_MAX},
+        {"larger width", HEADER_WIDTH, 4, 32},
+    };
+
+    TestImage test = CreateTestImage(RG_FORMAT_BC1_RGB_UNORM, 16, 16);
+    size_t size = 0;
+    uint8_t *file = egKtx2Write(NULL, &test.image, &size);
+
+    EgKtx2Image parsed;
+    TEST_CHECK(egKtx2Parse(file, size, &parsed));
+
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(corruptions); ++i)
+    {
+        const Corruption *corruption = &corruptions[i];
+        uint8_t *copy = (uint8_t *)egAllocate(NULL, size);
+        memcpy(copy, file, size);
+
+        uint8_t *p = copy + corruption->offset;
+        switch (corruption->size)
+        {
+        case 1: *p = (uint8_t)corruption->value; break;
+        case 4: WriteU32(p, (uint32_t)corruption->value); break;
+        default: WriteU64(p, corruption->value); break;
+        }
+
+        bool accepted = egKtx2Parse(copy, size, &parsed);
+        if (accepted) fprintf(stderr, "Accepted a KTX2 file with %s\n", corruption->name);
+        TEST_CHECK(!accepted);
+
+        egFree(NULL, copy);
+    }
+
+    // A level count of 0 means only the base level is stored
+    uint8_t *copy = (uint8_t *)egAllocate(NULL, size);
+    memcpy(copy, file, size);
+    WriteU32(copy + HEADER_LEVELS, 0);
+    TEST_CHECK(egKtx2Parse(copy, size, &parsed) && parsed.level_count == 1);
+    egFree(NULL, copy);
+
+    egFree(NULL, file);
+    egFree(NULL, test.storage);
+}
+// }}}
+
+int main(void)
+{
+    TEST_RUN(TestSolidBlocks);
+    TEST_RUN(TestGradientBlocks);
+    TEST_RUN(TestNoiseBlocks);
+    TEST_RUN(TestBC5StepBound);
+    TEST_RUN(TestExactBC1);
+    TEST_RUN(TestCompressImage);
+    TEST_RUN(TestKtx2RoundTrip);
+    TEST_RUN(TestKtx2Truncated);
+    TEST_RUN(TestKtx2Corrupt);
+    return TestResult();
+}
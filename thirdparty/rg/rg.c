@@ -4,6 +4,7 @@
 #include <string.h>
 #include <math.h>
 #include "rg.h"
+#include "rg_capture.h"
 
 #ifdef _MSC_VER
     #pragma warning(disable:4996)
@@ -15,6 +16,7 @@
     #include <windows.h>
 #else
     #define VK_USE_PLATFORM_XLIB_KHR
+    #include <pthread.h>
 #endif
 
 #include "volk.h"
@@ -90,7 +92,59 @@ static void *rgArrayGrow(void *ptr, size_t *cap, size_t wanted_cap, size_t item_
         (a)->cap = 0;                  \
     } while (0)
 
+// Mutex {{{
+#ifdef _WIN32
+typedef SRWLOCK RgMutex;
+
+static void rgMutexInit(RgMutex *mutex)
+{
+    InitializeSRWLock(mutex);
+}
+
+static void rgMutexDestroy(RgMutex *mutex)
+{
+    (void)mutex;
+}
+
+static void rgMutexLock(RgMutex *mutex)
+{
+    AcquireSRWLockExclusive(mutex);
+}
+
+static void rgMutexUnlock(RgMutex *mutex)
+{
+    ReleaseSRWLockExclusive(mutex);
+}
+#else
+typedef pthread_mutex_t RgMutex;
+
+static void rgMutexInit(RgMutex *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+static void rgMutexDestroy(RgMutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static void rgMutexLock(RgMutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static void rgMutexUnlock(RgMutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+#endif
+// }}}
+
 // Types {{{
+typedef ARRAY_OF(uint8_t) RgCaptureStream;
+typedef struct RgCapture RgCapture;
+typedef struct RgCaptureObject RgCaptureObject;
+
 typedef struct RgHashmap
 {
     uint64_t size;
@@ -127,6 +181,8 @@ typedef struct RgMemoryBlock
 typedef struct RgAllocator
 {
     RgDevice *device;
+    // Buffers and images can be created and destroyed from several threads
+    RgMutex mutex;
     ARRAY_OF(RgMemoryBlock*) blocks;
 } RgAllocator;
 
@@ -187,6 +243,8 @@ struct RgDevice
     VkQueue transfer_queue;
 
     RgAllocator *allocator;
+    // NULL unless the device was created with enable_capture
+    RgCapture *capture;
 };
 
 struct RgSwapchain
@@ -220,6 +278,7 @@ struct RgSwapchain
     ARRAY_OF(VkFence) wait_fences;
 
     RgRenderPass *render_pass;
+    RgCaptureObject *capture;
 };
 
 struct RgCmdPool
@@ -231,7 +290,9 @@ struct RgCmdPool
 struct RgCmdBuffer
 {
     RgDevice *device;
+    RgQueueType queue_type;
     VkQueue queue;
+    bool secondary;
 
     VkCommandBuffer cmd_buffer;
     VkSemaphore semaphore;
@@ -243,6 +304,15 @@ struct RgCmdBuffer
     RgRenderPass *current_render_pass;
     RgPipeline *current_pipeline;
     VkPipelineBindPoint current_bind_point;
+
+    // Written at the start and end of primary command buffers, NULL if the
+    // queue has no timestamps
+    VkQueryPool timestamps;
+
+    // Commands recorded while a capture is running
+    uint32_t capture_id;
+    bool capturing;
+    RgCaptureStream capture_stream;
 };
 
 struct RgRenderPass
@@ -257,6 +327,8 @@ struct RgRenderPass
     uint32_t current_framebuffer;
     uint32_t framebuffer_count;
     VkFramebuffer *framebuffers;
+
+    RgCaptureObject *capture;
 };
 
 struct RgBuffer
@@ -264,6 +336,7 @@ struct RgBuffer
     RgBufferInfo info;
     VkBuffer buffer;
     RgAllocation allocation;
+    RgCaptureObject *capture;
 };
 
 struct RgImage
@@ -272,6 +345,7 @@ struct RgImage
     VkImage image;
     RgAllocation allocation;
     VkImageView view;
+    RgCaptureObject *capture;
 };
 
 typedef struct RgDescriptorSetPool RgDescriptorSetPool;
@@ -280,6 +354,7 @@ struct RgDescriptorSet
 {
     VkDescriptorSet set;
     RgDescriptorSetPool *pool;
+    RgCaptureObject *capture;
 };
 
 struct RgDescriptorSetPool
@@ -300,11 +375,13 @@ struct RgDescriptorSetLayout
     uint32_t binding_count;
 
     ARRAY_OF(RgDescriptorSetPool *) pools;
+    RgCaptureObject *capture;
 };
 
 struct RgPipelineLayout
 {
     VkPipelineLayout pipeline_layout;
+    RgCaptureObject *capture;
 };
 
 typedef enum RgPipelineType
@@ -318,11 +395,15 @@ struct RgPipeline
     RgDevice *device;
     RgPipelineType type;
     RgPipelineLayout *layout;
+    RgCaptureObject *capture;
 
     union
     {
         struct
         {
+            // Instances are created lazily from whichever thread binds the
+            // pipeline first, so lookups go through instances_mutex
+            RgMutex instances_mutex;
             RgHashmap instances;
 
             uint32_t vertex_stride;
@@ -353,6 +434,84 @@ struct RgPipeline
 };
 // }}}
 
+// Capture {{{
+// Hooks that keep what's needed to recreate objects and serialise commands,
+// defined at the end. They do nothing on devices without capture.
+static RgCapture *rgCaptureCreate(void);
+static void rgCaptureDestroy(RgCapture *capture);
+static uint32_t rgCaptureNextId(RgDevice *device);
+static uint32_t rgCaptureId(RgCaptureObject *object);
+static void rgCaptureObjectDestroy(RgDevice *device, RgCaptureObject **object);
+
+static void rgCaptureBufferCreate(RgDevice *device, RgBuffer *buffer);
+static void rgCaptureBufferData(
+    RgDevice *device, RgBuffer *buffer, size_t offset, size_t size, const void *data);
+static void rgCaptureImageCreate(RgDevice *device, RgImage *image);
+static void rgCaptureImageData(
+    RgDevice *device,
+    const RgImageCopy *dst,
+    const RgExtent3D *extent,
+    size_t size,
+    const void *data);
+static void rgCaptureImageGenerateMipmaps(RgDevice *device, RgImage *image);
+static void rgCaptureSamplerCreate(RgDevice *device, RgSampler *sampler);
+static void rgCaptureRenderPassCreate(
+    RgDevice *device, RgRenderPass *render_pass, const RgRenderPassInfo *info);
+static void rgCaptureSwapchainResources(RgSwapchain *swapchain);
+static void rgCaptureDescriptorSetLayoutCreate(
+    RgDevice *device,
+    RgDescriptorSetLayout *set_layout,
+    const RgDescriptorSetLayoutInfo *info);
+static void rgCapturePipelineLayoutCreate(
+    RgDevice *device,
+    RgPipelineLayout *pipeline_layout,
+    const RgPipelineLayoutInfo *info);
+static void rgCaptureDescriptorSetCreate(
+    RgDevice *device, RgDescriptorSet *descriptor_set, RgDescriptorSetLayout *set_layout);
+static void rgCaptureDescriptorSetUpdate(
+    RgDevice *device,
+    RgDescriptorSet *descriptor_set,
+    const RgDescriptorUpdateInfo *entries,
+    uint32_t entry_count);
+static void rgCaptureGraphicsPipelineCreate(
+    RgDevice *device, RgPipeline *pipeline, const RgGraphicsPipelineInfo *info);
+static void rgCaptureComputePipelineCreate(
+    RgDevice *device, RgPipeline *pipeline, const RgComputePipelineInfo *info);
+
+// Command hooks are only called while cmd_buffer->capturing
+static void rgCaptureCmdBegin(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass);
+static void rgCaptureCmd(
+    RgCmdBuffer *cmd_buffer, RgCaptureOp op, uint32_t count, const uint32_t *values);
+static void rgCaptureCmdPushConstants(
+    RgCmdBuffer *cmd_buffer, size_t offset, size_t size, const void *data);
+static void rgCaptureCmdBindDescriptorSet(
+    RgCmdBuffer *cmd_buffer,
+    uint32_t index,
+    RgDescriptorSet *set,
+    uint32_t dynamic_offset_count,
+    const uint32_t *dynamic_offsets);
+static void rgCaptureCmdSetRenderPass(
+    RgCmdBuffer *cmd_buffer,
+    RgRenderPass *render_pass,
+    bool secondary_contents,
+    uint32_t clear_value_count,
+    const RgClearValue *clear_values);
+static void rgCaptureCmdExecuteCommands(
+    RgCmdBuffer *cmd_buffer, uint32_t secondary_count, RgCmdBuffer **secondaries);
+static void rgCaptureCmdBindBuffer(
+    RgCmdBuffer *cmd_buffer,
+    RgCaptureOp op,
+    RgBuffer *buffer,
+    size_t offset,
+    RgIndexType index_type);
+static void rgCaptureCmdCopyImageToBuffer(
+    RgCmdBuffer *cmd_buffer,
+    const RgImageCopy *src,
+    const RgBufferCopy *dst,
+    RgExtent3D extent);
+static void rgCaptureSubmit(RgCmdBuffer *cmd_buffer);
+// }}}
+
 // Hashing {{{
 static void fnvHashReset(uint64_t *hash)
 {
@@ -597,6 +756,14 @@ static VkFormat rgFormatToVk(RgFormat fmt)
 
     case RG_FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
     case RG_FORMAT_BC7_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+
+    case RG_FORMAT_BC1_RGB_UNORM: return VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    case RG_FORMAT_BC1_RGB_SRGB: return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+    case RG_FORMAT_BC5_UNORM: return VK_FORMAT_BC5_UNORM_BLOCK;
+
+    case RG_FORMAT_RG16_UNORM: return VK_FORMAT_R16G16_UNORM;
+    case RG_FORMAT_RGBA16_UNORM: return VK_FORMAT_R16G16B16A16_UNORM;
+    case RG_FORMAT_RG16_SNORM: return VK_FORMAT_R16G16_SNORM;
     }
     assert(0);
     return 0;
@@ -1238,6 +1405,7 @@ static RgAllocator *rgAllocatorCreate(RgDevice *device)
     memset(allocator, 0, sizeof(*allocator));
 
     allocator->device = device;
+    rgMutexInit(&allocator->mutex);
 
     return allocator;
 }
@@ -1250,10 +1418,11 @@ static void rgAllocatorDestroy(RgAllocator *allocator)
         rgAllocatorFreeMemoryBlock(allocator, block);
     }
     arrFree(&allocator->blocks);
+    rgMutexDestroy(&allocator->mutex);
     free(allocator);
 }
 
-static VkResult rgAllocatorAllocate(
+static VkResult rgAllocatorAllocateLocked(
     RgAllocator *allocator,
     RgAllocationInfo *info,
     RgAllocation *allocation)
@@ -1352,8 +1521,20 @@ static VkResult rgAllocatorAllocate(
     return result;
 }
 
+static VkResult rgAllocatorAllocate(
+    RgAllocator *allocator,
+    RgAllocationInfo *info,
+    RgAllocation *allocation)
+{
+    rgMutexLock(&allocator->mutex);
+    VkResult result = rgAllocatorAllocateLocked(allocator, info, allocation);
+    rgMutexUnlock(&allocator->mutex);
+    return result;
+}
+
 static void rgAllocatorFree(RgAllocator *allocator, const RgAllocation *allocation)
 {
+    rgMutexLock(&allocator->mutex);
     if (allocation->dedicated)
     {
         VK_CHECK(vkDeviceWaitIdle(allocator->device->device));
@@ -1369,6 +1550,7 @@ static void rgAllocatorFree(RgAllocator *allocator, const RgAllocation *allocati
     {
         rgMemoryBlockFree(allocation->block, allocation);
     }
+    rgMutexUnlock(&allocator->mutex);
 }
 
 static VkResult rgMapAllocation(RgAllocator *allocator, const RgAllocation *allocation, void **ppData)
@@ -1535,12 +1717,15 @@ RgDevice *rgDeviceCreate(const RgDeviceInfo *info)
         arrPush(&instance_extension_names, VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
 
-    arrPush(&instance_extension_names, "VK_KHR_surface");
+    if (!info->headless)
+    {
+        arrPush(&instance_extension_names, "VK_KHR_surface");
 #if defined(_WIN32)
-    arrPush(&instance_extension_names, "VK_KHR_win32_surface");
+        arrPush(&instance_extension_names, "VK_KHR_win32_surface");
 #else
-    arrPush(&instance_extension_names, "VK_KHR_xlib_surface");
+        arrPush(&instance_extension_names, "VK_KHR_xlib_surface");
 #endif
+    }
 
     VkApplicationInfo app_info = {0};
     app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -1648,6 +1833,11 @@ RgDevice *rgDeviceCreate(const RgDeviceInfo *info)
         device->enabled_features.fillModeNonSolid = VK_TRUE;
     }
 
+    if (device->physical_device_features.textureCompressionBC)
+    {
+        device->enabled_features.textureCompressionBC = VK_TRUE;
+    }
+
     VkQueueFlags requested_queue_types = 
         VK_QUEUE_GRAPHICS_BIT |
         VK_QUEUE_COMPUTE_BIT |
@@ -1712,7 +1902,7 @@ RgDevice *rgDeviceCreate(const RgDeviceInfo *info)
     }
 
     ARRAY_OF(char*) device_extensions = {0};
-    if (rgExtensionSupported(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
+    if (!info->headless && rgExtensionSupported(device, VK_KHR_SWAPCHAIN_EXTENSION_NAME))
     {
         arrPush(&device_extensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     }
@@ -1771,6 +1961,11 @@ RgDevice *rgDeviceCreate(const RgDeviceInfo *info)
 
     device->allocator = rgAllocatorCreate(device);
 
+    if (info->enable_capture)
+    {
+        device->capture = rgCaptureCreate();
+    }
+
     return device;
 }
 
@@ -1780,6 +1975,11 @@ void rgDeviceDestroy(RgDevice *device)
 
     VK_CHECK(vkDeviceWaitIdle(device->device));
 
+    if (device->capture)
+    {
+        rgCaptureDestroy(device->capture);
+    }
+
     rgAllocatorDestroy(device->allocator);
 
     vkDestroyDevice(device->device, NULL);
@@ -1794,6 +1994,43 @@ void rgDeviceDestroy(RgDevice *device)
     free(device);
 }
 
+void rgDeviceWaitIdle(RgDevice *device)
+{
+    VK_CHECK(vkDeviceWaitIdle(device->device));
+}
+
+bool rgDeviceSupportsLinearBlit(RgDevice *device, RgFormat format)
+{
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(
+        device->physical_device, rgFormatToVk(format), &properties);
+
+    VkFormatFeatureFlags required = VK_FORMAT_FEATURE_BLIT_SRC_BIT |
+                                    VK_FORMAT_FEATURE_BLIT_DST_BIT |
+                                    VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (properties.optimalTilingFeatures & required) == required;
+}
+
+bool rgDeviceSupportsSampledFormat(RgDevice *device, RgFormat format)
+{
+    switch (format)
+    {
+    case RG_FORMAT_BC1_RGB_UNORM:
+    case RG_FORMAT_BC1_RGB_SRGB:
+    case RG_FORMAT_BC5_UNORM:
+    case RG_FORMAT_BC7_UNORM:
+    case RG_FORMAT_BC7_SRGB:
+        if (!device->enabled_features.textureCompressionBC) return false;
+        break;
+    default: break;
+    }
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(
+        device->physical_device, rgFormatToVk(format), &properties);
+    return (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+}
+
 void rgDeviceGetLimits(RgDevice *device, RgLimits *limits)
 {
     const VkPhysicalDeviceLimits *vk_limits =
@@ -1879,12 +2116,15 @@ RgBuffer *rgBufferCreate(RgDevice *device, const RgBufferInfo *info)
             buffer->allocation.offset));
     }
 
+    rgCaptureBufferCreate(device, buffer);
+
     return buffer;
 }
 
 void rgBufferDestroy(RgDevice *device, RgBuffer *buffer)
 {
     VK_CHECK(vkDeviceWaitIdle(device->device));
+    rgCaptureObjectDestroy(device, &buffer->capture);
     if (buffer->buffer)
     {
         rgAllocatorFree(device->allocator, &buffer->allocation);
@@ -1914,6 +2154,8 @@ void rgBufferUpload(
     size_t size,
     void *data)
 {
+    rgCaptureBufferData(device, buffer, offset, size, data);
+
     RgCmdBuffer *cmd_buffer = rgCmdBufferCreate(device, cmd_pool);
 
     RgBufferInfo buffer_info;
@@ -1939,7 +2181,7 @@ void rgBufferUpload(
 
     rgCmdBufferEnd(cmd_buffer);
 
-    rgCmdBufferSubmit(cmd_buffer);
+    rgCmdBufferSubmitFenceOnly(cmd_buffer);
 
     rgCmdBufferWait(device, cmd_buffer);
     rgCmdBufferDestroy(device, cmd_pool, cmd_buffer);
@@ -2090,6 +2332,8 @@ RgImage *rgImageCreate(RgDevice *device, const RgImageInfo *image_info)
         VK_CHECK(vkCreateImageView(device->device, &ci, NULL, &image->view));
     }
 
+    rgCaptureImageCreate(device, image);
+
     return image;
 }
 
@@ -2098,6 +2342,7 @@ void rgImageDestroy(RgDevice *device, RgImage *image)
     if (!image) return;
 
     VK_CHECK(vkDeviceWaitIdle(device->device));
+    rgCaptureObjectDestroy(device, &image->capture);
 
     vkDestroyImageView(device->device, image->view, NULL);
     vkDestroyImage(device->device, image->image, NULL);
@@ -2106,30 +2351,13 @@ void rgImageDestroy(RgDevice *device, RgImage *image)
     free(image);
 }
 
-void rgImageUpload(
-    RgDevice *device,
-    RgCmdPool *cmd_pool,
+static void rgCmdCopyBufferToImageForSampling(
+    RgCmdBuffer *cmd_buffer,
+    RgBuffer *src,
+    size_t src_offset,
     RgImageCopy *dst,
-    RgExtent3D *extent,
-    size_t size,
-    void *data)
+    RgExtent3D *extent)
 {
-    RgCmdBuffer *cmd_buffer = rgCmdBufferCreate(device, cmd_pool);
-
-    RgBufferInfo buffer_info;
-    memset(&buffer_info, 0, sizeof(buffer_info));
-    buffer_info.size = size;
-    buffer_info.usage = RG_BUFFER_USAGE_TRANSFER_SRC;
-    buffer_info.memory = RG_BUFFER_MEMORY_HOST;
-
-    RgBuffer *staging = rgBufferCreate(device, &buffer_info);
-
-    void *staging_ptr = rgBufferMap(device, staging);
-    memcpy(staging_ptr, data, size);
-    rgBufferUnmap(device, staging);
-
-    rgCmdBufferBegin(cmd_buffer);
-
     VkImageSubresourceRange subresource_range;
     memset(&subresource_range, 0, sizeof(subresource_range));
     subresource_range.aspectMask = rgImageAspectToVk(dst->image->info.aspect);
@@ -2164,6 +2392,7 @@ void rgImageUpload(
 
     VkBufferImageCopy region;
     memset(&region, 0, sizeof(region));
+    region.bufferOffset = src_offset;
     region.imageSubresource.aspectMask = rgImageAspectToVk(dst->image->info.aspect);
     region.imageSubresource.mipLevel = dst->mip_level;
     region.imageSubresource.baseArrayLayer = dst->array_layer;
@@ -2177,7 +2406,7 @@ void rgImageUpload(
 
     vkCmdCopyBufferToImage(
         cmd_buffer->cmd_buffer,
-        staging->buffer,
+        src->buffer,
         dst->image->image,
         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
         1,
@@ -2199,10 +2428,81 @@ void rgImageUpload(
         NULL,
         1,
         &barrier);
+}
+
+void rgImageUpload(
+    RgDevice *device,
+    RgCmdPool *cmd_pool,
+    RgImageCopy *dst,
+    RgExtent3D *extent,
+    size_t size,
+    void *data)
+{
+    RgImageUploadInfo upload;
+    memset(&upload, 0, sizeof(upload));
+    upload.dst = *dst;
+    upload.extent = *extent;
+    upload.size = size;
+    upload.data = data;
+
+    rgImageUploadBatch(device, cmd_pool, 1, &upload);
+}
+
+void rgImageUploadBatch(
+    RgDevice *device,
+    RgCmdPool *cmd_pool,
+    uint32_t upload_count,
+    RgImageUploadInfo *uploads)
+{
+    if (upload_count == 0) return;
+
+    // Copy offsets must be a multiple of the texel block size
+    const size_t staging_alignment = 16;
+
+    size_t staging_size = 0;
+    for (uint32_t i = 0; i < upload_count; ++i)
+    {
+        staging_size = RG_ALIGN(staging_size, staging_alignment) + uploads[i].size;
+    }
+
+    RgCmdBuffer *cmd_buffer = rgCmdBufferCreate(device, cmd_pool);
+
+    RgBufferInfo buffer_info;
+    memset(&buffer_info, 0, sizeof(buffer_info));
+    buffer_info.size = staging_size;
+    buffer_info.usage = RG_BUFFER_USAGE_TRANSFER_SRC;
+    buffer_info.memory = RG_BUFFER_MEMORY_HOST;
+
+    RgBuffer *staging = rgBufferCreate(device, &buffer_info);
+
+    uint8_t *staging_ptr = rgBufferMap(device, staging);
+
+    rgCmdBufferBegin(cmd_buffer);
+
+    size_t staging_offset = 0;
+    for (uint32_t i = 0; i < upload_count; ++i)
+    {
+        rgCaptureImageData(
+            device,
+            &uploads[i].dst,
+            &uploads[i].extent,
+            uploads[i].size,
+            uploads[i].data);
+
+        staging_offset = RG_ALIGN(staging_offset, staging_alignment);
+        memcpy(staging_ptr + staging_offset, uploads[i].data, uploads[i].size);
+
+        rgCmdCopyBufferToImageForSampling(
+            cmd_buffer, staging, staging_offset, &uploads[i].dst, &uploads[i].extent);
+
+        staging_offset += uploads[i].size;
+    }
+
+    rgBufferUnmap(device, staging);
 
     rgCmdBufferEnd(cmd_buffer);
 
-    rgCmdBufferSubmit(cmd_buffer);
+    rgCmdBufferSubmitFenceOnly(cmd_buffer);
 
     rgCmdBufferWait(device, cmd_buffer);
 
@@ -2217,6 +2517,7 @@ struct RgSampler
 {
     RgSamplerInfo info;
     VkSampler sampler;
+    RgCaptureObject *capture;
 };
 
 RgSampler *rgSamplerCreate(RgDevice *device, RgSamplerInfo *info)
@@ -2254,6 +2555,8 @@ RgSampler *rgSamplerCreate(RgDevice *device, RgSamplerInfo *info)
     ci.borderColor = rgBorderColorToVk(sampler->info.border_color);
     VK_CHECK(vkCreateSampler(device->device, &ci, NULL, &sampler->sampler));
 
+    rgCaptureSamplerCreate(device, sampler);
+
     return sampler;
 }
 
@@ -2262,6 +2565,7 @@ void rgSamplerDestroy(RgDevice *device, RgSampler *sampler)
     if (!sampler) return;
 
     VK_CHECK(vkDeviceWaitIdle(device->device));
+    rgCaptureObjectDestroy(device, &sampler->capture);
 
     vkDestroySampler(device->device, sampler->sampler, NULL);
 
@@ -2763,6 +3067,8 @@ static void rgSwapchainCreateResources(RgSwapchain *swapchain)
                     NULL,
                     &swapchain->render_pass->framebuffers[i]));
     }
+
+    rgCaptureSwapchainResources(swapchain);
 }
 
 static void rgSwapchainDestroyResources(RgSwapchain *swapchain)
@@ -2849,6 +3155,7 @@ void rgSwapchainDestroy(RgDevice *device, RgSwapchain *swapchain)
     if (!swapchain) return;
 
     rgSwapchainDestroyResources(swapchain);
+    rgCaptureObjectDestroy(device, &swapchain->capture);
 
     vkDestroySwapchainKHR(
             device->device,
@@ -3146,6 +3453,8 @@ RgRenderPass *rgRenderPassCreate(RgDevice *device, const RgRenderPassInfo *info)
     render_pass->width = width;
     render_pass->height = height;
 
+    rgCaptureRenderPassCreate(device, render_pass, info);
+
     return render_pass;
 }
 
@@ -3154,6 +3463,7 @@ void rgRenderPassDestroy(RgDevice *device, RgRenderPass *render_pass)
     if (!render_pass) return;
 
     VK_CHECK(vkDeviceWaitIdle(device->device));
+    rgCaptureObjectDestroy(device, &render_pass->capture);
 
     for (uint32_t i = 0; i < render_pass->framebuffer_count; ++i)
     {
@@ -3327,6 +3637,8 @@ RgDescriptorSetLayout *rgDescriptorSetLayoutCreate(
 
     free(flags);
 
+    rgCaptureDescriptorSetLayoutCreate(device, set_layout, info);
+
     return set_layout;
 }
 
@@ -3334,6 +3646,8 @@ void rgDescriptorSetLayoutDestroy(
         RgDevice *device,
         RgDescriptorSetLayout *set_layout)
 {
+    rgCaptureObjectDestroy(device, &set_layout->capture);
+
     for (RgDescriptorSetPool **pool = set_layout->pools.ptr;
          pool != set_layout->pools.ptr + set_layout->pools.len;
          ++pool)
@@ -3381,11 +3695,14 @@ RgPipelineLayout *rgPipelineLayoutCreate(
 
     free(vk_set_layouts);
 
+    rgCapturePipelineLayoutCreate(device, pipeline_layout, info);
+
     return pipeline_layout;
 }
 
 void rgPipelineLayoutDestroy(RgDevice *device, RgPipelineLayout *pipeline_layout)
 {
+    rgCaptureObjectDestroy(device, &pipeline_layout->capture);
     vkDestroyPipelineLayout(device->device, pipeline_layout->pipeline_layout, NULL);
     free(pipeline_layout);
 }
@@ -3425,6 +3742,8 @@ RgDescriptorSet *rgDescriptorSetCreate(RgDevice *device, RgDescriptorSetLayout *
         return rgDescriptorSetCreate(device, set_layout);
     }
 
+    rgCaptureDescriptorSetCreate(device, descriptor_set, set_layout);
+
     return descriptor_set;
 }
 
@@ -3548,6 +3867,8 @@ void rgDescriptorSetUpdate(
 
     vkUpdateDescriptorSets(device->device, entry_count, writes, 0, NULL);
 
+    rgCaptureDescriptorSetUpdate(device, descriptor_set, entries, entry_count);
+
     for (uint32_t i = 0; i < entry_count; ++i)
     {
         VkWriteDescriptorSet *write = &writes[i];
@@ -3582,7 +3903,7 @@ void rgDescriptorSetUpdate(
 
 void rgDescriptorSetDestroy(RgDevice *device, RgDescriptorSet *descriptor_set)
 {
-    (void)device;
+    rgCaptureObjectDestroy(device, &descriptor_set->capture);
 
     RgDescriptorSetPool *pool = descriptor_set->pool;
     // Return the set to the free list
@@ -3634,6 +3955,7 @@ RgPipeline *rgGraphicsPipelineCreate(RgDevice *device, const RgGraphicsPipelineI
         pipeline->graphics.num_vertex_attributes *
         sizeof(*pipeline->graphics.vertex_attributes));
 
+    rgMutexInit(&pipeline->graphics.instances_mutex);
     rgHashmapInit(&pipeline->graphics.instances, 8);
 
     //
@@ -3670,6 +3992,8 @@ RgPipeline *rgGraphicsPipelineCreate(RgDevice *device, const RgGraphicsPipelineI
             &pipeline->graphics.fragment_shader));
     }
 
+    rgCaptureGraphicsPipelineCreate(device, pipeline, info);
+
     return pipeline;
 }
 
@@ -3720,12 +4044,15 @@ RgPipeline *rgComputePipelineCreate(RgDevice *device, const RgComputePipelineInf
         NULL,
         &pipeline->compute.instance);
 
+    rgCaptureComputePipelineCreate(device, pipeline, info);
+
     return pipeline;
 }
 
 void rgPipelineDestroy(RgDevice *device, RgPipeline *pipeline)
 {
     VK_CHECK(vkDeviceWaitIdle(device->device));
+    rgCaptureObjectDestroy(device, &pipeline->capture);
 
     switch (pipeline->type)
     {
@@ -3767,6 +4094,7 @@ void rgPipelineDestroy(RgDevice *device, RgPipeline *pipeline)
         }
 
         rgHashmapDestroy(&pipeline->graphics.instances);
+        rgMutexDestroy(&pipeline->graphics.instances_mutex);
         break;
     }
 
@@ -3788,16 +4116,9 @@ void rgPipelineDestroy(RgDevice *device, RgPipeline *pipeline)
     free(pipeline);
 }
 
-static VkPipeline rgGraphicsPipelineGetInstance(
+static VkPipeline rgGraphicsPipelineCreateInstance(
     RgDevice *device, RgPipeline *pipeline, RgRenderPass *render_pass)
 {
-    uint64_t *found = rgHashmapGet(&pipeline->graphics.instances, render_pass->hash);
-    if (found)
-    {
-        VkPipeline instance;
-        memcpy(&instance, found, sizeof(VkPipeline));
-        return instance;
-    }
 
     ARRAY_OF(VkPipelineShaderStageCreateInfo) stages = {0};
 
@@ -3993,9 +4314,31 @@ static VkPipeline rgGraphicsPipelineGetInstance(
     free(attributes);
     free(blend_infos);
 
-    uint64_t instance_id = 0;
-    memcpy(&instance_id, &instance, sizeof(VkPipeline));
-    rgHashmapSet(&pipeline->graphics.instances, render_pass->hash, instance_id);
+    return instance;
+}
+
+static VkPipeline rgGraphicsPipelineGetInstance(
+    RgDevice *device, RgPipeline *pipeline, RgRenderPass *render_pass)
+{
+    VkPipeline instance = VK_NULL_HANDLE;
+
+    rgMutexLock(&pipeline->graphics.instances_mutex);
+
+    uint64_t *found = rgHashmapGet(&pipeline->graphics.instances, render_pass->hash);
+    if (found)
+    {
+        memcpy(&instance, found, sizeof(VkPipeline));
+    }
+    else
+    {
+        instance = rgGraphicsPipelineCreateInstance(device, pipeline, render_pass);
+
+        uint64_t instance_id = 0;
+        memcpy(&instance_id, &instance, sizeof(VkPipeline));
+        rgHashmapSet(&pipeline->graphics.instances, render_pass->hash, instance_id);
+    }
+
+    rgMutexUnlock(&pipeline->graphics.instances_mutex);
 
     return instance;
 }
@@ -4041,12 +4384,21 @@ void rgCmdPoolDestroy(RgDevice *device, RgCmdPool *cmd_pool)
     free(cmd_pool);
 }
 
-RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
+void rgCmdPoolReset(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    VK_CHECK(vkResetCommandPool(device->device, cmd_pool->cmd_pool, 0));
+}
+
+static RgCmdBuffer *
+rgCmdBufferAllocate(RgDevice *device, RgCmdPool *cmd_pool, VkCommandBufferLevel level)
 {
     RgCmdBuffer *cmd_buffer = malloc(sizeof(*cmd_buffer));
     memset(cmd_buffer, 0, sizeof(*cmd_buffer));
 
     cmd_buffer->device = device;
+    cmd_buffer->queue_type = cmd_pool->queue_type;
+    cmd_buffer->secondary = (level == VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+    cmd_buffer->capture_id = rgCaptureNextId(device);
 
     switch (cmd_pool->queue_type)
     {
@@ -4063,7 +4415,7 @@ RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
 
     VkCommandBufferAllocateInfo cmd_buf_allocate_info = {0};
     cmd_buf_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    cmd_buf_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    cmd_buf_allocate_info.level = level;
     cmd_buf_allocate_info.commandPool = cmd_pool->cmd_pool;
     cmd_buf_allocate_info.commandBufferCount = 1;
     VK_CHECK(vkAllocateCommandBuffers(
@@ -4071,6 +4423,14 @@ RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
                 &cmd_buf_allocate_info,
                 &cmd_buffer->cmd_buffer));
 
+    return cmd_buffer;
+}
+
+RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    RgCmdBuffer *cmd_buffer =
+        rgCmdBufferAllocate(device, cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
     VkSemaphoreCreateInfo semaphore_create_info = {0};
     semaphore_create_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
@@ -4090,18 +4450,55 @@ RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
                 NULL,
                 &cmd_buffer->fence));
 
+    // Query pools can't be reset on transfer queues
+    uint32_t queue_family_index = (cmd_pool->queue_type == RG_QUEUE_TYPE_COMPUTE)
+        ? device->compute_queue_family_index
+        : device->graphics_queue_family_index;
+    if (cmd_pool->queue_type != RG_QUEUE_TYPE_TRANSFER &&
+        device->queue_family_properties[queue_family_index].timestampValidBits > 0)
+    {
+        VkQueryPoolCreateInfo query_pool_info = {0};
+        query_pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        query_pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        query_pool_info.queryCount = 2;
+
+        VK_CHECK(vkCreateQueryPool(
+                    device->device,
+                    &query_pool_info,
+                    NULL,
+                    &cmd_buffer->timestamps));
+    }
+
     return cmd_buffer;
 }
 
+RgCmdBuffer *rgCmdBufferCreateSecondary(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    // Secondary command buffers are never submitted on their own, so they
+    // don't need a semaphore or a fence
+    return rgCmdBufferAllocate(device, cmd_pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+}
+
 void rgCmdBufferDestroy(RgDevice *device, RgCmdPool *cmd_pool, RgCmdBuffer *cmd_buffer)
 {
     VK_CHECK(vkDeviceWaitIdle(device->device));
 
-    vkDestroyFence(device->device, cmd_buffer->fence, NULL);
-    vkDestroySemaphore(device->device, cmd_buffer->semaphore, NULL);
+    if (cmd_buffer->fence)
+    {
+        vkDestroyFence(device->device, cmd_buffer->fence, NULL);
+    }
+    if (cmd_buffer->semaphore)
+    {
+        vkDestroySemaphore(device->device, cmd_buffer->semaphore, NULL);
+    }
+    if (cmd_buffer->timestamps)
+    {
+        vkDestroyQueryPool(device->device, cmd_buffer->timestamps, NULL);
+    }
     vkFreeCommandBuffers(device->device, cmd_pool->cmd_pool, 1, &cmd_buffer->cmd_buffer);
     arrFree(&cmd_buffer->wait_semaphores);
     arrFree(&cmd_buffer->wait_stages);
+    arrFree(&cmd_buffer->capture_stream);
     free(cmd_buffer);
 }
 
@@ -4112,17 +4509,84 @@ void rgCmdBufferBegin(RgCmdBuffer *cmd_buffer)
     cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
     VK_CHECK(vkBeginCommandBuffer(cmd_buffer->cmd_buffer, &cmd_buf_info));
+
+    if (cmd_buffer->timestamps)
+    {
+        vkCmdResetQueryPool(cmd_buffer->cmd_buffer, cmd_buffer->timestamps, 0, 2);
+        vkCmdWriteTimestamp(
+            cmd_buffer->cmd_buffer,
+            VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+            cmd_buffer->timestamps,
+            0);
+    }
+
+    rgCaptureCmdBegin(cmd_buffer, NULL);
+}
+
+static void rgCmdSetDynamicState(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass)
+{
+    // Update dynamic viewport state
+    VkViewport viewport = {0};
+    viewport.width = (float)render_pass->width;
+    viewport.height = (float)render_pass->height;
+    viewport.minDepth = (float)0.0f;
+    viewport.maxDepth = (float)1.0f;
+    vkCmdSetViewport(cmd_buffer->cmd_buffer, 0, 1, &viewport);
+
+    // Update dynamic scissor state
+    VkRect2D scissor = {0};
+    scissor.extent.width = render_pass->width;
+    scissor.extent.height = render_pass->height;
+    vkCmdSetScissor(cmd_buffer->cmd_buffer, 0, 1, &scissor);
+}
+
+void rgCmdBufferBeginSecondary(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass)
+{
+    assert(cmd_buffer->secondary);
+
+    VkCommandBufferInheritanceInfo inheritance_info = {0};
+    inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance_info.renderPass = render_pass->render_pass;
+    inheritance_info.subpass = 0;
+    inheritance_info.framebuffer =
+        render_pass->framebuffers[render_pass->current_framebuffer];
+
+    VkCommandBufferBeginInfo cmd_buf_info = {0};
+    cmd_buf_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    cmd_buf_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                         VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    cmd_buf_info.pInheritanceInfo = &inheritance_info;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd_buffer->cmd_buffer, &cmd_buf_info));
+
+    // The render pass is only inherited, it's ended by the primary command buffer
+    cmd_buffer->current_render_pass = render_pass;
+    cmd_buffer->current_pipeline = NULL;
+
+    // Dynamic state is not inherited from the primary command buffer
+    rgCmdSetDynamicState(cmd_buffer, render_pass);
+
+    rgCaptureCmdBegin(cmd_buffer, render_pass);
 }
 
 void rgCmdBufferEnd(RgCmdBuffer *cmd_buffer)
 {
-    if (cmd_buffer->current_render_pass)
+    if (cmd_buffer->current_render_pass && !cmd_buffer->secondary)
     {
         vkCmdEndRenderPass(cmd_buffer->cmd_buffer);
     }
 
     cmd_buffer->current_render_pass = NULL;
 
+    if (cmd_buffer->timestamps)
+    {
+        vkCmdWriteTimestamp(
+            cmd_buffer->cmd_buffer,
+            VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+            cmd_buffer->timestamps,
+            1);
+    }
+
     VK_CHECK(vkEndCommandBuffer(cmd_buffer->cmd_buffer));
 }
 
@@ -4131,20 +4595,33 @@ void rgCmdBufferWaitForPresent(RgCmdBuffer *cmd_buffer, RgSwapchain *swapchain)
     arrPush(&cmd_buffer->wait_semaphores,
             swapchain->present_complete_semaphores[swapchain->current_semaphore_index]);
     arrPush(&cmd_buffer->wait_stages, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmd(cmd_buffer, RG_CAPTURE_OP_WAIT_FOR_PRESENT, 0, NULL);
+    }
 }
 
 void rgCmdBufferWaitForCommands(RgCmdBuffer *cmd_buffer, RgCmdBuffer *wait_cmd_buffer)
 {
     arrPush(&cmd_buffer->wait_semaphores, wait_cmd_buffer->semaphore);
     arrPush(&cmd_buffer->wait_stages, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmd(
+            cmd_buffer, RG_CAPTURE_OP_WAIT_FOR_COMMANDS, 1, &wait_cmd_buffer->capture_id);
+    }
 }
 
 void rgCmdBufferWait(RgDevice *device, RgCmdBuffer *cmd_buffer)
 {
     VK_CHECK(vkWaitForFences(device->device, 1, &cmd_buffer->fence, VK_TRUE, UINT64_MAX));
+    // The fence has to be unsignaled for the next submission
+    VK_CHECK(vkResetFences(device->device, 1, &cmd_buffer->fence));
 }
 
-void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer)
+static void rgCmdBufferSubmitInternal(RgCmdBuffer *cmd_buffer, bool signal_semaphore)
 {
     VkSubmitInfo submit_info = {0};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -4154,8 +4631,11 @@ void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer)
     submit_info.pWaitDstStageMask = cmd_buffer->wait_stages.ptr;
     submit_info.pWaitSemaphores = cmd_buffer->wait_semaphores.ptr;
 
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = &cmd_buffer->semaphore;
+    if (signal_semaphore)
+    {
+        submit_info.signalSemaphoreCount = 1;
+        submit_info.pSignalSemaphores = &cmd_buffer->semaphore;
+    }
     submit_info.commandBufferCount = 1;
     submit_info.pCommandBuffers = &cmd_buffer->cmd_buffer;
     VK_CHECK(vkQueueSubmit(
@@ -4167,11 +4647,54 @@ void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer)
     // Reset waits
     cmd_buffer->wait_stages.len = 0;
     cmd_buffer->wait_semaphores.len = 0;
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureSubmit(cmd_buffer);
+    }
 }
 
-void rgCmdBindPipeline(RgCmdBuffer *cmd_buffer, RgPipeline *pipeline)
+void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer)
 {
-    cmd_buffer->current_pipeline = pipeline;
+    rgCmdBufferSubmitInternal(cmd_buffer, true);
+}
+
+void rgCmdBufferSubmitFenceOnly(RgCmdBuffer *cmd_buffer)
+{
+    // A binary semaphore can't be signaled again before something waits on
+    // it, so submissions nothing waits on must not signal it
+    rgCmdBufferSubmitInternal(cmd_buffer, false);
+}
+
+double rgCmdBufferGetGpuTime(RgDevice *device, RgCmdBuffer *cmd_buffer)
+{
+    if (!cmd_buffer->timestamps) return 0.0;
+
+    uint64_t timestamps[2] = {0};
+    VK_CHECK(vkGetQueryPoolResults(
+                device->device,
+                cmd_buffer->timestamps,
+                0,
+                2,
+                sizeof(timestamps),
+                timestamps,
+                sizeof(timestamps[0]),
+                VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+    // timestampPeriod is in nanoseconds per tick
+    double ticks = (double)(timestamps[1] - timestamps[0]);
+    return ticks * device->physical_device_properties.limits.timestampPeriod * 1e-6;
+}
+
+void rgCmdBindPipeline(RgCmdBuffer *cmd_buffer, RgPipeline *pipeline)
+{
+    if (cmd_buffer->capturing)
+    {
+        uint32_t id = rgCaptureId(pipeline->capture);
+        rgCaptureCmd(cmd_buffer, RG_CAPTURE_OP_BIND_PIPELINE, 1, &id);
+    }
+
+    cmd_buffer->current_pipeline = pipeline;
 
     switch (pipeline->type)
     {
@@ -4206,6 +4729,11 @@ void rgCmdPushConstants(
         size_t size,
         const void *data)
 {
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdPushConstants(cmd_buffer, offset, size, data);
+    }
+
     vkCmdPushConstants(
         cmd_buffer->cmd_buffer,
         cmd_buffer->current_pipeline->layout->pipeline_layout,
@@ -4222,6 +4750,12 @@ void rgCmdBindDescriptorSet(
         uint32_t dynamic_offset_count,
         uint32_t *dynamic_offsets)
 {
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdBindDescriptorSet(
+            cmd_buffer, index, set, dynamic_offset_count, dynamic_offsets);
+    }
+
     vkCmdBindDescriptorSets(
         cmd_buffer->cmd_buffer,
         cmd_buffer->current_bind_point,
@@ -4233,12 +4767,25 @@ void rgCmdBindDescriptorSet(
         dynamic_offsets);
 }
 
-void rgCmdSetRenderPass(
+static void rgCmdBeginRenderPass(
         RgCmdBuffer *cmd_buffer,
         RgRenderPass *render_pass,
         uint32_t clear_value_count,
-        RgClearValue *clear_values)
+        RgClearValue *clear_values,
+        VkSubpassContents contents)
 {
+    assert(!cmd_buffer->secondary);
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdSetRenderPass(
+            cmd_buffer,
+            render_pass,
+            contents == VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS,
+            clear_value_count,
+            clear_values);
+    }
+
     if (cmd_buffer->current_render_pass)
     {
         vkCmdEndRenderPass(cmd_buffer->cmd_buffer);
@@ -4259,24 +4806,68 @@ void rgCmdSetRenderPass(
     render_pass_begin_info.framebuffer =
         render_pass->framebuffers[render_pass->current_framebuffer];
 
-    vkCmdBeginRenderPass(
-            cmd_buffer->cmd_buffer,
-            &render_pass_begin_info,
-            VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(cmd_buffer->cmd_buffer, &render_pass_begin_info, contents);
+}
 
-    // Update dynamic viewport state
-    VkViewport viewport = {0};
-    viewport.width = (float)render_pass->width;
-    viewport.height = (float)render_pass->height;
-    viewport.minDepth = (float)0.0f;
-    viewport.maxDepth = (float)1.0f;
-    vkCmdSetViewport(cmd_buffer->cmd_buffer, 0, 1, &viewport);
+void rgCmdSetRenderPass(
+        RgCmdBuffer *cmd_buffer,
+        RgRenderPass *render_pass,
+        uint32_t clear_value_count,
+        RgClearValue *clear_values)
+{
+    rgCmdBeginRenderPass(
+        cmd_buffer,
+        render_pass,
+        clear_value_count,
+        clear_values,
+        VK_SUBPASS_CONTENTS_INLINE);
+
+    rgCmdSetDynamicState(cmd_buffer, render_pass);
+}
 
-    // Update dynamic scissor state
-    VkRect2D scissor = {0};
-    scissor.extent.width = render_pass->width;
-    scissor.extent.height = render_pass->height;
-    vkCmdSetScissor(cmd_buffer->cmd_buffer, 0, 1, &scissor);
+void rgCmdSetRenderPassSecondary(
+        RgCmdBuffer *cmd_buffer,
+        RgRenderPass *render_pass,
+        uint32_t clear_value_count,
+        RgClearValue *clear_values)
+{
+    // Only vkCmdExecuteCommands is allowed inside this render pass, so the
+    // dynamic state is set by each secondary command buffer instead
+    rgCmdBeginRenderPass(
+        cmd_buffer,
+        render_pass,
+        clear_value_count,
+        clear_values,
+        VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+}
+
+void rgCmdExecuteCommands(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t secondary_count,
+        RgCmdBuffer **secondaries)
+{
+    assert(!cmd_buffer->secondary);
+
+    if (secondary_count == 0) return;
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdExecuteCommands(cmd_buffer, secondary_count, secondaries);
+    }
+
+    VkCommandBuffer *vk_secondaries = malloc(sizeof(VkCommandBuffer) * secondary_count);
+    for (uint32_t i = 0; i < secondary_count; ++i)
+    {
+        assert(secondaries[i]->secondary);
+        vk_secondaries[i] = secondaries[i]->cmd_buffer;
+    }
+
+    vkCmdExecuteCommands(cmd_buffer->cmd_buffer, secondary_count, vk_secondaries);
+
+    free(vk_secondaries);
+
+    // Bound state is undefined after executing secondary command buffers
+    cmd_buffer->current_pipeline = NULL;
 }
 
 void rgCmdBindVertexBuffer(
@@ -4284,6 +4875,16 @@ void rgCmdBindVertexBuffer(
         RgBuffer *vertex_buffer,
         size_t offset)
 {
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdBindBuffer(
+            cmd_buffer,
+            RG_CAPTURE_OP_BIND_VERTEX_BUFFER,
+            vertex_buffer,
+            offset,
+            RG_INDEX_TYPE_UINT32);
+    }
+
     vkCmdBindVertexBuffers(
             cmd_buffer->cmd_buffer,
             0,
@@ -4298,6 +4899,16 @@ void rgCmdBindIndexBuffer(
         size_t offset,
         RgIndexType index_type)
 {
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdBindBuffer(
+            cmd_buffer,
+            RG_CAPTURE_OP_BIND_INDEX_BUFFER,
+            index_buffer,
+            offset,
+            index_type);
+    }
+
     vkCmdBindIndexBuffer(
             cmd_buffer->cmd_buffer,
             index_buffer->buffer,
@@ -4312,6 +4923,13 @@ void rgCmdDraw(
         uint32_t first_vertex,
         uint32_t first_instance)
 {
+    if (cmd_buffer->capturing)
+    {
+        uint32_t values[] = {vertex_count, instance_count, first_vertex, first_instance};
+        rgCaptureCmd(
+            cmd_buffer, RG_CAPTURE_OP_DRAW, RG_STATIC_ARRAY_SIZE(values), values);
+    }
+
     vkCmdDraw(
             cmd_buffer->cmd_buffer,
             vertex_count,
@@ -4328,6 +4946,19 @@ void rgCmdDrawIndexed(
         int32_t  vertex_offset,
         uint32_t first_instance)
 {
+    if (cmd_buffer->capturing)
+    {
+        uint32_t values[] = {
+            index_count,
+            instance_count,
+            first_index,
+            (uint32_t)vertex_offset,
+            first_instance,
+        };
+        rgCaptureCmd(
+            cmd_buffer, RG_CAPTURE_OP_DRAW_INDEXED, RG_STATIC_ARRAY_SIZE(values), values);
+    }
+
     vkCmdDrawIndexed(
             cmd_buffer->cmd_buffer,
             index_count,
@@ -4343,11 +4974,1619 @@ void rgCmdDispatch(
         uint32_t group_count_y,
         uint32_t group_count_z)
 {
+    if (cmd_buffer->capturing)
+    {
+        uint32_t values[] = {group_count_x, group_count_y, group_count_z};
+        rgCaptureCmd(
+            cmd_buffer, RG_CAPTURE_OP_DISPATCH, RG_STATIC_ARRAY_SIZE(values), values);
+    }
+
     vkCmdDispatch(
             cmd_buffer->cmd_buffer,
             group_count_x,
             group_count_y,
             group_count_z);
 }
+
+static VkPipelineStageFlags rgPipelineStagesToVk(uint32_t stages)
+{
+    VkPipelineStageFlags flags = 0;
+    if (stages & RG_PIPELINE_STAGE_TRANSFER) flags |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    if (stages & RG_PIPELINE_STAGE_VERTEX)
+    {
+        flags |= VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT;
+    }
+    if (stages & RG_PIPELINE_STAGE_FRAGMENT)
+    {
+        flags |= VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    }
+    if (stages & RG_PIPELINE_STAGE_COMPUTE) flags |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    return flags;
+}
+
+static VkAccessFlags rgPipelineStagesToVkAccess(uint32_t stages)
+{
+    VkAccessFlags flags = 0;
+    if (stages & RG_PIPELINE_STAGE_TRANSFER)
+    {
+        flags |= VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+    if (stages & RG_PIPELINE_STAGE_VERTEX)
+    {
+        flags |= VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT |
+                 VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    if (stages & (RG_PIPELINE_STAGE_FRAGMENT | RG_PIPELINE_STAGE_COMPUTE))
+    {
+        flags |= VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    }
+    return flags;
+}
+
+void rgCmdMemoryBarrier(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t src_stages,
+        uint32_t dst_stages)
+{
+    assert(!cmd_buffer->current_render_pass);
+    assert(src_stages != 0 && dst_stages != 0);
+
+    if (cmd_buffer->capturing)
+    {
+        uint32_t values[] = {src_stages, dst_stages};
+        rgCaptureCmd(
+            cmd_buffer,
+            RG_CAPTURE_OP_MEMORY_BARRIER,
+            RG_STATIC_ARRAY_SIZE(values),
+            values);
+    }
+
+    // Only writes need to be made available, reads just have to finish
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = rgPipelineStagesToVkAccess(src_stages) &
+                            (VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT);
+    barrier.dstAccessMask = rgPipelineStagesToVkAccess(dst_stages);
+
+    vkCmdPipelineBarrier(
+        cmd_buffer->cmd_buffer,
+        rgPipelineStagesToVk(src_stages),
+        rgPipelineStagesToVk(dst_stages),
+        0,
+        1,
+        &barrier,
+        0,
+        NULL,
+        0,
+        NULL);
+}
+
+void rgCmdCopyImageToBuffer(
+        RgCmdBuffer *cmd_buffer,
+        const RgImageCopy *src,
+        const RgBufferCopy *dst,
+        RgExtent3D extent)
+{
+    assert(!cmd_buffer->secondary);
+    assert(src->image->info.usage & RG_IMAGE_USAGE_TRANSFER_SRC);
+    assert(dst->buffer->info.usage & RG_BUFFER_USAGE_TRANSFER_DST);
+
+    if (cmd_buffer->capturing)
+    {
+        rgCaptureCmdCopyImageToBuffer(cmd_buffer, src, dst, extent);
+    }
+
+    if (cmd_buffer->current_render_pass)
+    {
+        vkCmdEndRenderPass(cmd_buffer->cmd_buffer);
+        cmd_buffer->current_render_pass = NULL;
+    }
+
+    VkImageMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = src->image->image;
+    barrier.subresourceRange.aspectMask = rgImageAspectToVk(src->image->info.aspect);
+    barrier.subresourceRange.baseMipLevel = src->mip_level;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = src->array_layer;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                            VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+    vkCmdPipelineBarrier(
+        cmd_buffer->cmd_buffer,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &barrier);
+
+    VkBufferImageCopy region;
+    memset(&region, 0, sizeof(region));
+    region.bufferOffset = dst->offset;
+    region.bufferRowLength = dst->row_length;
+    region.bufferImageHeight = dst->image_height;
+    region.imageSubresource.aspectMask = rgImageAspectToVk(src->image->info.aspect);
+    region.imageSubresource.mipLevel = src->mip_level;
+    region.imageSubresource.baseArrayLayer = src->array_layer;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset.x = src->offset.x;
+    region.imageOffset.y = src->offset.y;
+    region.imageOffset.z = src->offset.z;
+    region.imageExtent.width = extent.width;
+    region.imageExtent.height = extent.height;
+    region.imageExtent.depth = extent.depth;
+
+    vkCmdCopyImageToBuffer(
+        cmd_buffer->cmd_buffer,
+        src->image->image,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        dst->buffer->buffer,
+        1,
+        &region);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkMemoryBarrier host_barrier = {0};
+    host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+
+    vkCmdPipelineBarrier(
+        cmd_buffer->cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT | VK_PIPELINE_STAGE_HOST_BIT,
+        0,
+        1,
+        &host_barrier,
+        0,
+        NULL,
+        1,
+        &barrier);
+}
+
+void rgCmdGenerateMipmaps(RgCmdBuffer *cmd_buffer, RgImage *image)
+{
+    assert(image->info.usage & RG_IMAGE_USAGE_TRANSFER_SRC);
+    assert(image->info.usage & RG_IMAGE_USAGE_TRANSFER_DST);
+
+    if (image->info.mip_count <= 1) return;
+
+    // The mip levels are part of the contents of the image, whether they are
+    // generated at load time or during a captured frame
+    rgCaptureImageGenerateMipmaps(cmd_buffer->device, image);
+    if (cmd_buffer->capturing)
+    {
+        uint32_t id = rgCaptureId(image->capture);
+        rgCaptureCmd(cmd_buffer, RG_CAPTURE_OP_GENERATE_MIPMAPS, 1, &id);
+    }
+
+    VkImageMemoryBarrier barriers[2];
+    memset(barriers, 0, sizeof(barriers));
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        barriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        barriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barriers[i].image = image->image;
+        barriers[i].subresourceRange.aspectMask = rgImageAspectToVk(image->info.aspect);
+        barriers[i].subresourceRange.levelCount = 1;
+        barriers[i].subresourceRange.baseArrayLayer = 0;
+        barriers[i].subresourceRange.layerCount = image->info.layer_count;
+    }
+
+    int32_t width = (int32_t)image->info.extent.width;
+    int32_t height = (int32_t)image->info.extent.height;
+
+    for (uint32_t level = 1; level < image->info.mip_count; ++level)
+    {
+        int32_t next_width = RG_MAX(width / 2, 1);
+        int32_t next_height = RG_MAX(height / 2, 1);
+
+        // The previous level becomes the blit source
+        barriers[0].subresourceRange.baseMipLevel = level - 1;
+        barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].oldLayout = (level == 1) ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                             : VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+        barriers[1].subresourceRange.baseMipLevel = level;
+        barriers[1].srcAccessMask = 0;
+        barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barriers[1].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+
+        vkCmdPipelineBarrier(
+            cmd_buffer->cmd_buffer,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            0,
+            0,
+            NULL,
+            0,
+            NULL,
+            2,
+            barriers);
+
+        VkImageBlit blit;
+        memset(&blit, 0, sizeof(blit));
+        blit.srcSubresource.aspectMask = rgImageAspectToVk(image->info.aspect);
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.baseArrayLayer = 0;
+        blit.srcSubresource.layerCount = image->info.layer_count;
+        blit.srcOffsets[1].x = width;
+        blit.srcOffsets[1].y = height;
+        blit.srcOffsets[1].z = 1;
+        blit.dstSubresource = blit.srcSubresource;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstOffsets[1].x = next_width;
+        blit.dstOffsets[1].y = next_height;
+        blit.dstOffsets[1].z = 1;
+
+        vkCmdBlitImage(
+            cmd_buffer->cmd_buffer,
+            image->image,
+            VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+            image->image,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1,
+            &blit,
+            VK_FILTER_LINEAR);
+
+        // The previous level is final
+        barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+        vkCmdPipelineBarrier(
+            cmd_buffer->cmd_buffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+            0,
+            0,
+            NULL,
+            0,
+            NULL,
+            1,
+            barriers);
+
+        width = next_width;
+        height = next_height;
+    }
+
+    barriers[1].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barriers[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barriers[1].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barriers[1].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    vkCmdPipelineBarrier(
+        cmd_buffer->cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        0,
+        NULL,
+        0,
+        NULL,
+        1,
+        &barriers[1]);
+}
 // }}}
 
+// Upload context {{{
+#define RG_UPLOAD_BATCH_COUNT 4
+#define RG_UPLOAD_DEFAULT_STAGING_SIZE (64 * 1024 * 1024)
+// Copy offsets must be a multiple of the texel block size
+#define RG_UPLOAD_ALIGNMENT 16
+
+typedef struct RgUploadBatch
+{
+    RgCmdBuffer *cmd_buffer;
+    VkFence fence;
+    uint64_t id;
+    bool recording;
+    bool in_flight;
+
+    // Ring position right after the last staging range used by the batch
+    uint64_t ring_end;
+    // Staging buffers for uploads that don't fit in the ring
+    ARRAY_OF(RgBuffer *) overflow_buffers;
+} RgUploadBatch;
+
+struct RgUploadContext
+{
+    RgDevice *device;
+    RgCmdPool *cmd_pool;
+
+    RgBuffer *staging;
+    uint8_t *staging_ptr;
+    size_t staging_size;
+
+    // Positions only ever grow, byte p lives at p % staging_size. Everything
+    // between tail and head is still in use by a batch.
+    uint64_t ring_head;
+    uint64_t ring_tail;
+
+    RgUploadBatch batches[RG_UPLOAD_BATCH_COUNT];
+    uint32_t current_batch;
+    uint64_t next_batch_id;
+    // Every batch up to this id has finished executing
+    uint64_t completed_batch_id;
+};
+
+RgUploadContext *rgUploadContextCreate(RgDevice *device, const RgUploadContextInfo *info)
+{
+    RgUploadContext *ctx = (RgUploadContext *)malloc(sizeof(RgUploadContext));
+    memset(ctx, 0, sizeof(*ctx));
+
+    ctx->device = device;
+    ctx->cmd_pool = rgCmdPoolCreate(device, info->queue_type);
+
+    ctx->staging_size = info->staging_size;
+    if (ctx->staging_size == 0)
+    {
+        ctx->staging_size = RG_UPLOAD_DEFAULT_STAGING_SIZE;
+    }
+    ctx->staging_size = RG_ALIGN(ctx->staging_size, RG_UPLOAD_ALIGNMENT);
+
+    RgBufferInfo buffer_info;
+    memset(&buffer_info, 0, sizeof(buffer_info));
+    buffer_info.size = ctx->staging_size;
+    buffer_info.usage = RG_BUFFER_USAGE_TRANSFER_SRC;
+    buffer_info.memory = RG_BUFFER_MEMORY_HOST;
+
+    // Host memory is coherent, so the ring stays mapped for its whole lifetime
+    ctx->staging = rgBufferCreate(device, &buffer_info);
+    ctx->staging_ptr = (uint8_t *)rgBufferMap(device, ctx->staging);
+
+    for (uint32_t i = 0; i < RG_UPLOAD_BATCH_COUNT; ++i)
+    {
+        RgUploadBatch *batch = &ctx->batches[i];
+        batch->cmd_buffer =
+            rgCmdBufferAllocate(device, ctx->cmd_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        VkFenceCreateInfo fence_create_info = {0};
+        fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        VK_CHECK(vkCreateFence(device->device, &fence_create_info, NULL, &batch->fence));
+    }
+
+    ctx->next_batch_id = 1;
+
+    return ctx;
+}
+
+static void rgUploadBatchFreeOverflow(RgUploadContext *ctx, RgUploadBatch *batch)
+{
+    for (uint32_t i = 0; i < batch->overflow_buffers.len; ++i)
+    {
+        rgBufferUnmap(ctx->device, batch->overflow_buffers.ptr[i]);
+        rgBufferDestroy(ctx->device, batch->overflow_buffers.ptr[i]);
+    }
+    batch->overflow_buffers.len = 0;
+}
+
+// Retires finished batches in submission order. Blocks until every batch up
+// to wait_id has finished, a wait_id of 0 only polls.
+static void rgUploadContextRetire(RgUploadContext *ctx, uint64_t wait_id)
+{
+    // Slots are reused round robin, so the one after the most recently
+    // submitted batch holds the oldest
+    for (uint32_t i = 0; i < RG_UPLOAD_BATCH_COUNT; ++i)
+    {
+        RgUploadBatch *batch =
+            &ctx->batches[(ctx->current_batch + i) % RG_UPLOAD_BATCH_COUNT];
+        if (!batch->in_flight) continue;
+
+        if (batch->id <= wait_id)
+        {
+            VK_CHECK(vkWaitForFences(
+                ctx->device->device, 1, &batch->fence, VK_TRUE, UINT64_MAX));
+        }
+        else
+        {
+            VkResult result = vkGetFenceStatus(ctx->device->device, batch->fence);
+            if (result == VK_NOT_READY) break;
+            VK_CHECK(result);
+        }
+
+        VK_CHECK(vkResetFences(ctx->device->device, 1, &batch->fence));
+        rgUploadBatchFreeOverflow(ctx, batch);
+
+        batch->in_flight = false;
+        ctx->ring_tail = RG_MAX(ctx->ring_tail, batch->ring_end);
+        ctx->completed_batch_id = batch->id;
+    }
+}
+
+static RgUploadBatch *rgUploadContextBeginBatch(RgUploadContext *ctx)
+{
+    RgUploadBatch *batch = &ctx->batches[ctx->current_batch];
+    if (batch->recording) return batch;
+
+    if (batch->in_flight)
+    {
+        // Every slot is busy, wait for the oldest batch
+        rgUploadContextRetire(ctx, batch->id);
+    }
+
+    batch->id = ctx->next_batch_id++;
+    batch->recording = true;
+    batch->ring_end = ctx->ring_head;
+
+    rgCmdBufferBegin(batch->cmd_buffer);
+
+    return batch;
+}
+
+// Reserves size bytes of staging memory in the current batch
+static RgUploadBatch *rgUploadContextReserve(
+    RgUploadContext *ctx,
+    size_t size,
+    RgBuffer **staging,
+    size_t *staging_offset,
+    uint8_t **staging_ptr)
+{
+    size_t aligned_size = RG_ALIGN(size, RG_UPLOAD_ALIGNMENT);
+
+    if (aligned_size > ctx->staging_size)
+    {
+        // Too big for the ring, it gets a staging buffer of its own that is
+        // freed once the batch is retired
+        RgUploadBatch *batch = rgUploadContextBeginBatch(ctx);
+
+        RgBufferInfo buffer_info;
+        memset(&buffer_info, 0, sizeof(buffer_info));
+        buffer_info.size = size;
+        buffer_info.usage = RG_BUFFER_USAGE_TRANSFER_SRC;
+        buffer_info.memory = RG_BUFFER_MEMORY_HOST;
+
+        RgBuffer *buffer = rgBufferCreate(ctx->device, &buffer_info);
+        arrPush(&batch->overflow_buffers, buffer);
+
+        *staging = buffer;
+        *staging_offset = 0;
+        *staging_ptr = (uint8_t *)rgBufferMap(ctx->device, buffer);
+        return batch;
+    }
+
+    while (true)
+    {
+        uint64_t head = ctx->ring_head;
+
+        // Ranges never wrap around the end of the ring
+        size_t ring_offset = (size_t)(head % ctx->staging_size);
+        if (ring_offset + aligned_size > ctx->staging_size)
+        {
+            head += ctx->staging_size - ring_offset;
+        }
+
+        if (ctx->ring_tail == ctx->ring_head)
+        {
+            // Nothing is in use, skipping to the start of the ring is free
+            ctx->ring_tail = head;
+        }
+
+        if (head + aligned_size - ctx->ring_tail <= ctx->staging_size)
+        {
+            RgUploadBatch *batch = rgUploadContextBeginBatch(ctx);
+
+            ctx->ring_head = head + aligned_size;
+            batch->ring_end = ctx->ring_head;
+
+            *staging = ctx->staging;
+            *staging_offset = (size_t)(head % ctx->staging_size);
+            *staging_ptr = ctx->staging_ptr + *staging_offset;
+            return batch;
+        }
+
+        // The ring is full: wait for the oldest batch in flight, or submit the
+        // current one if it's holding everything
+        uint64_t oldest_id = 0;
+        for (uint32_t i = 0; i < RG_UPLOAD_BATCH_COUNT; ++i)
+        {
+            RgUploadBatch *batch = &ctx->batches[i];
+            if (batch->in_flight && (oldest_id == 0 || batch->id < oldest_id))
+            {
+                oldest_id = batch->id;
+            }
+        }
+
+        if (oldest_id != 0)
+        {
+            rgUploadContextRetire(ctx, oldest_id);
+        }
+        else
+        {
+            assert(ctx->batches[ctx->current_batch].recording);
+            rgUploadContextSubmit(ctx);
+        }
+    }
+}
+
+void rgUploadContextDestroy(RgDevice *device, RgUploadContext *ctx)
+{
+    rgUploadContextWait(ctx, rgUploadContextSubmit(ctx));
+
+    for (uint32_t i = 0; i < RG_UPLOAD_BATCH_COUNT; ++i)
+    {
+        RgUploadBatch *batch = &ctx->batches[i];
+        rgUploadBatchFreeOverflow(ctx, batch);
+        arrFree(&batch->overflow_buffers);
+        vkDestroyFence(device->device, batch->fence, NULL);
+        rgCmdBufferDestroy(device, ctx->cmd_pool, batch->cmd_buffer);
+    }
+
+    rgBufferUnmap(device, ctx->staging);
+    rgBufferDestroy(device, ctx->staging);
+    rgCmdPoolDestroy(device, ctx->cmd_pool);
+
+    free(ctx);
+}
+
+void rgUploadBuffer(
+    RgUploadContext *ctx, RgBuffer *buffer, size_t offset, size_t size, const void *data)
+{
+    RgBuffer *staging;
+    size_t staging_offset;
+    uint8_t *staging_ptr;
+    RgUploadBatch *batch =
+        rgUploadContextReserve(ctx, size, &staging, &staging_offset, &staging_ptr);
+
+    memcpy(staging_ptr, data, size);
+    rgCaptureBufferData(ctx->device, buffer, offset, size, data);
+
+    VkBufferCopy region;
+    memset(&region, 0, sizeof(region));
+    region.srcOffset = staging_offset;
+    region.dstOffset = offset;
+    region.size = size;
+    vkCmdCopyBuffer(
+        batch->cmd_buffer->cmd_buffer, staging->buffer, buffer->buffer, 1, &region);
+}
+
+void rgUploadImage(
+    RgUploadContext *ctx,
+    RgImageCopy *dst,
+    RgExtent3D *extent,
+    size_t size,
+    const void *data)
+{
+    RgBuffer *staging;
+    size_t staging_offset;
+    uint8_t *staging_ptr;
+    RgUploadBatch *batch =
+        rgUploadContextReserve(ctx, size, &staging, &staging_offset, &staging_ptr);
+
+    memcpy(staging_ptr, data, size);
+    rgCaptureImageData(ctx->device, dst, extent, size, data);
+
+    rgCmdCopyBufferToImageForSampling(
+        batch->cmd_buffer, staging, staging_offset, dst, extent);
+}
+
+uint64_t rgUploadContextSubmit(RgUploadContext *ctx)
+{
+    RgUploadBatch *batch = &ctx->batches[ctx->current_batch];
+    if (!batch->recording)
+    {
+        // Nothing new was recorded, the last batch is the one to wait for
+        return ctx->next_batch_id - 1;
+    }
+
+    // Make the copies visible to any command that reads them afterwards
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    vkCmdPipelineBarrier(
+        batch->cmd_buffer->cmd_buffer,
+        VK_PIPELINE_STAGE_TRANSFER_BIT,
+        VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+        0,
+        1,
+        &barrier,
+        0,
+        NULL,
+        0,
+        NULL);
+
+    rgCmdBufferEnd(batch->cmd_buffer);
+
+    VkSubmitInfo submit_info = {0};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &batch->cmd_buffer->cmd_buffer;
+    VK_CHECK(vkQueueSubmit(batch->cmd_buffer->queue, 1, &submit_info, batch->fence));
+
+    batch->recording = false;
+    batch->in_flight = true;
+
+    ctx->current_batch = (ctx->current_batch + 1) % RG_UPLOAD_BATCH_COUNT;
+
+    return batch->id;
+}
+
+void rgUploadGenerateMipmaps(RgUploadContext *ctx, RgImage *image)
+{
+    assert(ctx->cmd_pool->queue_type == RG_QUEUE_TYPE_GRAPHICS);
+
+    RgUploadBatch *batch = rgUploadContextBeginBatch(ctx);
+    rgCmdGenerateMipmaps(batch->cmd_buffer, image);
+}
+
+bool rgUploadContextIsComplete(RgUploadContext *ctx, uint64_t batch_id)
+{
+    if (batch_id <= ctx->completed_batch_id) return true;
+
+    rgUploadContextRetire(ctx, 0);
+    return batch_id <= ctx->completed_batch_id;
+}
+
+void rgUploadContextWait(RgUploadContext *ctx, uint64_t batch_id)
+{
+    if (batch_id <= ctx->completed_batch_id) return;
+    assert(batch_id < ctx->next_batch_id);
+
+    RgUploadBatch *current = &ctx->batches[ctx->current_batch];
+    if (current->recording && current->id == batch_id)
+    {
+        rgUploadContextSubmit(ctx);
+    }
+
+    rgUploadContextRetire(ctx, batch_id);
+}
+// }}}
+
+
+// Capture {{{
+typedef struct RgCaptureData
+{
+    RgCaptureStream record;
+    // Box of the subresource the record writes, earlier records whose box is
+    // inside it are dropped. Records with an empty box are always kept.
+    uint64_t subresource;
+    int64_t begin[3];
+    int64_t end[3];
+} RgCaptureData;
+
+struct RgCaptureObject
+{
+    RgCaptureObject *prev;
+    RgCaptureObject *next;
+    uint32_t id;
+    // Destroyed while a capture was running, commands of the frame may still
+    // refer to it so it's freed when the capture ends
+    bool destroyed;
+
+    RgCaptureStream create;
+    ARRAY_OF(RgCaptureData) data;
+    // Host buffers the GPU reads from are saved whole when the capture ends,
+    // their contents are written through mappings rg doesn't see
+    RgBuffer *host_buffer;
+};
+
+struct RgCapture
+{
+    // Objects can be created from several threads
+    RgMutex mutex;
+    uint32_t next_id;
+    // Every object with a record, in id order
+    RgCaptureObject *first;
+    RgCaptureObject *last;
+
+    bool active;
+    RgCaptureStream frame;
+    uint32_t submit_count;
+};
+
+static void rgCaptureWrite(RgCaptureStream *stream, const void *data, size_t size)
+{
+    if (stream->len + size > stream->cap)
+    {
+        size_t cap = RG_MAX(stream->cap * 2, stream->len + size);
+        stream->ptr = rgArrayGrow(stream->ptr, &stream->cap, cap, sizeof(uint8_t));
+    }
+
+    if (size > 0)
+    {
+        memcpy(stream->ptr + stream->len, data, size);
+    }
+    stream->len += size;
+}
+
+static void rgCaptureU32(RgCaptureStream *stream, uint32_t value)
+{
+    rgCaptureWrite(stream, &value, sizeof(value));
+}
+
+static void rgCaptureU64(RgCaptureStream *stream, uint64_t value)
+{
+    rgCaptureWrite(stream, &value, sizeof(value));
+}
+
+static void rgCaptureF32(RgCaptureStream *stream, float value)
+{
+    rgCaptureWrite(stream, &value, sizeof(value));
+}
+
+static void rgCaptureString(RgCaptureStream *stream, const char *str)
+{
+    uint32_t length = str ? (uint32_t)strlen(str) : 0;
+    rgCaptureU32(stream, length);
+    rgCaptureWrite(stream, str, length);
+}
+
+static void rgCaptureBlob(RgCaptureStream *stream, const void *data, size_t size)
+{
+    rgCaptureU64(stream, size);
+    rgCaptureWrite(stream, data, size);
+}
+
+// Returns where the payload starts, to pass to rgCaptureEndRecord once it's
+// written
+static size_t rgCaptureBeginRecord(RgCaptureStream *stream, RgCaptureOp op)
+{
+    RgCaptureRecord record = {0};
+    record.op = (uint32_t)op;
+    rgCaptureWrite(stream, &record, sizeof(record));
+    return stream->len;
+}
+
+static void rgCaptureEndRecord(RgCaptureStream *stream, size_t payload_begin)
+{
+    size_t size = stream->len - payload_begin;
+    assert(size <= UINT32_MAX);
+
+    uint32_t size_u32 = (uint32_t)size;
+    memcpy(
+        stream->ptr + payload_begin - sizeof(uint32_t),
+        &size_u32,
+        sizeof(size_u32));
+}
+
+static uint32_t rgCaptureId(RgCaptureObject *object)
+{
+    return object ? object->id : 0;
+}
+
+static RgCapture *rgCaptureCreate(void)
+{
+    RgCapture *capture = malloc(sizeof(*capture));
+    memset(capture, 0, sizeof(*capture));
+    rgMutexInit(&capture->mutex);
+    capture->next_id = 1;
+    return capture;
+}
+
+static void rgCaptureObjectFree(RgCaptureObject *object)
+{
+    for (size_t i = 0; i < object->data.len; ++i)
+    {
+        arrFree(&object->data.ptr[i].record);
+    }
+    arrFree(&object->data);
+    arrFree(&object->create);
+    free(object);
+}
+
+static void rgCaptureUnlink(RgCapture *capture, RgCaptureObject *object)
+{
+    if (object->prev) object->prev->next = object->next;
+    else capture->first = object->next;
+
+    if (object->next) object->next->prev = object->prev;
+    else capture->last = object->prev;
+}
+
+static void rgCaptureDestroy(RgCapture *capture)
+{
+    RgCaptureObject *object = capture->first;
+    while (object)
+    {
+        RgCaptureObject *next = object->next;
+        rgCaptureObjectFree(object);
+        object = next;
+    }
+
+    arrFree(&capture->frame);
+    rgMutexDestroy(&capture->mutex);
+    free(capture);
+}
+
+static uint32_t rgCaptureNextId(RgDevice *device)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return 0;
+
+    rgMutexLock(&capture->mutex);
+    uint32_t id = capture->next_id++;
+    rgMutexUnlock(&capture->mutex);
+    return id;
+}
+
+// Called with the mutex locked. The object is appended to the list, which
+// keeps it sorted as ids only grow.
+static RgCaptureObject *rgCaptureObjectCreate(RgCapture *capture)
+{
+    RgCaptureObject *object = malloc(sizeof(*object));
+    memset(object, 0, sizeof(*object));
+    object->id = capture->next_id++;
+
+    object->prev = capture->last;
+    if (capture->last) capture->last->next = object;
+    else capture->first = object;
+    capture->last = object;
+
+    return object;
+}
+
+// Record of the whole contents of a host buffer
+static void rgCaptureHostBuffer(
+    RgDevice *device, RgCaptureObject *object, RgCaptureStream *stream)
+{
+    RgBuffer *buffer = object->host_buffer;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_BUFFER_DATA);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU64(stream, 0);
+    rgCaptureBlob(stream, rgBufferMap(device, buffer), buffer->info.size);
+    rgBufferUnmap(device, buffer);
+    rgCaptureEndRecord(stream, record);
+}
+
+// Called with the mutex locked
+static void rgCaptureAddData(RgCaptureObject *object, RgCaptureData *data)
+{
+    bool has_box = data->end[0] > data->begin[0];
+    if (has_box)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < object->data.len; ++i)
+        {
+            RgCaptureData *old = &object->data.ptr[i];
+
+            bool covered = old->end[0] > old->begin[0] &&
+                           old->subresource == data->subresource;
+            for (uint32_t d = 0; d < 3 && covered; ++d)
+            {
+                covered = old->begin[d] >= data->begin[d] && old->end[d] <= data->end[d];
+            }
+
+            if (covered)
+            {
+                arrFree(&old->record);
+            }
+            else
+            {
+                object->data.ptr[kept++] = *old;
+            }
+        }
+        object->data.len = kept;
+    }
+
+    arrPush(&object->data, *data);
+}
+
+static void rgCaptureObjectDestroy(RgDevice *device, RgCaptureObject **object_ptr)
+{
+    RgCapture *capture = device->capture;
+    RgCaptureObject *object = *object_ptr;
+    if (!capture || !object) return;
+
+    *object_ptr = NULL;
+
+    rgMutexLock(&capture->mutex);
+    if (capture->active)
+    {
+        if (object->host_buffer)
+        {
+            // The buffer won't be there to read when the capture ends
+            RgCaptureData data;
+            memset(&data, 0, sizeof(data));
+            rgCaptureHostBuffer(device, object, &data.record);
+            arrPush(&object->data, data);
+            object->host_buffer = NULL;
+        }
+        object->destroyed = true;
+    }
+    else
+    {
+        rgCaptureUnlink(capture, object);
+        rgCaptureObjectFree(object);
+    }
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureBufferCreate(RgDevice *device, RgBuffer *buffer)
+{
+    RgCapture *capture = device->capture;
+    // Buffers that can only be copied from are staging buffers, no command
+    // can refer to them
+    if (!capture || buffer->info.usage == RG_BUFFER_USAGE_TRANSFER_SRC) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_BUFFER_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, buffer->info.usage);
+    rgCaptureU32(stream, buffer->info.memory);
+    rgCaptureU64(stream, buffer->info.size);
+    rgCaptureEndRecord(stream, record);
+
+    const RgFlags gpu_read_usage = RG_BUFFER_USAGE_VERTEX | RG_BUFFER_USAGE_INDEX |
+                                   RG_BUFFER_USAGE_UNIFORM | RG_BUFFER_USAGE_STORAGE;
+    if (buffer->info.memory == RG_BUFFER_MEMORY_HOST &&
+        (buffer->info.usage & gpu_read_usage))
+    {
+        object->host_buffer = buffer;
+    }
+
+    buffer->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureBufferData(
+    RgDevice *device, RgBuffer *buffer, size_t offset, size_t size, const void *data)
+{
+    RgCapture *capture = device->capture;
+    RgCaptureObject *object = buffer->capture;
+    if (!capture || !object || object->host_buffer) return;
+
+    RgCaptureData capture_data;
+    memset(&capture_data, 0, sizeof(capture_data));
+    capture_data.begin[0] = (int64_t)offset;
+    capture_data.end[0] = (int64_t)(offset + size);
+    capture_data.end[1] = capture_data.end[2] = 1;
+
+    RgCaptureStream *stream = &capture_data.record;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_BUFFER_DATA);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU64(stream, offset);
+    rgCaptureBlob(stream, data, size);
+    rgCaptureEndRecord(stream, record);
+
+    rgMutexLock(&capture->mutex);
+    rgCaptureAddData(object, &capture_data);
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureImageCreate(RgDevice *device, RgImage *image)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_IMAGE_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, image->info.extent.width);
+    rgCaptureU32(stream, image->info.extent.height);
+    rgCaptureU32(stream, image->info.extent.depth);
+    rgCaptureU32(stream, image->info.format);
+    rgCaptureU32(stream, image->info.usage);
+    rgCaptureU32(stream, image->info.aspect);
+    rgCaptureU32(stream, image->info.sample_count);
+    rgCaptureU32(stream, image->info.mip_count);
+    rgCaptureU32(stream, image->info.layer_count);
+    rgCaptureEndRecord(stream, record);
+
+    image->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureImageData(
+    RgDevice *device,
+    const RgImageCopy *dst,
+    const RgExtent3D *extent,
+    size_t size,
+    const void *data)
+{
+    RgCapture *capture = device->capture;
+    RgCaptureObject *object = dst->image->capture;
+    if (!capture || !object) return;
+
+    RgCaptureData capture_data;
+    memset(&capture_data, 0, sizeof(capture_data));
+    capture_data.subresource = ((uint64_t)dst->mip_level << 32) | dst->array_layer;
+    capture_data.begin[0] = dst->offset.x;
+    capture_data.begin[1] = dst->offset.y;
+    capture_data.begin[2] = dst->offset.z;
+    capture_data.end[0] = (int64_t)dst->offset.x + extent->width;
+    capture_data.end[1] = (int64_t)dst->offset.y + extent->height;
+    capture_data.end[2] = (int64_t)dst->offset.z + extent->depth;
+
+    RgCaptureStream *stream = &capture_data.record;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_IMAGE_DATA);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, dst->mip_level);
+    rgCaptureU32(stream, dst->array_layer);
+    rgCaptureU32(stream, (uint32_t)dst->offset.x);
+    rgCaptureU32(stream, (uint32_t)dst->offset.y);
+    rgCaptureU32(stream, (uint32_t)dst->offset.z);
+    rgCaptureU32(stream, extent->width);
+    rgCaptureU32(stream, extent->height);
+    rgCaptureU32(stream, extent->depth);
+    rgCaptureBlob(stream, data, size);
+    rgCaptureEndRecord(stream, record);
+
+    rgMutexLock(&capture->mutex);
+    rgCaptureAddData(object, &capture_data);
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureImageGenerateMipmaps(RgDevice *device, RgImage *image)
+{
+    RgCapture *capture = device->capture;
+    RgCaptureObject *object = image->capture;
+    if (!capture || !object) return;
+
+    RgCaptureData capture_data;
+    memset(&capture_data, 0, sizeof(capture_data));
+
+    RgCaptureStream *stream = &capture_data.record;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_IMAGE_GENERATE_MIPMAPS);
+    rgCaptureU32(stream, object->id);
+    rgCaptureEndRecord(stream, record);
+
+    rgMutexLock(&capture->mutex);
+    rgCaptureAddData(object, &capture_data);
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureSamplerCreate(RgDevice *device, RgSampler *sampler)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_SAMPLER_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, sampler->info.anisotropy);
+    rgCaptureF32(stream, sampler->info.max_anisotropy);
+    rgCaptureF32(stream, sampler->info.min_lod);
+    rgCaptureF32(stream, sampler->info.max_lod);
+    rgCaptureU32(stream, sampler->info.mag_filter);
+    rgCaptureU32(stream, sampler->info.min_filter);
+    rgCaptureU32(stream, sampler->info.address_mode);
+    rgCaptureU32(stream, sampler->info.border_color);
+    rgCaptureEndRecord(stream, record);
+
+    sampler->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureRenderPassCreate(
+    RgDevice *device, RgRenderPass *render_pass, const RgRenderPassInfo *info)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_RENDER_PASS_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, info->color_attachment_count);
+    for (uint32_t i = 0; i < info->color_attachment_count; ++i)
+    {
+        rgCaptureU32(stream, rgCaptureId(info->color_attachments[i]->capture));
+    }
+    rgCaptureU32(
+        stream,
+        info->depth_stencil_attachment
+            ? rgCaptureId(info->depth_stencil_attachment->capture)
+            : 0);
+    rgCaptureEndRecord(stream, record);
+
+    render_pass->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+// Called whenever the swapchain images are (re)created, the record follows
+// the current size
+static void rgCaptureSwapchainResources(RgSwapchain *swapchain)
+{
+    RgCapture *capture = swapchain->device->capture;
+    if (!capture) return;
+
+    RgFormat color_format = RG_FORMAT_BGRA8_UNORM;
+    switch (swapchain->color_format)
+    {
+    case VK_FORMAT_B8G8R8A8_SRGB: color_format = RG_FORMAT_BGRA8_SRGB; break;
+    case VK_FORMAT_R8G8B8A8_UNORM: color_format = RG_FORMAT_RGBA8_UNORM; break;
+    default: break;
+    }
+
+    rgMutexLock(&capture->mutex);
+    if (!swapchain->capture)
+    {
+        swapchain->capture = rgCaptureObjectCreate(capture);
+    }
+    RgCaptureObject *object = swapchain->capture;
+
+    RgCaptureStream *stream = &object->create;
+    stream->len = 0;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_SWAPCHAIN_RENDER_PASS);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, swapchain->render_pass->width);
+    rgCaptureU32(stream, swapchain->render_pass->height);
+    rgCaptureU32(stream, color_format);
+    rgCaptureU32(stream, swapchain->depth_format);
+    rgCaptureEndRecord(stream, record);
+
+    // Commands refer to the render pass of the swapchain
+    swapchain->render_pass->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureDescriptorSetLayoutCreate(
+    RgDevice *device,
+    RgDescriptorSetLayout *set_layout,
+    const RgDescriptorSetLayoutInfo *info)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record =
+        rgCaptureBeginRecord(stream, RG_CAPTURE_OP_DESCRIPTOR_SET_LAYOUT_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, info->entry_count);
+    for (uint32_t i = 0; i < info->entry_count; ++i)
+    {
+        rgCaptureU32(stream, info->entries[i].binding);
+        rgCaptureU32(stream, info->entries[i].type);
+        rgCaptureU32(stream, info->entries[i].shader_stages);
+        rgCaptureU32(stream, info->entries[i].count);
+    }
+    rgCaptureEndRecord(stream, record);
+
+    set_layout->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCapturePipelineLayoutCreate(
+    RgDevice *device,
+    RgPipelineLayout *pipeline_layout,
+    const RgPipelineLayoutInfo *info)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_PIPELINE_LAYOUT_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, info->set_layout_count);
+    for (uint32_t i = 0; i < info->set_layout_count; ++i)
+    {
+        rgCaptureU32(stream, rgCaptureId(info->set_layouts[i]->capture));
+    }
+    rgCaptureEndRecord(stream, record);
+
+    pipeline_layout->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureDescriptorSetCreate(
+    RgDevice *device, RgDescriptorSet *descriptor_set, RgDescriptorSetLayout *set_layout)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_DESCRIPTOR_SET_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, rgCaptureId(set_layout->capture));
+    rgCaptureEndRecord(stream, record);
+
+    descriptor_set->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureDescriptorSetUpdate(
+    RgDevice *device,
+    RgDescriptorSet *descriptor_set,
+    const RgDescriptorUpdateInfo *entries,
+    uint32_t entry_count)
+{
+    RgCapture *capture = device->capture;
+    RgCaptureObject *object = descriptor_set->capture;
+    if (!capture || !object) return;
+
+    RgDescriptorSetLayout *set_layout = descriptor_set->pool->set_layout;
+
+    // One record per entry, so that the ones a later update overwrites can be
+    // dropped, bindless sets are updated every time a resource is created
+    for (uint32_t i = 0; i < entry_count; ++i)
+    {
+        const RgDescriptorUpdateInfo *entry = &entries[i];
+
+        RgCaptureDescriptorKind kind = RG_CAPTURE_DESCRIPTOR_IMAGE;
+        switch (set_layout->bindings[entry->binding].descriptorType)
+        {
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER:
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER:
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC:
+            kind = RG_CAPTURE_DESCRIPTOR_BUFFER;
+            break;
+        default: break;
+        }
+
+        RgCaptureData capture_data;
+        memset(&capture_data, 0, sizeof(capture_data));
+        capture_data.subresource = entry->binding;
+        capture_data.begin[0] = entry->base_index;
+        capture_data.end[0] = (int64_t)entry->base_index + entry->descriptor_count;
+        capture_data.end[1] = capture_data.end[2] = 1;
+
+        RgCaptureStream *stream = &capture_data.record;
+        size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_DESCRIPTOR_SET_UPDATE);
+        rgCaptureU32(stream, object->id);
+        rgCaptureU32(stream, 1);
+        rgCaptureU32(stream, entry->binding);
+        rgCaptureU32(stream, entry->base_index);
+        rgCaptureU32(stream, entry->descriptor_count);
+        rgCaptureU32(stream, kind);
+        for (uint32_t j = 0; j < entry->descriptor_count; ++j)
+        {
+            const RgDescriptor *descriptor = &entry->descriptors[j];
+            if (kind == RG_CAPTURE_DESCRIPTOR_BUFFER)
+            {
+                rgCaptureU32(stream, rgCaptureId(descriptor->buffer.buffer->capture));
+                rgCaptureU64(stream, descriptor->buffer.offset);
+                rgCaptureU64(stream, descriptor->buffer.size);
+            }
+            else
+            {
+                RgImage *image = descriptor->image.image;
+                RgSampler *sampler = descriptor->image.sampler;
+                rgCaptureU32(stream, image ? rgCaptureId(image->capture) : 0);
+                rgCaptureU32(stream, sampler ? rgCaptureId(sampler->capture) : 0);
+            }
+        }
+        rgCaptureEndRecord(stream, record);
+
+        rgMutexLock(&capture->mutex);
+        rgCaptureAddData(object, &capture_data);
+        rgMutexUnlock(&capture->mutex);
+    }
+}
+
+static void rgCaptureGraphicsPipelineCreate(
+    RgDevice *device, RgPipeline *pipeline, const RgGraphicsPipelineInfo *info)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_GRAPHICS_PIPELINE_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, rgCaptureId(info->pipeline_layout->capture));
+    rgCaptureU32(stream, info->polygon_mode);
+    rgCaptureU32(stream, info->cull_mode);
+    rgCaptureU32(stream, info->front_face);
+    rgCaptureU32(stream, info->topology);
+    rgCaptureU32(stream, info->blend.enable);
+    rgCaptureU32(stream, info->depth_stencil.test_enable);
+    rgCaptureU32(stream, info->depth_stencil.write_enable);
+    rgCaptureU32(stream, info->depth_stencil.bias_enable);
+    rgCaptureU32(stream, info->depth_stencil.compare_op);
+    rgCaptureU32(stream, info->vertex_stride);
+    rgCaptureU32(stream, info->num_vertex_attributes);
+    for (uint32_t i = 0; i < info->num_vertex_attributes; ++i)
+    {
+        rgCaptureU32(stream, info->vertex_attributes[i].format);
+        rgCaptureU32(stream, info->vertex_attributes[i].offset);
+    }
+    rgCaptureString(stream, info->vertex_entry);
+    rgCaptureBlob(stream, info->vertex, info->vertex ? info->vertex_size : 0);
+    rgCaptureString(stream, info->fragment_entry);
+    rgCaptureBlob(stream, info->fragment, info->fragment ? info->fragment_size : 0);
+    rgCaptureEndRecord(stream, record);
+
+    pipeline->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureComputePipelineCreate(
+    RgDevice *device, RgPipeline *pipeline, const RgComputePipelineInfo *info)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    RgCaptureObject *object = rgCaptureObjectCreate(capture);
+
+    RgCaptureStream *stream = &object->create;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_COMPUTE_PIPELINE_CREATE);
+    rgCaptureU32(stream, object->id);
+    rgCaptureU32(stream, rgCaptureId(info->pipeline_layout->capture));
+    rgCaptureString(stream, info->entry);
+    rgCaptureBlob(stream, info->code, info->code_size);
+    rgCaptureEndRecord(stream, record);
+
+    pipeline->capture = object;
+    rgMutexUnlock(&capture->mutex);
+}
+
+static void rgCaptureCmdBegin(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass)
+{
+    RgCapture *capture = cmd_buffer->device->capture;
+    cmd_buffer->capture_stream.len = 0;
+    cmd_buffer->capturing = false;
+    if (!capture) return;
+
+    rgMutexLock(&capture->mutex);
+    cmd_buffer->capturing = capture->active;
+    rgMutexUnlock(&capture->mutex);
+
+    if (cmd_buffer->capturing && render_pass)
+    {
+        uint32_t id = rgCaptureId(render_pass->capture);
+        rgCaptureCmd(cmd_buffer, RG_CAPTURE_OP_BEGIN_SECONDARY, 1, &id);
+    }
+}
+
+static void rgCaptureCmd(
+    RgCmdBuffer *cmd_buffer, RgCaptureOp op, uint32_t count, const uint32_t *values)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, op);
+    rgCaptureWrite(stream, values, sizeof(*values) * count);
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdPushConstants(
+    RgCmdBuffer *cmd_buffer, size_t offset, size_t size, const void *data)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_PUSH_CONSTANTS);
+    rgCaptureU32(stream, (uint32_t)offset);
+    rgCaptureBlob(stream, data, size);
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdBindDescriptorSet(
+    RgCmdBuffer *cmd_buffer,
+    uint32_t index,
+    RgDescriptorSet *set,
+    uint32_t dynamic_offset_count,
+    const uint32_t *dynamic_offsets)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_BIND_DESCRIPTOR_SET);
+    rgCaptureU32(stream, index);
+    rgCaptureU32(stream, rgCaptureId(set->capture));
+    rgCaptureU32(stream, dynamic_offset_count);
+    rgCaptureWrite(stream, dynamic_offsets, sizeof(uint32_t) * dynamic_offset_count);
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdSetRenderPass(
+    RgCmdBuffer *cmd_buffer,
+    RgRenderPass *render_pass,
+    bool secondary_contents,
+    uint32_t clear_value_count,
+    const RgClearValue *clear_values)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_SET_RENDER_PASS);
+    rgCaptureU32(stream, rgCaptureId(render_pass->capture));
+    rgCaptureU32(stream, secondary_contents);
+    rgCaptureU32(stream, clear_value_count);
+    rgCaptureWrite(stream, clear_values, sizeof(RgClearValue) * clear_value_count);
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdExecuteCommands(
+    RgCmdBuffer *cmd_buffer, uint32_t secondary_count, RgCmdBuffer **secondaries)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_EXECUTE_COMMANDS);
+    rgCaptureU32(stream, secondary_count);
+    for (uint32_t i = 0; i < secondary_count; ++i)
+    {
+        // Empty if the secondary was begun before the capture
+        RgCaptureStream *secondary_stream = &secondaries[i]->capture_stream;
+        size_t secondary_record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_SECONDARY);
+        rgCaptureWrite(stream, secondary_stream->ptr, secondary_stream->len);
+        rgCaptureEndRecord(stream, secondary_record);
+    }
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdBindBuffer(
+    RgCmdBuffer *cmd_buffer,
+    RgCaptureOp op,
+    RgBuffer *buffer,
+    size_t offset,
+    RgIndexType index_type)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, op);
+    rgCaptureU32(stream, rgCaptureId(buffer->capture));
+    rgCaptureU64(stream, offset);
+    if (op == RG_CAPTURE_OP_BIND_INDEX_BUFFER)
+    {
+        rgCaptureU32(stream, index_type);
+    }
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureCmdCopyImageToBuffer(
+    RgCmdBuffer *cmd_buffer,
+    const RgImageCopy *src,
+    const RgBufferCopy *dst,
+    RgExtent3D extent)
+{
+    RgCaptureStream *stream = &cmd_buffer->capture_stream;
+    size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_COPY_IMAGE_TO_BUFFER);
+    rgCaptureU32(stream, rgCaptureId(src->image->capture));
+    rgCaptureU32(stream, src->mip_level);
+    rgCaptureU32(stream, src->array_layer);
+    rgCaptureU32(stream, (uint32_t)src->offset.x);
+    rgCaptureU32(stream, (uint32_t)src->offset.y);
+    rgCaptureU32(stream, (uint32_t)src->offset.z);
+    rgCaptureU32(stream, rgCaptureId(dst->buffer->capture));
+    rgCaptureU64(stream, dst->offset);
+    rgCaptureU32(stream, dst->row_length);
+    rgCaptureU32(stream, dst->image_height);
+    rgCaptureU32(stream, extent.width);
+    rgCaptureU32(stream, extent.height);
+    rgCaptureU32(stream, extent.depth);
+    rgCaptureEndRecord(stream, record);
+}
+
+static void rgCaptureSubmit(RgCmdBuffer *cmd_buffer)
+{
+    RgCapture *capture = cmd_buffer->device->capture;
+    RgCaptureStream *commands = &cmd_buffer->capture_stream;
+
+    // Submissions without rg commands, such as the copies of rgBufferUpload,
+    // are left out
+    if (commands->len == 0) return;
+
+    rgMutexLock(&capture->mutex);
+    if (capture->active)
+    {
+        RgCaptureStream *stream = &capture->frame;
+        size_t record = rgCaptureBeginRecord(stream, RG_CAPTURE_OP_SUBMIT);
+        rgCaptureU32(stream, cmd_buffer->capture_id);
+        rgCaptureU32(stream, cmd_buffer->queue_type);
+        rgCaptureWrite(stream, commands->ptr, commands->len);
+        rgCaptureEndRecord(stream, record);
+        capture->submit_count++;
+    }
+    rgMutexUnlock(&capture->mutex);
+}
+
+bool rgDeviceBeginCapture(RgDevice *device)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return false;
+
+    rgMutexLock(&capture->mutex);
+    assert(!capture->active);
+    capture->active = true;
+    capture->frame.len = 0;
+    capture->submit_count = 0;
+    rgMutexUnlock(&capture->mutex);
+
+    return true;
+}
+
+static void rgCaptureFileWrite(
+    FILE *file, const RgCaptureStream *stream, uint64_t *section_size)
+{
+    if (stream->len == 0) return;
+
+    fwrite(stream->ptr, 1, stream->len, file);
+    *section_size += stream->len;
+}
+
+bool rgDeviceEndCapture(RgDevice *device, const char *path)
+{
+    RgCapture *capture = device->capture;
+    if (!capture) return false;
+
+    rgMutexLock(&capture->mutex);
+    assert(capture->active);
+    capture->active = false;
+
+    FILE *file = fopen(path, "wb");
+    bool success = file != NULL;
+    if (file)
+    {
+        RgCaptureHeader header;
+        memset(&header, 0, sizeof(header));
+        header.magic = RG_CAPTURE_MAGIC;
+        header.version = RG_CAPTURE_VERSION;
+        header.id_count = capture->next_id;
+        header.submit_count = capture->submit_count;
+        fwrite(&header, sizeof(header), 1, file);
+
+        for (RgCaptureObject *object = capture->first; object; object = object->next)
+        {
+            rgCaptureFileWrite(file, &object->create, &header.setup_size);
+        }
+
+        RgCaptureStream host_data = {0};
+        for (RgCaptureObject *object = capture->first; object; object = object->next)
+        {
+            for (size_t i = 0; i < object->data.len; ++i)
+            {
+                rgCaptureFileWrite(file, &object->data.ptr[i].record, &header.setup_size);
+            }
+
+            if (object->host_buffer)
+            {
+                host_data.len = 0;
+                rgCaptureHostBuffer(device, object, &host_data);
+                rgCaptureFileWrite(file, &host_data, &header.setup_size);
+            }
+        }
+        arrFree(&host_data);
+
+        rgCaptureFileWrite(file, &capture->frame, &header.frame_size);
+
+        // Now that the sizes are known
+        fseek(file, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, file);
+
+        success = !ferror(file);
+        success = (fclose(file) == 0) && success;
+    }
+
+    RgCaptureObject *object = capture->first;
+    while (object)
+    {
+        RgCaptureObject *next = object->next;
+        if (object->destroyed)
+        {
+            rgCaptureUnlink(capture, object);
+            rgCaptureObjectFree(object);
+        }
+        object = next;
+    }
+
+    arrFree(&capture->frame);
+    capture->submit_count = 0;
+    rgMutexUnlock(&capture->mutex);
+
+    return success;
+}
+// }}}
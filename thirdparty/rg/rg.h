@@ -17,6 +17,7 @@ typedef struct RgImage RgImage;
 typedef struct RgSampler RgSampler;
 typedef struct RgCmdPool RgCmdPool;
 typedef struct RgCmdBuffer RgCmdBuffer;
+typedef struct RgUploadContext RgUploadContext;
 typedef struct RgRenderPass RgRenderPass;
 typedef struct RgDescriptorSetLayout RgDescriptorSetLayout;
 typedef struct RgDescriptorSet RgDescriptorSet;
@@ -82,6 +83,14 @@ typedef enum RgFormat
 
     RG_FORMAT_BC7_UNORM = 31,
     RG_FORMAT_BC7_SRGB = 32,
+
+    RG_FORMAT_BC1_RGB_UNORM = 33,
+    RG_FORMAT_BC1_RGB_SRGB = 34,
+    RG_FORMAT_BC5_UNORM = 35,
+
+    RG_FORMAT_RG16_UNORM = 36,
+    RG_FORMAT_RGBA16_UNORM = 37,
+    RG_FORMAT_RG16_SNORM = 38,
 } RgFormat;
 
 typedef enum RgImageUsage
@@ -181,6 +190,13 @@ typedef union RgClearValue {
 typedef struct RgDeviceInfo
 {
     bool enable_validation;
+    // Leaves out the surface and swapchain extensions, so the device works
+    // without a display (and with software implementations such as lavapipe).
+    // Swapchains can't be created.
+    bool headless;
+    // Keeps what it takes to recreate every object, including a copy of all
+    // uploaded data, so that frames can be captured with rgDeviceBeginCapture
+    bool enable_capture;
 } RgDeviceInfo;
 
 typedef struct RgImageInfo
@@ -222,6 +238,16 @@ typedef enum RgBufferMemory
 	RG_BUFFER_MEMORY_DEVICE,
 } RgBufferMemory;
 
+// Stages a barrier waits for and blocks, combined as flags
+typedef enum RgPipelineStage
+{
+	RG_PIPELINE_STAGE_TRANSFER = 1 << 0,
+	// Vertex and index fetch and vertex shaders
+	RG_PIPELINE_STAGE_VERTEX   = 1 << 1,
+	RG_PIPELINE_STAGE_FRAGMENT = 1 << 2,
+	RG_PIPELINE_STAGE_COMPUTE  = 1 << 3,
+} RgPipelineStage;
+
 typedef struct RgBufferInfo
 {
 	size_t size;
@@ -430,6 +456,20 @@ typedef struct RgBufferCopy
     uint32_t  image_height;
 } RgBufferCopy;
 
+typedef struct RgImageUploadInfo
+{
+    RgImageCopy dst;
+    RgExtent3D  extent;
+    size_t      size;
+    void       *data;
+} RgImageUploadInfo;
+
+typedef struct RgUploadContextInfo
+{
+    RgQueueType queue_type;
+    size_t      staging_size; // 0 for the default of 64MiB
+} RgUploadContextInfo;
+
 typedef struct RgImageRegion
 {
     uint32_t base_mip_level;
@@ -440,12 +480,27 @@ typedef struct RgImageRegion
 
 RgDevice *rgDeviceCreate(const RgDeviceInfo *info);
 void rgDeviceDestroy(RgDevice *device);
+// Waits until the device has finished all submitted work
+void rgDeviceWaitIdle(RgDevice *device);
 void rgDeviceGetLimits(RgDevice *device, RgLimits *limits);
+// Whether rgCmdGenerateMipmaps can be used with images of this format
+bool rgDeviceSupportsLinearBlit(RgDevice *device, RgFormat format);
+// Whether sampled images can be created with this format
+bool rgDeviceSupportsSampledFormat(RgDevice *device, RgFormat format);
+// Serialises the commands of every command buffer begun from now on, until
+// rgDeviceEndCapture writes them to a file along with the objects they need
+// (see rg_capture.h). Call between frames, on a device created with
+// enable_capture. Returns false if the device can't capture.
+bool rgDeviceBeginCapture(RgDevice *device);
+// Writes the command buffers submitted since rgDeviceBeginCapture, returns
+// false if the file couldn't be written
+bool rgDeviceEndCapture(RgDevice *device, const char *path);
 
 RgBuffer *rgBufferCreate(RgDevice *device, const RgBufferInfo *info);
 void rgBufferDestroy(RgDevice *device, RgBuffer *buffer);
 void *rgBufferMap(RgDevice *device, RgBuffer *buffer);
 void rgBufferUnmap(RgDevice *device, RgBuffer *buffer);
+// Submits and waits for the copy, batch uploads with an RgUploadContext instead
 void rgBufferUpload(
         RgDevice *device,
         RgCmdPool *cmd_pool,
@@ -463,6 +518,12 @@ void rgImageUpload(
     RgExtent3D *extent,
     size_t size,
     void *data);
+// Uploads every image through a single staging buffer and submission
+void rgImageUploadBatch(
+    RgDevice *device,
+    RgCmdPool *cmd_pool,
+    uint32_t upload_count,
+    RgImageUploadInfo *uploads);
 
 RgSampler *rgSamplerCreate(RgDevice *device, RgSamplerInfo *info);
 void rgSamplerDestroy(RgDevice *device, RgSampler *sampler);
@@ -499,14 +560,57 @@ void rgPipelineDestroy(RgDevice *device, RgPipeline *pipeline);
 
 RgCmdPool *rgCmdPoolCreate(RgDevice *device, RgQueueType type);
 void rgCmdPoolDestroy(RgDevice *device, RgCmdPool *cmd_pool);
+// Resets every command buffer allocated from the pool. Command pools are not
+// thread safe, so each recording thread should use a pool of its own.
+void rgCmdPoolReset(RgDevice *device, RgCmdPool *cmd_pool);
 RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool);
+// Secondary command buffers can't be submitted, they are recorded inside a
+// render pass and executed from a primary with rgCmdExecuteCommands
+RgCmdBuffer *rgCmdBufferCreateSecondary(RgDevice *device, RgCmdPool *cmd_pool);
 void rgCmdBufferDestroy(RgDevice *device, RgCmdPool *cmd_pool, RgCmdBuffer *cmd_buffer);
 void rgCmdBufferBegin(RgCmdBuffer *cmd_buffer);
+// Begins a secondary command buffer that continues the render pass
+void rgCmdBufferBeginSecondary(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass);
 void rgCmdBufferEnd(RgCmdBuffer *cmd_buffer);
 void rgCmdBufferWaitForPresent(RgCmdBuffer *cmd_buffer, RgSwapchain *swapchain);
 void rgCmdBufferWaitForCommands(RgCmdBuffer *cmd_buffer, RgCmdBuffer *wait_cmd_buffer);
+// Waits for the last submission of cmd_buffer, after which it can be
+// submitted again
 void rgCmdBufferWait(RgDevice *device, RgCmdBuffer *cmd_buffer);
+// Signals the semaphore that rgCmdBufferWaitForCommands and
+// rgSwapchainWaitForCommands wait on, and the fence of rgCmdBufferWait
 void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer);
+// Only signals the fence, for submissions that are only ever waited on with
+// rgCmdBufferWait
+void rgCmdBufferSubmitFenceOnly(RgCmdBuffer *cmd_buffer);
+// Milliseconds the GPU spent executing the last submission of cmd_buffer,
+// which must have completed. 0 if its queue has no timestamps.
+double rgCmdBufferGetGpuTime(RgDevice *device, RgCmdBuffer *cmd_buffer);
+
+// Upload contexts record copies from a persistently mapped staging ring into
+// batches. Each batch is one command buffer and one fence, so many uploads cost a
+// single submission. They are not thread safe.
+RgUploadContext *rgUploadContextCreate(RgDevice *device, const RgUploadContextInfo *info);
+// Waits for every pending upload
+void rgUploadContextDestroy(RgDevice *device, RgUploadContext *ctx);
+// Only block when the staging ring is full
+void rgUploadBuffer(
+    RgUploadContext *ctx, RgBuffer *buffer, size_t offset, size_t size, const void *data);
+// Leaves the image in the shader read only layout
+void rgUploadImage(
+    RgUploadContext *ctx,
+    RgImageCopy *dst,
+    RgExtent3D *extent,
+    size_t size,
+    const void *data);
+// Submits the uploads recorded so far and returns the id of their batch. If
+// nothing was recorded it returns the id of the last batch.
+uint64_t rgUploadContextSubmit(RgUploadContext *ctx);
+// Records rgCmdGenerateMipmaps after the uploads so far, the context has to use
+// the graphics queue
+void rgUploadGenerateMipmaps(RgUploadContext *ctx, RgImage *image);
+bool rgUploadContextIsComplete(RgUploadContext *ctx, uint64_t batch_id);
+void rgUploadContextWait(RgUploadContext *ctx, uint64_t batch_id);
 
 void rgCmdBindPipeline(RgCmdBuffer *cmd_buffer, RgPipeline *pipeline);
 void rgCmdPushConstants(
@@ -525,6 +629,17 @@ void rgCmdSetRenderPass(
         RgRenderPass *render_pass,
         uint32_t clear_value_count,
         RgClearValue *clear_values);
+// Like rgCmdSetRenderPass, but the render pass contents must come from
+// secondary command buffers executed with rgCmdExecuteCommands
+void rgCmdSetRenderPassSecondary(
+        RgCmdBuffer *cmd_buffer,
+        RgRenderPass *render_pass,
+        uint32_t clear_value_count,
+        RgClearValue *clear_values);
+void rgCmdExecuteCommands(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t secondary_count,
+        RgCmdBuffer **secondaries);
 void rgCmdBindVertexBuffer(
         RgCmdBuffer *cmd_buffer,
         RgBuffer *vertex_buffer,
@@ -547,11 +662,30 @@ void rgCmdDrawIndexed(
         uint32_t first_index,
         int32_t  vertex_offset,
         uint32_t first_instance);
+// Fills every mip level after the first with linear blits. Level 0 has to be in
+// the shader read only layout, which all levels are left in.
+void rgCmdGenerateMipmaps(RgCmdBuffer *cmd_buffer, RgImage *image);
 void rgCmdDispatch(
         RgCmdBuffer *cmd_buffer,
         uint32_t group_count_x,
         uint32_t group_count_y,
         uint32_t group_count_z);
+// Makes what src_stages (RgPipelineStage flags) of earlier commands wrote
+// visible to dst_stages of later commands, and keeps later writes from
+// overtaking earlier reads. Not allowed inside a render pass.
+void rgCmdMemoryBarrier(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t src_stages,
+        uint32_t dst_stages);
+// Copies a region of an image in the shader read only layout, where render
+// passes leave their color attachments, to a buffer, and makes the copy
+// visible to the host once the command buffer has completed. Ends the current
+// render pass.
+void rgCmdCopyImageToBuffer(
+        RgCmdBuffer *cmd_buffer,
+        const RgImageCopy *src,
+        const RgBufferCopy *dst,
+        RgExtent3D extent);
 
 #ifdef __cplusplus
 }
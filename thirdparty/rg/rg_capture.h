@@ -0,0 +1,161 @@
+#ifndef RG_CAPTURE_H
+#define RG_CAPTURE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// File format of rgDeviceEndCapture, read back by tools/rg_replay.c.
+//
+// The file is an RgCaptureHeader followed by setup_size bytes of setup records
+// and frame_size bytes of frame records. A record is an RgCaptureRecord
+// followed by size bytes of payload, laid out as listed next to each op.
+// Everything is little endian, u32 and u64 are unsigned integers, f32 is a
+// float and i32 a signed integer. A string is a u32 length followed by that
+// many bytes, and a blob a u64 size followed by that many bytes.
+//
+// Every object gets an id, unique across all types, when it's created. Ids
+// grow with creation order, so objects only ever refer to objects with lower
+// ids, and 0 stands for no object. Objects destroyed before the capture began
+// are left out, descriptors may still refer to their ids and have to be
+// skipped. Staging buffers (only RG_BUFFER_USAGE_TRANSFER_SRC) are left out
+// too.
+//
+// The setup records recreate every object alive during the capture: first
+// all the create records in id order, then the data records (buffer and
+// image contents, mipmap generation, descriptor set updates) of each object
+// in id order, in the order they happened. Data records that a later one
+// overwrites completely are dropped. Host buffers the GPU reads from have
+// their contents as of the end of the capture, or of their destruction.
+//
+// The frame records are the RG_CAPTURE_OP_SUBMIT records of every command
+// buffer submitted between rgDeviceBeginCapture and rgDeviceEndCapture, in
+// submission order. Their payload holds the commands of the command buffer.
+
+#define RG_CAPTURE_MAGIC 0x50414352 // "RCAP"
+#define RG_CAPTURE_VERSION 1
+
+typedef struct RgCaptureHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    // Highest object id + 1
+    uint32_t id_count;
+    uint32_t submit_count;
+    uint64_t setup_size;
+    uint64_t frame_size;
+} RgCaptureHeader;
+
+typedef struct RgCaptureRecord
+{
+    uint32_t op;
+    // Bytes of payload that follow
+    uint32_t size;
+} RgCaptureRecord;
+
+typedef enum RgCaptureOp
+{
+    // Setup {{{
+    // id, usage, memory, u64 size
+    RG_CAPTURE_OP_BUFFER_CREATE = 1,
+    // id, width, height, depth, format, usage, aspect, sample_count,
+    // mip_count, layer_count
+    RG_CAPTURE_OP_IMAGE_CREATE = 2,
+    // id, anisotropy, f32 max_anisotropy, f32 min_lod, f32 max_lod,
+    // mag_filter, min_filter, address_mode, border_color
+    RG_CAPTURE_OP_SAMPLER_CREATE = 3,
+    // id, color_attachment_count, the color attachment ids, depth stencil
+    // attachment id
+    RG_CAPTURE_OP_RENDER_PASS_CREATE = 4,
+    // id, width, height, color format, depth format. The render pass of a
+    // swapchain, replays render into an image instead.
+    RG_CAPTURE_OP_SWAPCHAIN_RENDER_PASS = 5,
+    // id, entry_count, then binding, type, shader_stages, count per entry
+    RG_CAPTURE_OP_DESCRIPTOR_SET_LAYOUT_CREATE = 6,
+    // id, set_layout_count, the set layout ids
+    RG_CAPTURE_OP_PIPELINE_LAYOUT_CREATE = 7,
+    // id, set layout id
+    RG_CAPTURE_OP_DESCRIPTOR_SET_CREATE = 8,
+    // id, pipeline layout id, polygon_mode, cull_mode, front_face, topology,
+    // blend enable, depth test_enable, write_enable, bias_enable, compare_op,
+    // vertex_stride, attribute count, then format, offset per attribute,
+    // string vertex_entry, blob vertex code, string fragment_entry, blob
+    // fragment code
+    RG_CAPTURE_OP_GRAPHICS_PIPELINE_CREATE = 9,
+    // id, pipeline layout id, string entry, blob code
+    RG_CAPTURE_OP_COMPUTE_PIPELINE_CREATE = 10,
+
+    // buffer id, u64 offset, blob data
+    RG_CAPTURE_OP_BUFFER_DATA = 11,
+    // image id, mip_level, array_layer, i32 x, i32 y, i32 z, width, height,
+    // depth, blob data
+    RG_CAPTURE_OP_IMAGE_DATA = 12,
+    // image id
+    RG_CAPTURE_OP_IMAGE_GENERATE_MIPMAPS = 13,
+    // descriptor set id, entry_count, then per entry binding, base_index,
+    // descriptor_count, kind (RgCaptureDescriptorKind) and per descriptor
+    // either buffer id, u64 offset, u64 size or image id, sampler id
+    RG_CAPTURE_OP_DESCRIPTOR_SET_UPDATE = 14,
+    // }}}
+
+    // Frame {{{
+    // cmd buffer id, queue type, then the command records
+    RG_CAPTURE_OP_SUBMIT = 32,
+    // Payload is the command records of a secondary command buffer, which
+    // start with RG_CAPTURE_OP_BEGIN_SECONDARY. Only inside
+    // RG_CAPTURE_OP_EXECUTE_COMMANDS.
+    RG_CAPTURE_OP_SECONDARY = 33,
+    // }}}
+
+    // Commands {{{
+    // render pass id
+    RG_CAPTURE_OP_BEGIN_SECONDARY = 64,
+    // cmd buffer id of an earlier submission
+    RG_CAPTURE_OP_WAIT_FOR_COMMANDS = 65,
+    // No payload
+    RG_CAPTURE_OP_WAIT_FOR_PRESENT = 66,
+    // pipeline id
+    RG_CAPTURE_OP_BIND_PIPELINE = 67,
+    // u32 offset, blob data
+    RG_CAPTURE_OP_PUSH_CONSTANTS = 68,
+    // index, descriptor set id, dynamic offset count, the dynamic offsets
+    RG_CAPTURE_OP_BIND_DESCRIPTOR_SET = 69,
+    // render pass id, secondary contents (0 or 1), clear value count, then
+    // 16 bytes per clear value
+    RG_CAPTURE_OP_SET_RENDER_PASS = 70,
+    // secondary count, then that many RG_CAPTURE_OP_SECONDARY records
+    RG_CAPTURE_OP_EXECUTE_COMMANDS = 71,
+    // buffer id, u64 offset
+    RG_CAPTURE_OP_BIND_VERTEX_BUFFER = 72,
+    // buffer id, u64 offset, index type
+    RG_CAPTURE_OP_BIND_INDEX_BUFFER = 73,
+    // vertex_count, instance_count, first_vertex, first_instance
+    RG_CAPTURE_OP_DRAW = 74,
+    // index_count, instance_count, first_index, i32 vertex_offset,
+    // first_instance
+    RG_CAPTURE_OP_DRAW_INDEXED = 75,
+    // group count x, y and z
+    RG_CAPTURE_OP_DISPATCH = 76,
+    // src_stages, dst_stages
+    RG_CAPTURE_OP_MEMORY_BARRIER = 77,
+    // image id
+    RG_CAPTURE_OP_GENERATE_MIPMAPS = 78,
+    // image id, mip_level, array_layer, i32 x, i32 y, i32 z, buffer id,
+    // u64 offset, row_length, image_height, width, height, depth
+    RG_CAPTURE_OP_COPY_IMAGE_TO_BUFFER = 79,
+    // }}}
+} RgCaptureOp;
+
+typedef enum RgCaptureDescriptorKind
+{
+    RG_CAPTURE_DESCRIPTOR_BUFFER = 0,
+    RG_CAPTURE_DESCRIPTOR_IMAGE = 1,
+} RgCaptureDescriptorKind;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RG_CAPTURE_H
@@ -0,0 +1,970 @@
+// Null backend of rg.h, see rg_null.h
+
+#include "rg_null.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define RG_MAX(a, b) (((a) > (b)) ? (a) : (b))
+
+typedef enum RgPipelineType
+{
+    RG_PIPELINE_TYPE_GRAPHICS,
+    RG_PIPELINE_TYPE_COMPUTE,
+} RgPipelineType;
+
+struct RgDevice
+{
+    RgDeviceInfo info;
+    // Updated atomically, objects can be created from several threads
+    RgNullStats stats;
+};
+
+struct RgBuffer
+{
+    RgBufferInfo info;
+    // Only host buffers have memory
+    void *memory;
+};
+
+struct RgImage
+{
+    RgImageInfo info;
+    uint64_t size;
+};
+
+struct RgSampler
+{
+    RgSamplerInfo info;
+};
+
+struct RgRenderPass
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t color_attachment_count;
+    bool has_depth_stencil;
+};
+
+struct RgSwapchain
+{
+    RgDevice *device;
+    RgSwapchainInfo info;
+    RgRenderPass render_pass;
+};
+
+struct RgDescriptorSetLayout
+{
+    uint32_t entry_count;
+};
+
+struct RgPipelineLayout
+{
+    uint32_t set_layout_count;
+};
+
+struct RgDescriptorSet
+{
+    RgDescriptorSetLayout *set_layout;
+};
+
+struct RgPipeline
+{
+    RgPipelineType type;
+};
+
+struct RgCmdPool
+{
+    RgQueueType type;
+};
+
+struct RgCmdBuffer
+{
+    RgDevice *device;
+    bool secondary;
+    bool recording;
+    RgRenderPass *current_render_pass;
+    // Only the command counters are used
+    RgNullStats counts;
+};
+
+struct RgUploadContext
+{
+    RgDevice *device;
+    uint64_t next_batch_id;
+};
+
+// Stats {{{
+static void rgNullAdd(uint64_t *counter, uint64_t value)
+{
+#if defined(_MSC_VER)
+    _InterlockedExchangeAdd64((volatile __int64 *)counter, (__int64)value);
+#else
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+#endif
+}
+
+static void rgNullSub(uint64_t *counter, uint64_t value)
+{
+    rgNullAdd(counter, (uint64_t)0 - value);
+}
+
+static uint64_t rgNullLoad(uint64_t *counter)
+{
+#if defined(_MSC_VER)
+    return (uint64_t)_InterlockedOr64((volatile __int64 *)counter, 0);
+#else
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+#endif
+}
+
+// The command counters are the fields from submit_count on
+static uint64_t *rgNullCommandCounters(RgNullStats *stats, size_t *count)
+{
+    *count = (sizeof(RgNullStats) - offsetof(RgNullStats, submit_count)) /
+             sizeof(uint64_t);
+    return &stats->submit_count;
+}
+
+static void rgNullAddCommands(RgNullStats *dst, RgNullStats *src, bool atomic)
+{
+    size_t count;
+    uint64_t *dst_counters = rgNullCommandCounters(dst, &count);
+    uint64_t *src_counters = rgNullCommandCounters(src, &count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (atomic)
+        {
+            rgNullAdd(&dst_counters[i], src_counters[i]);
+        }
+        else
+        {
+            dst_counters[i] += src_counters[i];
+        }
+    }
+}
+
+void rgNullGetStats(RgDevice *device, RgNullStats *stats)
+{
+    uint64_t *src = (uint64_t *)&device->stats;
+    uint64_t *dst = (uint64_t *)stats;
+    for (size_t i = 0; i < sizeof(RgNullStats) / sizeof(uint64_t); ++i)
+    {
+        dst[i] = rgNullLoad(&src[i]);
+    }
+}
+
+void rgNullResetStats(RgDevice *device)
+{
+    size_t count;
+    uint64_t *counters = rgNullCommandCounters(&device->stats, &count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        rgNullSub(&counters[i], rgNullLoad(&counters[i]));
+    }
+}
+// }}}
+
+// Device {{{
+RgDevice *rgDeviceCreate(const RgDeviceInfo *info)
+{
+    RgDevice *device = malloc(sizeof(*device));
+    memset(device, 0, sizeof(*device));
+    device->info = *info;
+    return device;
+}
+
+void rgDeviceDestroy(RgDevice *device)
+{
+    if (!device) return;
+    free(device);
+}
+
+void rgDeviceWaitIdle(RgDevice *device)
+{
+    (void)device;
+}
+
+void rgDeviceGetLimits(RgDevice *device, RgLimits *limits)
+{
+    (void)device;
+    // Common desktop values
+    limits->max_bound_descriptor_sets = 8;
+    limits->min_texel_buffer_offset_alignment = 16;
+    limits->min_uniform_buffer_offset_alignment = 256;
+    limits->min_storage_buffer_offset_alignment = 16;
+}
+
+bool rgDeviceSupportsLinearBlit(RgDevice *device, RgFormat format)
+{
+    (void)device;
+    (void)format;
+    return true;
+}
+
+bool rgDeviceSupportsSampledFormat(RgDevice *device, RgFormat format)
+{
+    (void)device;
+    (void)format;
+    return true;
+}
+
+// Nothing reaches a GPU, so there's nothing to replay
+bool rgDeviceBeginCapture(RgDevice *device)
+{
+    (void)device;
+    return false;
+}
+
+bool rgDeviceEndCapture(RgDevice *device, const char *path)
+{
+    (void)device;
+    (void)path;
+    return false;
+}
+// }}}
+
+// Buffer {{{
+RgBuffer *rgBufferCreate(RgDevice *device, const RgBufferInfo *info)
+{
+    assert(info->size > 0);
+
+    RgBuffer *buffer = malloc(sizeof(*buffer));
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->info = *info;
+
+    if (info->memory == RG_BUFFER_MEMORY_HOST)
+    {
+        buffer->memory = calloc(1, info->size);
+    }
+
+    rgNullAdd(&device->stats.buffer_count, 1);
+    rgNullAdd(&device->stats.buffer_bytes, info->size);
+    return buffer;
+}
+
+void rgBufferDestroy(RgDevice *device, RgBuffer *buffer)
+{
+    if (!buffer) return;
+
+    rgNullSub(&device->stats.buffer_count, 1);
+    rgNullSub(&device->stats.buffer_bytes, buffer->info.size);
+
+    free(buffer->memory);
+    free(buffer);
+}
+
+void *rgBufferMap(RgDevice *device, RgBuffer *buffer)
+{
+    (void)device;
+    assert(buffer->memory);
+    return buffer->memory;
+}
+
+void rgBufferUnmap(RgDevice *device, RgBuffer *buffer)
+{
+    (void)device;
+    (void)buffer;
+}
+
+void rgBufferUpload(
+        RgDevice *device,
+        RgCmdPool *cmd_pool,
+        RgBuffer *buffer,
+        size_t offset,
+        size_t size,
+        void *data)
+{
+    (void)cmd_pool;
+    assert(offset + size <= buffer->info.size);
+
+    if (buffer->memory)
+    {
+        memcpy((uint8_t *)buffer->memory + offset, data, size);
+    }
+
+    rgNullAdd(&device->stats.submit_count, 1);
+    rgNullAdd(&device->stats.copy_count, 1);
+    rgNullAdd(&device->stats.upload_bytes, size);
+}
+// }}}
+
+// Image {{{
+// Bytes of a texel, or of a 4x4 block for compressed formats
+static uint32_t rgFormatBlockSize(RgFormat format, bool *compressed)
+{
+    *compressed = false;
+    switch (format)
+    {
+    case RG_FORMAT_UNDEFINED: return 0;
+
+    case RG_FORMAT_R8_UNORM:
+    case RG_FORMAT_R8_UINT: return 1;
+    case RG_FORMAT_RG8_UNORM:
+    case RG_FORMAT_RG8_UINT:
+    case RG_FORMAT_R16_UINT:
+    case RG_FORMAT_R16_SFLOAT:
+    case RG_FORMAT_D16_UNORM: return 2;
+    case RG_FORMAT_RGB8_UNORM:
+    case RG_FORMAT_RGB8_UINT:
+    case RG_FORMAT_D16_UNORM_S8_UINT: return 3;
+    case RG_FORMAT_RGBA8_UNORM:
+    case RG_FORMAT_RGBA8_UINT:
+    case RG_FORMAT_BGRA8_UNORM:
+    case RG_FORMAT_BGRA8_SRGB:
+    case RG_FORMAT_RG16_UINT:
+    case RG_FORMAT_RG16_SFLOAT:
+    case RG_FORMAT_RG16_UNORM:
+    case RG_FORMAT_RG16_SNORM:
+    case RG_FORMAT_R32_UINT:
+    case RG_FORMAT_R32_SFLOAT:
+    case RG_FORMAT_D32_SFLOAT:
+    case RG_FORMAT_D24_UNORM_S8_UINT: return 4;
+    case RG_FORMAT_RGB16_UINT: return 6;
+    case RG_FORMAT_RGBA16_UINT:
+    case RG_FORMAT_RGBA16_SFLOAT:
+    case RG_FORMAT_RGBA16_UNORM:
+    case RG_FORMAT_RG32_UINT:
+    case RG_FORMAT_RG32_SFLOAT:
+    case RG_FORMAT_D32_SFLOAT_S8_UINT: return 8;
+    case RG_FORMAT_RGB32_UINT:
+    case RG_FORMAT_RGB32_SFLOAT: return 12;
+    case RG_FORMAT_RGBA32_UINT:
+    case RG_FORMAT_RGBA32_SFLOAT: return 16;
+
+    case RG_FORMAT_BC1_RGB_UNORM:
+    case RG_FORMAT_BC1_RGB_SRGB: *compressed = true; return 8;
+    case RG_FORMAT_BC5_UNORM:
+    case RG_FORMAT_BC7_UNORM:
+    case RG_FORMAT_BC7_SRGB: *compressed = true; return 16;
+    }
+
+    return 0;
+}
+
+static uint64_t rgImageComputeSize(const RgImageInfo *info)
+{
+    bool compressed;
+    uint64_t block_size = rgFormatBlockSize(info->format, &compressed);
+
+    uint64_t size = 0;
+    uint32_t width = info->extent.width;
+    uint32_t height = info->extent.height;
+    uint32_t depth = info->extent.depth;
+    for (uint32_t level = 0; level < info->mip_count; ++level)
+    {
+        uint64_t blocks_x = compressed ? (width + 3) / 4 : width;
+        uint64_t blocks_y = compressed ? (height + 3) / 4 : height;
+        size += blocks_x * blocks_y * depth * block_size;
+
+        width = RG_MAX(width / 2, 1);
+        height = RG_MAX(height / 2, 1);
+        depth = RG_MAX(depth / 2, 1);
+    }
+
+    return size * info->layer_count * RG_MAX(info->sample_count, 1);
+}
+
+RgImage *rgImageCreate(RgDevice *device, const RgImageInfo *info)
+{
+    RgImage *image = malloc(sizeof(*image));
+    memset(image, 0, sizeof(*image));
+    image->info = *info;
+    image->size = rgImageComputeSize(info);
+
+    rgNullAdd(&device->stats.image_count, 1);
+    rgNullAdd(&device->stats.image_bytes, image->size);
+    return image;
+}
+
+void rgImageDestroy(RgDevice *device, RgImage *image)
+{
+    if (!image) return;
+
+    rgNullSub(&device->stats.image_count, 1);
+    rgNullSub(&device->stats.image_bytes, image->size);
+    free(image);
+}
+
+void rgImageUpload(
+    RgDevice *device,
+    RgCmdPool *cmd_pool,
+    RgImageCopy *dst,
+    RgExtent3D *extent,
+    size_t size,
+    void *data)
+{
+    (void)cmd_pool;
+    (void)dst;
+    (void)extent;
+    (void)data;
+
+    rgNullAdd(&device->stats.submit_count, 1);
+    rgNullAdd(&device->stats.copy_count, 1);
+    rgNullAdd(&device->stats.upload_bytes, size);
+}
+
+void rgImageUploadBatch(
+    RgDevice *device,
+    RgCmdPool *cmd_pool,
+    uint32_t upload_count,
+    RgImageUploadInfo *uploads)
+{
+    (void)cmd_pool;
+
+    rgNullAdd(&device->stats.submit_count, 1);
+    for (uint32_t i = 0; i < upload_count; ++i)
+    {
+        rgNullAdd(&device->stats.copy_count, 1);
+        rgNullAdd(&device->stats.upload_bytes, uploads[i].size);
+    }
+}
+// }}}
+
+// Sampler {{{
+RgSampler *rgSamplerCreate(RgDevice *device, RgSamplerInfo *info)
+{
+    RgSampler *sampler = malloc(sizeof(*sampler));
+    sampler->info = *info;
+    rgNullAdd(&device->stats.sampler_count, 1);
+    return sampler;
+}
+
+void rgSamplerDestroy(RgDevice *device, RgSampler *sampler)
+{
+    if (!sampler) return;
+    rgNullSub(&device->stats.sampler_count, 1);
+    free(sampler);
+}
+// }}}
+
+// Swapchain {{{
+RgSwapchain *rgSwapchainCreate(RgDevice *device, const RgSwapchainInfo *info)
+{
+    assert(!device->info.headless);
+
+    RgSwapchain *swapchain = malloc(sizeof(*swapchain));
+    memset(swapchain, 0, sizeof(*swapchain));
+    swapchain->device = device;
+    swapchain->info = *info;
+    swapchain->info.old_swapchain = NULL;
+    swapchain->render_pass.width = info->width;
+    swapchain->render_pass.height = info->height;
+    swapchain->render_pass.color_attachment_count = 1;
+    swapchain->render_pass.has_depth_stencil =
+        info->depth_format != RG_FORMAT_UNDEFINED;
+    return swapchain;
+}
+
+void rgSwapchainDestroy(RgDevice *device, RgSwapchain *swapchain)
+{
+    (void)device;
+    free(swapchain);
+}
+
+RgRenderPass *rgSwapchainGetRenderPass(RgSwapchain *swapchain)
+{
+    return &swapchain->render_pass;
+}
+
+void rgSwapchainWaitForCommands(RgSwapchain *swapchain, RgCmdBuffer *wait_cmd_buffer)
+{
+    (void)swapchain;
+    (void)wait_cmd_buffer;
+}
+
+void rgSwapchainAcquireImage(RgSwapchain *swapchain)
+{
+    (void)swapchain;
+}
+
+void rgSwapchainPresent(RgSwapchain *swapchain)
+{
+    rgNullAdd(&swapchain->device->stats.present_count, 1);
+}
+// }}}
+
+// Render pass {{{
+RgRenderPass *rgRenderPassCreate(RgDevice *device, const RgRenderPassInfo *info)
+{
+    RgImage *first = info->color_attachment_count > 0 ? info->color_attachments[0]
+                                                      : info->depth_stencil_attachment;
+    assert(first);
+
+    RgRenderPass *render_pass = malloc(sizeof(*render_pass));
+    memset(render_pass, 0, sizeof(*render_pass));
+    render_pass->width = first->info.extent.width;
+    render_pass->height = first->info.extent.height;
+    render_pass->color_attachment_count = info->color_attachment_count;
+    render_pass->has_depth_stencil = info->depth_stencil_attachment != NULL;
+
+    rgNullAdd(&device->stats.render_pass_count, 1);
+    return render_pass;
+}
+
+void rgRenderPassDestroy(RgDevice *device, RgRenderPass *render_pass)
+{
+    if (!render_pass) return;
+    rgNullSub(&device->stats.render_pass_count, 1);
+    free(render_pass);
+}
+// }}}
+
+// Descriptors and pipelines {{{
+RgDescriptorSetLayout *rgDescriptorSetLayoutCreate(
+        RgDevice *device, const RgDescriptorSetLayoutInfo *info)
+{
+    (void)device;
+    RgDescriptorSetLayout *set_layout = malloc(sizeof(*set_layout));
+    set_layout->entry_count = info->entry_count;
+    return set_layout;
+}
+
+void rgDescriptorSetLayoutDestroy(RgDevice *device, RgDescriptorSetLayout *set_layout)
+{
+    (void)device;
+    free(set_layout);
+}
+
+RgPipelineLayout *rgPipelineLayoutCreate(
+        RgDevice *device, const RgPipelineLayoutInfo *info)
+{
+    (void)device;
+    RgPipelineLayout *pipeline_layout = malloc(sizeof(*pipeline_layout));
+    pipeline_layout->set_layout_count = info->set_layout_count;
+    return pipeline_layout;
+}
+
+void rgPipelineLayoutDestroy(RgDevice *device, RgPipelineLayout *pipeline_layout)
+{
+    (void)device;
+    free(pipeline_layout);
+}
+
+RgDescriptorSet *rgDescriptorSetCreate(
+        RgDevice *device, RgDescriptorSetLayout *set_layout)
+{
+    RgDescriptorSet *descriptor_set = malloc(sizeof(*descriptor_set));
+    descriptor_set->set_layout = set_layout;
+    rgNullAdd(&device->stats.descriptor_set_count, 1);
+    return descriptor_set;
+}
+
+void rgDescriptorSetUpdate(
+    RgDevice *device,
+    RgDescriptorSet *descriptor_set,
+    const RgDescriptorUpdateInfo *entries,
+    uint32_t entry_count)
+{
+    (void)descriptor_set;
+    for (uint32_t i = 0; i < entry_count; ++i)
+    {
+        rgNullAdd(&device->stats.descriptor_write_count, entries[i].descriptor_count);
+    }
+}
+
+void rgDescriptorSetDestroy(RgDevice *device, RgDescriptorSet *descriptor_set)
+{
+    if (!descriptor_set) return;
+    rgNullSub(&device->stats.descriptor_set_count, 1);
+    free(descriptor_set);
+}
+
+RgPipeline *rgGraphicsPipelineCreate(RgDevice *device, const RgGraphicsPipelineInfo *info)
+{
+    assert(info->vertex && info->vertex_size > 0);
+
+    RgPipeline *pipeline = malloc(sizeof(*pipeline));
+    pipeline->type = RG_PIPELINE_TYPE_GRAPHICS;
+    rgNullAdd(&device->stats.pipeline_count, 1);
+    return pipeline;
+}
+
+RgPipeline *rgComputePipelineCreate(RgDevice *device, const RgComputePipelineInfo *info)
+{
+    assert(info->code && info->code_size > 0);
+
+    RgPipeline *pipeline = malloc(sizeof(*pipeline));
+    pipeline->type = RG_PIPELINE_TYPE_COMPUTE;
+    rgNullAdd(&device->stats.pipeline_count, 1);
+    return pipeline;
+}
+
+void rgPipelineDestroy(RgDevice *device, RgPipeline *pipeline)
+{
+    if (!pipeline) return;
+    rgNullSub(&device->stats.pipeline_count, 1);
+    free(pipeline);
+}
+// }}}
+
+// Command buffers {{{
+RgCmdPool *rgCmdPoolCreate(RgDevice *device, RgQueueType type)
+{
+    (void)device;
+    RgCmdPool *cmd_pool = malloc(sizeof(*cmd_pool));
+    cmd_pool->type = type;
+    return cmd_pool;
+}
+
+void rgCmdPoolDestroy(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    (void)device;
+    free(cmd_pool);
+}
+
+void rgCmdPoolReset(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    (void)device;
+    (void)cmd_pool;
+}
+
+static RgCmdBuffer *rgCmdBufferAllocate(RgDevice *device, bool secondary)
+{
+    RgCmdBuffer *cmd_buffer = malloc(sizeof(*cmd_buffer));
+    memset(cmd_buffer, 0, sizeof(*cmd_buffer));
+    cmd_buffer->device = device;
+    cmd_buffer->secondary = secondary;
+    rgNullAdd(&device->stats.cmd_buffer_count, 1);
+    return cmd_buffer;
+}
+
+RgCmdBuffer *rgCmdBufferCreate(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    (void)cmd_pool;
+    return rgCmdBufferAllocate(device, false);
+}
+
+RgCmdBuffer *rgCmdBufferCreateSecondary(RgDevice *device, RgCmdPool *cmd_pool)
+{
+    (void)cmd_pool;
+    return rgCmdBufferAllocate(device, true);
+}
+
+void rgCmdBufferDestroy(RgDevice *device, RgCmdPool *cmd_pool, RgCmdBuffer *cmd_buffer)
+{
+    (void)cmd_pool;
+    if (!cmd_buffer) return;
+    rgNullSub(&device->stats.cmd_buffer_count, 1);
+    free(cmd_buffer);
+}
+
+void rgCmdBufferBegin(RgCmdBuffer *cmd_buffer)
+{
+    assert(!cmd_buffer->secondary);
+    memset(&cmd_buffer->counts, 0, sizeof(cmd_buffer->counts));
+    cmd_buffer->current_render_pass = NULL;
+    cmd_buffer->recording = true;
+}
+
+void rgCmdBufferBeginSecondary(RgCmdBuffer *cmd_buffer, RgRenderPass *render_pass)
+{
+    assert(cmd_buffer->secondary);
+    memset(&cmd_buffer->counts, 0, sizeof(cmd_buffer->counts));
+    cmd_buffer->current_render_pass = render_pass;
+    cmd_buffer->recording = true;
+}
+
+void rgCmdBufferEnd(RgCmdBuffer *cmd_buffer)
+{
+    assert(cmd_buffer->recording);
+    cmd_buffer->current_render_pass = NULL;
+    cmd_buffer->recording = false;
+}
+
+void rgCmdBufferWaitForPresent(RgCmdBuffer *cmd_buffer, RgSwapchain *swapchain)
+{
+    (void)cmd_buffer;
+    (void)swapchain;
+}
+
+void rgCmdBufferWaitForCommands(RgCmdBuffer *cmd_buffer, RgCmdBuffer *wait_cmd_buffer)
+{
+    (void)cmd_buffer;
+    (void)wait_cmd_buffer;
+}
+
+void rgCmdBufferWait(RgDevice *device, RgCmdBuffer *cmd_buffer)
+{
+    (void)device;
+    (void)cmd_buffer;
+}
+
+double rgCmdBufferGetGpuTime(RgDevice *device, RgCmdBuffer *cmd_buffer)
+{
+    (void)device;
+    (void)cmd_buffer;
+    return 0.0;
+}
+
+void rgCmdBufferSubmit(RgCmdBuffer *cmd_buffer)
+{
+    assert(!cmd_buffer->secondary);
+    assert(!cmd_buffer->recording);
+
+    RgDevice *device = cmd_buffer->device;
+    rgNullAdd(&device->stats.submit_count, 1);
+    rgNullAddCommands(&device->stats, &cmd_buffer->counts, true);
+}
+
+void rgCmdBufferSubmitFenceOnly(RgCmdBuffer *cmd_buffer)
+{
+    rgCmdBufferSubmit(cmd_buffer);
+}
+// }}}
+
+// Upload context {{{
+RgUploadContext *rgUploadContextCreate(RgDevice *device, const RgUploadContextInfo *info)
+{
+    (void)info;
+    RgUploadContext *ctx = malloc(sizeof(*ctx));
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->device = device;
+    ctx->next_batch_id = 1;
+    return ctx;
+}
+
+void rgUploadContextDestroy(RgDevice *device, RgUploadContext *ctx)
+{
+    (void)device;
+    free(ctx);
+}
+
+void rgUploadBuffer(
+    RgUploadContext *ctx, RgBuffer *buffer, size_t offset, size_t size, const void *data)
+{
+    assert(offset + size <= buffer->info.size);
+
+    if (buffer->memory)
+    {
+        memcpy((uint8_t *)buffer->memory + offset, data, size);
+    }
+
+    rgNullAdd(&ctx->device->stats.copy_count, 1);
+    rgNullAdd(&ctx->device->stats.upload_bytes, size);
+}
+
+void rgUploadImage(
+    RgUploadContext *ctx,
+    RgImageCopy *dst,
+    RgExtent3D *extent,
+    size_t size,
+    const void *data)
+{
+    (void)dst;
+    (void)extent;
+    (void)data;
+
+    rgNullAdd(&ctx->device->stats.copy_count, 1);
+    rgNullAdd(&ctx->device->stats.upload_bytes, size);
+}
+
+uint64_t rgUploadContextSubmit(RgUploadContext *ctx)
+{
+    // Nothing runs, so every batch is complete as soon as it's submitted
+    rgNullAdd(&ctx->device->stats.submit_count, 1);
+    return ctx->next_batch_id++;
+}
+
+void rgUploadGenerateMipmaps(RgUploadContext *ctx, RgImage *image)
+{
+    (void)ctx;
+    (void)image;
+}
+
+bool rgUploadContextIsComplete(RgUploadContext *ctx, uint64_t batch_id)
+{
+    (void)ctx;
+    (void)batch_id;
+    return true;
+}
+
+void rgUploadContextWait(RgUploadContext *ctx, uint64_t batch_id)
+{
+    (void)ctx;
+    (void)batch_id;
+}
+// }}}
+
+// Commands {{{
+void rgCmdBindPipeline(RgCmdBuffer *cmd_buffer, RgPipeline *pipeline)
+{
+    assert(cmd_buffer->recording);
+    assert(pipeline->type == RG_PIPELINE_TYPE_COMPUTE || cmd_buffer->current_render_pass);
+    cmd_buffer->counts.pipeline_bind_count++;
+}
+
+void rgCmdPushConstants(
+        RgCmdBuffer *cmd_buffer,
+        size_t offset,
+        size_t size,
+        const void *data)
+{
+    (void)offset;
+    (void)data;
+    assert(cmd_buffer->recording);
+    cmd_buffer->counts.push_constant_count++;
+    cmd_buffer->counts.push_constant_bytes += size;
+}
+
+void rgCmdBindDescriptorSet(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t index,
+        RgDescriptorSet *set,
+        uint32_t dynamic_offset_count,
+        uint32_t *dynamic_offsets)
+{
+    (void)index;
+    (void)set;
+    (void)dynamic_offset_count;
+    (void)dynamic_offsets;
+    assert(cmd_buffer->recording);
+    cmd_buffer->counts.descriptor_set_bind_count++;
+}
+
+void rgCmdSetRenderPass(
+        RgCmdBuffer *cmd_buffer,
+        RgRenderPass *render_pass,
+        uint32_t clear_value_count,
+        RgClearValue *clear_values)
+{
+    (void)clear_value_count;
+    (void)clear_values;
+    assert(cmd_buffer->recording && !cmd_buffer->secondary);
+    cmd_buffer->current_render_pass = render_pass;
+    cmd_buffer->counts.render_pass_begin_count++;
+}
+
+void rgCmdSetRenderPassSecondary(
+        RgCmdBuffer *cmd_buffer,
+        RgRenderPass *render_pass,
+        uint32_t clear_value_count,
+        RgClearValue *clear_values)
+{
+    rgCmdSetRenderPass(cmd_buffer, render_pass, clear_value_count, clear_values);
+}
+
+void rgCmdExecuteCommands(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t secondary_count,
+        RgCmdBuffer **secondaries)
+{
+    assert(!cmd_buffer->secondary);
+    assert(cmd_buffer->current_render_pass);
+
+    for (uint32_t i = 0; i < secondary_count; ++i)
+    {
+        assert(secondaries[i]->secondary && !secondaries[i]->recording);
+        rgNullAddCommands(&cmd_buffer->counts, &secondaries[i]->counts, false);
+    }
+    cmd_buffer->counts.secondary_execute_count += secondary_count;
+}
+
+void rgCmdBindVertexBuffer(
+        RgCmdBuffer *cmd_buffer,
+        RgBuffer *vertex_buffer,
+        size_t offset)
+{
+    (void)offset;
+    assert(vertex_buffer->info.usage & RG_BUFFER_USAGE_VERTEX);
+    cmd_buffer->counts.vertex_buffer_bind_count++;
+}
+
+void rgCmdBindIndexBuffer(
+        RgCmdBuffer *cmd_buffer,
+        RgBuffer *index_buffer,
+        size_t offset,
+        RgIndexType index_type)
+{
+    (void)offset;
+    (void)index_type;
+    assert(index_buffer->info.usage & RG_BUFFER_USAGE_INDEX);
+    cmd_buffer->counts.index_buffer_bind_count++;
+}
+
+void rgCmdDraw(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t vertex_count,
+        uint32_t instance_count,
+        uint32_t first_vertex,
+        uint32_t first_instance)
+{
+    (void)first_vertex;
+    (void)first_instance;
+    assert(cmd_buffer->current_render_pass);
+    cmd_buffer->counts.draw_count++;
+    cmd_buffer->counts.vertex_count += (uint64_t)vertex_count * instance_count;
+}
+
+void rgCmdDrawIndexed(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t index_count,
+        uint32_t instance_count,
+        uint32_t first_index,
+        int32_t  vertex_offset,
+        uint32_t first_instance)
+{
+    (void)first_index;
+    (void)vertex_offset;
+    (void)first_instance;
+    assert(cmd_buffer->current_render_pass);
+    cmd_buffer->counts.draw_count++;
+    cmd_buffer->counts.vertex_count += (uint64_t)index_count * instance_count;
+}
+
+void rgCmdGenerateMipmaps(RgCmdBuffer *cmd_buffer, RgImage *image)
+{
+    assert(image->info.usage & RG_IMAGE_USAGE_TRANSFER_SRC);
+    assert(image->info.usage & RG_IMAGE_USAGE_TRANSFER_DST);
+    if (image->info.mip_count <= 1) return;
+
+    cmd_buffer->counts.copy_count += image->info.mip_count - 1;
+    cmd_buffer->counts.barrier_count += 2 * (image->info.mip_count - 1) + 1;
+}
+
+void rgCmdDispatch(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t group_count_x,
+        uint32_t group_count_y,
+        uint32_t group_count_z)
+{
+    (void)group_count_x;
+    (void)group_count_y;
+    (void)group_count_z;
+    assert(cmd_buffer->recording && !cmd_buffer->current_render_pass);
+    cmd_buffer->counts.dispatch_count++;
+}
+
+void rgCmdMemoryBarrier(
+        RgCmdBuffer *cmd_buffer,
+        uint32_t src_stages,
+        uint32_t dst_stages)
+{
+    assert(!cmd_buffer->current_render_pass);
+    assert(src_stages != 0 && dst_stages != 0);
+    cmd_buffer->counts.barrier_count++;
+}
+
+void rgCmdCopyImageToBuffer(
+        RgCmdBuffer *cmd_buffer,
+        const RgImageCopy *src,
+        const RgBufferCopy *dst,
+        RgExtent3D extent)
+{
+    (void)extent;
+    assert(!cmd_buffer->secondary);
+    assert(src->image->info.usage & RG_IMAGE_USAGE_TRANSFER_SRC);
+    assert(dst->buffer->info.usage & RG_BUFFER_USAGE_TRANSFER_DST);
+
+    // The buffer keeps its contents, there's no image data to copy
+    cmd_buffer->current_render_pass = NULL;
+    cmd_buffer->counts.copy_count++;
+    cmd_buffer->counts.barrier_count += 2;
+}
+// }}}
@@ -0,0 +1,61 @@
+#ifndef RG_NULL_H
+#define RG_NULL_H
+
+#include "rg.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The null backend (rg_null.c, built instead of rg.c with the RG_NULL_BACKEND
+// CMake option) implements rg.h without a GPU. Objects are tracked, host
+// buffers get real memory and commands are only counted, so the CPU cost of
+// everything above rg can be measured on machines without Vulkan.
+
+typedef struct RgNullStats
+{
+    // Objects alive
+    uint64_t buffer_count;
+    uint64_t image_count;
+    uint64_t sampler_count;
+    uint64_t pipeline_count;
+    uint64_t render_pass_count;
+    uint64_t descriptor_set_count;
+    uint64_t cmd_buffer_count;
+    // Memory the buffers and images alive would take on a device
+    uint64_t buffer_bytes;
+    uint64_t image_bytes;
+
+    // Counted since the device was created or the last rgNullResetStats.
+    // Commands count once their command buffer is submitted, secondary
+    // command buffers as part of the primary that executes them.
+    uint64_t submit_count;
+    uint64_t present_count;
+    uint64_t render_pass_begin_count;
+    uint64_t secondary_execute_count;
+    uint64_t pipeline_bind_count;
+    uint64_t descriptor_set_bind_count;
+    uint64_t vertex_buffer_bind_count;
+    uint64_t index_buffer_bind_count;
+    uint64_t push_constant_count;
+    uint64_t push_constant_bytes;
+    uint64_t draw_count;
+    // Vertices or indices of every instance of every draw
+    uint64_t vertex_count;
+    uint64_t dispatch_count;
+    uint64_t barrier_count;
+    uint64_t copy_count;
+    uint64_t descriptor_write_count;
+    // Through rgBufferUpload, rgImageUpload and upload contexts
+    uint64_t upload_bytes;
+} RgNullStats;
+
+void rgNullGetStats(RgDevice *device, RgNullStats *stats);
+// Zeroes the counters, the object counts are kept
+void rgNullResetStats(RgDevice *device);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RG_NULL_H
@@ -0,0 +1,495 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <renderer/allocator.h>
+#include <renderer/job_system.h>
+#include <renderer/math.h>
+#include <renderer/meshlet.h>
+#include <renderer/model_asset.h>
+#include <renderer/scene.h>
+#include <renderer/thread.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Moves every instance of a large scene each frame, keeps the BVH of the scene
+// up to date and times frustum, sphere and ray queries against linear scans of
+// the scene arrays. Both sides test the same boxes around the instance spheres
+// and must agree. Needs no window or GPU.
+
+enum {
+    INSTANCE_COUNT = 100000,
+    FRUSTUM_QUERIES = 4, // Per frame, and the same for the others
+    SPHERE_QUERIES = 64,
+    RAY_QUERIES = 256,
+};
+
+#define WORLD_SIZE 1000.0f // Side of the cube the instances move in
+#define MAX_SPEED 2.0f     // Per frame and axis
+#define SPHERE_RADIUS 20.0f
+
+static double GetMonotonicTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static uint32_t rng_state = 0x12345678;
+
+// In [0, 1)
+static float RandomFloat(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return (float)(rng_state >> 8) / (float)(1 << 24);
+}
+
+static float RandomRange(float min, float max)
+{
+    return min + (max - min) * RandomFloat();
+}
+
+// Stand-in model {{{
+// The scene only asks models for their bounds and queues them for rendering,
+// so the benchmark links these instead of model_asset.c and the engine
+struct EgModelAsset
+{
+    float3 center;
+    float radius;
+};
+
+bool egModelAssetGetBounds(EgModelAsset *model, float3 *center, float *radius)
+{
+    *center = model->center;
+    *radius = model->radius;
+    return true;
+}
+
+void egModelAssetQueueRender(EgModelAsset *model, float4x4 *transform)
+{
+    (void)model;
+    (void)transform;
+}
+// }}}
+
+// Linear scans {{{
+// Same tests as bvh.c, on the boxes the scene gives the BVH
+static void InstanceBox(const EgSceneArrays *arrays, size_t i, float3 *min, float3 *max)
+{
+    float r = arrays->radius[i];
+    *min = V3(arrays->center_x[i] - r, arrays->center_y[i] - r, arrays->center_z[i] - r);
+    *max = V3(arrays->center_x[i] + r, arrays->center_y[i] + r, arrays->center_z[i] + r);
+}
+
+static size_t LinearFrustum(
+    const EgSceneArrays *arrays, const float4x4 *view_proj, EgSceneHandle *handles)
+{
+    EgMeshletCuller culler;
+    egMeshletCullerInit(&culler, view_proj, V3(0.0f, 0.0f, 0.0f));
+
+    size_t count = 0;
+    for (size_t i = 0; i < arrays->count; ++i)
+    {
+        if (arrays->radius[i] < 0.0f) continue;
+
+        float3 min, max;
+        InstanceBox(arrays, i, &min, &max);
+        bool inside = true;
+        for (uint32_t p = 0; p < 6 && inside; ++p)
+        {
+            float px = culler.plane_x[p];
+            float py = culler.plane_y[p];
+            float pz = culler.plane_z[p];
+            float furthest = px * (px > 0.0f ? max.x : min.x) +
+                             py * (py > 0.0f ? max.y : min.y) +
+                             pz * (pz > 0.0f ? max.z : min.z) + culler.plane_w[p];
+            inside = furthest >= 0.0f;
+        }
+        if (inside) handles[count++] = arrays->handles[i];
+    }
+    return count;
+}
+
+static size_t LinearSphere(
+    const EgSceneArrays *arrays, float3 center, float radius, EgSceneHandle *handles)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < arrays->count; ++i)
+    {
+        if (arrays->radius[i] < 0.0f) continue;
+
+        float3 min, max;
+        InstanceBox(arrays, i, &min, &max);
+        float3 closest = V3(
+            EG_CLAMP(center.x, min.x, max.x),
+            EG_CLAMP(center.y, min.y, max.y),
+            EG_CLAMP(center.z, min.z, max.z));
+        float3 offset = egFloat3Sub(closest, center);
+        if (egFloat3Dot(offset, offset) <= radius * radius)
+        {
+            handles[count++] = arrays->handles[i];
+        }
+    }
+    return count;
+}
+
+static bool LinearRaycast(
+    const EgSceneArrays *arrays,
+    float3 origin,
+    float3 direction,
+    float max_distance,
+    float *distance)
+{
+    float3 inverse_direction =
+        V3(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+    float best = max_distance;
+    bool hit = false;
+    for (size_t i = 0; i < arrays->count; ++i)
+    {
+        if (arrays->radius[i] < 0.0f) continue;
+
+        float3 min, max;
+        InstanceBox(arrays, i, &min, &max);
+        float tx0 = (min.x - origin.x) * inverse_direction.x;
+        float tx1 = (max.x - origin.x) * inverse_direction.x;
+        float ty0 = (min.y - origin.y) * inverse_direction.y;
+        float ty1 = (max.y - origin.y) * inverse_direction.y;
+        float tz0 = (min.z - origin.z) * inverse_direction.z;
+        float tz1 = (max.z - origin.z) * inverse_direction.z;
+        float enter =
+            EG_MAX(EG_MAX(EG_MIN(tx0, tx1), EG_MIN(ty0, ty1)), EG_MIN(tz0, tz1));
+        float exit =
+            EG_MIN(EG_MIN(EG_MAX(tx0, tx1), EG_MAX(ty0, ty1)), EG_MAX(tz0, tz1));
+        enter = EG_MAX(enter, 0.0f);
+        if (exit >= enter && enter <= best)
+        {
+            best = enter;
+            hit = true;
+        }
+    }
+    *distance = best;
+    return hit;
+}
+// }}}
+
+// Queries {{{
+typedef struct Queries
+{
+    float4x4 view_projs[FRUSTUM_QUERIES];
+    float3 sphere_centers[SPHERE_QUERIES];
+    float3 ray_origins[RAY_QUERIES];
+    float3 ray_directions[RAY_QUERIES];
+} Queries;
+
+static float3 RandomPoint(void)
+{
+    float half = WORLD_SIZE * 0.5f;
+    return V3(
+        RandomRange(-half, half), RandomRange(-half, half), RandomRange(-half, half));
+}
+
+// Cameras on a circle around the world looking at its center, spheres and rays
+// anywhere in it
+static void MakeQueries(Queries *queries, uint32_t frame)
+{
+    float4x4 correction_matrix = egFloat4x4Diagonal(1.0f);
+    correction_matrix.yy = -1.0f;
+    float4x4 proj = egFloat4x4PerspectiveReserveZ(1.0f, 16.0f / 9.0f, 0.1f);
+    proj = egFloat4x4Mul(&correction_matrix, &proj);
+
+    for (uint32_t i = 0; i < FRUSTUM_QUERIES; ++i)
+    {
+        float angle = (float)frame * 0.01f + (float)i * 6.2831853f / FRUSTUM_QUERIES;
+        float3 eye = V3(cosf(angle) * WORLD_SIZE, 0.0f, sinf(angle) * WORLD_SIZE);
+        float4x4 view =
+            egFloat4x4LookAt(eye, V3(0.0f, 0.0f, 0.0f), V3(0.0f, 1.0f, 0.0f));
+        queries->view_projs[i] = egFloat4x4Mul(&view, &proj);
+    }
+
+    for (uint32_t i = 0; i < SPHERE_QUERIES; ++i)
+    {
+        queries->sphere_centers[i] = RandomPoint();
+    }
+
+    for (uint32_t i = 0; i < RAY_QUERIES; ++i)
+    {
+        queries->ray_origins[i] = RandomPoint();
+        float3 direction = V3(
+            RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f), RandomRange(-1.0f, 1.0f));
+        queries->ray_directions[i] = egFloat3Normalize(direction);
+    }
+}
+// }}}
+
+typedef enum Timer
+{
+    TIMER_SET_TRANSFORMS,
+    TIMER_UPDATE_BVH,
+    TIMER_REFIT,
+    TIMER_BVH_FRUSTUM,
+    TIMER_BVH_SPHERE,
+    TIMER_BVH_RAY,
+    TIMER_LINEAR_FRUSTUM,
+    TIMER_LINEAR_SPHERE,
+    TIMER_LINEAR_RAY,
+    TIMER_COUNT,
+} Timer;
+
+typedef struct Bench
+{
+    EgScene *scene;
+    EgSceneHandle *instances;
+    float4x4 *transforms;
+    float3 *velocities;
+    EgSceneHandle *bvh_handles;
+    EgSceneHandle *linear_handles;
+    double times[TIMER_COUNT];
+    size_t hit_count; // Of the rays, to show the queries find something
+    size_t sphere_result_count;
+} Bench;
+
+static void Mismatch(const char *query, uint32_t frame, uint32_t index)
+{
+    fprintf(
+        stderr,
+        "%s query %u of frame %u differs from the linear scan\n",
+        query,
+        index,
+        frame);
+    exit(1);
+}
+
+// Bounces the instances off the sides of the world
+static void MoveInstances(Bench *bench)
+{
+    float half = WORLD_SIZE * 0.5f;
+    for (uint32_t i = 0; i < INSTANCE_COUNT; ++i)
+    {
+        float *position = &bench->transforms[i].wx;
+        float *velocity = &bench->velocities[i].x;
+        for (uint32_t axis = 0; axis < 3; ++axis)
+        {
+            position[axis] += velocity[axis];
+            if (position[axis] < -half || position[axis] > half)
+            {
+                velocity[axis] = -velocity[axis];
+                position[axis] = EG_CLAMP(position[axis], -half, half);
+            }
+        }
+    }
+}
+
+static void RunFrame(Bench *bench, EgJobSystem *job_system, uint32_t frame)
+{
+    MoveInstances(bench);
+
+    double start_time = GetMonotonicTime();
+    for (uint32_t i = 0; i < INSTANCE_COUNT; ++i)
+    {
+        egSceneSetTransform(bench->scene, bench->instances[i], &bench->transforms[i]);
+    }
+    double time = GetMonotonicTime();
+    bench->times[TIMER_SET_TRANSFORMS] += time - start_time;
+
+    start_time = time;
+    egSceneUpdateBvh(bench->scene, job_system);
+    time = GetMonotonicTime();
+    bench->times[TIMER_UPDATE_BVH] += time - start_time;
+
+    // The first query of a frame refits the tree, an empty one outside the
+    // world keeps that cost apart from the timed queries
+    start_time = time;
+    egSceneQuerySphere(bench->scene, V3(0.0f, WORLD_SIZE * 2.0f, 0.0f), 0.0f, NULL, 0);
+    time = GetMonotonicTime();
+    bench->times[TIMER_REFIT] += time - start_time;
+
+    Queries queries;
+    MakeQueries(&queries, frame);
+    EgSceneArrays arrays = egSceneGetArrays(bench->scene);
+
+    for (uint32_t i = 0; i < FRUSTUM_QUERIES; ++i)
+    {
+        start_time = GetMonotonicTime();
+        size_t bvh_count = egSceneQueryFrustum(
+            bench->scene, &queries.view_projs[i], bench->bvh_handles, INSTANCE_COUNT);
+        time = GetMonotonicTime();
+        bench->times[TIMER_BVH_FRUSTUM] += time - start_time;
+
+        start_time = time;
+        size_t linear_count =
+            LinearFrustum(&arrays, &queries.view_projs[i], bench->linear_handles);
+        bench->times[TIMER_LINEAR_FRUSTUM] += GetMonotonicTime() - start_time;
+
+        if (bvh_count != linear_count) Mismatch("Frustum", frame, i);
+    }
+
+    for (uint32_t i = 0; i < SPHERE_QUERIES; ++i)
+    {
+        float3 center = queries.sphere_centers[i];
+        start_time = GetMonotonicTime();
+        size_t bvh_count = egSceneQuerySphere(
+            bench->scene, center, SPHERE_RADIUS, bench->bvh_handles, INSTANCE_COUNT);
+        time = GetMonotonicTime();
+        bench->times[TIMER_BVH_SPHERE] += time - start_time;
+
+        start_time = time;
+        size_t linear_count =
+            LinearSphere(&arrays, center, SPHERE_RADIUS, bench->linear_handles);
+        bench->times[TIMER_LINEAR_SPHERE] += GetMonotonicTime() - start_time;
+
+        if (bvh_count != linear_count) Mismatch("Sphere", frame, i);
+        bench->sphere_result_count += bvh_count;
+    }
+
+    for (uint32_t i = 0; i < RAY_QUERIES; ++i)
+    {
+        float3 origin = queries.ray_origins[i];
+        float3 direction = queries.ray_directions[i];
+        EgSceneHandle handle;
+        float bvh_distance = WORLD_SIZE * 2.0f;
+        start_time = GetMonotonicTime();
+        bool bvh_hit = egSceneRaycast(
+            bench->scene, origin, direction, WORLD_SIZE * 2.0f, &handle, &bvh_distance);
+        time = GetMonotonicTime();
+        bench->times[TIMER_BVH_RAY] += time - start_time;
+
+        float linear_distance;
+        start_time = time;
+        bool linear_hit = LinearRaycast(
+            &arrays, origin, direction, WORLD_SIZE * 2.0f, &linear_distance);
+        bench->times[TIMER_LINEAR_RAY] += GetMonotonicTime() - start_time;
+
+        // Ties can pick different instances, the distance is the same
+        if (bvh_hit != linear_hit || (bvh_hit && bvh_distance != linear_distance))
+        {
+            Mismatch("Ray", frame, i);
+        }
+        bench->hit_count += bvh_hit;
+    }
+}
+
+static void PrintUsage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: bvh_bench [frames] [threads]\n"
+        "  Moves %u instances for frames frames (default 30), rebuilding the\n"
+        "  BVH on a job system of threads threads (default: one per\n"
+        "  processor, 1 rebuilds on the main thread)\n",
+        INSTANCE_COUNT);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    uint32_t frame_count = 30;
+    uint32_t thread_count = egGetCpuCount();
+    if (argc >= 2) frame_count = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (argc >= 3) thread_count = (uint32_t)strtoul(argv[2], NULL, 10);
+    if (frame_count == 0 || thread_count == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    EgJobSystem *job_system = NULL;
+    if (thread_count > 1)
+    {
+        EgJobSystemInfo info = {.worker_count = thread_count - 1};
+        job_system = egJobSystemCreate(NULL, &info);
+    }
+
+    EgModelAsset model = {V3(0.0f, 0.0f, 0.0f), 1.0f};
+    Bench bench = {
+        .scene = egSceneCreate(NULL, INSTANCE_COUNT),
+        .instances = (EgSceneHandle *)egAllocate(
+            NULL, sizeof(EgSceneHandle) * INSTANCE_COUNT),
+        .transforms = (float4x4 *)egAllocate(NULL, sizeof(float4x4) * INSTANCE_COUNT),
+        .velocities = (float3 *)egAllocate(NULL, sizeof(float3) * INSTANCE_COUNT),
+        .bvh_handles = (EgSceneHandle *)egAllocate(
+            NULL, sizeof(EgSceneHandle) * INSTANCE_COUNT),
+        .linear_handles = (EgSceneHandle *)egAllocate(
+            NULL, sizeof(EgSceneHandle) * INSTANCE_COUNT),
+    };
+
+    for (uint32_t i = 0; i < INSTANCE_COUNT; ++i)
+    {
+        bench.transforms[i] = egFloat4x4Diagonal(RandomRange(0.5f, 2.0f));
+        bench.transforms[i].ww = 1.0f;
+        egFloat4x4Translate(&bench.transforms[i], RandomPoint());
+        bench.velocities[i] = V3(
+            RandomRange(-MAX_SPEED, MAX_SPEED),
+            RandomRange(-MAX_SPEED, MAX_SPEED),
+            RandomRange(-MAX_SPEED, MAX_SPEED));
+        bench.instances[i] = egSceneAdd(bench.scene, &model, &bench.transforms[i], 0);
+    }
+
+    for (uint32_t frame = 0; frame < frame_count; ++frame)
+    {
+        RunFrame(&bench, job_system, frame);
+    }
+
+    double ms = 1000.0 / frame_count;
+    printf(
+        "%u moving instances, %u frames, %u threads, ms per frame\n",
+        INSTANCE_COUNT,
+        frame_count,
+        thread_count);
+    printf("set transforms   %.3f\n", bench.times[TIMER_SET_TRANSFORMS] * ms);
+    printf("update bvh       %.3f\n", bench.times[TIMER_UPDATE_BVH] * ms);
+    printf("refit            %.3f\n", bench.times[TIMER_REFIT] * ms);
+    printf("query        count  bvh      linear   speedup\n");
+
+    static const struct
+    {
+        const char *name;
+        uint32_t count;
+        Timer bvh;
+        Timer linear;
+    } rows[] = {
+        {"frustum", FRUSTUM_QUERIES, TIMER_BVH_FRUSTUM, TIMER_LINEAR_FRUSTUM},
+        {"sphere", SPHERE_QUERIES, TIMER_BVH_SPHERE, TIMER_LINEAR_SPHERE},
+        {"ray", RAY_QUERIES, TIMER_BVH_RAY, TIMER_LINEAR_RAY},
+    };
+    for (uint32_t i = 0; i < EG_CARRAY_LENGTH(rows); ++i)
+    {
+        printf(
+            "%-11s  %-5u  %-7.3f  %-7.3f  %.1f\n",
+            rows[i].name,
+            rows[i].count,
+            bench.times[rows[i].bvh] * ms,
+            bench.times[rows[i].linear] * ms,
+            bench.times[rows[i].linear] / bench.times[rows[i].bvh]);
+    }
+    printf(
+        "%.1f instances per sphere, %.0f%% of rays hit\n",
+        (double)bench.sphere_result_count / (frame_count * SPHERE_QUERIES),
+        100.0 * bench.hit_count / (frame_count * RAY_QUERIES));
+
+    egFree(NULL, bench.linear_handles);
+    egFree(NULL, bench.bvh_handles);
+    egFree(NULL, bench.velocities);
+    egFree(NULL, bench.transforms);
+    egFree(NULL, bench.instances);
+    egSceneDestroy(bench.scene);
+    if (job_system) egJobSystemDestroy(job_system);
+    return 0;
+}
@@ -0,0 +1,145 @@
+#include <stdio.h>
+#include <string.h>
+#include <renderer/allocator.h>
+#include <renderer/job_system.h>
+#include <renderer/model_asset.h>
+#include <renderer/mesh_optimizer.h>
+
+// Converts GLB models to the cooked .egm format loaded by
+// egModelAssetFromCookedFile. Skinned and animated models are rejected, load
+// their GLB directly.
+
+static uint8_t *ReadFile(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (file_size <= 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    *size = (size_t)file_size;
+    uint8_t *data = (uint8_t *)egAllocate(NULL, *size);
+    size_t read_size = fread(data, 1, *size, f);
+    fclose(f);
+
+    if (read_size != *size)
+    {
+        egFree(NULL, data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static bool WriteFile(const char *path, const uint8_t *data, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) return false;
+
+    size_t written_size = fwrite(data, 1, size, f);
+    return fclose(f) == 0 && written_size == size;
+}
+
+static void PrintUsage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: egcook [--no-compress] <input.glb> <output.egm>\n"
+        "  --no-compress  Store images as RGBA8 instead of BC1/BC5/BC7, for\n"
+        "                 devices without BC support\n");
+}
+
+int main(int argc, char **argv)
+{
+    bool compress_images = true;
+    const char *paths[2] = {NULL, NULL};
+    uint32_t path_count = 0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--no-compress") == 0)
+        {
+            compress_images = false;
+        }
+        else if (argv[i][0] != '-' && path_count < 2)
+        {
+            paths[path_count++] = argv[i];
+        }
+        else
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    if (path_count != 2)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    size_t gltf_size = 0;
+    uint8_t *gltf_data = ReadFile(paths[0], &gltf_size);
+    if (!gltf_data)
+    {
+        fprintf(stderr, "Failed to read %s\n", paths[0]);
+        return 1;
+    }
+
+    // Image decoding and compression run on every core
+    EgJobSystemInfo job_system_info = {0};
+    EgJobSystem *job_system = egJobSystemCreate(NULL, &job_system_info);
+
+    size_t cooked_size = 0;
+    EgMeshOptimizeStats mesh_stats = {0};
+    uint8_t *cooked = egModelCookGltf(
+        NULL,
+        job_system,
+        gltf_data,
+        gltf_size,
+        compress_images,
+        &cooked_size,
+        &mesh_stats);
+
+    egJobSystemDestroy(job_system);
+    egFree(NULL, gltf_data);
+
+    if (!cooked)
+    {
+        fprintf(stderr, "Failed to cook %s\n", paths[0]);
+        return 1;
+    }
+
+    bool written = WriteFile(paths[1], cooked, cooked_size);
+    egFree(NULL, cooked);
+
+    if (!written)
+    {
+        fprintf(stderr, "Failed to write %s\n", paths[1]);
+        return 1;
+    }
+
+    printf("Cooked %s (%zu bytes) to %s (%zu bytes)\n",
+           paths[0],
+           gltf_size,
+           paths[1],
+           cooked_size);
+
+    if (mesh_stats.triangle_count > 0)
+    {
+        double triangle_count = (double)mesh_stats.triangle_count;
+        printf("Vertices: %llu -> %llu, ACMR: %.3f -> %.3f\n",
+               (unsigned long long)mesh_stats.vertex_count_before,
+               (unsigned long long)mesh_stats.vertex_count_after,
+               (double)mesh_stats.cache_misses_before / triangle_count,
+               (double)mesh_stats.cache_misses_after / triangle_count);
+    }
+
+    return 0;
+}
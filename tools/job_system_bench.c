@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <renderer/allocator.h>
+#include <renderer/job_system.h>
+#include <renderer/thread.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Measures how the job system scales with its thread count: a coarse
+// parallel for that is bound by the work of its items, and fine grained
+// jobs that spawn more jobs, which is bound by the cost of pushing, stealing
+// and counting jobs. Needs no window or GPU.
+
+enum {
+    ITEM_COUNT = 1 << 20,
+    ITEM_ROUNDS = 256, // Work per item of the coarse loop
+    COARSE_GRAIN = 1024,
+    FANOUT_DEPTH = 4,
+    FANOUT_WIDTH = 16, // Jobs spawned by each job above the leaves
+};
+
+static double GetMonotonicTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+// Coarse {{{
+static uint32_t HashItem(uint32_t x)
+{
+    for (uint32_t i = 0; i < ITEM_ROUNDS; ++i)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+    }
+    return x;
+}
+
+static void CoarseProc(void *user_data, size_t begin, size_t end)
+{
+    uint32_t *items = (uint32_t *)user_data;
+    for (size_t i = begin; i < end; ++i)
+    {
+        items[i] = HashItem(items[i]);
+    }
+}
+// }}}
+
+// Fan out {{{
+// Jobs form a tree of FANOUT_DEPTH levels below a root that isn't a job, laid
+// out like a heap: the children of node n are nodes n * FANOUT_WIDTH + 1 to
+// n * FANOUT_WIDTH + FANOUT_WIDTH
+typedef struct FanoutNode
+{
+    struct Fanout *fanout;
+    uint32_t index;
+    uint32_t depth;
+} FanoutNode;
+
+typedef struct Fanout
+{
+    EgJobSystem *job_system;
+    FanoutNode *nodes;
+    EgJobCounter counter;
+    volatile uint32_t leaf_count;
+} Fanout;
+
+static void FanoutProc(void *user_data);
+
+static void SpawnChildren(Fanout *fanout, uint32_t index, uint32_t depth)
+{
+    for (uint32_t i = 1; i <= FANOUT_WIDTH; ++i)
+    {
+        uint32_t child = index * FANOUT_WIDTH + i;
+        fanout->nodes[child] = (FanoutNode){fanout, child, depth + 1};
+        egJobSystemRun(
+            fanout->job_system, FanoutProc, &fanout->nodes[child], &fanout->counter);
+    }
+}
+
+static void FanoutProc(void *user_data)
+{
+    FanoutNode *node = (FanoutNode *)user_data;
+    if (node->depth == FANOUT_DEPTH)
+    {
+        egAtomicFetchAddU32(&node->fanout->leaf_count, 1);
+        return;
+    }
+
+    // Pushed to the deque of the running worker, others steal them from there
+    SpawnChildren(node->fanout, node->index, node->depth);
+}
+
+static uint32_t JobCount(void)
+{
+    uint32_t count = 0;
+    uint32_t level = 1;
+    for (uint32_t d = 1; d <= FANOUT_DEPTH; ++d)
+    {
+        level *= FANOUT_WIDTH;
+        count += level;
+    }
+    return count;
+}
+
+static uint32_t LeafCount(void)
+{
+    uint32_t count = 1;
+    for (uint32_t d = 1; d <= FANOUT_DEPTH; ++d)
+    {
+        count *= FANOUT_WIDTH;
+    }
+    return count;
+}
+// }}}
+
+typedef struct Result
+{
+    double coarse_time;
+    double fanout_time;
+} Result;
+
+static Result Measure(
+    EgJobSystem *job_system, uint32_t *items, FanoutNode *nodes, uint32_t repetitions)
+{
+    Result best = {1e30, 1e30};
+    for (uint32_t r = 0; r < repetitions; ++r)
+    {
+        double start_time = GetMonotonicTime();
+        if (job_system)
+        {
+            egJobSystemParallelFor(
+                job_system, ITEM_COUNT, COARSE_GRAIN, CoarseProc, items);
+        }
+        else
+        {
+            // Through a pointer like the job system, so the compiler can't
+            // specialize this call and both run the same code
+            EgParallelForProc volatile proc = CoarseProc;
+            proc(items, 0, ITEM_COUNT);
+        }
+        double coarse_time = GetMonotonicTime() - start_time;
+        if (coarse_time < best.coarse_time) best.coarse_time = coarse_time;
+
+        if (!job_system) continue;
+
+        Fanout fanout = {.job_system = job_system, .nodes = nodes};
+        start_time = GetMonotonicTime();
+        SpawnChildren(&fanout, 0, 0);
+        egJobSystemWait(job_system, &fanout.counter);
+        double fanout_time = GetMonotonicTime() - start_time;
+        if (fanout_time < best.fanout_time) best.fanout_time = fanout_time;
+
+        if (fanout.leaf_count != LeafCount())
+        {
+            fprintf(stderr, "Ran %u leaf jobs of %u\n", fanout.leaf_count, LeafCount());
+            exit(1);
+        }
+    }
+    return best;
+}
+
+static void PrintUsage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: job_system_bench [max threads] [repetitions]\n"
+        "  Runs the benchmarks on job systems of 2 threads up to max threads\n"
+        "  (default: one per processor, at least 2), keeping the best of\n"
+        "  repetitions runs (default 5) for each\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    uint32_t max_thread_count = egGetCpuCount() > 2 ? egGetCpuCount() : 2;
+    uint32_t repetitions = 5;
+    if (argc >= 2) max_thread_count = (uint32_t)strtoul(argv[1], NULL, 10);
+    if (argc >= 3) repetitions = (uint32_t)strtoul(argv[2], NULL, 10);
+    if (max_thread_count < 2 || repetitions == 0)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    uint32_t *items = (uint32_t *)egAllocate(NULL, sizeof(uint32_t) * ITEM_COUNT);
+    for (uint32_t i = 0; i < ITEM_COUNT; ++i)
+    {
+        items[i] = i + 1;
+    }
+
+    printf(
+        "%u items of %u rounds in chunks of %u, %u fan out jobs\n",
+        ITEM_COUNT,
+        ITEM_ROUNDS,
+        COARSE_GRAIN,
+        JobCount());
+    // us/job is thread time, the cost of one job summed over all threads
+    printf("threads  items/s     speedup  jobs/s      us/job\n");
+
+    FanoutNode *nodes =
+        (FanoutNode *)egAllocate(NULL, sizeof(FanoutNode) * (1 + JobCount()));
+
+    Result serial = Measure(NULL, items, nodes, repetitions);
+    printf("serial   %-10.3g  1.00     -           -\n", ITEM_COUNT / serial.coarse_time);
+
+    for (uint32_t thread_count = 2; thread_count <= max_thread_count;)
+    {
+        EgJobSystemInfo info = {.worker_count = thread_count - 1};
+        EgJobSystem *job_system = egJobSystemCreate(NULL, &info);
+        Result result = Measure(job_system, items, nodes, repetitions);
+        egJobSystemDestroy(job_system);
+
+        printf(
+            "%-7u  %-10.3g  %-7.2f  %-10.3g  %.3f\n",
+            thread_count,
+            ITEM_COUNT / result.coarse_time,
+            serial.coarse_time / result.coarse_time,
+            JobCount() / result.fanout_time,
+            result.fanout_time * 1e6 / JobCount() * thread_count);
+
+        if (thread_count == max_thread_count) break;
+        thread_count = (thread_count * 2 > max_thread_count) ? max_thread_count
+                                                              : thread_count * 2;
+    }
+
+    // Keeps the coarse loop from being optimized away
+    uint32_t checksum = 0;
+    for (uint32_t i = 0; i < ITEM_COUNT; ++i)
+    {
+        checksum ^= items[i];
+    }
+    printf("checksum %08x\n", checksum);
+
+    egFree(NULL, nodes);
+    egFree(NULL, items);
+    return 0;
+}
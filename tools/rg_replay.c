@@ -0,0 +1,1149 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <float.h>
+#include <rg.h>
+#include <rg_capture.h>
+#include <renderer/allocator.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Replays a frame captured with rgDeviceBeginCapture/rgDeviceEndCapture (see
+// rg_capture.h) on a headless device, and reports its CPU recording time and
+// GPU time. Swapchain render passes are replayed into offscreen images.
+
+typedef enum ObjectType
+{
+    OBJECT_NONE = 0,
+    OBJECT_BUFFER,
+    OBJECT_IMAGE,
+    OBJECT_SAMPLER,
+    OBJECT_RENDER_PASS,
+    OBJECT_SET_LAYOUT,
+    OBJECT_PIPELINE_LAYOUT,
+    OBJECT_DESCRIPTOR_SET,
+    OBJECT_PIPELINE,
+} ObjectType;
+
+typedef struct Object
+{
+    ObjectType type;
+    void *handle;
+    RgBufferMemory memory; // Of buffers
+    // Attachments of a replayed swapchain render pass
+    RgImage *color_image;
+    RgImage *depth_image;
+} Object;
+
+typedef struct Reader
+{
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+} Reader;
+
+typedef struct Submission
+{
+    uint32_t id;
+    RgQueueType queue_type;
+    Reader commands;
+    RgCmdBuffer *cmd_buffer;
+    // A later submission of the frame waits on its semaphore
+    bool waited_on;
+} Submission;
+
+typedef struct Replay
+{
+    RgDevice *device;
+    RgCmdPool *cmd_pools[3]; // By RgQueueType, created when first needed
+
+    Object *objects;
+    uint32_t object_count;
+
+    Submission *submissions;
+    uint32_t submission_count;
+
+    // One per RG_CAPTURE_OP_SECONDARY record of the frame, used in order
+    RgCmdBuffer **secondaries;
+    uint32_t secondary_count;
+    uint32_t next_secondary;
+} Replay;
+
+static double GetMonotonicTime(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+static uint8_t *ReadFile(const char *path, size_t *size)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (file_size <= 0)
+    {
+        fclose(f);
+        return NULL;
+    }
+
+    *size = (size_t)file_size;
+    uint8_t *data = (uint8_t *)egAllocate(NULL, *size);
+    size_t read_size = fread(data, 1, *size, f);
+    fclose(f);
+
+    if (read_size != *size)
+    {
+        egFree(NULL, data);
+        return NULL;
+    }
+
+    return data;
+}
+
+static void Fail(const char *message, uint32_t value)
+{
+    fprintf(stderr, "Invalid capture: %s (%u)\n", message, value);
+    exit(1);
+}
+
+// Reader {{{
+// Returns a pointer to the next size bytes. Fields are copied out with memcpy
+// as blobs leave the ones after them unaligned.
+static const uint8_t *ReadBytes(Reader *reader, size_t size)
+{
+    if (size > reader->size - reader->offset)
+    {
+        Fail("record extends past its end", (uint32_t)reader->offset);
+    }
+
+    const uint8_t *bytes = reader->data + reader->offset;
+    reader->offset += size;
+    return bytes;
+}
+
+static uint32_t ReadU32(Reader *reader)
+{
+    uint32_t value;
+    memcpy(&value, ReadBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static int32_t ReadI32(Reader *reader)
+{
+    int32_t value;
+    memcpy(&value, ReadBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static uint64_t ReadU64(Reader *reader)
+{
+    uint64_t value;
+    memcpy(&value, ReadBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+static float ReadF32(Reader *reader)
+{
+    float value;
+    memcpy(&value, ReadBytes(reader, sizeof(value)), sizeof(value));
+    return value;
+}
+
+// The returned string is allocated, and NULL if empty
+static char *ReadString(Reader *reader)
+{
+    uint32_t length = ReadU32(reader);
+    const uint8_t *bytes = ReadBytes(reader, length);
+    if (length == 0) return NULL;
+
+    char *str = (char *)egAllocate(NULL, length + 1);
+    memcpy(str, bytes, length);
+    str[length] = '\0';
+    return str;
+}
+
+static const uint8_t *ReadBlob(Reader *reader, size_t *size)
+{
+    uint64_t blob_size = ReadU64(reader);
+    if (blob_size > reader->size - reader->offset)
+    {
+        Fail("blob extends past its record", (uint32_t)reader->offset);
+    }
+
+    *size = (size_t)blob_size;
+    return ReadBytes(reader, *size);
+}
+
+// Copies count u32s, they may not be aligned in the file
+static uint32_t *ReadU32Array(Reader *reader, uint32_t count)
+{
+    const uint8_t *bytes = ReadBytes(reader, sizeof(uint32_t) * (size_t)count);
+    if (count == 0) return NULL;
+
+    uint32_t *values = (uint32_t *)egAllocate(NULL, sizeof(uint32_t) * count);
+    memcpy(values, bytes, sizeof(uint32_t) * count);
+    return values;
+}
+
+// Splits off the next record, returns false at the end of the reader
+static bool ReadRecord(Reader *reader, RgCaptureOp *op, Reader *payload)
+{
+    if (reader->offset == reader->size) return false;
+
+    RgCaptureRecord record;
+    memcpy(&record, ReadBytes(reader, sizeof(record)), sizeof(record));
+
+    *op = (RgCaptureOp)record.op;
+    payload->data = ReadBytes(reader, record.size);
+    payload->size = record.size;
+    payload->offset = 0;
+    return true;
+}
+// }}}
+
+// Objects {{{
+static Object *NewObject(Replay *replay, uint32_t id, ObjectType type)
+{
+    if (id == 0 || id >= replay->object_count || replay->objects[id].type != OBJECT_NONE)
+    {
+        Fail("bad object id", id);
+    }
+
+    Object *object = &replay->objects[id];
+    object->type = type;
+    return object;
+}
+
+// Objects that are missing or of the wrong type can't be replayed around, so
+// they end the replay. 0 gives NULL.
+static void *GetObject(Replay *replay, uint32_t id, ObjectType type)
+{
+    if (id == 0) return NULL;
+    if (id >= replay->object_count || replay->objects[id].type != type)
+    {
+        Fail("reference to a missing object", id);
+    }
+    return replay->objects[id].handle;
+}
+
+// Like GetObject, but descriptors may still refer to objects destroyed before
+// the capture began, which are skipped
+static bool HasObject(Replay *replay, uint32_t id, ObjectType type)
+{
+    return id < replay->object_count && replay->objects[id].type == type;
+}
+
+static RgCmdPool *GetCmdPool(Replay *replay, RgQueueType queue_type)
+{
+    if (queue_type > RG_QUEUE_TYPE_TRANSFER) Fail("bad queue type", queue_type);
+
+    if (!replay->cmd_pools[queue_type])
+    {
+        replay->cmd_pools[queue_type] = rgCmdPoolCreate(replay->device, queue_type);
+    }
+    return replay->cmd_pools[queue_type];
+}
+
+static void DestroyObjects(Replay *replay)
+{
+    RgDevice *device = replay->device;
+
+    // In reverse, objects are destroyed before the ones they were created from
+    for (uint32_t id = replay->object_count; id-- > 0;)
+    {
+        Object *object = &replay->objects[id];
+        switch (object->type)
+        {
+        case OBJECT_NONE: break;
+        case OBJECT_BUFFER: rgBufferDestroy(device, (RgBuffer *)object->handle); break;
+        case OBJECT_IMAGE: rgImageDestroy(device, (RgImage *)object->handle); break;
+        case OBJECT_SAMPLER: rgSamplerDestroy(device, (RgSampler *)object->handle); break;
+        case OBJECT_RENDER_PASS:
+            rgRenderPassDestroy(device, (RgRenderPass *)object->handle);
+            if (object->color_image) rgImageDestroy(device, object->color_image);
+            if (object->depth_image) rgImageDestroy(device, object->depth_image);
+            break;
+        case OBJECT_SET_LAYOUT:
+            rgDescriptorSetLayoutDestroy(device, (RgDescriptorSetLayout *)object->handle);
+            break;
+        case OBJECT_PIPELINE_LAYOUT:
+            rgPipelineLayoutDestroy(device, (RgPipelineLayout *)object->handle);
+            break;
+        case OBJECT_DESCRIPTOR_SET:
+            rgDescriptorSetDestroy(device, (RgDescriptorSet *)object->handle);
+            break;
+        case OBJECT_PIPELINE:
+            rgPipelineDestroy(device, (RgPipeline *)object->handle);
+            break;
+        }
+    }
+}
+// }}}
+
+// Setup {{{
+static void CreateSwapchainRenderPass(Replay *replay, Reader *payload)
+{
+    Object *object = NewObject(replay, ReadU32(payload), OBJECT_RENDER_PASS);
+    uint32_t width = ReadU32(payload);
+    uint32_t height = ReadU32(payload);
+    RgFormat color_format = (RgFormat)ReadU32(payload);
+    RgFormat depth_format = (RgFormat)ReadU32(payload);
+
+    RgImageInfo image_info = {0};
+    image_info.extent = (RgExtent3D){width, height, 1};
+    image_info.format = color_format;
+    image_info.usage = RG_IMAGE_USAGE_COLOR_ATTACHMENT | RG_IMAGE_USAGE_SAMPLED;
+    image_info.aspect = RG_IMAGE_ASPECT_COLOR;
+    image_info.sample_count = 1;
+    image_info.mip_count = 1;
+    image_info.layer_count = 1;
+    object->color_image = rgImageCreate(replay->device, &image_info);
+
+    if (depth_format != RG_FORMAT_UNDEFINED)
+    {
+        image_info.format = depth_format;
+        image_info.usage = RG_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT;
+        image_info.aspect = RG_IMAGE_ASPECT_DEPTH;
+        if (depth_format == RG_FORMAT_D16_UNORM_S8_UINT ||
+            depth_format == RG_FORMAT_D24_UNORM_S8_UINT ||
+            depth_format == RG_FORMAT_D32_SFLOAT_S8_UINT)
+        {
+            image_info.aspect |= RG_IMAGE_ASPECT_STENCIL;
+        }
+        object->depth_image = rgImageCreate(replay->device, &image_info);
+    }
+
+    RgRenderPassInfo render_pass_info = {0};
+    render_pass_info.color_attachments = &object->color_image;
+    render_pass_info.color_attachment_count = 1;
+    render_pass_info.depth_stencil_attachment = object->depth_image;
+    object->handle = rgRenderPassCreate(replay->device, &render_pass_info);
+}
+
+static void CreateGraphicsPipeline(Replay *replay, Reader *payload)
+{
+    Object *object = NewObject(replay, ReadU32(payload), OBJECT_PIPELINE);
+
+    RgGraphicsPipelineInfo info = {0};
+    info.pipeline_layout = (RgPipelineLayout *)GetObject(
+        replay, ReadU32(payload), OBJECT_PIPELINE_LAYOUT);
+    info.polygon_mode = (RgPolygonMode)ReadU32(payload);
+    info.cull_mode = (RgCullMode)ReadU32(payload);
+    info.front_face = (RgFrontFace)ReadU32(payload);
+    info.topology = (RgPrimitiveTopology)ReadU32(payload);
+    info.blend.enable = ReadU32(payload) != 0;
+    info.depth_stencil.test_enable = ReadU32(payload) != 0;
+    info.depth_stencil.write_enable = ReadU32(payload) != 0;
+    info.depth_stencil.bias_enable = ReadU32(payload) != 0;
+    info.depth_stencil.compare_op = (RgCompareOp)ReadU32(payload);
+    info.vertex_stride = ReadU32(payload);
+    info.num_vertex_attributes = ReadU32(payload);
+
+    RgVertexAttribute *attributes = NULL;
+    if (info.num_vertex_attributes > 0)
+    {
+        attributes = (RgVertexAttribute *)egAllocate(
+            NULL, sizeof(RgVertexAttribute) * info.num_vertex_attributes);
+        for (uint32_t i = 0; i < info.num_vertex_attributes; ++i)
+        {
+            attributes[i].format = (RgFormat)ReadU32(payload);
+            attributes[i].offset = ReadU32(payload);
+        }
+    }
+    info.vertex_attributes = attributes;
+
+    char *vertex_entry = ReadString(payload);
+    info.vertex_entry = vertex_entry;
+    info.vertex = ReadBlob(payload, &info.vertex_size);
+    char *fragment_entry = ReadString(payload);
+    info.fragment_entry = fragment_entry;
+    info.fragment = ReadBlob(payload, &info.fragment_size);
+    if (info.vertex_size == 0) info.vertex = NULL;
+    if (info.fragment_size == 0) info.fragment = NULL;
+
+    object->handle = rgGraphicsPipelineCreate(replay->device, &info);
+
+    if (attributes) egFree(NULL, attributes);
+    if (vertex_entry) egFree(NULL, vertex_entry);
+    if (fragment_entry) egFree(NULL, fragment_entry);
+}
+
+static void UpdateDescriptorSet(Replay *replay, Reader *payload)
+{
+    RgDescriptorSet *set =
+        (RgDescriptorSet *)GetObject(replay, ReadU32(payload), OBJECT_DESCRIPTOR_SET);
+    uint32_t entry_count = ReadU32(payload);
+
+    for (uint32_t i = 0; i < entry_count; ++i)
+    {
+        RgDescriptorUpdateInfo entry = {0};
+        entry.binding = ReadU32(payload);
+        uint32_t base_index = ReadU32(payload);
+        uint32_t descriptor_count = ReadU32(payload);
+        RgCaptureDescriptorKind kind = (RgCaptureDescriptorKind)ReadU32(payload);
+
+        // Written one at a time, descriptors of destroyed objects are left as
+        // they were
+        for (uint32_t j = 0; j < descriptor_count; ++j)
+        {
+            RgDescriptor descriptor;
+            memset(&descriptor, 0, sizeof(descriptor));
+            bool valid = true;
+
+            if (kind == RG_CAPTURE_DESCRIPTOR_BUFFER)
+            {
+                uint32_t buffer_id = ReadU32(payload);
+                descriptor.buffer.offset = (size_t)ReadU64(payload);
+                descriptor.buffer.size = (size_t)ReadU64(payload);
+                valid = HasObject(replay, buffer_id, OBJECT_BUFFER);
+                if (valid)
+                {
+                    descriptor.buffer.buffer =
+                        (RgBuffer *)replay->objects[buffer_id].handle;
+                }
+            }
+            else
+            {
+                uint32_t image_id = ReadU32(payload);
+                uint32_t sampler_id = ReadU32(payload);
+                if (image_id != 0)
+                {
+                    valid = HasObject(replay, image_id, OBJECT_IMAGE);
+                    if (valid)
+                    {
+                        descriptor.image.image =
+                            (RgImage *)replay->objects[image_id].handle;
+                    }
+                }
+                if (sampler_id != 0 && valid)
+                {
+                    valid = HasObject(replay, sampler_id, OBJECT_SAMPLER);
+                    if (valid)
+                    {
+                        descriptor.image.sampler =
+                            (RgSampler *)replay->objects[sampler_id].handle;
+                    }
+                }
+            }
+
+            if (!valid) continue;
+
+            entry.base_index = base_index + j;
+            entry.descriptor_count = 1;
+            entry.descriptors = &descriptor;
+            rgDescriptorSetUpdate(replay->device, set, &entry, 1);
+        }
+    }
+}
+
+static void ReplaySetupRecord(
+    Replay *replay, RgUploadContext *upload_context, RgCaptureOp op, Reader *payload)
+{
+    RgDevice *device = replay->device;
+
+    switch (op)
+    {
+    case RG_CAPTURE_OP_BUFFER_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_BUFFER);
+        RgBufferInfo info = {0};
+        info.usage = ReadU32(payload);
+        info.memory = (RgBufferMemory)ReadU32(payload);
+        info.size = (size_t)ReadU64(payload);
+        object->memory = info.memory;
+        object->handle = rgBufferCreate(device, &info);
+        break;
+    }
+    case RG_CAPTURE_OP_IMAGE_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_IMAGE);
+        RgImageInfo info = {0};
+        info.extent.width = ReadU32(payload);
+        info.extent.height = ReadU32(payload);
+        info.extent.depth = ReadU32(payload);
+        info.format = (RgFormat)ReadU32(payload);
+        info.usage = ReadU32(payload);
+        info.aspect = ReadU32(payload);
+        info.sample_count = ReadU32(payload);
+        info.mip_count = ReadU32(payload);
+        info.layer_count = ReadU32(payload);
+        object->handle = rgImageCreate(device, &info);
+        break;
+    }
+    case RG_CAPTURE_OP_SAMPLER_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_SAMPLER);
+        RgSamplerInfo info = {0};
+        info.anisotropy = ReadU32(payload) != 0;
+        info.max_anisotropy = ReadF32(payload);
+        info.min_lod = ReadF32(payload);
+        info.max_lod = ReadF32(payload);
+        info.mag_filter = (RgFilter)ReadU32(payload);
+        info.min_filter = (RgFilter)ReadU32(payload);
+        info.address_mode = (RgSamplerAddressMode)ReadU32(payload);
+        info.border_color = (RgBorderColor)ReadU32(payload);
+        object->handle = rgSamplerCreate(device, &info);
+        break;
+    }
+    case RG_CAPTURE_OP_RENDER_PASS_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_RENDER_PASS);
+        RgRenderPassInfo info = {0};
+        info.color_attachment_count = ReadU32(payload);
+        RgImage **color_attachments = NULL;
+        if (info.color_attachment_count > 0)
+        {
+            color_attachments = (RgImage **)egAllocate(
+                NULL, sizeof(RgImage *) * info.color_attachment_count);
+            for (uint32_t i = 0; i < info.color_attachment_count; ++i)
+            {
+                color_attachments[i] =
+                    (RgImage *)GetObject(replay, ReadU32(payload), OBJECT_IMAGE);
+            }
+        }
+        info.color_attachments = color_attachments;
+        info.depth_stencil_attachment =
+            (RgImage *)GetObject(replay, ReadU32(payload), OBJECT_IMAGE);
+        object->handle = rgRenderPassCreate(device, &info);
+        if (color_attachments) egFree(NULL, color_attachments);
+        break;
+    }
+    case RG_CAPTURE_OP_SWAPCHAIN_RENDER_PASS: {
+        CreateSwapchainRenderPass(replay, payload);
+        break;
+    }
+    case RG_CAPTURE_OP_DESCRIPTOR_SET_LAYOUT_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_SET_LAYOUT);
+        RgDescriptorSetLayoutInfo info = {0};
+        info.entry_count = ReadU32(payload);
+        RgDescriptorSetLayoutEntry *entries = NULL;
+        if (info.entry_count > 0)
+        {
+            entries = (RgDescriptorSetLayoutEntry *)egAllocate(
+                NULL, sizeof(RgDescriptorSetLayoutEntry) * info.entry_count);
+            for (uint32_t i = 0; i < info.entry_count; ++i)
+            {
+                entries[i].binding = ReadU32(payload);
+                entries[i].type = (RgDescriptorType)ReadU32(payload);
+                entries[i].shader_stages = ReadU32(payload);
+                entries[i].count = ReadU32(payload);
+            }
+        }
+        info.entries = entries;
+        object->handle = rgDescriptorSetLayoutCreate(device, &info);
+        if (entries) egFree(NULL, entries);
+        break;
+    }
+    case RG_CAPTURE_OP_PIPELINE_LAYOUT_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_PIPELINE_LAYOUT);
+        RgPipelineLayoutInfo info = {0};
+        info.set_layout_count = ReadU32(payload);
+        RgDescriptorSetLayout **set_layouts = NULL;
+        if (info.set_layout_count > 0)
+        {
+            set_layouts = (RgDescriptorSetLayout **)egAllocate(
+                NULL, sizeof(RgDescriptorSetLayout *) * info.set_layout_count);
+            for (uint32_t i = 0; i < info.set_layout_count; ++i)
+            {
+                set_layouts[i] = (RgDescriptorSetLayout *)GetObject(
+                    replay, ReadU32(payload), OBJECT_SET_LAYOUT);
+            }
+        }
+        info.set_layouts = set_layouts;
+        object->handle = rgPipelineLayoutCreate(device, &info);
+        if (set_layouts) egFree(NULL, set_layouts);
+        break;
+    }
+    case RG_CAPTURE_OP_DESCRIPTOR_SET_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_DESCRIPTOR_SET);
+        RgDescriptorSetLayout *set_layout = (RgDescriptorSetLayout *)GetObject(
+            replay, ReadU32(payload), OBJECT_SET_LAYOUT);
+        object->handle = rgDescriptorSetCreate(device, set_layout);
+        break;
+    }
+    case RG_CAPTURE_OP_GRAPHICS_PIPELINE_CREATE: {
+        CreateGraphicsPipeline(replay, payload);
+        break;
+    }
+    case RG_CAPTURE_OP_COMPUTE_PIPELINE_CREATE: {
+        Object *object = NewObject(replay, ReadU32(payload), OBJECT_PIPELINE);
+        RgComputePipelineInfo info = {0};
+        info.pipeline_layout = (RgPipelineLayout *)GetObject(
+            replay, ReadU32(payload), OBJECT_PIPELINE_LAYOUT);
+        char *entry = ReadString(payload);
+        info.entry = entry;
+        info.code = ReadBlob(payload, &info.code_size);
+        object->handle = rgComputePipelineCreate(device, &info);
+        if (entry) egFree(NULL, entry);
+        break;
+    }
+    case RG_CAPTURE_OP_BUFFER_DATA: {
+        uint32_t id = ReadU32(payload);
+        RgBuffer *buffer = (RgBuffer *)GetObject(replay, id, OBJECT_BUFFER);
+        size_t offset = (size_t)ReadU64(payload);
+        size_t size;
+        const uint8_t *data = ReadBlob(payload, &size);
+
+        if (replay->objects[id].memory == RG_BUFFER_MEMORY_HOST)
+        {
+            uint8_t *mapping = (uint8_t *)rgBufferMap(device, buffer);
+            memcpy(mapping + offset, data, size);
+            rgBufferUnmap(device, buffer);
+        }
+        else
+        {
+            rgUploadBuffer(upload_context, buffer, offset, size, data);
+        }
+        break;
+    }
+    case RG_CAPTURE_OP_IMAGE_DATA: {
+        RgImageCopy dst = {0};
+        dst.image = (RgImage *)GetObject(replay, ReadU32(payload), OBJECT_IMAGE);
+        dst.mip_level = ReadU32(payload);
+        dst.array_layer = ReadU32(payload);
+        dst.offset.x = ReadI32(payload);
+        dst.offset.y = ReadI32(payload);
+        dst.offset.z = ReadI32(payload);
+        RgExtent3D extent;
+        extent.width = ReadU32(payload);
+        extent.height = ReadU32(payload);
+        extent.depth = ReadU32(payload);
+        size_t size;
+        const uint8_t *data = ReadBlob(payload, &size);
+        rgUploadImage(upload_context, &dst, &extent, size, data);
+        break;
+    }
+    case RG_CAPTURE_OP_IMAGE_GENERATE_MIPMAPS: {
+        RgImage *image = (RgImage *)GetObject(replay, ReadU32(payload), OBJECT_IMAGE);
+        rgUploadGenerateMipmaps(upload_context, image);
+        break;
+    }
+    case RG_CAPTURE_OP_DESCRIPTOR_SET_UPDATE: {
+        UpdateDescriptorSet(replay, payload);
+        break;
+    }
+    default: Fail("unknown setup op", op);
+    }
+}
+
+static void ReplaySetup(Replay *replay, Reader *setup)
+{
+    RgUploadContextInfo upload_info = {0};
+    upload_info.queue_type = RG_QUEUE_TYPE_GRAPHICS;
+    RgUploadContext *upload_context = rgUploadContextCreate(replay->device, &upload_info);
+
+    RgCaptureOp op;
+    Reader payload;
+    while (ReadRecord(setup, &op, &payload))
+    {
+        ReplaySetupRecord(replay, upload_context, op, &payload);
+    }
+
+    rgUploadContextWait(upload_context, rgUploadContextSubmit(upload_context));
+    rgUploadContextDestroy(replay->device, upload_context);
+}
+// }}}
+
+// Frame {{{
+static uint32_t CountSecondaries(Reader commands)
+{
+    uint32_t count = 0;
+    RgCaptureOp op;
+    Reader payload;
+    while (ReadRecord(&commands, &op, &payload))
+    {
+        if (op == RG_CAPTURE_OP_EXECUTE_COMMANDS)
+        {
+            count += ReadU32(&payload);
+        }
+    }
+    return count;
+}
+
+// Splits the frame into its submissions and creates their command buffers
+static void PrepareFrame(Replay *replay, Reader *frame, uint32_t submit_count)
+{
+    replay->submissions =
+        (Submission *)egAllocate(NULL, sizeof(Submission) * (submit_count + 1));
+    memset(replay->submissions, 0, sizeof(Submission) * (submit_count + 1));
+
+    RgCaptureOp op;
+    Reader payload;
+    while (ReadRecord(frame, &op, &payload))
+    {
+        if (op != RG_CAPTURE_OP_SUBMIT) Fail("unknown frame op", op);
+        if (replay->submission_count == submit_count) Fail("too many submissions", op);
+
+        Submission *submission = &replay->submissions[replay->submission_count++];
+        submission->id = ReadU32(&payload);
+        submission->queue_type = (RgQueueType)ReadU32(&payload);
+        submission->commands.data = payload.data + payload.offset;
+        submission->commands.size = payload.size - payload.offset;
+
+        RgCmdPool *cmd_pool = GetCmdPool(replay, submission->queue_type);
+        submission->cmd_buffer = rgCmdBufferCreate(replay->device, cmd_pool);
+
+        replay->secondary_count += CountSecondaries(submission->commands);
+    }
+
+    // Only the waits on submissions earlier in the frame are replayed
+    for (uint32_t i = 0; i < replay->submission_count; ++i)
+    {
+        Reader commands = replay->submissions[i].commands;
+        while (ReadRecord(&commands, &op, &payload))
+        {
+            if (op != RG_CAPTURE_OP_WAIT_FOR_COMMANDS) continue;
+
+            uint32_t id = ReadU32(&payload);
+            for (uint32_t j = 0; j < i; ++j)
+            {
+                if (replay->submissions[j].id == id)
+                {
+                    replay->submissions[j].waited_on = true;
+                }
+            }
+        }
+    }
+
+    if (replay->secondary_count > 0)
+    {
+        replay->secondaries = (RgCmdBuffer **)egAllocate(
+            NULL, sizeof(RgCmdBuffer *) * replay->secondary_count);
+        RgCmdPool *cmd_pool = GetCmdPool(replay, RG_QUEUE_TYPE_GRAPHICS);
+        for (uint32_t i = 0; i < replay->secondary_count; ++i)
+        {
+            replay->secondaries[i] = rgCmdBufferCreateSecondary(replay->device, cmd_pool);
+        }
+    }
+}
+
+static void RecordCommands(
+    Replay *replay,
+    RgCmdBuffer *cmd_buffer,
+    Reader commands,
+    uint32_t submission_index,
+    RgRenderPass *render_pass);
+
+static void RecordExecuteCommands(
+    Replay *replay, RgCmdBuffer *cmd_buffer, Reader *payload, RgRenderPass *render_pass)
+{
+    uint32_t secondary_count = ReadU32(payload);
+    if (secondary_count > replay->secondary_count - replay->next_secondary)
+    {
+        Fail("too many secondary command buffers", secondary_count);
+    }
+
+    RgCmdBuffer **secondaries = &replay->secondaries[replay->next_secondary];
+    replay->next_secondary += secondary_count;
+
+    // Recorded here, on one thread, however the frame recorded them
+    for (uint32_t i = 0; i < secondary_count; ++i)
+    {
+        RgCaptureOp op;
+        Reader secondary;
+        if (!ReadRecord(payload, &op, &secondary) || op != RG_CAPTURE_OP_SECONDARY)
+        {
+            Fail("missing secondary command buffer", i);
+        }
+
+        // Secondaries begun before the capture have no commands recorded
+        RgCaptureOp first_op;
+        Reader first;
+        Reader rest = secondary;
+        RgRenderPass *secondary_pass = render_pass;
+        if (ReadRecord(&rest, &first_op, &first) &&
+            first_op == RG_CAPTURE_OP_BEGIN_SECONDARY)
+        {
+            secondary_pass = (RgRenderPass *)GetObject(
+                replay, ReadU32(&first), OBJECT_RENDER_PASS);
+            secondary = rest;
+        }
+        if (!secondary_pass) Fail("secondary outside of a render pass", i);
+
+        rgCmdBufferBeginSecondary(secondaries[i], secondary_pass);
+        RecordCommands(replay, secondaries[i], secondary, UINT32_MAX, secondary_pass);
+        rgCmdBufferEnd(secondaries[i]);
+    }
+
+    rgCmdExecuteCommands(cmd_buffer, secondary_count, secondaries);
+}
+
+// submission_index is UINT32_MAX for secondaries
+static void RecordCommands(
+    Replay *replay,
+    RgCmdBuffer *cmd_buffer,
+    Reader commands,
+    uint32_t submission_index,
+    RgRenderPass *render_pass)
+{
+    RgCaptureOp op;
+    Reader payload;
+    while (ReadRecord(&commands, &op, &payload))
+    {
+        switch (op)
+        {
+        case RG_CAPTURE_OP_WAIT_FOR_COMMANDS: {
+            // Only submissions earlier in the frame are waited on, the others
+            // happened before the capture
+            uint32_t id = ReadU32(&payload);
+            uint32_t earlier_count = submission_index < replay->submission_count
+                                         ? submission_index
+                                         : replay->submission_count;
+            for (uint32_t i = 0; i < earlier_count; ++i)
+            {
+                if (replay->submissions[i].id == id)
+                {
+                    rgCmdBufferWaitForCommands(
+                        cmd_buffer, replay->submissions[i].cmd_buffer);
+                }
+            }
+            break;
+        }
+        case RG_CAPTURE_OP_WAIT_FOR_PRESENT: break; // Nothing is presented
+        case RG_CAPTURE_OP_BIND_PIPELINE: {
+            rgCmdBindPipeline(
+                cmd_buffer,
+                (RgPipeline *)GetObject(replay, ReadU32(&payload), OBJECT_PIPELINE));
+            break;
+        }
+        case RG_CAPTURE_OP_PUSH_CONSTANTS: {
+            uint32_t offset = ReadU32(&payload);
+            size_t size;
+            const uint8_t *data = ReadBlob(&payload, &size);
+            rgCmdPushConstants(cmd_buffer, offset, size, data);
+            break;
+        }
+        case RG_CAPTURE_OP_BIND_DESCRIPTOR_SET: {
+            uint32_t index = ReadU32(&payload);
+            RgDescriptorSet *set = (RgDescriptorSet *)GetObject(
+                replay, ReadU32(&payload), OBJECT_DESCRIPTOR_SET);
+            uint32_t dynamic_offset_count = ReadU32(&payload);
+            uint32_t *dynamic_offsets = ReadU32Array(&payload, dynamic_offset_count);
+            rgCmdBindDescriptorSet(
+                cmd_buffer, index, set, dynamic_offset_count, dynamic_offsets);
+            if (dynamic_offsets) egFree(NULL, dynamic_offsets);
+            break;
+        }
+        case RG_CAPTURE_OP_SET_RENDER_PASS: {
+            render_pass = (RgRenderPass *)GetObject(
+                replay, ReadU32(&payload), OBJECT_RENDER_PASS);
+            bool secondary_contents = ReadU32(&payload) != 0;
+            uint32_t clear_value_count = ReadU32(&payload);
+            const uint8_t *bytes =
+                ReadBytes(&payload, sizeof(RgClearValue) * (size_t)clear_value_count);
+
+            RgClearValue *clear_values = NULL;
+            if (clear_value_count > 0)
+            {
+                clear_values = (RgClearValue *)egAllocate(
+                    NULL, sizeof(RgClearValue) * clear_value_count);
+                memcpy(clear_values, bytes, sizeof(RgClearValue) * clear_value_count);
+            }
+
+            if (secondary_contents)
+            {
+                rgCmdSetRenderPassSecondary(
+                    cmd_buffer, render_pass, clear_value_count, clear_values);
+            }
+            else
+            {
+                rgCmdSetRenderPass(
+                    cmd_buffer, render_pass, clear_value_count, clear_values);
+            }
+
+            if (clear_values) egFree(NULL, clear_values);
+            break;
+        }
+        case RG_CAPTURE_OP_EXECUTE_COMMANDS: {
+            RecordExecuteCommands(replay, cmd_buffer, &payload, render_pass);
+            break;
+        }
+        case RG_CAPTURE_OP_BIND_VERTEX_BUFFER: {
+            RgBuffer *buffer =
+                (RgBuffer *)GetObject(replay, ReadU32(&payload), OBJECT_BUFFER);
+            size_t offset = (size_t)ReadU64(&payload);
+            rgCmdBindVertexBuffer(cmd_buffer, buffer, offset);
+            break;
+        }
+        case RG_CAPTURE_OP_BIND_INDEX_BUFFER: {
+            RgBuffer *buffer =
+                (RgBuffer *)GetObject(replay, ReadU32(&payload), OBJECT_BUFFER);
+            size_t offset = (size_t)ReadU64(&payload);
+            RgIndexType index_type = (RgIndexType)ReadU32(&payload);
+            rgCmdBindIndexBuffer(cmd_buffer, buffer, offset, index_type);
+            break;
+        }
+        case RG_CAPTURE_OP_DRAW: {
+            uint32_t vertex_count = ReadU32(&payload);
+            uint32_t instance_count = ReadU32(&payload);
+            uint32_t first_vertex = ReadU32(&payload);
+            uint32_t first_instance = ReadU32(&payload);
+            rgCmdDraw(
+                cmd_buffer, vertex_count, instance_count, first_vertex, first_instance);
+            break;
+        }
+        case RG_CAPTURE_OP_DRAW_INDEXED: {
+            uint32_t index_count = ReadU32(&payload);
+            uint32_t instance_count = ReadU32(&payload);
+            uint32_t first_index = ReadU32(&payload);
+            int32_t vertex_offset = ReadI32(&payload);
+            uint32_t first_instance = ReadU32(&payload);
+            rgCmdDrawIndexed(
+                cmd_buffer,
+                index_count,
+                instance_count,
+                first_index,
+                vertex_offset,
+                first_instance);
+            break;
+        }
+        case RG_CAPTURE_OP_DISPATCH: {
+            uint32_t x = ReadU32(&payload);
+            uint32_t y = ReadU32(&payload);
+            uint32_t z = ReadU32(&payload);
+            rgCmdDispatch(cmd_buffer, x, y, z);
+            break;
+        }
+        case RG_CAPTURE_OP_MEMORY_BARRIER: {
+            uint32_t src_stages = ReadU32(&payload);
+            uint32_t dst_stages = ReadU32(&payload);
+            rgCmdMemoryBarrier(cmd_buffer, src_stages, dst_stages);
+            break;
+        }
+        case RG_CAPTURE_OP_GENERATE_MIPMAPS: {
+            rgCmdGenerateMipmaps(
+                cmd_buffer,
+                (RgImage *)GetObject(replay, ReadU32(&payload), OBJECT_IMAGE));
+            break;
+        }
+        case RG_CAPTURE_OP_COPY_IMAGE_TO_BUFFER: {
+            RgImageCopy src = {0};
+            src.image = (RgImage *)GetObject(replay, ReadU32(&payload), OBJECT_IMAGE);
+            src.mip_level = ReadU32(&payload);
+            src.array_layer = ReadU32(&payload);
+            src.offset.x = ReadI32(&payload);
+            src.offset.y = ReadI32(&payload);
+            src.offset.z = ReadI32(&payload);
+            RgBufferCopy dst = {0};
+            dst.buffer = (RgBuffer *)GetObject(replay, ReadU32(&payload), OBJECT_BUFFER);
+            dst.offset = (size_t)ReadU64(&payload);
+            dst.row_length = ReadU32(&payload);
+            dst.image_height = ReadU32(&payload);
+            RgExtent3D extent;
+            extent.width = ReadU32(&payload);
+            extent.height = ReadU32(&payload);
+            extent.depth = ReadU32(&payload);
+            rgCmdCopyImageToBuffer(cmd_buffer, &src, &dst, extent);
+            break;
+        }
+        default: Fail("unknown command op", op);
+        }
+    }
+}
+
+// Records and submits every submission of the frame, returns the CPU time it
+// took in seconds
+static double ReplayFrame(Replay *replay)
+{
+    double start_time = GetMonotonicTime();
+
+    replay->next_secondary = 0;
+    for (uint32_t i = 0; i < replay->submission_count; ++i)
+    {
+        Submission *submission = &replay->submissions[i];
+        rgCmdBufferBegin(submission->cmd_buffer);
+        RecordCommands(replay, submission->cmd_buffer, submission->commands, i, NULL);
+        rgCmdBufferEnd(submission->cmd_buffer);
+        if (submission->waited_on)
+        {
+            rgCmdBufferSubmit(submission->cmd_buffer);
+        }
+        else
+        {
+            rgCmdBufferSubmitFenceOnly(submission->cmd_buffer);
+        }
+    }
+
+    return GetMonotonicTime() - start_time;
+}
+
+// Waits for the frame, returns the GPU time of its submissions in milliseconds
+static double WaitFrame(Replay *replay)
+{
+    double gpu_time = 0.0;
+    for (uint32_t i = 0; i < replay->submission_count; ++i)
+    {
+        RgCmdBuffer *cmd_buffer = replay->submissions[i].cmd_buffer;
+        rgCmdBufferWait(replay->device, cmd_buffer);
+        gpu_time += rgCmdBufferGetGpuTime(replay->device, cmd_buffer);
+    }
+    return gpu_time;
+}
+// }}}
+
+static void PrintUsage(void)
+{
+    fprintf(
+        stderr,
+        "Usage: rg_replay <capture file> [iterations]\n"
+        "  Replays the captured frame iterations times (default 100) and\n"
+        "  prints its CPU recording time and GPU time\n");
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    uint32_t iteration_count = 100;
+    if (argc == 3)
+    {
+        iteration_count = (uint32_t)strtoul(argv[2], NULL, 10);
+        if (iteration_count == 0)
+        {
+            PrintUsage();
+            return 1;
+        }
+    }
+
+    size_t file_size = 0;
+    uint8_t *file = ReadFile(argv[1], &file_size);
+    if (!file)
+    {
+        fprintf(stderr, "Failed to read %s\n", argv[1]);
+        return 1;
+    }
+
+    RgCaptureHeader header;
+    memset(&header, 0, sizeof(header));
+    if (file_size >= sizeof(header)) memcpy(&header, file, sizeof(header));
+
+    const char *error = NULL;
+    if (header.magic != RG_CAPTURE_MAGIC || header.version != RG_CAPTURE_VERSION)
+    {
+        error = "is not a capture of this version";
+    }
+    else if (
+        header.setup_size > file_size - sizeof(header) ||
+        header.frame_size > file_size - sizeof(header) - header.setup_size)
+    {
+        error = "is truncated";
+    }
+
+    if (error)
+    {
+        fprintf(stderr, "%s %s\n", argv[1], error);
+        egFree(NULL, file);
+        return 1;
+    }
+
+    Reader setup = {file + sizeof(header), (size_t)header.setup_size, 0};
+    Reader frame = {setup.data + setup.size, (size_t)header.frame_size, 0};
+
+    RgDeviceInfo device_info = {0};
+    device_info.headless = true;
+
+    Replay replay;
+    memset(&replay, 0, sizeof(replay));
+    replay.device = rgDeviceCreate(&device_info);
+    replay.object_count = header.id_count;
+    replay.objects = (Object *)egAllocate(NULL, sizeof(Object) * (header.id_count + 1));
+    memset(replay.objects, 0, sizeof(Object) * (header.id_count + 1));
+
+    double setup_start = GetMonotonicTime();
+    ReplaySetup(&replay, &setup);
+    double setup_time = GetMonotonicTime() - setup_start;
+
+    PrepareFrame(&replay, &frame, header.submit_count);
+
+    uint32_t object_count = 0;
+    for (uint32_t id = 0; id < replay.object_count; ++id)
+    {
+        if (replay.objects[id].type != OBJECT_NONE) object_count++;
+    }
+
+    printf(
+        "%s: %u objects, %u submissions, %u secondary command buffers, setup %.3f ms\n",
+        argv[1],
+        object_count,
+        replay.submission_count,
+        replay.secondary_count,
+        setup_time * 1000.0);
+
+    // The first iteration creates the pipeline instances, it's left out
+    ReplayFrame(&replay);
+    WaitFrame(&replay);
+
+    double cpu_total = 0.0, cpu_min = DBL_MAX, cpu_max = 0.0;
+    double gpu_total = 0.0, gpu_min = DBL_MAX, gpu_max = 0.0;
+    for (uint32_t i = 0; i < iteration_count; ++i)
+    {
+        double cpu_time = ReplayFrame(&replay) * 1000.0;
+        double gpu_time = WaitFrame(&replay);
+
+        cpu_total += cpu_time;
+        cpu_min = cpu_time < cpu_min ? cpu_time : cpu_min;
+        cpu_max = cpu_time > cpu_max ? cpu_time : cpu_max;
+        gpu_total += gpu_time;
+        gpu_min = gpu_time < gpu_min ? gpu_time : gpu_min;
+        gpu_max = gpu_time > gpu_max ? gpu_time : gpu_max;
+    }
+
+    printf(
+        "%u iterations, cpu %.3f ms (min %.3f, max %.3f), "
+        "gpu %.3f ms (min %.3f, max %.3f)\n",
+        iteration_count,
+        cpu_total / iteration_count,
+        cpu_min,
+        cpu_max,
+        gpu_total / iteration_count,
+        gpu_min,
+        gpu_max);
+
+    rgDeviceWaitIdle(replay.device);
+
+    for (uint32_t i = 0; i < replay.submission_count; ++i)
+    {
+        Submission *submission = &replay.submissions[i];
+        rgCmdBufferDestroy(
+            replay.device,
+            GetCmdPool(&replay, submission->queue_type),
+            submission->cmd_buffer);
+    }
+    for (uint32_t i = 0; i < replay.secondary_count; ++i)
+    {
+        rgCmdBufferDestroy(
+            replay.device,
+            GetCmdPool(&replay, RG_QUEUE_TYPE_GRAPHICS),
+            replay.secondaries[i]);
+    }
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        if (replay.cmd_pools[i]) rgCmdPoolDestroy(replay.device, replay.cmd_pools[i]);
+    }
+
+    DestroyObjects(&replay);
+    rgDeviceDestroy(replay.device);
+
+    if (replay.secondaries) egFree(NULL, replay.secondaries);
+    egFree(NULL, replay.submissions);
+    egFree(NULL, replay.objects);
+    egFree(NULL, file);
+
+    return 0;
+}